@@ -0,0 +1,214 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#define __SOLDIN_BENCHALLOC_IMPL__
+#include <bench.h>
+#include <benchalloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <new>
+
+ULONGLONG    Bench::mAllocations   = 0;
+ULONGLONG    Bench::mBytes         = 0;
+ULONGLONG    Bench::mSent          = 0;
+BenchResult *Bench::mBaseline      = NULL;
+size_t       Bench::mBaselineCount = 0;
+
+volatile uint32_t g_bench_sink = 0;
+
+/* Counts an allocation made with malloc(). */
+void *Bench_Malloc( size_t size )
+{
+	Bench::CountAllocation( size );
+	return malloc( size );
+}
+
+/* Counts an allocation made with calloc(). */
+void *Bench_Calloc( size_t count, size_t size )
+{
+	Bench::CountAllocation( count * size );
+	return calloc( count, size );
+}
+
+/* Counts a reallocation, growing a block is as expensive as a new allocation. */
+void *Bench_Realloc( void *ptr, size_t size )
+{
+	if ( size > 0 )
+		Bench::CountAllocation( size );
+
+	return realloc( ptr, size );
+}
+
+/* Counts allocations made with operator new. */
+void *operator new( size_t size )
+{
+	Bench::CountAllocation( size );
+
+	void *ptr = malloc( size > 0 ? size : 1 );
+	if ( ptr == NULL )
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+/* Counts allocations made with operator new[]. */
+void *operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+/* Releases memory allocated with operator new. */
+void operator delete( void *ptr )
+{
+	free( ptr );
+}
+
+/* Releases memory allocated with operator new[]. */
+void operator delete[]( void *ptr )
+{
+	free( ptr );
+}
+
+/* Runs a benchmark BENCH_REPEAT times and keeps the fastest run. */
+void Bench::Run( const Benchmark &benchmark, BenchResult &result )
+{
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency( &frequency );
+
+	result.mName        = benchmark.mName;
+	result.mIterations  = benchmark.mIterations;
+	result.mNanoseconds = 0;
+	result.mAllocations = 0;
+	result.mBytes       = 0;
+	result.mSent        = 0;
+
+	for ( int i = 0; i < BENCH_REPEAT; i++ )
+	{
+		if ( benchmark.mSetup != NULL )
+			benchmark.mSetup();
+
+		mAllocations = 0;
+		mBytes       = 0;
+		mSent        = 0;
+
+		QueryPerformanceCounter( &start );
+		benchmark.mRun( benchmark.mIterations );
+		QueryPerformanceCounter( &end );
+
+		double elapsed = (double)( end.QuadPart - start.QuadPart ) * 1000000000.0 / (double)frequency.QuadPart;
+		double per_op  = elapsed / benchmark.mIterations;
+
+		if ( i == 0 || per_op < result.mNanoseconds )
+			result.mNanoseconds = per_op;
+
+		/* The first run also pays for warming up, the rest should all allocate the same. */
+		result.mAllocations = (double)(LONGLONG)mAllocations / benchmark.mIterations;
+		result.mBytes       = (double)(LONGLONG)mBytes / benchmark.mIterations;
+		result.mSent        = (double)(LONGLONG)mSent / benchmark.mIterations;
+
+		if ( benchmark.mTeardown != NULL )
+			benchmark.mTeardown();
+	}
+}
+
+/* Reads the results of an earlier run (CSV) to compare against. */
+bool Bench::LoadBaseline( const char *path )
+{
+	FILE *fp = fopen( path, "rb" );
+	if ( fp == NULL )
+		return false;
+
+	size_t capacity = 0;
+	char   line[256];
+	while ( fgets( line, sizeof( line ), fp ) != NULL )
+	{
+		char        name[128];
+		BenchResult result;
+		if ( sscanf( line, "%127[^,],%u,%lf,%lf,%lf", name, &result.mIterations, &result.mNanoseconds, &result.mAllocations, &result.mBytes ) != 5 )
+			continue; /* Header or a malformed line. */
+
+		if ( mBaselineCount == capacity )
+		{
+			capacity  = MAX( capacity * 2, 16 );
+			mBaseline = (BenchResult *)realloc( mBaseline, sizeof( BenchResult ) * capacity );
+		}
+
+		result.mName = _strdup( name );
+		mBaseline[mBaselineCount++] = result;
+	}
+
+	fclose( fp );
+	return true;
+}
+
+/* Finds the baseline result of a benchmark. */
+const BenchResult *Bench::FindBaseline( const char *name )
+{
+	for ( size_t i = 0; i < mBaselineCount; i++ )
+		if ( strcmp( mBaseline[i].mName, name ) == 0 )
+			return &mBaseline[i];
+
+	return NULL;
+}
+
+/* Writes the results to stdout, with the change in time against the baseline if one was loaded. */
+void Bench::Print( const BenchResult *results, size_t count, int format )
+{
+	if ( format == BENCH_JSON )
+		printf( "[\n" );
+	else
+		printf( "name,iterations,ns_per_op,allocs_per_op,bytes_per_op,sent_per_op%s\n", mBaseline != NULL ? ",baseline_ns_per_op,change_pct" : "" );
+
+	for ( size_t i = 0; i < count; i++ )
+	{
+		const BenchResult &r = results[i];
+		const BenchResult *b = FindBaseline( r.mName );
+
+		if ( format == BENCH_JSON )
+		{
+			printf( "  { \"name\": \"%s\", \"iterations\": %u, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f, \"sent_per_op\": %.1f", 
+				r.mName, r.mIterations, r.mNanoseconds, r.mAllocations, r.mBytes, r.mSent );
+
+			if ( b != NULL )
+				printf( ", \"baseline_ns_per_op\": %.2f, \"change_pct\": %.1f", b->mNanoseconds, ( r.mNanoseconds / b->mNanoseconds - 1.0 ) * 100.0 );
+
+			printf( " }%s\n", ( i + 1 < count ) ? "," : "" );
+		}
+		else
+		{
+			printf( "%s,%u,%.2f,%.3f,%.1f,%.1f", r.mName, r.mIterations, r.mNanoseconds, r.mAllocations, r.mBytes, r.mSent );
+
+			if ( b != NULL )
+				printf( ",%.2f,%.1f", b->mNanoseconds, ( r.mNanoseconds / b->mNanoseconds - 1.0 ) * 100.0 );
+			else if ( mBaseline != NULL )
+				printf( ",," );
+
+			printf( "\n" );
+		}
+	}
+
+	if ( format == BENCH_JSON )
+		printf( "]\n" );
+}
@@ -0,0 +1,895 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <bench.h>
+#include <buffer.h>
+#include <utf.h>
+#include <crypt.h>
+#include <sessionmanager.h>
+#include <settings.h>
+#include <stage.h>
+#include <playersession.h>
+#include <migration.h>
+#include <chat.h>
+#include <account.h>
+#include <character.h>
+#include <socket.h>
+#include <poller.h>
+#include <stdio.h>
+#include <vector>
+
+/* Sizes used by the benchmarks. */
+#define BENCH_BUFFER_VALUES  1024
+#define BENCH_CRYPTO_BLOCK   1024
+#define BENCH_SETTINGS_COUNT 64
+#define BENCH_STAGE_PLAYERS  100
+#define BENCH_STAGE_ACTIONS  2      /* Actions of every player in a tick. */
+#define BENCH_MIGRANTS       500
+#define BENCH_CHAT_PLAYERS   1000
+#define BENCH_CHAT_LINES     10     /* Lines of chat in a tick. */
+#define BENCH_MIGRATE_BATCH  100    /* Migrations between two stage ticks. */
+#define BENCH_SETTINGS_FILE  "bench.cfg"
+#define BENCH_IO_SOCKETS     200
+#define BENCH_IO_ACTIVE      8      /* Connections that get data in a tick. */
+#define BENCH_IO_PORT        14999
+#define BENCH_STORM_CONNECTS 10000
+#define BENCH_STORM_BURST    500    /* Connects the clients start per tick. */
+#define BENCH_STORM_PORT     14998
+
+static Buffer         s_buffer;
+static char           s_block[BENCH_CRYPTO_BLOCK];
+static Crypto        *s_crypto;
+static Session       *s_sessions;
+static uint32_t       s_session_count;
+static Settings      *s_settings;
+static Stage         *s_stage;
+static PlayerSession *s_players[BENCH_STAGE_PLAYERS];
+static Stage         *s_stages[2];
+static PlayerSession *s_migrants[BENCH_MIGRANTS];
+static uint32_t       s_wave;
+static uint32_t       s_tick;
+static Socket        *s_listener;
+static Socket        *s_io_clients[BENCH_IO_SOCKETS];
+static Socket        *s_io_servers[BENCH_IO_SOCKETS];
+static uint32_t       s_io_count;
+static Socket        *s_storm_clients[BENCH_STORM_CONNECTS];
+static PlayerSession *s_storm_players[BENCH_STORM_CONNECTS];
+static uint32_t       s_storm_count;
+
+extern std::vector<PlayerSession *> g_clients;
+
+/* ----------------------------------------------------------------------- 
+ * Buffer
+ * ----------------------------------------------------------------------- */
+
+/* Fills the shared buffer with values to read. */
+static void Buffer_Fill()
+{
+	s_buffer.Reset();
+	for ( uint32_t i = 0; i < BENCH_BUFFER_VALUES; i++ )
+		s_buffer.WriteUInt32( i );
+}
+
+/* Empties the shared buffer, the memory is kept for the next benchmark. */
+static void Buffer_Empty()
+{
+	s_buffer.Reset();
+}
+
+/* Appends integers to a buffer that already has its memory. */
+static void Buffer_WriteUInt32( uint32_t iterations )
+{
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		if ( i % BENCH_BUFFER_VALUES == 0 )
+			s_buffer.Reset();
+
+		s_buffer.WriteUInt32( i );
+	}
+}
+
+/* Reads integers back from a buffer. */
+static void Buffer_ReadUInt32( uint32_t iterations )
+{
+	uint32_t sum = 0;
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		if ( i % BENCH_BUFFER_VALUES == 0 )
+			s_buffer.Seek( 0 );
+
+		sum += s_buffer.ReadUInt32();
+	}
+	g_bench_sink = sum;
+}
+
+/* Copies a packet sized block out of a buffer. */
+static void Buffer_Slice( uint32_t iterations )
+{
+	char dest[64];
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		s_buffer.Slice( dest, sizeof( dest ), ( i * 4 ) % ( BENCH_BUFFER_VALUES * 4 - sizeof( dest ) ) );
+		g_bench_sink += dest[0];
+	}
+}
+
+/* Writes narrow and wide strings, as done for names and chat. */
+static void Buffer_WriteString( uint32_t iterations )
+{
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		if ( i % 64 == 0 )
+			s_buffer.Reset();
+
+		s_buffer.WriteString( "Seipheroth" );
+		s_buffer.WriteWideString( "Seipheroth" );
+	}
+}
+
+/* Reads a wide string back into a narrow buffer. */
+static void Buffer_ReadWideString( uint32_t iterations )
+{
+	s_buffer.Reset();
+	s_buffer.WriteWideString( "Seipheroth" );
+
+	char name[33];
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		s_buffer.Seek( 0 );
+		g_bench_sink += s_buffer.ReadWideString( name, sizeof( name ) );
+	}
+}
+
+/* Builds a typical small packet in a fresh buffer, including its allocation. */
+static void Buffer_Packet( uint32_t iterations )
+{
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		Buffer packet;
+		packet.WriteUInt32( i );
+		packet.WriteUInt16( 1 );
+		packet.WriteFloat( 1200.0f );
+		packet.WriteFloat( 0.0f );
+		packet.WriteFloat( 610.0f );
+		packet.WriteWideString( "Seipheroth" );
+		g_bench_sink += packet.Size();
+	}
+}
+
+/* ----------------------------------------------------------------------- 
+ * UTF
+ * ----------------------------------------------------------------------- */
+
+/* A line of chat (102 characters), a character name (10) and a line of Korean chat (33 characters, 81 bytes). */
+static const char s_utf_chat[]   = 
+	"Selling a Stone of Ouroboros and two Red Potion bundles, whisper me with an offer before the next raid";
+static const char s_utf_name[]   = "Seipheroth";
+static const char s_utf_hangul[] = 
+	"\xEC\x98\xA4\xEB\x8A\x98 \xEB\xB0\xA4 \xEA\xB4\x91\xEC\x9E\xA5\xEC\x97\x90\xEC\x84\x9C \xEA\xB8\xB8\xEB\x93\x9C "
+	"\xEB\xAA\xA8\xEC\x9E\x84\xEC\x9D\xB4 \xEC\x9E\x88\xEC\x8A\xB5\xEB\x8B\x88\xEB\x8B\xA4, \xEB\x8A\xA6\xEC\xA7\x80 "
+	"\xEB\xA7\x90\xEA\xB3\xA0 \xEC\x99\x80\xEC\xA3\xBC\xEC\x84\xB8\xEC\x9A\x94";
+
+/* Converts a chat message sized string to UTF-16 and back. */
+static void Utf_RoundTrip( uint32_t iterations )
+{
+	uint16_t wide[256];
+	char     narrow[512];
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		size_t len = Utf8ToUtf16( s_utf_chat, sizeof( s_utf_chat ) - 1, wide, 256 );
+		g_bench_sink += Utf16ToUtf8( wide, len, narrow, sizeof( narrow ) );
+	}
+}
+
+/* Converts a UTF-8 string to UTF-16. */
+static void Utf_ToUtf16( const char *str, size_t len, uint32_t iterations )
+{
+	uint16_t wide[256];
+	for ( uint32_t i = 0; i < iterations; i++ )
+		g_bench_sink += Utf8ToUtf16( str, len, wide, 256 );
+}
+
+/* Converts a UTF-16 string to UTF-8, the UTF-16 string is made once up front. */
+static void Utf_ToUtf8( const char *str, size_t len, uint32_t iterations )
+{
+	uint16_t wide[256];
+	char     narrow[512];
+	size_t   wide_len = Utf8ToUtf16( str, len, wide, 256 );
+
+	for ( uint32_t i = 0; i < iterations; i++ )
+		g_bench_sink += Utf16ToUtf8( wide, wide_len, narrow, sizeof( narrow ) );
+}
+
+/* Serializes a UTF-8 string into a packet as UTF-16, without a wide copy in between. */
+static void Utf_WriteWide( const char *str, uint32_t iterations )
+{
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		if ( i % 64 == 0 )
+			s_buffer.Reset();
+
+		s_buffer.WriteWideString( str );
+	}
+}
+
+static void Utf_ToUtf16Chat( uint32_t iterations )   { Utf_ToUtf16( s_utf_chat, sizeof( s_utf_chat ) - 1, iterations ); }
+static void Utf_ToUtf16Name( uint32_t iterations )   { Utf_ToUtf16( s_utf_name, sizeof( s_utf_name ) - 1, iterations ); }
+static void Utf_ToUtf16Hangul( uint32_t iterations ) { Utf_ToUtf16( s_utf_hangul, sizeof( s_utf_hangul ) - 1, iterations ); }
+static void Utf_ToUtf8Chat( uint32_t iterations )    { Utf_ToUtf8( s_utf_chat, sizeof( s_utf_chat ) - 1, iterations ); }
+static void Utf_ToUtf8Name( uint32_t iterations )    { Utf_ToUtf8( s_utf_name, sizeof( s_utf_name ) - 1, iterations ); }
+static void Utf_ToUtf8Hangul( uint32_t iterations )  { Utf_ToUtf8( s_utf_hangul, sizeof( s_utf_hangul ) - 1, iterations ); }
+static void Utf_WriteWideChat( uint32_t iterations ) { Utf_WriteWide( s_utf_chat, iterations ); }
+static void Utf_WriteWideName( uint32_t iterations ) { Utf_WriteWide( s_utf_name, iterations ); }
+
+/* ----------------------------------------------------------------------- 
+ * Crypto
+ * ----------------------------------------------------------------------- */
+
+/* Creates the cipher and a block of data to encrypt. */
+static void Crypto_Setup()
+{
+	s_crypto = new Crypto();
+	s_crypto->SetKey( 0x1A2B3C4D );
+
+	for ( uint32_t i = 0; i < BENCH_CRYPTO_BLOCK; i++ )
+		s_block[i] = (char)i;
+}
+
+/* Releases the cipher. */
+static void Crypto_Teardown()
+{
+	delete s_crypto;
+	s_crypto = NULL;
+}
+
+/* Encrypts a block of data, one operation is one block. */
+static void Crypto_Encrypt( uint32_t iterations )
+{
+	for ( uint32_t i = 0; i < iterations; i++ )
+		s_crypto->Encrypt( (byte *)s_block, BENCH_CRYPTO_BLOCK );
+
+	g_bench_sink += s_block[0];
+}
+
+/* Decrypts a block of data, one operation is one block. */
+static void Crypto_Decrypt( uint32_t iterations )
+{
+	for ( uint32_t i = 0; i < iterations; i++ )
+		s_crypto->Decrypt( (byte *)s_block, BENCH_CRYPTO_BLOCK );
+
+	g_bench_sink += s_block[0];
+}
+
+/* ----------------------------------------------------------------------- 
+ * SessionManager
+ * ----------------------------------------------------------------------- */
+
+/* Registers the specified number of sessions, all with a unique key. */
+static void Sessions_Setup( uint32_t count )
+{
+	s_sessions      = new Session[count + 1];
+	s_session_count = count;
+
+	for ( uint32_t i = 0; i <= count; i++ )
+	{
+		sprintf( s_sessions[i].mSessionKey, "%08X", i );
+		if ( i < count )
+			SessionManager::Create( SESS_USER, &s_sessions[i] );
+	}
+}
+
+/* Fills the session table with 200 sessions. */
+static void Sessions_Setup200()
+{
+	Sessions_Setup( 200 );
+}
+
+/* Fills the session table with 50000 sessions. */
+static void Sessions_Setup50k()
+{
+	Sessions_Setup( 50000 );
+}
+
+/* Removes all sessions. */
+static void Sessions_Teardown()
+{
+	for ( uint32_t i = 0; i < s_session_count; i++ )
+		SessionManager::Destroy( s_sessions[i].mSessionId );
+
+	delete [] s_sessions;
+	s_sessions = NULL;
+}
+
+/* Registers and removes a session while the table holds the others. */
+static void Sessions_CreateDestroy( uint32_t iterations )
+{
+	Session *session = &s_sessions[s_session_count];
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		SessionManager::Create( SESS_USER, session );
+		SessionManager::Destroy( session->mSessionId );
+	}
+}
+
+/* Looks up sessions by their key, as done when a client reconnects. */
+static void Sessions_Find( uint32_t iterations )
+{
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		const char *key = s_sessions[( i * 7919 ) % s_session_count].mSessionKey;
+		if ( SessionManager::Find<Session>( key ) != NULL )
+			g_bench_sink++;
+	}
+}
+
+/* ----------------------------------------------------------------------- 
+ * Settings
+ * ----------------------------------------------------------------------- */
+
+/* Writes a configuration file and loads it. */
+static void Settings_Setup()
+{
+	FILE *fp = fopen( BENCH_SETTINGS_FILE, "wb" );
+	if ( fp != NULL )
+	{
+		for ( uint32_t i = 0; i < BENCH_SETTINGS_COUNT; i++ )
+			fprintf( fp, "setting_%u = %u\n", i, i );
+
+		fclose( fp );
+	}
+	s_settings = new Settings( BENCH_SETTINGS_FILE );
+}
+
+/* Releases the settings and removes the file. */
+static void Settings_Teardown()
+{
+	delete s_settings;
+	s_settings = NULL;
+
+	remove( BENCH_SETTINGS_FILE );
+}
+
+/* Reads an integer setting, as done every tick. */
+static void Settings_GetInt( uint32_t iterations )
+{
+	static const char *names[] = { "setting_0", "SETTING_17", "setting_42", "setting_63" };
+
+	int sum = 0;
+	for ( uint32_t i = 0; i < iterations; i++ )
+		sum += s_settings->GetInt( names[i & 3], 0 );
+
+	g_bench_sink = sum;
+}
+
+/* Looks up a setting that does not exist, which falls back to the default. */
+static void Settings_Miss( uint32_t iterations )
+{
+	int sum = 0;
+	for ( uint32_t i = 0; i < iterations; i++ )
+		sum += s_settings->GetInt( "not_configured", 1 );
+
+	g_bench_sink = sum;
+}
+
+/* ----------------------------------------------------------------------- 
+ * Stage
+ * ----------------------------------------------------------------------- */
+
+/* Creates a session that takes over the preloaded character of a migration. */
+static PlayerSession *Stage_Resume( MigrationState &state )
+{
+	PlayerSession *player = new PlayerSession( new Socket() );
+	SessionManager::Create( SESS_USER, player );
+	player->ResumeMigration( &state );
+
+	return player;
+}
+
+/* Creates a player, the character is handed over as if it migrated. */
+static PlayerSession *Stage_CreatePlayer( uint32_t id )
+{
+	MigrationState state;
+	memset( &state, 0, sizeof( state ) );
+
+	state.mAccount   = new AccountInfo();
+	state.mCharacter = new CharacterData();
+	state.mAccount->mId   = id;
+	state.mCharacter->mId = id;
+	state.mCharacter->mEquipmentCount = 0;
+	sprintf( state.mCharacter->mName, "Player%u", id );
+
+	return Stage_Resume( state );
+}
+
+/* Fills a stage with players. */
+static void Stage_Setup()
+{
+	s_stage = new Stage( 0, 0, BENCH_STAGE_PLAYERS );
+	s_stage->Initialize();
+
+	for ( uint32_t i = 0; i < BENCH_STAGE_PLAYERS; i++ )
+	{
+		PlayerSession *player = Stage_CreatePlayer( i + 1 );
+
+		s_stage->Join( player );
+		s_players[i] = player;
+	}
+}
+
+/* Removes the players and the stage. */
+static void Stage_Teardown()
+{
+	for ( uint32_t i = 0; i < BENCH_STAGE_PLAYERS; i++ )
+	{
+		SessionManager::Destroy( s_players[i]->mSessionId );
+		delete s_players[i];
+	}
+	delete s_stage;
+	s_stage = NULL;
+}
+
+/* Sends a packet to every player on the stage. */
+static void Stage_Send( uint32_t iterations )
+{
+	Buffer packet;
+	packet.WriteUInt32( 1 );
+	packet.WriteFloat( 1200.0f );
+	packet.WriteFloat( 0.0f );
+	packet.WriteFloat( 610.0f );
+	packet.WriteWideString( "Seipheroth" );
+
+	for ( uint32_t i = 0; i < iterations; i++ )
+		s_stage->Send( packet, 0x1234 );
+}
+
+/* ----------------------------------------------------------------------- 
+ * Chat
+ * ----------------------------------------------------------------------- */
+
+/* Fills the square with players to chat to. */
+static void Chat_Setup()
+{
+	for ( uint32_t i = 0; i < BENCH_CHAT_PLAYERS; i++ )
+		g_clients.push_back( Stage_CreatePlayer( i + 1 ) );
+}
+
+/* Removes the players. */
+static void Chat_Teardown()
+{
+	for ( size_t i = 0; i < g_clients.size(); i++ )
+	{
+		SessionManager::Destroy( g_clients[i]->mSessionId );
+		delete g_clients[i];
+	}
+	g_clients.clear();
+}
+
+/* Gets the number of bytes waiting to be sent to the players on the square. */
+static size_t Chat_QueuedBytes()
+{
+	size_t queued = 0;
+	for ( size_t i = 0; i < g_clients.size(); i++ )
+		queued += g_clients[i]->GetQueuedBytes();
+
+	return queued;
+}
+
+/* Fans a tick of chat out to every player through the chat service, each line is serialized once 
+ * and every player gets the chat of the tick in a single write. */
+static void Chat_FanOut( uint32_t iterations )
+{
+	size_t queued = Chat_QueuedBytes();
+
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		for ( uint32_t l = 0; l < BENCH_CHAT_LINES; l++ )
+			ChatService::Announce( g_clients[( i * BENCH_CHAT_LINES + l ) % BENCH_CHAT_PLAYERS]->GetCharacter()->mName, s_utf_chat );
+
+		ChatService::Flush();
+	}
+	Bench::CountSent( Chat_QueuedBytes() - queued );
+}
+
+/* Sends a tick of chat the way the square did before the chat service, every line is serialized 
+ * and written for every player on its own, as SendBoardMessage() does. */
+static void Chat_Broadcast( uint32_t iterations )
+{
+	size_t queued = Chat_QueuedBytes();
+
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		for ( uint32_t l = 0; l < BENCH_CHAT_LINES; l++ )
+		{
+			const char *from = g_clients[( i * BENCH_CHAT_LINES + l ) % BENCH_CHAT_PLAYERS]->GetCharacter()->mName;
+			for ( size_t p = 0; p < g_clients.size(); p++ )
+				g_clients[p]->SendBoardMessage( from, s_utf_chat );
+		}
+	}
+	Bench::CountSent( Chat_QueuedBytes() - queued );
+}
+
+/* ----------------------------------------------------------------------- 
+ * Migration
+ * ----------------------------------------------------------------------- */
+
+/* Creates two stages that each have players running around, the migrants start on the first. */
+static void Migration_Setup()
+{
+	uint32_t id = 1;
+	for ( uint32_t s = 0; s < 2; s++ )
+	{
+		s_stages[s] = new Stage( 0, s, BENCH_MIGRANTS * 2 );
+		s_stages[s]->Initialize();
+
+		for ( uint32_t i = 0; i < BENCH_MIGRANTS; i++ )
+		{
+			PlayerSession *player = Stage_CreatePlayer( id++ );
+			s_stages[s]->Join( player );
+			s_stages[s]->GetMovement().SetDirection( player->mStageSlot, ( i & 1 ) ? DIR_EAST : DIR_NORTH );
+		}
+	}
+
+	for ( uint32_t i = 0; i < BENCH_MIGRANTS; i++ )
+	{
+		s_migrants[i] = Stage_CreatePlayer( id++ );
+		s_stages[0]->Join( s_migrants[i] );
+	}
+	s_wave = 0;
+	s_tick = 0;
+}
+
+/* Removes the players and both stages. */
+static void Migration_Teardown()
+{
+	for ( uint32_t s = 0; s < 2; s++ )
+	{
+		while ( s_stages[s]->GetPlayerCount() > 0 )
+		{
+			PlayerSession *player = s_stages[s]->GetPlayer( 0 );
+			s_stages[s]->Leave( player );
+			SessionManager::Destroy( player->mSessionId );
+			delete player;
+		}
+		delete s_stages[s];
+		s_stages[s] = NULL;
+	}
+}
+
+/* Moves every migrant to the other stage, while the stages keep ticking for the players that stay. 
+ * Measures the serialization and session turnover of a migration: the state is written and read the 
+ * way the shards do, the old session is dropped and the state resumed in a new one. The prepare, 
+ * ready, commit and redirect round trips through the gateway are not part of it, and the account is 
+ * taken from the state instead of the database. */
+static void Migration_Wave( uint32_t iterations )
+{
+	Buffer packet;
+
+	for ( uint32_t n = 0; n < iterations; n++, s_wave++ )
+	{
+		Stage *source = s_stages[s_wave % 2];
+		Stage *target = s_stages[( s_wave + 1 ) % 2];
+
+		for ( uint32_t i = 0; i < BENCH_MIGRANTS; i++ )
+		{
+			PlayerSession *player = s_migrants[i];
+
+			packet.Reset();
+			packet.WriteUInt32( player->GetAccount()->mId );
+			Migration::WriteCharacter( packet, player->GetCharacter() );
+			player->WriteMigrationState( packet );
+
+			source->Leave( player );
+			SessionManager::Destroy( player->mSessionId );
+			delete player;
+
+			MigrationState state;
+			memset( &state, 0, sizeof( state ) );
+
+			state.mAccount   = new AccountInfo();
+			state.mCharacter = new CharacterData();
+			state.mAccount->mId = packet.ReadUInt32();
+			Migration::ReadCharacter( packet, state.mCharacter );
+			Migration::ReadState( packet, &state );
+
+			s_migrants[i] = Stage_Resume( state );
+			target->Join( s_migrants[i] );
+
+			if ( ( i + 1 ) % BENCH_MIGRATE_BATCH == 0 )
+			{
+				s_tick += 10;
+				s_stages[0]->Update( s_tick );
+				s_stages[1]->Update( s_tick );
+			}
+		}
+		g_bench_sink += target->GetPlayerCount();
+	}
+}
+
+/* ----------------------------------------------------------------------- 
+ * I/O backends
+ * ----------------------------------------------------------------------- */
+
+/* Takes the connections waiting on the listener. */
+static void Io_Accept()
+{
+	Socket *socket;
+	while ( s_io_count < BENCH_IO_SOCKETS && ( socket = s_listener->Accept() ) != NULL )
+		s_io_servers[s_io_count++] = socket;
+}
+
+/* Connects pairs of sockets over the loopback, the accepted ends are the ones a server reads. */
+static void Io_Setup( int backend )
+{
+	Poller::Initialize( backend );
+
+	s_listener = new Socket();
+	s_listener->Listen( BENCH_IO_PORT );
+	s_io_count = 0;
+
+	for ( uint32_t i = 0; i < BENCH_IO_SOCKETS; i++ )
+	{
+		s_io_clients[i] = new Socket();
+		s_io_clients[i]->Connect( "127.0.0.1", BENCH_IO_PORT );
+
+		/* Only the server ends are measured. */
+		Poller::Unregister( s_io_clients[i] );
+		Io_Accept();
+	}
+
+	/* Loopback connects finish right away, but do not wait forever for one that does not. */
+	for ( uint32_t tries = 0; s_io_count < BENCH_IO_SOCKETS && tries < 1000; tries++ )
+	{
+		Sleep( 1 );
+		Io_Accept();
+	}
+
+	for ( uint32_t i = 0; i < BENCH_IO_SOCKETS; i++ )
+		s_io_clients[i]->FinishConnect();
+}
+
+/* Connects the sockets with the poller collecting their readiness. */
+static void Io_SetupPoller()
+{
+	Io_Setup( IO_BACKEND_POLLER );
+}
+
+/* Connects the sockets with every socket checking its own readiness. */
+static void Io_SetupSocket()
+{
+	Io_Setup( IO_BACKEND_SOCKET );
+}
+
+/* Closes the connections and switches back to the default backend. */
+static void Io_Teardown()
+{
+	for ( uint32_t i = 0; i < s_io_count; i++ )
+		delete s_io_servers[i];
+	for ( uint32_t i = 0; i < BENCH_IO_SOCKETS; i++ )
+		delete s_io_clients[i];
+
+	delete s_listener;
+	s_listener = NULL;
+	s_io_count = 0;
+
+	Poller::Initialize( IO_BACKEND_SOCKET );
+}
+
+/* Runs the receive side of a server tick, a few connections got data and the others are idle. */
+static void Io_Tick( uint32_t iterations )
+{
+	Buffer received;
+	char   data = 0x20;
+
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		for ( uint32_t j = 0; j < BENCH_IO_ACTIVE; j++ )
+			s_io_clients[( i * BENCH_IO_ACTIVE + j ) % BENCH_IO_SOCKETS]->Send( &data, 1 );
+
+		if ( Poller::IsEnabled() )
+			Poller::Poll();
+
+		for ( uint32_t j = 0; j < s_io_count; j++ )
+			s_io_servers[j]->Receive( &received );
+
+		g_bench_sink += received.Size();
+		received.Reset();
+	}
+}
+
+/* ----------------------------------------------------------------------- 
+ * Action updates
+ * ----------------------------------------------------------------------- */
+
+/* Gets the number of bytes waiting to be sent to the players of the stage. */
+static size_t Stage_QueuedBytes()
+{
+	size_t queued = 0;
+	for ( uint32_t i = 0; i < BENCH_STAGE_PLAYERS; i++ )
+		queued += s_players[i]->GetQueuedBytes();
+
+	return queued;
+}
+
+/* Gets where a player is for one of its actions in a tick. */
+static void Stage_ActionPosition( uint32_t tick, uint32_t player, uint32_t action, Vector3 &position )
+{
+	position.x = 1200.0f + (float)( tick * BENCH_STAGE_ACTIONS + action );
+	position.y = 0.0f;
+	position.z = 610.0f + (float)player;
+}
+
+/* Publishes the actions of a tick with snapshots, only the latest state of every player is send once. */
+static void Stage_SnapshotTick( uint32_t iterations )
+{
+	Vector3 position, direction = MovementSystem::GetDirection( DIR_EAST );
+	size_t  queued = Stage_QueuedBytes();
+
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		for ( uint32_t p = 0; p < BENCH_STAGE_PLAYERS; p++ )
+		{
+			for ( uint32_t a = 0; a < BENCH_STAGE_ACTIONS; a++ )
+			{
+				Stage_ActionPosition( i, p, a, position );
+				s_stage->GetSnapshots().Set( s_players[p]->mStageSlot, ( a & 1 ) ? ACT_IDLE : ACT_RUN, position, direction );
+			}
+		}
+		s_stage->Update( i * 10 );
+	}
+	Bench::CountSent( Stage_QueuedBytes() - queued );
+}
+
+/* Publishes the actions of a tick the way the stage did before snapshots, every action is broadcast when it happens. */
+static void Stage_BroadcastTick( uint32_t iterations )
+{
+	Vector3 position, direction = MovementSystem::GetDirection( DIR_EAST );
+	Buffer  packet;
+	size_t  queued = Stage_QueuedBytes();
+
+	for ( uint32_t i = 0; i < iterations; i++ )
+	{
+		for ( uint32_t p = 0; p < BENCH_STAGE_PLAYERS; p++ )
+		{
+			for ( uint32_t a = 0; a < BENCH_STAGE_ACTIONS; a++ )
+			{
+				Stage_ActionPosition( i, p, a, position );
+
+				packet.Reset();
+				packet.WriteUInt32( s_players[p]->GetCharacter()->mId );
+				packet.WriteUInt32( ( a & 1 ) ? ACT_IDLE : ACT_RUN );
+				packet.WriteFloat( position.x );
+				packet.WriteFloat( position.y );
+				packet.WriteFloat( position.z );
+				packet.WriteFloat( direction.x );
+				packet.WriteFloat( direction.y );
+				packet.WriteFloat( direction.z );
+				packet.WriteFloat( 0 );
+				s_stage->Send( packet, MSG_CHARACTER_SETACTION );
+			}
+		}
+	}
+	Bench::CountSent( Stage_QueuedBytes() - queued );
+}
+
+/* ----------------------------------------------------------------------- 
+ * Connect storm
+ * ----------------------------------------------------------------------- */
+
+/* Opens the listener the storm connects to. */
+static void Storm_Setup()
+{
+	s_listener = new Socket();
+	s_listener->Listen( BENCH_STORM_PORT );
+
+	memset( s_storm_clients, 0, sizeof( s_storm_clients ) );
+	s_storm_count = 0;
+}
+
+/* Closes every connection, the server ends first so the client ports do not linger in TIME_WAIT. */
+static void Storm_Teardown()
+{
+	for ( uint32_t i = 0; i < s_storm_count; i++ )
+	{
+		SessionManager::Destroy( s_storm_players[i]->mSessionId );
+		delete s_storm_players[i];
+	}
+	for ( uint32_t i = 0; i < BENCH_STORM_CONNECTS; i++ )
+		delete s_storm_clients[i];
+
+	delete s_listener;
+	s_listener    = NULL;
+	s_storm_count = 0;
+}
+
+/* Starts BENCH_STORM_CONNECTS connections in bursts, while the server accepts them each tick the way the 
+ * square does. The storm is a single operation that lasts until every connection has a session, the 
+ * steady state, or until no connection arrived for a second. */
+static void Storm_Connect( uint32_t iterations )
+{
+	uint32_t started = 0, idle = 0;
+
+	while ( s_storm_count < BENCH_STORM_CONNECTS && idle < 1000 )
+	{
+		for ( uint32_t n = 0; n < BENCH_STORM_BURST && started < BENCH_STORM_CONNECTS; n++, started++ )
+		{
+			s_storm_clients[started] = new Socket();
+			s_storm_clients[started]->Connect( "127.0.0.1", BENCH_STORM_PORT );
+		}
+
+		Socket  *socket;
+		uint32_t accepted = 0;
+		for ( ; accepted < ACCEPT_BATCH && s_storm_count < BENCH_STORM_CONNECTS && ( socket = s_listener->Accept() ) != NULL; accepted++ )
+		{
+			PlayerSession *player = new PlayerSession( socket );
+			SessionManager::Create( SESS_USER, player );
+			s_storm_players[s_storm_count++] = player;
+		}
+
+		/* Every client has started, wait for the rest to arrive. */
+		if ( accepted == 0 && started == BENCH_STORM_CONNECTS )
+		{
+			Sleep( 1 );
+			idle++;
+		}
+	}
+	g_bench_sink += s_storm_count;
+}
+
+Benchmark g_benchmarks[] = {
+	{ "buffer_write_uint32",           1000000, Buffer_WriteUInt32,     NULL,              Buffer_Empty      },
+	{ "buffer_read_uint32",            1000000, Buffer_ReadUInt32,      Buffer_Fill,       Buffer_Empty      },
+	{ "buffer_slice_64",               1000000, Buffer_Slice,           Buffer_Fill,       Buffer_Empty      },
+	{ "buffer_write_string",           1000000, Buffer_WriteString,     NULL,              Buffer_Empty      },
+	{ "buffer_read_widestring",        1000000, Buffer_ReadWideString,  NULL,              Buffer_Empty      },
+	{ "buffer_packet",                 1000000, Buffer_Packet,          NULL,              NULL              },
+	{ "utf_roundtrip",                 1000000, Utf_RoundTrip,          NULL,              NULL              },
+	{ "utf8_to_utf16_chat",            1000000, Utf_ToUtf16Chat,        NULL,              NULL              },
+	{ "utf8_to_utf16_name",            1000000, Utf_ToUtf16Name,        NULL,              NULL              },
+	{ "utf8_to_utf16_hangul",          1000000, Utf_ToUtf16Hangul,      NULL,              NULL              },
+	{ "utf16_to_utf8_chat",            1000000, Utf_ToUtf8Chat,         NULL,              NULL              },
+	{ "utf16_to_utf8_name",            1000000, Utf_ToUtf8Name,         NULL,              NULL              },
+	{ "utf16_to_utf8_hangul",          1000000, Utf_ToUtf8Hangul,       NULL,              NULL              },
+	{ "utf_write_widestring_chat",     1000000, Utf_WriteWideChat,      NULL,              Buffer_Empty      },
+	{ "utf_write_widestring_name",     1000000, Utf_WriteWideName,      NULL,              Buffer_Empty      },
+	{ "crypto_encrypt_1k",               10000, Crypto_Encrypt,         Crypto_Setup,      Crypto_Teardown   },
+	{ "crypto_decrypt_1k",               10000, Crypto_Decrypt,         Crypto_Setup,      Crypto_Teardown   },
+	{ "sessions_create_destroy_200",    100000, Sessions_CreateDestroy, Sessions_Setup200, Sessions_Teardown },
+	{ "sessions_create_destroy_50k",      1000, Sessions_CreateDestroy, Sessions_Setup50k, Sessions_Teardown },
+	{ "sessions_find_200",              100000, Sessions_Find,          Sessions_Setup200, Sessions_Teardown },
+	{ "sessions_find_50k",                1000, Sessions_Find,          Sessions_Setup50k, Sessions_Teardown },
+	{ "settings_get_int",              1000000, Settings_GetInt,        Settings_Setup,    Settings_Teardown },
+	{ "settings_miss",                 1000000, Settings_Miss,          Settings_Setup,    Settings_Teardown },
+	{ "stage_send_100",                   1000, Stage_Send,             Stage_Setup,       Stage_Teardown    },
+	{ "actions_snapshot_100",               50, Stage_SnapshotTick,     Stage_Setup,       Stage_Teardown    },
+	{ "actions_broadcast_100",              50, Stage_BroadcastTick,    Stage_Setup,       Stage_Teardown    },
+	{ "chat_fanout_1000",                   20, Chat_FanOut,            Chat_Setup,        Chat_Teardown     },
+	{ "chat_broadcast_1000",                20, Chat_Broadcast,         Chat_Setup,        Chat_Teardown     },
+	{ "migrate_500",                        10, Migration_Wave,         Migration_Setup,   Migration_Teardown },
+	{ "io_poller_200",                    1000, Io_Tick,                Io_SetupPoller,    Io_Teardown       },
+	{ "io_socket_200",                    1000, Io_Tick,                Io_SetupSocket,    Io_Teardown       },
+	{ "connect_storm_10k",                   1, Storm_Connect,          Storm_Setup,       Storm_Teardown    },
+};
+
+size_t g_benchmark_count = sizeof( g_benchmarks ) / sizeof( g_benchmarks[0] );
@@ -0,0 +1,102 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_BENCH_H__
+#define __SOLDIN_BENCH_H__
+
+#include <shared.h>
+
+/* Number of times every benchmark is measured, the fastest run is reported. */
+#define BENCH_REPEAT 5
+
+/* Output formats of the results. */
+#define BENCH_CSV  0
+#define BENCH_JSON 1
+
+/* Runs a benchmark for the specified number of operations. */
+typedef void (*BenchFunc)( uint32_t iterations );
+
+/* Prepares or releases the state of a benchmark, outside of the measured time. */
+typedef void (*BenchFixture)();
+
+/* A single benchmark. */
+struct benchmark_t {
+	const char  *mName;
+	uint32_t     mIterations;
+	BenchFunc    mRun;
+	BenchFixture mSetup;
+	BenchFixture mTeardown;
+};
+typedef struct benchmark_t Benchmark;
+
+/* Result of a benchmark, per operation. */
+struct bench_result_t {
+	const char *mName;
+	uint32_t    mIterations;
+	double      mNanoseconds;
+	double      mAllocations;
+	double      mBytes;
+	double      mSent;        /* Bytes queued for the network, for benchmarks that count them. */
+};
+typedef struct bench_result_t BenchResult;
+
+/* Runs the benchmarks and reports the results in a machine readable form. */
+class Bench {
+public:
+	static void Run( const Benchmark &benchmark, BenchResult &result );
+	static bool LoadBaseline( const char *path );
+	static void Print( const BenchResult *results, size_t count, int format );
+
+	/* Counts a heap allocation of the specified size. */
+	inline static void CountAllocation( size_t size )
+	{
+		mAllocations++;
+		mBytes += size;
+	}
+
+	/* Counts bytes that were queued to be sent. */
+	inline static void CountSent( size_t size )
+	{
+		mSent += size;
+	}
+
+private:
+	static const BenchResult *FindBaseline( const char *name );
+
+	static ULONGLONG    mAllocations;
+	static ULONGLONG    mBytes;
+	static ULONGLONG    mSent;
+	static BenchResult *mBaseline;
+	static size_t       mBaselineCount;
+};
+
+/* Defined by the individual benchmark sets. */
+extern Benchmark g_benchmarks[];
+extern size_t    g_benchmark_count;
+
+/* Values that are consumed so the compiler can not remove the measured work. */
+extern volatile uint32_t g_bench_sink;
+
+#endif /* __SOLDIN_BENCH_H__ */
@@ -0,0 +1,44 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_BENCHALLOC_H__
+#define __SOLDIN_BENCHALLOC_H__
+
+/* Routes the C heap functions through counters, so the benchmarks can report
+ * allocations of code that does not use operator new. Only included by
+ * shared.h when building the benchmarks (_BENCH). */
+#include <stdlib.h>
+
+void *Bench_Malloc( size_t size );
+void *Bench_Calloc( size_t count, size_t size );
+void *Bench_Realloc( void *ptr, size_t size );
+
+#ifndef __SOLDIN_BENCHALLOC_IMPL__
+#	define malloc( size )        Bench_Malloc( size )
+#	define calloc( count, size ) Bench_Calloc( count, size )
+#	define realloc( ptr, size )  Bench_Realloc( ptr, size )
+#endif
+
+#endif /* __SOLDIN_BENCHALLOC_H__ */
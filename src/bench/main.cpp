@@ -0,0 +1,104 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <bench.h>
+#include <log.h>
+#include <gatewayclient.h>
+#include <playersession.h>
+
+/* The square code is linked in for the stage benchmarks, it expects the globals of the server. */
+GatewayClient *g_gateway = NULL;
+
+uint16_t    cfg_square_port     = 0;
+uint32_t    cfg_square_host     = 0;
+uint32_t    cfg_square_capacity = 0;
+const char *cfg_square_name     = "Bench";
+uint32_t    cfg_square_shard    = 0;
+
+std::vector<PlayerSession *> g_clients;
+
+/* Shows how to run the benchmarks. */
+void PrintUsage()
+{
+	printf( "Usage: soldin-bench [-json] [-baseline <results.csv>] [-filter <text>]\n" );
+	printf( "  -json       Writes the results as JSON instead of CSV.\n" );
+	printf( "  -baseline   Compares the time per operation with an earlier CSV run.\n" );
+	printf( "  -filter     Only runs the benchmarks with the text in their name.\n" );
+}
+
+/* Main entry point of the application. */
+int main( int argc, char **argv )
+{
+	int         format = BENCH_CSV;
+	const char *filter = NULL;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( strcmp( argv[i], "-json" ) == 0 )
+		{
+			format = BENCH_JSON;
+		}
+		else if ( strcmp( argv[i], "-baseline" ) == 0 && i + 1 < argc )
+		{
+			if ( !Bench::LoadBaseline( argv[++i] ) )
+			{
+				fprintf( stderr, "Unable to read baseline %s.\n", argv[i] );
+				return 1;
+			}
+		}
+		else if ( strcmp( argv[i], "-filter" ) == 0 && i + 1 < argc )
+		{
+			filter = argv[++i];
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	/* Only the results may end up on stdout. */
+	Log::SetLevel( "error" );
+
+	BenchResult *results = new BenchResult[g_benchmark_count];
+	size_t       count   = 0;
+
+	for ( size_t i = 0; i < g_benchmark_count; i++ )
+	{
+		if ( filter != NULL && strstr( g_benchmarks[i].mName, filter ) == NULL )
+			continue;
+
+		fprintf( stderr, "Running %s...\n", g_benchmarks[i].mName );
+		Bench::Run( g_benchmarks[i], results[count++] );
+	}
+
+	Bench::Print( results, count, format );
+
+	delete [] results;
+	return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <dbbench.h>
+#include <database.h>
+#include <character.h>
+#include <inventory.h>
+#include <log.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <algorithm>
+
+/* Passes the generated data on to another sink and keeps a copy, to compare with what the storage returns. */
+class CaptureSink: public DataSink {
+public:
+	CaptureSink( DataSink &sink ): mSink( sink ) { }
+
+	/* Gets the highest ID from the storage. */
+	uint32_t GetMaxId( uint8_t type ) { return mSink.GetMaxId( type ); }
+
+	/* Keeps an account. */
+	void AddAccount( const AccountInfo &account )
+	{
+		LocalAccount &copy = mAccounts[account.mId];
+		copy.mId       = account.mId;
+		copy.mMaxChars = account.mMaxChars;
+		copy.mStatus   = account.mStatus;
+		copy.mGmLevel  = account.mGmLevel;
+		memcpy( copy.mName, account.mName, sizeof( copy.mName ) );
+		memcpy( copy.mPassword, account.mPassword, sizeof( copy.mPassword ) );
+
+		mSink.AddAccount( account );
+	}
+
+	/* Keeps a character license. */
+	void AddLicense( uint32_t account_id, uint32_t class_id )
+	{
+		mAccounts[account_id].mLicenses.push_back( class_id );
+		mSink.AddLicense( account_id, class_id );
+	}
+
+	/* Keeps a character. */
+	void AddCharacter( uint32_t account_id, const LocalCharacter &c )
+	{
+		mCharacters[c.mId] = c;
+		mAccounts[account_id].mCharacters.push_back( c.mId );
+		mSink.AddCharacter( account_id, c );
+	}
+
+	/* Keeps a bag license. */
+	void AddBag( uint32_t char_id, const BagLicense &bag )
+	{
+		mCharacters[char_id].mBags.push_back( bag );
+		mSink.AddBag( char_id, bag );
+	}
+
+	/* Keeps an item. */
+	void AddItem( uint32_t char_id, const LocalItem &item )
+	{
+		mCharacters[char_id].mItems.push_back( item );
+		mSink.AddItem( char_id, item );
+	}
+
+	/* Finishes the sink the data is passed on to. */
+	bool Finish() { return mSink.Finish(); }
+
+	std::map<uint32_t, LocalAccount>   mAccounts;
+	std::map<uint32_t, LocalCharacter> mCharacters;
+
+private:
+	DataSink &mSink;
+};
+
+static uint32_t g_checks   = 0;
+static uint32_t g_failures = 0;
+
+/* Counts a check and logs it when it failed. */
+static void Check( bool passed, const char *format, ... )
+{
+	g_checks++;
+	if ( passed )
+		return;
+
+	char    message[256];
+	va_list args;
+
+	va_start( args, format );
+	_vsnprintf( message, sizeof( message ) - 1, format, args );
+	message[sizeof( message ) - 1] = 0;
+	va_end( args );
+
+	ErrorLog.Write( "Conformance: %s\n", E_ERROR, message );
+	g_failures++;
+}
+
+/* Compares the character summary the storage returned with the one that was written. */
+static void CheckCharacter( const CharacterData *loaded, const LocalCharacter &c )
+{
+	Check( strcmp( loaded->mName, c.mName ) == 0, "character %u has name '%s', expected '%s'", c.mId, loaded->mName, c.mName );
+	Check( loaded->mClassId == c.mClassId && loaded->mLevel == c.mLevel && loaded->mExperience == c.mExperience, "character %u has the wrong class or level", c.mId );
+	Check( loaded->mPvpLevel == c.mPvpLevel && loaded->mPvpExperience == c.mPvpExperience, "character %u has the wrong pvp level", c.mId );
+	Check( loaded->mWarLevel == c.mWarLevel && loaded->mWarExperience == c.mWarExperience, "character %u has the wrong war level", c.mId );
+	Check( loaded->mRebirthLevel == c.mRebirthLevel && loaded->mRebirthCount == c.mRebirthCount, "character %u has the wrong rebirths", c.mId );
+	Check( (uint32_t)loaded->mLastPlayed == c.mLastPlayed, "character %u was last played at %u, expected %u", c.mId, (uint32_t)loaded->mLastPlayed, c.mLastPlayed );
+}
+
+/* Checks that an inventory holds exactly the items of the specified type. */
+static void CheckItems( const Inventory *inventory, const LocalCharacter &c, uint8_t type )
+{
+	const char *what = ( type == 0 ) ? "bags" : "bank";
+
+	if ( inventory == NULL )
+	{
+		Check( false, "the %s of character %u were not loaded", what, c.mId );
+		return;
+	}
+
+	uint32_t expected = 0;
+	for ( size_t i = 0; i < c.mItems.size(); i++ )
+	{
+		const LocalItem &item = c.mItems[i];
+		if ( item.mType != type )
+			continue;
+
+		const ItemInfo *loaded = inventory->Get( item.mBag, item.mSlot );
+		Check( loaded != NULL && loaded->mId == item.mItem.mId && loaded->mItemId == item.mItem.mItemId && loaded->mAmount == item.mItem.mAmount, 
+			"item %u of character %u is missing from %d:%d in the %s", (uint32_t)item.mItem.mId, c.mId, item.mBag, item.mSlot, what );
+		expected++;
+	}
+
+	Check( inventory->GetItemCount() == expected, "the %s of character %u hold %u items, expected %u", what, c.mId, inventory->GetItemCount(), expected );
+}
+
+/* Checks an account, its characters and their bags and items. */
+static void CheckAccount( const LocalAccount &stored, const std::map<uint32_t, LocalCharacter> &characters )
+{
+	AccountInfo *account = DB::Account_Load( stored.mName, NULL, true );
+	if ( account == NULL )
+	{
+		Check( false, "account '%s' was not found", stored.mName );
+		return;
+	}
+
+	Check( account->mId == stored.mId, "account '%s' has id %u, expected %u", stored.mName, account->mId, stored.mId );
+	Check( strcmp( account->mPassword, stored.mPassword ) == 0, "account '%s' has the wrong password", stored.mName );
+	Check( account->mMaxChars == stored.mMaxChars && account->mStatus == stored.mStatus && account->mGmLevel == stored.mGmLevel, "account '%s' has the wrong settings", stored.mName );
+
+	/* The licenses can come back in any order. */
+	std::vector<uint32_t> licenses( account->mLicenses, account->mLicenses + account->mLicenseCount );
+	std::vector<uint32_t> expected( stored.mLicenses );
+	std::sort( licenses.begin(), licenses.end() );
+	std::sort( expected.begin(), expected.end() );
+	Check( licenses == expected, "account '%s' has %u licenses, expected %u", stored.mName, account->mLicenseCount, (uint32_t)expected.size() );
+
+	Check( account->mCharacters.size() == stored.mCharacters.size(), "account '%s' has %u characters, expected %u", stored.mName, (uint32_t)account->mCharacters.size(), (uint32_t)stored.mCharacters.size() );
+
+	for ( CharacterList::iterator i = account->mCharacters.begin(); i != account->mCharacters.end(); i++ )
+	{
+		std::map<uint32_t, LocalCharacter>::const_iterator c = characters.find( ( *i )->mId );
+		if ( c == characters.end() )
+		{
+			Check( false, "account '%s' lists unknown character %u", stored.mName, ( *i )->mId );
+			continue;
+		}
+
+		CheckCharacter( *i, c->second );
+	}
+
+	/* The square loads the account by id, without the characters. */
+	AccountInfo *by_id = DB::Account_Load( stored.mId, NULL, false );
+	Check( by_id != NULL && strcmp( by_id->mName, stored.mName ) == 0 && by_id->mCharacters.empty(), "account %u was not loaded by id", stored.mId );
+
+	delete by_id;
+	delete account;
+}
+
+/* Checks the details the square loads for a character. */
+static void CheckCharacterDetails( const LocalCharacter &c )
+{
+	CharacterData *loaded = DB::Character_Load( c.mId, NULL );
+	if ( loaded == NULL )
+	{
+		Check( false, "character %u was not found", c.mId );
+		return;
+	}
+
+	CheckCharacter( loaded, c );
+	Check( loaded->mMoney == c.mMoney && loaded->mBankMoney == c.mBankMoney, "character %u has the wrong money", c.mId );
+	Check( loaded->mLicenseCount == c.mBags.size(), "character %u has %u bag licenses, expected %u", c.mId, loaded->mLicenseCount, (uint32_t)c.mBags.size() );
+
+	for ( uint32_t i = 0; i < loaded->mLicenseCount && i < c.mBags.size(); i++ )
+	{
+		const BagLicense &bag = loaded->mLicenses[i];
+		const BagLicense *match = NULL;
+		for ( size_t b = 0; b < c.mBags.size(); b++ )
+		{
+			if ( c.mBags[b].mId == bag.mId )
+				match = &c.mBags[b];
+		}
+
+		Check( match != NULL && match->mIndex == bag.mIndex && match->mStatus == bag.mStatus && match->mExpires == bag.mExpires, "bag license %u of character %u does not match", bag.mId, c.mId );
+	}
+
+	DB::Character_LoadInventory( loaded );
+	DB::Character_LoadBank( loaded );
+	CheckItems( loaded->mInventory, c, 0 );
+	CheckItems( loaded->mBank, c, 1 );
+
+	delete loaded;
+}
+
+/* Creates, finds and deletes a character the way the gateway does. */
+static void CheckCreateDelete( const LocalAccount &stored, uint32_t seed )
+{
+	char name[33], other_case[33];
+	sprintf( name, "Conform%u", seed );
+	for ( size_t i = 0; i <= strlen( name ); i++ )
+		other_case[i] = ( name[i] >= 'a' && name[i] <= 'z' ) ? name[i] - 32 : name[i];
+
+	if ( DB::Character_Exists( name ) )
+	{
+		Check( false, "character '%s' is left over from an earlier check, use another seed", name );
+		return;
+	}
+
+	CharacterList before;
+	uint32_t count = DB::Character_GetList( stored.mId, before );
+
+	uint32_t char_id = DB::Character_Create( stored.mId, 1, name );
+	Check( char_id != 0, "character '%s' was not created", name );
+	if ( char_id == 0 )
+		return;
+
+	Check( DB::Character_Exists( other_case ), "character '%s' is not found as '%s'", name, other_case );
+
+	CharacterData *created = DB::Character_Load( char_id, NULL );
+	Check( created != NULL && strcmp( created->mName, name ) == 0 && created->mClassId == 1, "created character %u was not loaded", char_id );
+	delete created;
+
+	CharacterList after;
+	Check( DB::Character_GetList( stored.mId, after ) == count + 1, "the created character is not in the list of account %u", stored.mId );
+
+	DB::Character_Delete( char_id );
+	Check( !DB::Character_Exists( name ), "deleted character '%s' still exists", name );
+	Check( DB::Character_Load( char_id, NULL ) == NULL, "deleted character %u can still be loaded", char_id );
+
+	CharacterList deleted;
+	Check( DB::Character_GetList( stored.mId, deleted ) == count, "the deleted character is still in the list of account %u", stored.mId );
+
+	for ( CharacterList::iterator i = before.begin(); i != before.end(); i++ ) delete *i;
+	for ( CharacterList::iterator i = after.begin(); i != after.end(); i++ )   delete *i;
+	for ( CharacterList::iterator i = deleted.begin(); i != deleted.end(); i++ ) delete *i;
+}
+
+/* Generates a small data set through the sink and reads all of it back through the storage in use. */
+bool Conformance::Run( DataSink &sink, uint32_t seed )
+{
+	CaptureSink capture( sink );
+	if ( !DataGen::Run( capture, CONFORM_ACCOUNTS, seed ) || capture.mAccounts.empty() )
+		return false;
+
+	g_checks = g_failures = 0;
+
+	uint32_t last_id = 0;
+	for ( std::map<uint32_t, LocalAccount>::iterator i = capture.mAccounts.begin(); i != capture.mAccounts.end(); i++ )
+	{
+		CheckAccount( i->second, capture.mCharacters );
+		last_id = i->first;
+	}
+
+	for ( std::map<uint32_t, LocalCharacter>::iterator i = capture.mCharacters.begin(); i != capture.mCharacters.end(); i++ )
+		CheckCharacterDetails( i->second );
+
+	/* Unknown accounts are not found, by name or by id. */
+	Check( DB::Account_Load( "conform-missing", NULL ) == NULL, "an unknown account name was found" );
+	Check( DB::Account_Load( last_id + 1000000, NULL, false ) == NULL, "an unknown account id was found" );
+
+	CheckCreateDelete( capture.mAccounts.begin()->second, seed );
+
+	printf( "storage,checks,failures\n%s,%u,%u\n", DB::GetStorage()->GetName(), g_checks, g_failures );
+	return g_failures == 0;
+}
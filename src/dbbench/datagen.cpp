@@ -0,0 +1,402 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <dbbench.h>
+#include <database.h>
+#include <character.h>
+#include <inventory.h>
+#include <log.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Collects rows for a table and writes them with multi-row INSERT statements. */
+class Batch {
+public:
+	/* Starts a batch for the specified INSERT statement, without the values. */
+	Batch( MySqlStorage *mysql, const char *prefix ): mMySql( mysql ), mPrefix( prefix ), mRows( 0 ), mTotal( 0 ), mFailed( false )
+	{
+		mSql    = (char *)malloc( DATAGEN_SQL_SIZE );
+		mLength = sprintf( mSql, "%s", mPrefix );
+	}
+
+	/* Frees the statement buffer. */
+	~Batch() { free( mSql ); }
+
+	/* Adds a row, formatted as "(...)", and writes the batch once it is full. */
+	void Add( const char *row )
+	{
+		size_t len = strlen( row );
+		if ( mRows == DATAGEN_BATCH_ROWS || mLength + len + 2 >= DATAGEN_SQL_SIZE )
+			Flush();
+
+		if ( mRows > 0 )
+			mSql[mLength++] = ',';
+
+		memcpy( mSql + mLength, row, len + 1 );
+		mLength += len;
+		mRows++;
+	}
+
+	/* Writes the rows that have been added. */
+	void Flush()
+	{
+		if ( mRows == 0 )
+			return;
+
+		if ( mMySql->Query( mSql ) != 0 )
+		{
+			mMySql->LogError();
+			mFailed = true;
+		}
+
+		mTotal += mRows;
+		mRows   = 0;
+		mLength = sprintf( mSql, "%s", mPrefix );
+	}
+
+	inline uint32_t GetTotal() const { return mTotal; }
+	inline bool     Failed()   const { return mFailed; }
+
+private:
+	MySqlStorage *mMySql;
+	const char   *mPrefix;
+	char         *mSql;
+	size_t        mLength;
+	uint32_t      mRows;
+	uint32_t      mTotal;
+	bool          mFailed;
+};
+
+/* Starts a batch for every table. The rows follow the column order the loaders in mysqlstorage.cpp read by position. */
+SqlSink::SqlSink( MySqlStorage *mysql ): mMySql( mysql )
+{
+	mAccounts   = new Batch( mysql, "INSERT INTO sol_accounts (id, name, passwd, max_chars, status, gmlevel) VALUES " );
+	mLicenses   = new Batch( mysql, "INSERT INTO sol_character_licenses (account_id, class_id) VALUES " );
+	mCharacters = new Batch( mysql, "INSERT INTO sol_characters VALUES " );
+	mBags       = new Batch( mysql, "INSERT INTO bags VALUES " );
+	mItems      = new Batch( mysql, "INSERT INTO items VALUES " );
+
+	/* The rows of a table are written in batches of their own, so a child can reach the server before its parent. */
+	mMySql->Query( "SET foreign_key_checks = 0" );
+}
+
+/* Frees the batches. */
+SqlSink::~SqlSink()
+{
+	delete mAccounts;
+	delete mLicenses;
+	delete mCharacters;
+	delete mBags;
+	delete mItems;
+}
+
+/* Gets the highest ID in the table of the specified record type. */
+uint32_t SqlSink::GetMaxId( uint8_t type )
+{
+	switch ( type )
+	{
+		case LOCAL_REC_ACCOUNT:   return mMySql->QueryInt( "SELECT COALESCE(MAX(id), 0) FROM sol_accounts" );
+		case LOCAL_REC_CHARACTER: return mMySql->QueryInt( "SELECT COALESCE(MAX(id), 0) FROM sol_characters" );
+		case LOCAL_REC_BAG:       return mMySql->QueryInt( "SELECT COALESCE(MAX(id), 0) FROM bags" );
+		case LOCAL_REC_ITEM:      return mMySql->QueryInt( "SELECT COALESCE(MAX(id), 0) FROM items" );
+	}
+	return 0;
+}
+
+/* Adds a row to sol_accounts. */
+void SqlSink::AddAccount( const AccountInfo &account )
+{
+	char row[128];
+	sprintf( row, "(%u,'%s','%s',%u,%u,%u)", account.mId, account.mName, account.mPassword, account.mMaxChars, account.mStatus, account.mGmLevel );
+	mAccounts->Add( row );
+}
+
+/* Adds a row to sol_character_licenses. */
+void SqlSink::AddLicense( uint32_t account_id, uint32_t class_id )
+{
+	char row[32];
+	sprintf( row, "(%u,%u)", account_id, class_id );
+	mLicenses->Add( row );
+}
+
+/* Adds a row to sol_characters. */
+void SqlSink::AddCharacter( uint32_t account_id, const LocalCharacter &c )
+{
+	char row[256];
+	sprintf( row, "(%u,%u,'%s',%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u)", 
+		c.mId, account_id, c.mName, c.mClassId, 
+		c.mLevel, c.mExperience, 
+		c.mPvpLevel, c.mPvpExperience, 
+		c.mWarLevel, c.mWarExperience, 
+		c.mRebirthLevel, c.mRebirthCount, 
+		c.mLastPlayed, c.mMoney, c.mBankMoney );
+	mCharacters->Add( row );
+}
+
+/* Adds a row to bags. */
+void SqlSink::AddBag( uint32_t char_id, const BagLicense &bag )
+{
+	char row[64];
+	sprintf( row, "(%u,%u,%u,%u,%u)", bag.mId, char_id, bag.mIndex, bag.mStatus, (uint32_t)bag.mExpires );
+	mBags->Add( row );
+}
+
+/* Adds a row to items. */
+void SqlSink::AddItem( uint32_t char_id, const LocalItem &item )
+{
+	char row[128];
+	sprintf( row, "(%u,%u,%u,%u,%u,%u,%u)", (uint32_t)item.mItem.mId, char_id, item.mItem.mItemId, item.mType, item.mBag, item.mSlot, item.mItem.mAmount );
+	mItems->Add( row );
+}
+
+/* Writes the rows that are left. */
+bool SqlSink::Finish()
+{
+	mAccounts->Flush();
+	mLicenses->Flush();
+	mCharacters->Flush();
+	mBags->Flush();
+	mItems->Flush();
+
+	mMySql->Query( "SET foreign_key_checks = 1" );
+
+	ServerLog.Write( "Generated %u accounts, %u character licenses, %u characters, %u bags and %u items.\n", E_SUCCESS, 
+		mAccounts->GetTotal(), mLicenses->GetTotal(), mCharacters->GetTotal(), mBags->GetTotal(), mItems->GetTotal() );
+
+	return !( mAccounts->Failed() || mLicenses->Failed() || mCharacters->Failed() || mBags->Failed() || mItems->Failed() );
+}
+
+/* Stops the local storage from flushing after every record. */
+LocalSink::LocalSink( LocalStorage *local ): mLocal( local )
+{
+	memset( mCounts, 0, sizeof( mCounts ) );
+	mLocal->BeginBatch();
+}
+
+/* Gets the highest ID used for the specified record type. */
+uint32_t LocalSink::GetMaxId( uint8_t type )
+{
+	return mLocal->GetMaxId( type );
+}
+
+/* Adds an account record. */
+void LocalSink::AddAccount( const AccountInfo &account )
+{
+	mLocal->PutAccount( account );
+	mCounts[LOCAL_REC_ACCOUNT]++;
+}
+
+/* Adds a character license record. */
+void LocalSink::AddLicense( uint32_t account_id, uint32_t class_id )
+{
+	mLocal->PutAccountLicense( account_id, class_id );
+	mCounts[LOCAL_REC_ACCOUNT_LICENSE]++;
+}
+
+/* Adds a character record. */
+void LocalSink::AddCharacter( uint32_t account_id, const LocalCharacter &c )
+{
+	mLocal->PutCharacter( account_id, c );
+	mCounts[LOCAL_REC_CHARACTER]++;
+}
+
+/* Adds a bag record. */
+void LocalSink::AddBag( uint32_t char_id, const BagLicense &bag )
+{
+	mLocal->PutBag( char_id, bag );
+	mCounts[LOCAL_REC_BAG]++;
+}
+
+/* Adds an item record. */
+void LocalSink::AddItem( uint32_t char_id, const LocalItem &item )
+{
+	mLocal->PutItem( char_id, item );
+	mCounts[LOCAL_REC_ITEM]++;
+}
+
+/* Writes everything to disk. */
+bool LocalSink::Finish()
+{
+	mLocal->EndBatch();
+
+	ServerLog.Write( "Generated %u accounts, %u character licenses, %u characters, %u bags and %u items.\n", E_SUCCESS, 
+		mCounts[LOCAL_REC_ACCOUNT], mCounts[LOCAL_REC_ACCOUNT_LICENSE], mCounts[LOCAL_REC_CHARACTER], mCounts[LOCAL_REC_BAG], mCounts[LOCAL_REC_ITEM] );
+	return true;
+}
+
+/* Picks how many characters an account has, most players only have one or two. */
+static uint32_t PickCharacterCount( Random &random )
+{
+	static const uint32_t weights[DATAGEN_MAX_CHARACTERS + 1] = { 5, 40, 25, 15, 8, 4, 3 };
+
+	uint32_t roll = random.Below( 100 );
+	for ( uint32_t i = 0; i <= DATAGEN_MAX_CHARACTERS; i++ )
+	{
+		if ( roll < weights[i] )
+			return i;
+		roll -= weights[i];
+	}
+	return 1;
+}
+
+/* Writes the items of one inventory, spread over the slots without overlapping. */
+static void AddItems( DataSink &sink, Random &random, uint32_t &item_id, uint32_t char_id, uint8_t type, uint32_t count, uint32_t capacity )
+{
+	uint32_t position = random.Below( 3 );
+
+	for ( uint32_t i = 0; i < count && position < capacity; i++ )
+	{
+		LocalItem item;
+		item.mType         = type;
+		item.mBag          = (uint8_t)( position / BAG_SIZE );
+		item.mSlot         = (uint8_t)( position % BAG_SIZE );
+		item.mItem.mId     = item_id++;
+		item.mItem.mItemId = 1000 + random.Below( 20000 );
+
+		/* Stackables are common, most other items come alone. */
+		item.mItem.mAmount = ( random.Below( 4 ) == 0 ) ? 1 + random.Below( 99 ) : 1;
+
+		sink.AddItem( char_id, item );
+		position += 1 + random.Below( 3 );
+	}
+}
+
+/* Checks if the generated account with the specified index exists. */
+static bool AccountExists( uint32_t index )
+{
+	char        name[33];
+	AccountInfo account;
+
+	sprintf( name, DATAGEN_ACCOUNT_NAME, index );
+	return DB::Account_Load( name, &account, false ) != NULL;
+}
+
+/* Counts the generated accounts, they are numbered without gaps so a binary search over the names works on every backend. */
+uint32_t DataGen::CountAccounts()
+{
+	if ( !AccountExists( 0 ) )
+		return 0;
+
+	/* Double until past the end, then narrow down between the last hit and the miss. */
+	uint32_t low = 0, high = 1;
+	while ( AccountExists( high ) )
+	{
+		low   = high;
+		high *= 2;
+	}
+
+	while ( high - low > 1 )
+	{
+		uint32_t middle = low + ( high - low ) / 2;
+		if ( AccountExists( middle ) )
+			low = middle;
+		else
+			high = middle;
+	}
+	return high;
+}
+
+/* Generates the specified number of accounts with everything that belongs to them. */
+bool DataGen::Run( DataSink &sink, uint32_t accounts, uint32_t seed )
+{
+	Random   random( seed );
+	uint32_t now = (uint32_t)time( NULL );
+
+	/* New rows continue after what is already there, so the tool can be run several times. */
+	uint32_t first      = CountAccounts();
+	uint32_t account_id = sink.GetMaxId( LOCAL_REC_ACCOUNT ) + 1;
+	uint32_t char_id    = sink.GetMaxId( LOCAL_REC_CHARACTER ) + 1;
+	uint32_t bag_id     = sink.GetMaxId( LOCAL_REC_BAG ) + 1;
+	uint32_t item_id    = sink.GetMaxId( LOCAL_REC_ITEM ) + 1;
+
+	for ( uint32_t i = 0; i < accounts; i++, account_id++ )
+	{
+		AccountInfo account;
+		account.mId       = account_id;
+		account.mMaxChars = DATAGEN_MAX_CHARACTERS;
+		account.mStatus   = 0;
+		account.mGmLevel  = 0;
+		sprintf( account.mName, DATAGEN_ACCOUNT_NAME, first + i );
+		strcpy( account.mPassword, "bench" );
+		sink.AddAccount( account );
+
+		/* Every account has the starting classes, some bought a few more. */
+		uint32_t licenses = 4 + ( random.Below( 3 ) == 0 ? random.Below( 5 ) : 0 );
+		for ( uint32_t l = 0; l < licenses; l++ )
+			sink.AddLicense( account_id, l );
+
+		uint32_t characters = PickCharacterCount( random );
+		for ( uint32_t c = 0; c < characters; c++, char_id++ )
+		{
+			/* Levels are skewed low, few characters make it to the top. */
+			float    progress = random.Unit() * random.Unit();
+			uint32_t level    = 1 + (uint32_t)( progress * 98 );
+			uint32_t rebirths = ( level > 90 ) ? random.Below( 4 ) : 0;
+
+			LocalCharacter chara;
+			chara.mId            = char_id;
+			chara.mAccountId     = account_id;
+			chara.mClassId       = random.Below( licenses );
+			chara.mLevel         = (uint16_t)level;
+			chara.mExperience    = random.Below( 100000 ) * level;
+			chara.mPvpLevel      = (uint16_t)( 1 + random.Below( level ) );
+			chara.mPvpExperience = random.Below( 10000 );
+			chara.mWarLevel      = (uint16_t)( 1 + random.Below( level ) );
+			chara.mWarExperience = random.Below( 10000 );
+			chara.mRebirthLevel  = (uint16_t)( rebirths * 10 );
+			chara.mRebirthCount  = (uint16_t)rebirths;
+			chara.mLastPlayed    = now - random.Below( 90 * 86400 );
+			chara.mMoney         = (uint32_t)( progress * 5000000 );
+			chara.mBankMoney     = random.Below( 100000 );
+			sprintf( chara.mName, "b%u", char_id );
+			sink.AddCharacter( account_id, chara );
+
+			/* The first bag comes with the character, the others are licensed for a while. */
+			uint32_t bags = 1 + ( random.Below( 2 ) == 0 ? random.Below( MAX_BAGS ) : 0 );
+			for ( uint32_t b = 0; b < bags; b++ )
+			{
+				BagLicense bag;
+				bag.mId      = bag_id++;
+				bag.mIndex   = (uint8_t)b;
+				bag.mStatus  = ( b == 0 ) ? LICENSE_PERMANENT : 1;
+				bag.mExpires = ( b == 0 ) ? 0 : now + random.Below( 30 * 86400 );
+				sink.AddBag( char_id, bag );
+			}
+
+			/* Inventories fill up with the level, a few players hoard everything in the bank. */
+			uint32_t bag_items  = (uint32_t)( ( 0.2f + 0.8f * random.Unit() ) * bags * BAG_SIZE * 0.6f );
+			uint32_t bank_items = (uint32_t)( random.Unit() * random.Unit() * random.Unit() * MAX_BANK_BOXES * BAG_SIZE );
+
+			AddItems( sink, random, item_id, char_id, 0, bag_items, bags * BAG_SIZE );
+			AddItems( sink, random, item_id, char_id, 1, bank_items, MAX_BANK_BOXES * BAG_SIZE );
+		}
+
+		if ( ( i + 1 ) % 10000 == 0 )
+			ServerLog.Write( "Generated %u of %u accounts.\n", E_INFO, i + 1, accounts );
+	}
+
+	return sink.Finish();
+}
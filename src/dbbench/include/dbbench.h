@@ -0,0 +1,235 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_DBBENCH_H__
+#define __SOLDIN_DBBENCH_H__
+
+#include <shared.h>
+#include <account.h>
+#include <localstorage.h>
+#include <mysqlstorage.h>
+#include <vector>
+
+/* Rows written by a single INSERT statement. */
+#define DATAGEN_BATCH_ROWS 500
+
+/* Size of the statement buffer, large enough for a full batch of the widest rows. */
+#define DATAGEN_SQL_SIZE   ( DATAGEN_BATCH_ROWS * 160 )
+
+/* Generated accounts are named with this prefix and their index. */
+#define DATAGEN_ACCOUNT_NAME "bench%07u"
+
+/* Characters an account can have, matching the client. */
+#define DATAGEN_MAX_CHARACTERS 6
+
+/* Most threads the load test can run, one connection each. */
+#define LOADTEST_MAX_THREADS MAXIMUM_WAIT_OBJECTS
+
+/* Access patterns replayed by the load test. */
+#define PATTERN_LOGIN          0  /* Gateway: account, licenses and character list. */
+#define PATTERN_CHARACTER_LIST 1  /* Gateway: character list after creating or deleting. */
+#define PATTERN_SQUARE_HANDOFF 2  /* Square: account and selected character. */
+#define PATTERN_INVENTORY      3  /* Square: bags and bank of the character. */
+#define PATTERN_LOGIN_FLOW     4  /* All of the above, once per login. */
+#define PATTERN_COUNT          5
+
+/* Small and fast random number generator (xorshift), so runs with the same seed produce the same data. */
+class Random {
+public:
+	Random( uint32_t seed ): mState( seed != 0 ? seed : 0x9E3779B9 ) { }
+
+	/* Gets the next random number. */
+	inline uint32_t Next()
+	{
+		mState ^= mState << 13;
+		mState ^= mState >> 17;
+		mState ^= mState << 5;
+		return mState;
+	}
+
+	/* Gets a random number between 0 and max - 1. */
+	inline uint32_t Below( uint32_t max ) { return ( max > 0 ) ? Next() % max : 0; }
+
+	/* Gets a random number between 0 and 1. */
+	inline float Unit() { return ( Next() >> 8 ) / 16777216.0f; }
+
+private:
+	uint32_t mState;
+};
+
+/* Measures the time between two calls, in microseconds. */
+class Stopwatch {
+public:
+	Stopwatch() { QueryPerformanceFrequency( &mFrequency ); Restart(); }
+
+	inline void Restart() { QueryPerformanceCounter( &mStart ); }
+
+	inline uint32_t Elapsed() const
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter( &now );
+		return (uint32_t)( ( now.QuadPart - mStart.QuadPart ) * 1000000 / mFrequency.QuadPart );
+	}
+
+private:
+	LARGE_INTEGER mFrequency;
+	LARGE_INTEGER mStart;
+};
+
+/* Accounts generated by the conformance check. */
+#define CONFORM_ACCOUNTS 40
+
+/* Receives the generated data and writes it to a storage backend. The 
+ * characters and items use the record types of the local storage, the 
+ * IDs are picked by the generator. */
+class DataSink {
+public:
+	virtual ~DataSink() { }
+
+	virtual uint32_t GetMaxId( uint8_t type ) = 0;
+	virtual void     AddAccount( const AccountInfo &account ) = 0;
+	virtual void     AddLicense( uint32_t account_id, uint32_t class_id ) = 0;
+	virtual void     AddCharacter( uint32_t account_id, const LocalCharacter &c ) = 0;
+	virtual void     AddBag( uint32_t char_id, const BagLicense &bag ) = 0;
+	virtual void     AddItem( uint32_t char_id, const LocalItem &item ) = 0;
+	virtual bool     Finish() = 0;
+};
+
+class Batch;
+
+/* Writes the generated data to MySQL with multi-row INSERT statements. */
+class SqlSink: public DataSink {
+public:
+	SqlSink( MySqlStorage *mysql );
+	~SqlSink();
+
+	uint32_t GetMaxId( uint8_t type );
+	void     AddAccount( const AccountInfo &account );
+	void     AddLicense( uint32_t account_id, uint32_t class_id );
+	void     AddCharacter( uint32_t account_id, const LocalCharacter &c );
+	void     AddBag( uint32_t char_id, const BagLicense &bag );
+	void     AddItem( uint32_t char_id, const LocalItem &item );
+	bool     Finish();
+
+private:
+	MySqlStorage *mMySql;
+	Batch        *mAccounts;
+	Batch        *mLicenses;
+	Batch        *mCharacters;
+	Batch        *mBags;
+	Batch        *mItems;
+};
+
+/* Writes the generated data to the log of the local storage, flushed once at the end. */
+class LocalSink: public DataSink {
+public:
+	LocalSink( LocalStorage *local );
+
+	uint32_t GetMaxId( uint8_t type );
+	void     AddAccount( const AccountInfo &account );
+	void     AddLicense( uint32_t account_id, uint32_t class_id );
+	void     AddCharacter( uint32_t account_id, const LocalCharacter &c );
+	void     AddBag( uint32_t char_id, const BagLicense &bag );
+	void     AddItem( uint32_t char_id, const LocalItem &item );
+	bool     Finish();
+
+private:
+	LocalStorage *mLocal;
+	uint32_t      mCounts[LOCAL_REC_ITEM + 1];
+};
+
+/* Fills the storage with generated accounts, characters, bags and items. */
+class DataGen {
+public:
+	static bool     Run( DataSink &sink, uint32_t accounts, uint32_t seed );
+	static uint32_t CountAccounts();
+};
+
+/* Generates a small data set and checks that the storage in use gives back what was written. */
+class Conformance {
+public:
+	static bool Run( DataSink &sink, uint32_t seed );
+};
+
+/* Latencies of one access pattern, in microseconds. */
+struct pattern_stats_t {
+	std::vector<uint32_t> mLatencies;
+	uint32_t              mQueries;
+};
+typedef struct pattern_stats_t PatternStats;
+
+/* Replays login and square traffic on several connections at once and reports the latencies. */
+class LoadTest {
+public:
+	static bool Run( uint32_t threads, uint32_t logins, uint32_t seed );
+
+private:
+	static DWORD WINAPI Worker( void *context );
+	static void         Print( PatternStats *stats, double seconds );
+
+	static uint32_t     mAccountCount;
+	static uint32_t     mLoginsPerThread;
+};
+
+/* Shape of the simulated server of the login storm. */
+#define STORM_TICK_INTERVAL 50    /* Time (ms) from the start of one tick to the next. */
+#define STORM_TICK_BUDGET   20    /* Time (ms) the admitted logins may take per tick. */
+#define STORM_MAX_IN_FLIGHT 32
+#define STORM_REQUEST_SIZE  64    /* Bytes answered to a request of a player that is already in. */
+#define STORM_MIN_TICKS     40    /* Ticks measured at least, so a storm that is over fast is not hidden. */
+
+/* Latencies measured during a login storm. */
+struct storm_result_t {
+	std::vector<uint32_t> mPlayers;  /* From a request of a player that is in until its answer (usec). */
+	std::vector<uint32_t> mLogins;   /* From the start of the storm until the login was answered (usec). */
+	uint32_t              mTicks;
+	uint32_t              mRejected;
+	double                mSeconds;
+};
+typedef struct storm_result_t StormResult;
+
+/* Lets a burst of clients log in at once on a simulated gateway loop, with
+ * real storage calls, while players that are already in send a request 
+ * every tick. Runs once without and once with admission control, and tells 
+ * if the p99 latency of the players stayed within the budget. */
+class LoginStorm {
+public:
+	static bool Run( uint32_t logins, uint32_t players, uint32_t budget, uint32_t seed );
+
+private:
+	static void RunOnce( bool admission, uint32_t logins, uint32_t players, uint32_t seed, StormResult &result );
+	static bool Print( const char *mode, uint32_t logins, uint32_t players, uint32_t budget, StormResult &result );
+
+	static uint32_t mAccountCount;
+};
+
+/* SQL connection settings, read from the square configuration. */
+extern const char *cfg_sql_host;
+extern const char *cfg_sql_username;
+extern const char *cfg_sql_password;
+extern const char *cfg_sql_database;
+extern uint16_t    cfg_sql_port;
+
+#endif /* __SOLDIN_DBBENCH_H__ */
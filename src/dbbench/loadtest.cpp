@@ -0,0 +1,204 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <dbbench.h>
+#include <database.h>
+#include <account.h>
+#include <character.h>
+#include <log.h>
+#include <stdio.h>
+#include <algorithm>
+
+uint32_t LoadTest::mAccountCount    = 0;
+uint32_t LoadTest::mLoginsPerThread = 0;
+
+static const char *g_pattern_names[PATTERN_COUNT] = { 
+	"login", "character_list", "square_handoff", "inventory_load", "login_flow" 
+};
+
+/* State of a single load test thread. */
+struct loadtest_worker_t {
+	uint32_t     mSeed;
+	PatternStats mStats[PATTERN_COUNT];
+};
+typedef struct loadtest_worker_t LoadTestWorker;
+
+/* Adds a measurement to the statistics of a pattern. */
+static void Record( PatternStats &stats, const Stopwatch &watch, uint32_t queries_before )
+{
+	stats.mLatencies.push_back( watch.Elapsed() );
+	stats.mQueries += MySqlStorage::GetQueryCount() - queries_before;
+}
+
+/* Logs in as random generated accounts, the way the gateway and square load a player. */
+DWORD WINAPI LoadTest::Worker( void *context )
+{
+	LoadTestWorker *worker = (LoadTestWorker *)context;
+	Random          random( worker->mSeed );
+	Stopwatch       flow, step;
+	char            name[33];
+
+	if ( !DB::Connect() )
+	{
+		DB::LogError();
+		return 1;
+	}
+
+	for ( uint32_t i = 0; i < mLoginsPerThread; i++ )
+	{
+		sprintf( name, DATAGEN_ACCOUNT_NAME, random.Below( mAccountCount ) );
+
+		uint32_t flow_queries = MySqlStorage::GetQueryCount();
+		flow.Restart();
+
+		/* The gateway loads the account by name, with its licenses and characters. */
+		uint32_t queries = MySqlStorage::GetQueryCount();
+		step.Restart();
+		AccountInfo *account = DB::Account_Load( name, NULL );
+		Record( worker->mStats[PATTERN_LOGIN], step, queries );
+
+		if ( account == NULL )
+			continue;
+
+		/* The list is send again after a character is created or deleted. */
+		CharacterList list;
+		queries = MySqlStorage::GetQueryCount();
+		step.Restart();
+		DB::Character_GetList( account->mId, list );
+		Record( worker->mStats[PATTERN_CHARACTER_LIST], step, queries );
+
+		for ( CharacterList::iterator c = list.begin(); c != list.end(); c++ )
+			delete *c;
+
+		if ( !account->mCharacters.empty() )
+		{
+			uint32_t char_id = account->mCharacters[random.Below( account->mCharacters.size() )]->mId;
+
+			/* The square loads the account and the selected character once the client arrives. */
+			queries = MySqlStorage::GetQueryCount();
+			step.Restart();
+			AccountInfo   *square_account = DB::Account_Load( account->mId, NULL, false );
+			CharacterData *character      = DB::Character_Load( char_id, NULL );
+			Record( worker->mStats[PATTERN_SQUARE_HANDOFF], step, queries );
+
+			/* The bags and bank follow once the client opens them. */
+			if ( character != NULL )
+			{
+				queries = MySqlStorage::GetQueryCount();
+				step.Restart();
+				DB::Character_LoadInventory( character );
+				DB::Character_LoadBank( character );
+				Record( worker->mStats[PATTERN_INVENTORY], step, queries );
+			}
+
+			delete character;
+			delete square_account;
+		}
+
+		Record( worker->mStats[PATTERN_LOGIN_FLOW], flow, flow_queries );
+		delete account;
+	}
+
+	DB::Disconnect();
+	return 0;
+}
+
+/* Runs the specified number of logins spread over the threads, and writes the results as CSV. */
+bool LoadTest::Run( uint32_t threads, uint32_t logins, uint32_t seed )
+{
+	mAccountCount = DataGen::CountAccounts();
+	if ( mAccountCount == 0 )
+	{
+		ErrorLog.Write( "There are no generated accounts, run the generator first.\n", E_ERROR );
+		return false;
+	}
+
+	threads          = MAX( 1, MIN( threads, LOADTEST_MAX_THREADS ) );
+	mLoginsPerThread = MAX( 1, logins / threads );
+
+	LoadTestWorker *workers = new LoadTestWorker[threads];
+	HANDLE          handles[LOADTEST_MAX_THREADS];
+
+	Stopwatch watch;
+	for ( uint32_t i = 0; i < threads; i++ )
+	{
+		for ( int p = 0; p < PATTERN_COUNT; p++ )
+		{
+			workers[i].mStats[p].mQueries = 0;
+			workers[i].mStats[p].mLatencies.reserve( mLoginsPerThread );
+		}
+
+		workers[i].mSeed = seed + i * 7919;
+		handles[i]       = CreateThread( NULL, 0, Worker, &workers[i], 0, NULL );
+	}
+
+	WaitForMultipleObjects( threads, handles, TRUE, INFINITE );
+	double seconds = watch.Elapsed() / 1000000.0;
+
+	for ( uint32_t i = 0; i < threads; i++ )
+		CloseHandle( handles[i] );
+
+	/* Merge the measurements of all threads. */
+	PatternStats total[PATTERN_COUNT];
+	for ( int p = 0; p < PATTERN_COUNT; p++ )
+	{
+		total[p].mQueries = 0;
+		for ( uint32_t i = 0; i < threads; i++ )
+		{
+			total[p].mQueries += workers[i].mStats[p].mQueries;
+			total[p].mLatencies.insert( total[p].mLatencies.end(), workers[i].mStats[p].mLatencies.begin(), workers[i].mStats[p].mLatencies.end() );
+		}
+	}
+	delete [] workers;
+
+	Print( total, seconds );
+	return true;
+}
+
+/* Writes the latency percentiles and queries per operation of every pattern. The storage 
+ * is named on every line, so the results of several backends can be put side by side. */
+void LoadTest::Print( PatternStats *stats, double seconds )
+{
+	const char *storage = DB::GetStorage()->GetName();
+
+	printf( "storage,pattern,count,ops_per_sec,p50_us,p99_us,max_us,queries_per_op\n" );
+
+	for ( int p = 0; p < PATTERN_COUNT; p++ )
+	{
+		std::vector<uint32_t> &latencies = stats[p].mLatencies;
+		size_t count = latencies.size();
+		if ( count == 0 )
+		{
+			printf( "%s,%s,0,0,0,0,0,0\n", storage, g_pattern_names[p] );
+			continue;
+		}
+
+		std::sort( latencies.begin(), latencies.end() );
+
+		printf( "%s,%s,%u,%.1f,%u,%u,%u,%.2f\n", storage, g_pattern_names[p], (uint32_t)count, count / seconds,
+			latencies[count / 2], latencies[MIN( count - 1, count * 99 / 100 )], latencies[count - 1], 
+			(double)stats[p].mQueries / count );
+	}
+}
@@ -0,0 +1,148 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dbbench.h>
+#include <database.h>
+#include <settings.h>
+#include <log.h>
+
+Settings    g_config( "config/soldin_square.cfg" );
+
+const char *cfg_sql_host;
+const char *cfg_sql_username;
+const char *cfg_sql_password;
+const char *cfg_sql_database;
+uint16_t    cfg_sql_port;
+
+/* Shows how to run the tool. */
+void PrintUsage()
+{
+	printf( "Usage: soldin-dbbench generate <accounts> [-seed <n>] [options]\n" );
+	printf( "       soldin-dbbench run [-threads <n>] [-logins <n>] [-seed <n>] [options]\n" );
+	printf( "       soldin-dbbench conform [-seed <n>] [options]\n" );
+	printf( "       soldin-dbbench storm [-logins <n>] [-players <n>] [-budget <ms>] [-seed <n>] [options]\n\n" );
+	printf( "  generate   Adds generated accounts, characters, bags and items to the storage.\n" );
+	printf( "  run        Replays logins on several connections and writes the latencies as CSV.\n" );
+	printf( "  conform    Adds a small data set and checks that the storage returns all of it.\n" );
+	printf( "  storm      Lets all logins in at once and checks the p99 latency of the players that are in.\n\n" );
+	printf( "Options:\n" );
+	printf( "  -storage <mysql|local>   Storage backend, the square configuration by default.\n" );
+	printf( "  -path <file>             File of the local storage.\n" );
+}
+
+/* Main entry point of the application. */
+int main( int argc, char **argv )
+{
+	if ( argc < 2 )
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	bool     generate = ( strcmp( argv[1], "generate" ) == 0 );
+	bool     conform  = ( strcmp( argv[1], "conform" ) == 0 );
+	bool     storm    = ( strcmp( argv[1], "storm" ) == 0 );
+	uint32_t accounts = 0;
+	uint32_t threads  = 8;
+	uint32_t logins   = storm ? 2000 : 10000;
+	uint32_t players  = 500;
+	uint32_t budget   = 100;
+	uint32_t seed     = 1;
+
+	/* Use the storage of the square server, unless told otherwise. */
+	const char *storage = g_config.GetString( "storage",      "mysql" );
+	const char *path    = g_config.GetString( "storage_path", "data/soldin.db" );
+
+	if ( generate )
+	{
+		if ( argc < 3 || ( accounts = atoi( argv[2] ) ) == 0 )
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+	else if ( !conform && !storm && strcmp( argv[1], "run" ) != 0 )
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	for ( int i = generate ? 3 : 2; i + 1 < argc; i += 2 )
+	{
+		if      ( strcmp( argv[i], "-seed" ) == 0 )    seed    = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-threads" ) == 0 ) threads = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-logins" ) == 0 )  logins  = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-players" ) == 0 ) players = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-budget" ) == 0 )  budget  = atoi( argv[i + 1] );
+		else if ( strcmp( argv[i], "-storage" ) == 0 ) storage = argv[i + 1];
+		else if ( strcmp( argv[i], "-path" ) == 0 )    path    = argv[i + 1];
+	}
+
+	/* The results of a run go to stdout, keep the log out of it. */
+	if ( !generate )
+		Log::SetLevel( "warning" );
+
+	MySqlStorage *mysql = NULL;
+	LocalStorage *local = NULL;
+
+	if ( _stricmp( storage, "local" ) == 0 )
+	{
+		local = new LocalStorage( path );
+	}
+	else
+	{
+		cfg_sql_host     = g_config.GetString( "sql_host",     "localhost" );
+		cfg_sql_username = g_config.GetString( "sql_username", "root" );
+		cfg_sql_password = g_config.GetString( "sql_password", "" );
+		cfg_sql_database = g_config.GetString( "sql_database", "soldin" );
+		cfg_sql_port     = g_config.GetInt(    "sql_port",     3306 );
+
+		mysql = new MySqlStorage( cfg_sql_host, cfg_sql_username, cfg_sql_password, cfg_sql_database, cfg_sql_port );
+	}
+
+	if ( !DB::Use( ( local != NULL ) ? (Storage *)local : (Storage *)mysql ) )
+	{
+		DB::LogError();
+		return 1;
+	}
+
+	bool result;
+	if ( generate || conform )
+	{
+		DataSink *sink = ( local != NULL ) ? (DataSink *)new LocalSink( local ) : (DataSink *)new SqlSink( mysql );
+
+		result = generate ? DataGen::Run( *sink, accounts, seed ) : Conformance::Run( *sink, seed );
+		delete sink;
+	}
+	else if ( storm )
+		result = LoginStorm::Run( logins, players, budget, seed );
+	else result = LoadTest::Run( threads, logins, seed );
+
+	DB::Disconnect();
+	return result ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <dbbench.h>
+#include <database.h>
+#include <admission.h>
+#include <loadmonitor.h>
+#include <sessionmanager.h>
+#include <buffer.h>
+#include <log.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+
+uint32_t LoginStorm::mAccountCount = 0;
+
+/* A client of the storm that wants to log in. */
+class StormClient: public Session {
+public:
+	char mAccountName[33];
+};
+
+static Buffer       s_reply;
+static Stopwatch   *s_clock;
+static StormResult *s_result;
+static uint32_t     s_done;
+
+/* Does what the gateway does for a login: loads the account and serializes the character list. */
+static void Login( StormClient *client )
+{
+	Admission::BeginWork();
+
+	AccountInfo *account = DB::Account_Load( client->mAccountName, NULL );
+	if ( account != NULL )
+	{
+		s_reply.Reset();
+		s_reply.WriteUInt32( account->mMaxChars );
+		s_reply.WriteUInt32( account->mLicenseCount );
+
+		for ( CharacterList::iterator i = account->mCharacters.begin(); i != account->mCharacters.end(); ++i )
+		{
+			CharacterData *chara = *i;
+
+			s_reply.WriteWideString( chara->mName );
+			s_reply.WriteUInt32( chara->mClassId );
+			s_reply.WriteUInt16( chara->mLevel );
+			s_reply.WriteUInt32( chara->mExperience );
+
+			struct tm *timeinfo = localtime( &chara->mLastPlayed );
+			s_reply.WriteUInt16( timeinfo->tm_year + 1900 );
+			s_reply.WriteUInt16( timeinfo->tm_mon + 1 );
+			s_reply.WriteUInt16( timeinfo->tm_mday );
+		}
+		delete account;
+	}
+
+	Admission::EndWork();
+	Admission::Finish( client );
+
+	s_result->mLogins.push_back( s_clock->Elapsed() );
+	s_done++;
+}
+
+/* The login of a client was let in after waiting. */
+static void OnAdmitted( void *target, const Mail *mail )
+{
+	Login( (StormClient *)target );
+}
+
+/* Runs the storm once and collects the latencies. */
+void LoginStorm::RunOnce( bool admission, uint32_t logins, uint32_t players, uint32_t seed, StormResult &result )
+{
+	Random       random( seed );
+	Stopwatch    clock;
+	StormClient *clients = new StormClient[logins];
+
+	for ( uint32_t i = 0; i < logins; i++ )
+	{
+		sprintf( clients[i].mAccountName, DATAGEN_ACCOUNT_NAME, random.Below( mAccountCount ) );
+		SessionManager::Create( SESS_USER, &clients[i] );
+		clients[i].mEOF = false;
+	}
+
+	result.mTicks    = 0;
+	result.mRejected = 0;
+	result.mPlayers.reserve( players * 256 );
+	result.mLogins.reserve( logins );
+
+	s_clock  = &clock;
+	s_result = &result;
+	s_done   = 0;
+
+	Admission::Configure( STORM_TICK_BUDGET, STORM_MAX_IN_FLIGHT, logins );
+	clock.Restart();
+
+	uint32_t last_start = 0;
+	while ( s_done + result.mRejected < logins || result.mTicks < STORM_MIN_TICKS )
+	{
+		uint32_t start = clock.Elapsed();
+		LoadMonitor::BeginTick();
+
+		if ( admission )
+			Admission::Pump();
+
+		/* Everyone arrives at once, as after a restart. */
+		if ( result.mTicks == 0 )
+		{
+			for ( uint32_t i = 0; i < logins; i++ )
+			{
+				if ( !admission )
+				{
+					Login( &clients[i] );
+					continue;
+				}
+
+				int admit = Admission::Request( &clients[i], OnAdmitted );
+				if ( admit == ADMIT_NOW )
+					Login( &clients[i] );
+				else if ( admit == ADMIT_REJECTED )
+					result.mRejected++;
+			}
+		}
+
+		/* The clients handle their mail, as in the update of a session. */
+		for ( uint32_t i = 0; i < logins; i++ )
+			clients[i].mMailbox.Drain( &clients[i] );
+
+		/* Every player that is in gets an answer to a request. */
+		for ( uint32_t p = 0; p < players; p++ )
+		{
+			s_reply.Reset();
+			for ( uint32_t j = 0; j < STORM_REQUEST_SIZE / 4; j++ )
+				s_reply.WriteUInt32( p + j );
+		}
+
+		LoadMonitor::EndTick();
+		uint32_t end = clock.Elapsed();
+
+		/* The requests came in at random times since the previous tick started, and were answered now. */
+		if ( result.mTicks == 0 )
+			last_start = ( start > STORM_TICK_INTERVAL * 1000 ) ? start - STORM_TICK_INTERVAL * 1000 : 0;
+
+		for ( uint32_t p = 0; p < players; p++ )
+			result.mPlayers.push_back( end - ( last_start + (uint32_t)( random.Unit() * ( start - last_start ) ) ) );
+
+		last_start = start;
+		result.mTicks++;
+
+		/* Wait for the next tick, a tick that ran over starts the next one right away. */
+		if ( end - start < STORM_TICK_INTERVAL * 1000 )
+			Sleep( STORM_TICK_INTERVAL - ( end - start ) / 1000 );
+	}
+
+	result.mSeconds = clock.Elapsed() / 1000000.0;
+
+	for ( uint32_t i = 0; i < logins; i++ )
+		SessionManager::Destroy( clients[i].mSessionId );
+	delete [] clients;
+}
+
+/* Runs the storm without and with admission control and writes the results as CSV, fails when
+ * the p99 latency of the players that are in exceeds the budget (in ms) with admission control. */
+bool LoginStorm::Run( uint32_t logins, uint32_t players, uint32_t budget, uint32_t seed )
+{
+	mAccountCount = DataGen::CountAccounts();
+	if ( mAccountCount == 0 )
+	{
+		ErrorLog.Write( "There are no generated accounts, run the generator first.\n", E_ERROR );
+		return false;
+	}
+
+	if ( logins > MAX_SESSIONS )
+	{
+		ErrorLog.Write( "A storm can have at most %u logins.\n", E_ERROR, MAX_SESSIONS );
+		return false;
+	}
+
+	printf( "storage,admission,logins,players,ticks,seconds,rejected,player_p50_us,player_p99_us,player_max_us,login_p50_ms,login_p99_ms,budget_ms,within_budget\n" );
+
+	StormResult without;
+	RunOnce( false, logins, players, seed, without );
+	Print( "off", logins, players, budget, without );
+
+	StormResult with;
+	RunOnce( true, logins, players, seed, with );
+	return Print( "on", logins, players, budget, with );
+}
+
+/* Writes the percentiles of a run, and tells if the p99 latency of the players stayed within the budget. */
+bool LoginStorm::Print( const char *mode, uint32_t logins, uint32_t players, uint32_t budget, StormResult &result )
+{
+	std::vector<uint32_t> &p = result.mPlayers;
+	std::vector<uint32_t> &l = result.mLogins;
+
+	std::sort( p.begin(), p.end() );
+	std::sort( l.begin(), l.end() );
+
+	uint32_t player_p50 = p.empty() ? 0 : p[p.size() / 2];
+	uint32_t player_p99 = p.empty() ? 0 : p[MIN( p.size() - 1, p.size() * 99 / 100 )];
+	uint32_t player_max = p.empty() ? 0 : p[p.size() - 1];
+	uint32_t login_p50  = l.empty() ? 0 : l[l.size() / 2];
+	uint32_t login_p99  = l.empty() ? 0 : l[MIN( l.size() - 1, l.size() * 99 / 100 )];
+	bool     within     = ( player_p99 <= budget * 1000 );
+
+	printf( "%s,%s,%u,%u,%u,%.1f,%u,%u,%u,%u,%u,%u,%u,%s\n", DB::GetStorage()->GetName(), mode, logins, players, 
+		result.mTicks, result.mSeconds, result.mRejected, player_p50, player_p99, player_max, login_p50 / 1000, 
+		login_p99 / 1000, budget, within ? "yes" : "no" );
+
+	return within;
+}
@@ -26,6 +26,8 @@
 #ifndef __SOLDIN_MESSAGES_H__
 #define __SOLDIN_MESSAGES_H__
 
+#include <link.h>
+
 /* Gateway <-> Client message ID's. */
 #define MSG_CLIENTHASH          0xAA41
 #define MSG_LOGIN               0xBA09
@@ -41,9 +43,4 @@
 #define MSG_SQUARE_SELECT       0x7AE9 // send by client only.
 #define MSG_SQUARE_DETAILS      0xB98B // send by server only.
 
-/* Gateway <-> Square message ID's. */
-#define MSG_SQUARE_AUTH         0x0001
-#define MSG_SQUARE_UPDATE       0x0002
-#define MSG_SQUARE_SESSIONINFO  0x0003
-
 #endif /* __SOLDIN_MESSAGES_H__ */
@@ -0,0 +1,67 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_NAMEINDEX_H__
+#define __SOLDIN_NAMEINDEX_H__
+
+#include <shared.h>
+
+#define NAMEINDEX_MIN_SLOTS    1024  /* Slots of the set before the first name is added. */
+#define NAMEINDEX_BLOOM_BITS   8     /* Bits of the Bloom filter per slot of the set. */
+#define NAMEINDEX_BLOOM_HASHES 4     /* Bits set in the Bloom filter per name. */
+
+/* Keeps the names of all characters in memory, so a name that is taken can
+ * be refused without asking the database. A name is kept as a 64 bit 
+ * fingerprint of its lower case form in an open addressed set, and a Bloom
+ * filter in front of it answers most lookups of free names without touching
+ * the set. The index is filled by a single scan at startup and follows the
+ * characters created and deleted by this gateway. Names it does not know are
+ * left to the unique key of the database, which remains the final judge. */
+class NameIndex {
+public:
+	static uint32_t Load();
+	static bool     Contains( const char *name );
+	static void     Add( const char *name );
+	static void     Remove( const char *name );
+
+	/* Gets the number of names in the index. */
+	inline static uint32_t GetCount() { return mCount; }
+
+private:
+	static ULONGLONG Fingerprint( const char *name );
+	static bool      Find( ULONGLONG fp );
+	static bool      MayContain( ULONGLONG fp );
+	static void      Insert( ULONGLONG fp );
+	static void      Rehash( uint32_t slot_count );
+	static void      OnName( const char *name, void *context );
+
+	static ULONGLONG *mSlots;
+	static uint32_t   mSlotCount;  /* Always a power of two. */
+	static uint32_t   mCount;
+	static uint32_t   mDeleted;
+	static uint32_t  *mBloom;
+};
+
+#endif /* __SOLDIN_NAMEINDEX_H__ */
@@ -0,0 +1,87 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_PASSWORDSERVICE_H__
+#define __SOLDIN_PASSWORDSERVICE_H__
+
+#include <shared.h>
+#include <account.h>
+#include <sessionmanager.h>
+#include <mailbox.h>
+#include <deque>
+
+/* Results of a password check, posted to the session in param 1. */
+#define PASSWORD_OK    0  /* The password matches. */
+#define PASSWORD_WRONG 1  /* The password does not match. */
+#define PASSWORD_ERROR 2  /* The stored password could not be read. */
+
+#define PASSWORD_MAX_WORKERS 16         /* Upper limit of the worker threads. */
+#define PASSWORD_INPUT_SIZE  33         /* Size of a password as typed by the client. */
+#define PASSWORD_HASH_PREFIX "$argon2"  /* Start of a stored hash, anything else is a password from before hashing. */
+
+/* A password waiting to be checked, or the result of the check. */
+struct password_job_t {
+	Session     *mSession;
+	int          mSessionId;
+	MailHandler  mHandler;
+	uint32_t     mAccountId;
+	uint32_t     mResult;
+	char         mStored[ACCOUNT_PASSWORD_SIZE];
+	char         mPassword[PASSWORD_INPUT_SIZE];
+};
+typedef struct password_job_t PasswordJob;
+
+/* Checks passwords against their Argon2id hashes on a pool of worker 
+ * threads. A hash is made slow on purpose, far too slow for the tick, so 
+ * the session hands the password over and gets the result posted to its
+ * mailbox once a worker is done. Passwords that are still stored from 
+ * before hashing are compared as they always were, and replaced with a 
+ * hash once they match. So are hashes made with less than the configured
+ * cost, which makes raising the cost take effect as players log in. */
+class PasswordService {
+public:
+	static bool Start( uint32_t workers );
+	static void SetCost( uint32_t ops, uint32_t memory );
+	static void Verify( Session *session, MailHandler handler, uint32_t account_id, const char *stored, const char *password );
+	static void Poll();
+
+	/* Gets the number of passwords that are queued or being checked. */
+	inline static uint32_t GetPending() { return (uint32_t)mPending; }
+
+private:
+	static DWORD WINAPI Worker( void *context );
+	static void         Check( PasswordJob *job, bool connected );
+	static void         OnChecked( void *target, const Mail *mail );
+
+	static std::deque<PasswordJob *> mJobs;
+	static CRITICAL_SECTION          mLock;
+	static HANDLE                    mSignal;   /* Semaphore that counts the queued jobs. */
+	static Mailbox                   mResults;  /* Checked jobs, drained by the main thread. */
+	static volatile LONG             mOps;
+	static volatile LONG             mMemory;   /* Kilobytes. */
+	static volatile LONG             mPending;
+};
+
+#endif /* __SOLDIN_PASSWORDSERVICE_H__ */
@@ -31,6 +31,7 @@
 #include <squaremanager.h>
 #include <database.h>
 #include <messages.h>
+#include <passwordservice.h>
 
 /* Hashes. */
 #define HASH_LIST_CHARACTERS       0x393CAF2B
@@ -89,9 +90,14 @@ public:
 	inline uint32_t   GetCharacterID()  const { return ( mCharacter != NULL ) ? mCharacter->mId : 0; }
 	inline uint32_t   GetAccountID()    const { return ( mAccount != NULL ) ? mAccount->mId : 0; }
 	inline uint8_t    GetStatus()       const { return mStatus; }
+	inline void       SetSquare( Square *square ) { mSquare = square; }
 	inline bool       IsConnected()     const { return mSocket->Connected(); }
 	inline bool       IsAuthenticated() const { return ( mAuthenticated && ( mAccount != NULL ) ); }
 
+	static void       OnLoginAdmitted( void *target, const Mail *mail );
+	static void       OnQueuePosition( void *target, const Mail *mail );
+	static void       OnPasswordChecked( void *target, const Mail *mail );
+
 private:
 	void Unsupported(Buffer &packet);
 
@@ -107,9 +113,15 @@ private:
 	void Msg_SquareList       ( Buffer &packet );
 	void Msg_Ping             ( Buffer &packet );
 	
+	void Login();
+	void FinishLogin( uint32_t password_result );
 	void SendCharacterList();
+	void BuildCharacterList();
 	void SendSquareList();
 
+	/* Marks the cached character list as outdated, after a character was created or deleted. */
+	inline void InvalidateCharacterList() { mCharacterVersion++; }
+
 	Socket        *mSocket;
 	Buffer         mBufferIn;
 	Buffer         mBufferOut;
@@ -118,6 +130,13 @@ private:
 	bool           mAuthenticated;
 	Square        *mSquare;
 	uint8_t        mStatus;
+	bool           mLoginPending;           /* Waiting for admission or the password check of the login below. */
+	char           mLoginName[UTF_BUFFER_SIZE];
+	char           mLoginPassword[PASSWORD_INPUT_SIZE];
+	Buffer         mLicensePacket;          /* Character list payloads, built for mCharacterPacketVersion. */
+	Buffer         mCharacterPacket;
+	uint32_t       mCharacterVersion;
+	uint32_t       mCharacterPacketVersion;
 };
 
 #endif /* __SOLDIN_PLAYERSESSION_H__ */
@@ -30,11 +30,19 @@
 #include <socket.h>
 #include <buffer.h>
 #include <squaresession.h>
+#include <link.h>
 
 #define MAX_SQUARES 25
 #define MAX_SQUARENAME_LEN 50
 #define INVALID_SQUARE -1
 
+/* Load thresholds used to derive the status of a square. */
+#define LOAD_TICK_BUDGET   40000        /* Tick time (usec) that counts as fully loaded. */
+#define LOAD_QUEUE_LIMIT   ( 1 << 20 )  /* Outgoing bytes that count as fully loaded. */
+#define LOAD_AVERAGE       50           /* Load (percent) from which a square is average. */
+#define LOAD_BUSY          75           /* Load (percent) from which a square is busy. */
+#define LOAD_FULL          90           /* Load (percent) from which a square is full. */
+
 enum squarestatus_t : uint32_t
 {
 	STATUS_SMOOTH    = 1,
@@ -51,33 +59,60 @@ enum squaretype_t : uint32_t
 	SQUARE_BEGINNER  = 3,
 };
 
-/* Represents a single square. */
+/* A stage hosted by a square shard. */
+struct square_stage_t
+{
+	uint32_t mStageId;
+	uint32_t mGroup;
+	uint16_t mLevel;
+	uint32_t mPlayers;
+	uint32_t mMaxPlayers;
+};
+typedef struct square_stage_t SquareStage;
+
+/* Represents a single square (shard). Several shards can serve the same square name. */
 class Square
 {
 public:
 	char            mName[MAX_SQUARENAME_LEN];
+	uint32_t        mShard;
+	uint32_t        mStageCount;
+	SquareStage     mStages[LINK_MAX_STAGES];
 	in_addr         mHostAddr;
 	uint16_t        mPort;
 	uint32_t        mCapacity;
 	uint32_t        mOnlineUsers;
+	uint32_t        mTickTime;
+	uint32_t        mQueueDepth;
+	uint32_t        mCpuUsage;
+	uint32_t        mLoad;
 	squarestatus_t  mStatus;
 	squaretype_t    mType;
 	SquareSession  *mSession;
 
 	inline bool IsActive() const { return (mSession != NULL); }
+	bool        HasRoom( uint32_t stage_group ) const;
 };
 
 /* Represents the square list. */
 class SquareManager
 {
 public:
-	static int     Add( const char *name, uint32_t hostaddr, uint16_t port, uint32_t capacity, SquareSession *session );
+	static int     Add( const char *name, uint32_t shard, uint32_t hostaddr, uint16_t port, uint32_t capacity, SquareSession *session );
 	static bool	   Remove( uint32_t index );
 	static Square *Find( const char *name );
+	static Square *FindShard( const char *name, uint32_t shard );
+	static Square *Route( const char *name, uint32_t stage_group );
+	static Square *FindLeastLoaded( squaretype_t type, uint32_t stage_group, const Square *exclude = NULL );
+	static void    UpdateLoad( Square *square );
+	static void    Reserve( Square *square, uint32_t stage_group );
 	static void    Initialize();
 	inline static  Square *GetList() { return mSquareList; }
 	inline static  uint32_t GetSquareCount() { return mSquareCount; }
 
+	/* Gets a number that changes whenever something shown in the square list changes. */
+	inline static  uint32_t GetVersion() { return mVersion; }
+
 	/* Gets a pointer to the square at the specified index. */
 	static Square *At( uint32_t index )
 	{
@@ -90,6 +125,7 @@ public:
 private:
 	static Square   mSquareList[MAX_SQUARES];
 	static uint32_t mSquareCount;
+	static uint32_t mVersion;
 };
 
 #endif /* __SOLDIN_SQUAREMANAGER_H__ */
@@ -30,7 +30,6 @@
 #include <sessionmanager.h>
 #include <messages.h>
 
-#define MAX_IDLE_TIME 10
 #define ERR_SESSION_NOTFOUND 1
 
 /* Represents a squareserver that has connected to the gateway.  */
@@ -51,11 +50,15 @@ private:
 	void Msg_Auth          ( Buffer &packet );
 	void Msg_Update        ( Buffer &packet );
 	void Msg_GetSessionInfo( Buffer &packet );
+	void Msg_Heartbeat     ( Buffer &packet );
+	void Msg_Stages        ( Buffer &packet );
+	void Msg_MigratePrepare( Buffer &packet );
+	void Msg_MigrateReady  ( Buffer &packet );
+	void Msg_MigrateCommit ( Buffer &packet );
 
 	Socket  *mSocket;
 	Buffer   mBufferIn;
 	Buffer   mBufferOut;
-	time_t   mLastUpdate;
 	uint32_t mSquareId;
 };
 
@@ -35,6 +35,15 @@
 #include <settings.h>
 #include <sessionmanager.h>
 #include <database.h>
+#include <localstorage.h>
+#include <shardedstorage.h>
+#include <dbstats.h>
+#include <nameindex.h>
+#include <passwordservice.h>
+#include <admission.h>
+#include <loadmonitor.h>
+#include <timerwheel.h>
+#include <poller.h>
 
 #define SOLDIN_VER "0.3"
 
@@ -77,9 +86,9 @@ void PrintBanner()
 /* Accept incoming connection requests. */
 void AcceptIncoming()
 {
-	/* Accept connections from game clients. */
-	Socket *sock = g_gate_socket.Accept();
-	if ( sock != NULL )
+	/* Accept connections from game clients, until the backlog is empty. */
+	Socket *sock;
+	for ( uint32_t n = 0; n < ACCEPT_BATCH && ( sock = g_gate_socket.Accept() ) != NULL; n++ )
 	{
 		PlayerSession *cl = new PlayerSession( sock );
 
@@ -97,8 +106,7 @@ void AcceptIncoming()
 	}
 
 	/* Accept connections from square servers. */
-	sock = g_square_socket.Accept();
-	if ( sock != NULL )
+	for ( uint32_t n = 0; n < ACCEPT_BATCH && ( sock = g_square_socket.Accept() ) != NULL; n++ )
 	{
 		SquareSession *square = new SquareSession( sock );
 
@@ -162,6 +170,21 @@ void Update()
 	}
 }
 
+/* Reads the settings that can be changed while the server is running. */
+void ApplySettings()
+{
+	Log::SetLevel( Config.GetString( "log_level", "debug" ) );
+
+	/* The string belongs to the settings, so it is taken again after every reload. */
+	cfg_gateway_ip = Config.GetString( "gateway_ip", "127.0.0.1" );
+
+	DBStats::SetSlowThreshold( Config.GetInt( "sql_slow_query_ms", 100 ) );
+	DBStats::Start( Config.GetInt( "sql_stats_interval", 60 ) );
+	Admission::Configure( Config.GetInt( "admission_tick_budget", 20 ), Config.GetInt( "admission_max_in_flight", 32 ), 
+		Config.GetInt( "admission_max_queue", 5000 ) );
+	PasswordService::SetCost( Config.GetInt( "password_hash_ops", 2 ), Config.GetInt( "password_hash_memory", 65536 ) );
+}
+
 /* Main entry point of the application. */
 int main()
 {
@@ -169,8 +192,11 @@ int main()
 
 	/* Load the configuration. */
 	cfg_gateway_port = Config.GetInt( "gateway_port", 15550 );
-	cfg_gateway_ip   = Config.GetString( "gateway_ip", "127.0.0.1" );
 	cfg_square_port  = Config.GetInt( "square_port",  14440 );
+	ApplySettings();
+
+	/* Select how socket readiness is collected. */
+	Poller::Initialize( _stricmp( Config.GetString( "io_backend", "poller" ), "socket" ) == 0 ? IO_BACKEND_SOCKET : IO_BACKEND_POLLER );
 
 	/* Start listening for connections from clients. */
 	if ( g_gate_socket.Listen( cfg_gateway_port ) != 0 )
@@ -195,21 +221,76 @@ int main()
 	cfg_sql_database = Config.GetString( "sql_database", "soldin" );
 	cfg_sql_port     = Config.GetInt( "sql_port", 3306);
 
-	if ( !DB::Connect( cfg_sql_host, cfg_sql_username, cfg_sql_password, cfg_sql_database, cfg_sql_port ) )
+	/* Use the embedded storage when no database server is wanted, and route
+	 * over several MySQL servers when shards or replicas are configured. */
+	ShardedStorage *sharded;
+	if ( _stricmp( Config.GetString( "storage", "mysql" ), "local" ) == 0 )
+	{
+		const char *path = Config.GetString( "storage_path", "data/soldin.db" );
+
+		if ( !DB::Use( new LocalStorage( path ) ) )
+		{
+			DB::LogError();
+			exit( -3 );
+		}
+		else ServerLog.Write( "Using the local storage in %s.\n", E_SUCCESS, path );
+	}
+	else if ( ( sharded = ShardedStorage::Load( Config ) ) != NULL )
+	{
+		if ( !DB::Use( sharded ) )
+		{
+			DB::LogError();
+			exit( -3 );
+		}
+		else ServerLog.Write( "Connection with %u MySQL shard(s) established.\n", E_SUCCESS, sharded->GetShardCount() );
+	}
+	else if ( !DB::Connect( cfg_sql_host, cfg_sql_username, cfg_sql_password, cfg_sql_database, cfg_sql_port ) )
 	{
 		DB::LogError();
 		exit( -3 );
 	}
 	else ServerLog.Write("Connection with the MySQL server established.\n", E_SUCCESS);
 
+	/* Know every character name, so taken names are refused without a query. */
+	NameIndex::Load();
+
+	/* Check passwords away from the main loop, hashing them takes far longer than a tick. */
+	if ( !PasswordService::Start( Config.GetInt( "password_workers", 0 ) ) )
+	{
+		exit( -4 );
+	}
+
+	/* The queue position only keeps waiting logins alive and is logged, the client has no packet to show it. */
+	Admission::SetReportHandler( PlayerSession::OnQueuePosition );
+
 	/* Main server loop. */
 	while (true)
 	{
+		LoadMonitor::BeginTick();
+
+		/* Pick up changes to the configuration file. */
+		if ( Config.Poll() )
+			ApplySettings();
+
+		/* Run everything that is due, timeouts and heartbeats. */
+		Timers.Advance( GetTick() );
+
+		/* Let in the logins the tick has room for. */
+		Admission::Pump();
+
+		/* Hand the checked passwords to their logins. */
+		PasswordService::Poll();
+
+		/* A single readiness check for every connection. */
+		Poller::Poll();
+
 		/* Accept incoming connection requests. */
 		AcceptIncoming();
 
 		/* Update all connected clients. */
 		Update();
+
+		LoadMonitor::EndTick();
 	}
 	return 0;
 }
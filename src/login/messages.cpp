@@ -26,6 +26,8 @@
 #include <playersession.h>
 #include <time.h>
 #include <log.h>
+#include <nameindex.h>
+#include <admission.h>
 
 /* Configuration Globals */
 extern const char *cfg_gateway_ip;
@@ -60,25 +62,73 @@ void PlayerSession::Msg_ClientHash( Buffer &buffer )
 /* Handles a login attemp from the client. */
 void PlayerSession::Msg_Login( Buffer &packet )
 {
-	const wchar_t *username = packet.ReadWideString();
-	const char    *password = packet.ReadString();
+	/* A client that is already waiting keeps its place. */
+	if ( mLoginPending || mAuthenticated )
+		return;
 
-	Buffer resultpkt;
+	packet.ReadWideString( mLoginName, sizeof( mLoginName ) );
+	size_t length = packet.ReadString( mLoginPassword, sizeof( mLoginPassword ) - 1 );
+	mLoginPassword[length] = 0;
+
+	/* Logins are let in as the tick has room for them, the others wait their turn. */
+	mLoginPending = true;
+	switch ( Admission::Request( this, OnLoginAdmitted ) )
+	{
+		case ADMIT_NOW:
+			Login();
+			break;
+
+		case ADMIT_QUEUED:
+			break;
+
+		default:
+			ServerLog.Write( "[%d][CLIENT] Login of %s refused, the login queue is full.\n", E_WARNING, mSessionId, mLoginName );
+			mEOF = true;
+			break;
+	}
+}
+
+/* Loads the account of the admitted login and hands the password to the workers. */
+void PlayerSession::Login()
+{
+	Admission::BeginWork();
 
 	/* Load the account. */
-	mAccount = DB::Account_Load( UTF8( username ), NULL );
+	mAccount = DB::Account_Load( mLoginName, NULL );
 	if ( mAccount == NULL )
 	{
+		Buffer resultpkt;
 		resultpkt.WriteUInt32( ERR_LOGIN_NOTFOUND );
-		resultpkt.WriteWideString( username );
+		resultpkt.WriteWideString( mLoginName );
 		resultpkt.WriteUInt32( 0 );
 
 		Send( resultpkt, MSG_LOGIN );
+		memset( mLoginPassword, 0, sizeof( mLoginPassword ) );
+		mLoginPending = false;
+
+		Admission::EndWork();
+		Admission::Finish( this );
 		return;
 	}
 	
-	/* Verify the passwords. */
-	if ( _stricmp( mAccount->mPassword, password ) != 0 )
+	/* Verify the passwords, the login goes on in FinishLogin() once a worker is done. */
+	PasswordService::Verify( this, OnPasswordChecked, mAccount->mId, mAccount->mPassword, mLoginPassword );
+	memset( mLoginPassword, 0, sizeof( mLoginPassword ) );
+
+	Admission::EndWork();
+}
+
+/* Sends the result of the login with the character list, once the password was checked. */
+void PlayerSession::FinishLogin( uint32_t password_result )
+{
+	Admission::BeginWork();
+
+	const char *username = mLoginName;
+	Buffer      resultpkt;
+
+	mLoginPending = false;
+
+	if ( password_result != PASSWORD_OK )
 	{
 		resultpkt.WriteUInt32( ERR_LOGIN_INVALIDPASSWD );
 		resultpkt.WriteWideString( username );
@@ -116,10 +166,14 @@ void PlayerSession::Msg_Login( Buffer &packet )
 
 	if ( mAuthenticated ) 
 	{
+		InvalidateCharacterList();
 		SendCharacterList();
 
 		mName = mAccount->mName;
 	}
+
+	Admission::EndWork();
+	Admission::Finish( this );
 }
 
 /* Closes the connection with the client. */
@@ -146,11 +200,13 @@ void PlayerSession::Msg_CharacterCreate( Buffer &packet )
 		0xF3, 0xE8, 0x3C, 0x39, 0x00, 0x00, 0x00, 0x00 
 	};
 
-	const char *char_name  = UTF8( packet.ReadWideString() );
-	uint32_t    char_class = packet.ReadUInt32();
+	char char_name[UTF_BUFFER_SIZE];
+	packet.ReadWideString( char_name, sizeof( char_name ) );
+	uint32_t char_class = packet.ReadUInt32();
 
-	/* Check if the requested name is available. */
-	if ( DB::Character_Exists( char_name ) )
+	/* Names in the index are known to be taken. The others are left to the 
+	 * database, which refuses a name that is taken by its unique key. */
+	if ( NameIndex::Contains( char_name ) )
 	{
 		result.WriteUInt32( ERR_CHARCREATE_NAMETAKEN );
 		result.Write( blank_character, 72 );
@@ -161,11 +217,19 @@ void PlayerSession::Msg_CharacterCreate( Buffer &packet )
 		uint32_t char_id = DB::Character_Create( mAccount->mId, char_class, char_name );
 		if ( char_id == 0 )
 		{
-			result.WriteUInt32( ERR_CHARCREATE_FAILED );
+			/* Tell a name the index did not know apart from a failure. */
+			if ( DB::Character_Exists( char_name ) )
+			{
+				NameIndex::Add( char_name );
+				result.WriteUInt32( ERR_CHARCREATE_NAMETAKEN );
+			}
+			else result.WriteUInt32( ERR_CHARCREATE_FAILED );
 			result.Write( blank_character, 72 );
 		}
 		else
 		{
+			NameIndex::Add( char_name );
+
 			CharacterData *chara = DB::Character_Load( char_id, NULL );
 			if ( chara == NULL )
 			{
@@ -176,9 +240,13 @@ void PlayerSession::Msg_CharacterCreate( Buffer &packet )
 			{
 				uint32_t i = mAccount->mCharacters.size();
 
+				/* Keep the character, so it can be selected and shows up in the next list. */
+				mAccount->mCharacters.push_back( chara );
+				InvalidateCharacterList();
+
 				result.WriteUInt32( ERR_NONE );
 				result.WriteUInt32( HASH_OBJ_NEWCHARACTER );
-				result.WriteWideString( UTF16( chara->mName) );
+				result.WriteWideString( chara->mName );
 
 				result.WriteUInt32( 0 );
 				result.WriteUInt32( chara->mClassId );
@@ -236,12 +304,18 @@ void PlayerSession::Msg_CharacterDelete( Buffer &packet )
 		if ( _stricmp( charname, ( *i )->mName ) == 0 )
 		{
 			DB::Character_Delete( ( *i )->mId );
+			NameIndex::Remove( ( *i )->mName );
 
 			resultpkt.WriteUInt32( ERR_NONE );
 			resultpkt.WriteWideString( widestr );
 			Send( resultpkt, MSG_CHARACTER_DELETE );
 
+			if ( mCharacter == *i )
+				mCharacter = NULL;
+
+			delete *i;
 			mAccount->mCharacters.erase( i );
+			InvalidateCharacterList();
 			return;
 		}
 	}
@@ -299,23 +373,43 @@ void PlayerSession::Msg_SquareSelect( Buffer &packet )
 {
 	Buffer resultpkt;
 
-	mSquare = SquareManager::Find( UTF8( packet.ReadWideString() ) );
-	if ( mSquare != NULL )
+	char name[UTF_BUFFER_SIZE];
+	packet.ReadWideString( name, sizeof( name ) );
+
+	/* Pick the shard of the square that has room on its hub stages. */
+	mSquare = SquareManager::Route( name, STAGE_GROUP_SQUARE );
+	if ( mSquare == NULL )
+		mSquare = SquareManager::Find( name );
+
+	if ( mSquare != NULL && ( mSquare->mStatus == STATUS_FULL || !mSquare->HasRoom( STAGE_GROUP_SQUARE ) ) )
 	{
-		if ( mSquare->mStatus == STATUS_FULL )
+		/* Quietly send the player to the least loaded square of the same kind. */
+		Square *sibling = SquareManager::FindLeastLoaded( mSquare->mType, STAGE_GROUP_SQUARE, mSquare );
+		if ( sibling != NULL )
+		{
+			ServerLog.Write( "[%d][CLIENT] Square '%s' is saturated, redirecting to '%s'.\n", E_INFO, mSessionId, mSquare->mName, sibling->mName );
+		}
+		mSquare = sibling;
+
+		if ( mSquare == NULL )
 		{
 			resultpkt.WriteUInt32( ERR_SELSQUARE_FULL );
 			resultpkt.WriteString( "" );
 			resultpkt.WriteUInt16( 0 );
 			resultpkt.WriteString( "" );
+			Send( resultpkt, MSG_SQUARE_DETAILS );
+			return;
 		}
-		else
-		{
-			resultpkt.WriteUInt32( ERR_NONE );
-			resultpkt.WriteString( inet_ntoa( mSquare->mHostAddr ) );
-			resultpkt.WriteUInt16( mSquare->mPort );
-			resultpkt.WriteString( mSessionKey );
-		}
+	}
+
+	if ( mSquare != NULL )
+	{
+		SquareManager::Reserve( mSquare, STAGE_GROUP_SQUARE );
+
+		resultpkt.WriteUInt32( ERR_NONE );
+		resultpkt.WriteString( inet_ntoa( mSquare->mHostAddr ) );
+		resultpkt.WriteUInt16( mSquare->mPort );
+		resultpkt.WriteString( mSessionKey );
 	}
 	else
 	{
@@ -0,0 +1,213 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <nameindex.h>
+#include <database.h>
+#include <log.h>
+#include <string.h>
+
+#define SLOT_EMPTY   0
+#define SLOT_DELETED 1
+
+ULONGLONG *NameIndex::mSlots     = NULL;
+uint32_t   NameIndex::mSlotCount = 0;
+uint32_t   NameIndex::mCount     = 0;
+uint32_t   NameIndex::mDeleted   = 0;
+uint32_t  *NameIndex::mBloom     = NULL;
+
+/* Fills the index with the names of all characters in the database, and returns how many there are. */
+uint32_t NameIndex::Load()
+{
+	uint32_t start = GetTick();
+
+	delete[] mSlots;
+	mSlots = NULL;
+	Rehash( NAMEINDEX_MIN_SLOTS );
+
+	uint32_t scanned = DB::Character_ScanNames( &NameIndex::OnName, NULL );
+
+	ServerLog.Write( "Indexed %u character names in %u ms (%u KB).\n", E_SUCCESS, scanned, GetTick() - start, 
+		( mSlotCount * ( sizeof( ULONGLONG ) + NAMEINDEX_BLOOM_BITS / 8 ) ) / 1024 );
+	return mCount;
+}
+
+/* Checks if a character with the specified name is known to exist. */
+bool NameIndex::Contains( const char *name )
+{
+	return Find( Fingerprint( name ) );
+}
+
+/* Adds the name of a character that was created. */
+void NameIndex::Add( const char *name )
+{
+	ULONGLONG fp = Fingerprint( name );
+	if ( mSlots == NULL || Find( fp ) )
+		return;
+
+	/* Keep the set at most three quarters full, counting deleted slots. A set 
+	 * that is mostly deleted slots is rebuilt at the same size. */
+	if ( ( mCount + mDeleted + 1 ) * 4 > mSlotCount * 3 )
+		Rehash( ( mCount + 1 ) * 2 > mSlotCount ? mSlotCount * 2 : mSlotCount );
+
+	Insert( fp );
+}
+
+/* Removes the name of a character that was deleted. */
+void NameIndex::Remove( const char *name )
+{
+	if ( mSlots == NULL )
+		return;
+
+	ULONGLONG fp = Fingerprint( name );
+
+	/* The slot is marked rather than emptied, so the names after it stay reachable. The
+	 * bits in the Bloom filter cannot be cleared, they are dropped by the next rehash. */
+	for ( uint32_t i = (uint32_t)fp & ( mSlotCount - 1 ); mSlots[i] != SLOT_EMPTY; i = ( i + 1 ) & ( mSlotCount - 1 ) )
+	{
+		if ( mSlots[i] == fp )
+		{
+			mSlots[i] = SLOT_DELETED;
+			mCount--;
+			mDeleted++;
+			return;
+		}
+	}
+}
+
+/* Looks up a fingerprint, the Bloom filter stops most of the names that are not in the set. */
+bool NameIndex::Find( ULONGLONG fp )
+{
+	if ( !MayContain( fp ) )
+		return false;
+
+	for ( uint32_t i = (uint32_t)fp & ( mSlotCount - 1 ); mSlots[i] != SLOT_EMPTY; i = ( i + 1 ) & ( mSlotCount - 1 ) )
+	{
+		if ( mSlots[i] == fp )
+			return true;
+	}
+	return false;
+}
+
+/* Gets the fingerprint of a name. Names are compared like the database does: ASCII 
+ * letters in any case and trailing spaces are equal. Two names that differ only in
+ * the case of other letters get different fingerprints, the database decides those. */
+ULONGLONG NameIndex::Fingerprint( const char *name )
+{
+	size_t length = strlen( name );
+	while ( length > 0 && name[length - 1] == ' ' )
+		length--;
+
+	/* FNV-1a */
+	ULONGLONG hash = 0xCBF29CE484222325ULL;
+	for ( size_t i = 0; i < length; i++ )
+	{
+		unsigned char c = (unsigned char)name[i];
+		if ( c >= 'A' && c <= 'Z' )
+			c += 'a' - 'A';
+
+		hash ^= c;
+		hash *= 0x100000001B3ULL;
+	}
+
+	/* The lowest values mark empty and deleted slots. */
+	return ( hash <= SLOT_DELETED ) ? hash + 2 : hash;
+}
+
+/* Checks the Bloom filter, false means the fingerprint is certainly not in the set. */
+bool NameIndex::MayContain( ULONGLONG fp )
+{
+	if ( mBloom == NULL )
+		return false;
+
+	/* The bits are derived from the upper half, the lower half picks the slot in the set. */
+	uint32_t mask = mSlotCount * NAMEINDEX_BLOOM_BITS - 1;
+	uint32_t hash = (uint32_t)( fp >> 32 );
+	uint32_t step = (uint32_t)( fp >> 45 ) | 1;
+
+	for ( uint8_t i = 0; i < NAMEINDEX_BLOOM_HASHES; i++, hash += step )
+	{
+		uint32_t bit = hash & mask;
+		if ( ( mBloom[bit >> 5] & ( 1u << ( bit & 31 ) ) ) == 0 )
+			return false;
+	}
+	return true;
+}
+
+/* Puts a fingerprint in the set and the Bloom filter, there must be room for it. */
+void NameIndex::Insert( ULONGLONG fp )
+{
+	uint32_t i = (uint32_t)fp & ( mSlotCount - 1 );
+	while ( mSlots[i] != SLOT_EMPTY && mSlots[i] != SLOT_DELETED )
+		i = ( i + 1 ) & ( mSlotCount - 1 );
+
+	if ( mSlots[i] == SLOT_DELETED )
+		mDeleted--;
+	mSlots[i] = fp;
+	mCount++;
+
+	uint32_t mask = mSlotCount * NAMEINDEX_BLOOM_BITS - 1;
+	uint32_t hash = (uint32_t)( fp >> 32 );
+	uint32_t step = (uint32_t)( fp >> 45 ) | 1;
+
+	for ( uint8_t j = 0; j < NAMEINDEX_BLOOM_HASHES; j++, hash += step )
+	{
+		uint32_t bit = hash & mask;
+		mBloom[bit >> 5] |= ( 1u << ( bit & 31 ) );
+	}
+}
+
+/* Moves the names to a set of the specified size, with a new Bloom filter. */
+void NameIndex::Rehash( uint32_t slot_count )
+{
+	ULONGLONG *old_slots = mSlots;
+	uint32_t   old_count = mSlotCount;
+
+	mSlotCount = slot_count;
+	mSlots     = new ULONGLONG[slot_count];
+	memset( mSlots, 0, slot_count * sizeof( ULONGLONG ) );
+
+	delete[] mBloom;
+	mBloom = new uint32_t[slot_count * NAMEINDEX_BLOOM_BITS / 32];
+	memset( mBloom, 0, slot_count * NAMEINDEX_BLOOM_BITS / 8 );
+
+	mCount   = 0;
+	mDeleted = 0;
+
+	if ( old_slots != NULL )
+	{
+		for ( uint32_t i = 0; i < old_count; i++ )
+		{
+			if ( old_slots[i] != SLOT_EMPTY && old_slots[i] != SLOT_DELETED )
+				Insert( old_slots[i] );
+		}
+		delete[] old_slots;
+	}
+}
+
+/* Adds a name found by the scan at startup. */
+void NameIndex::OnName( const char *name, void *context )
+{
+	Add( name );
+}
@@ -0,0 +1,203 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <passwordservice.h>
+#include <database.h>
+#include <log.h>
+#include <sodium.h>
+#include <string.h>
+
+std::deque<PasswordJob *> PasswordService::mJobs;
+CRITICAL_SECTION          PasswordService::mLock;
+HANDLE                    PasswordService::mSignal  = NULL;
+Mailbox                   PasswordService::mResults;
+volatile LONG             PasswordService::mOps     = 2;
+volatile LONG             PasswordService::mMemory  = 64 * 1024;
+volatile LONG             PasswordService::mPending = 0;
+
+/* Starts the worker threads, one per processor when no number is given. */
+bool PasswordService::Start( uint32_t workers )
+{
+	if ( sodium_init() < 0 )
+	{
+		ErrorLog.Write( "Failed to initialize libsodium.\n", E_ERROR );
+		return false;
+	}
+
+	if ( workers == 0 )
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo( &info );
+		workers = info.dwNumberOfProcessors;
+	}
+	workers = MIN( MAX( workers, 1 ), PASSWORD_MAX_WORKERS );
+
+	InitializeCriticalSection( &mLock );
+	mSignal = CreateSemaphore( NULL, 0, MAXLONG, NULL );
+	if ( mSignal == NULL )
+	{
+		ErrorLog.Write( "Failed to create the password job semaphore.\n", E_ERROR );
+		return false;
+	}
+
+	for ( uint32_t i = 0; i < workers; i++ )
+	{
+		HANDLE thread = CreateThread( NULL, 0, Worker, NULL, 0, NULL );
+		if ( thread == NULL )
+		{
+			ErrorLog.Write( "Failed to start password worker %u.\n", E_ERROR, i );
+			return false;
+		}
+		CloseHandle( thread );
+	}
+
+	ServerLog.Write( "Started %u password worker(s), hashing with %u pass(es) over %u KB.\n", E_SUCCESS, workers, (uint32_t)mOps, (uint32_t)mMemory );
+	return true;
+}
+
+/* Sets the cost of new hashes, the number of passes and the memory (in KB) they take. */
+void PasswordService::SetCost( uint32_t ops, uint32_t memory )
+{
+	InterlockedExchange( &mOps, (LONG)MAX( ops, crypto_pwhash_OPSLIMIT_MIN ) );
+	InterlockedExchange( &mMemory, (LONG)MAX( memory, crypto_pwhash_MEMLIMIT_MIN / 1024 ) );
+}
+
+/* Queues the password typed for an account, the handler is posted to the session with the result. */
+void PasswordService::Verify( Session *session, MailHandler handler, uint32_t account_id, const char *stored, const char *password )
+{
+	PasswordJob *job = new PasswordJob();
+	job->mSession   = session;
+	job->mSessionId = session->mSessionId;
+	job->mHandler   = handler;
+	job->mAccountId = account_id;
+	job->mResult    = PASSWORD_ERROR;
+
+	strncpy( job->mStored, stored, ACCOUNT_PASSWORD_SIZE - 1 );
+	strncpy( job->mPassword, password, PASSWORD_INPUT_SIZE - 1 );
+
+	InterlockedIncrement( &mPending );
+
+	EnterCriticalSection( &mLock );
+	mJobs.push_back( job );
+	LeaveCriticalSection( &mLock );
+
+	ReleaseSemaphore( mSignal, 1, NULL );
+}
+
+/* Hands the checked passwords to their sessions, called by the main thread every tick. */
+void PasswordService::Poll()
+{
+	while ( mResults.Drain( NULL ) > 0 )
+		;
+}
+
+/* Takes jobs from the queue and checks them, until the server stops. */
+DWORD WINAPI PasswordService::Worker( void *context )
+{
+	/* Hashes that are replaced are written by the worker itself. */
+	bool connected = DB::Connect();
+	if ( !connected )
+		DB::LogError();
+
+	while ( true )
+	{
+		WaitForSingleObject( mSignal, INFINITE );
+
+		EnterCriticalSection( &mLock );
+		PasswordJob *job = mJobs.front();
+		mJobs.pop_front();
+		LeaveCriticalSection( &mLock );
+
+		Check( job, connected );
+
+		/* The main thread drains the results every tick, a full mailbox is empty again soon. */
+		while ( !mResults.Post( OnChecked, 0, 0, job ) )
+			Sleep( 1 );
+	}
+	return 0;
+}
+
+/* Checks the password of a job, and replaces the stored password when it is outdated. */
+void PasswordService::Check( PasswordJob *job, bool connected )
+{
+	size_t   length = strlen( job->mPassword );
+	uint32_t ops    = (uint32_t)mOps;
+	size_t   memory = (size_t)mMemory * 1024;
+	bool     rehash = true;
+
+	if ( strncmp( job->mStored, PASSWORD_HASH_PREFIX, strlen( PASSWORD_HASH_PREFIX ) ) == 0 )
+	{
+		int outdated = crypto_pwhash_str_needs_rehash( job->mStored, ops, memory );
+		if ( outdated < 0 )
+		{
+			ErrorLog.Write( "The password hash of account %u is malformed.\n", E_ERROR, job->mAccountId );
+			job->mResult = PASSWORD_ERROR;
+		}
+		else job->mResult = ( crypto_pwhash_str_verify( job->mStored, job->mPassword, length ) == 0 ) ? PASSWORD_OK : PASSWORD_WRONG;
+
+		rehash = ( outdated > 0 );
+	}
+	else
+	{
+		/* Passwords from before hashing are compared the way they always were. */
+		job->mResult = ( _stricmp( job->mStored, job->mPassword ) == 0 ) ? PASSWORD_OK : PASSWORD_WRONG;
+	}
+
+	/* The typed password is known to be right, so it can be hashed with the current cost. */
+	if ( job->mResult == PASSWORD_OK && rehash )
+	{
+		char hash[crypto_pwhash_STRBYTES];
+
+		if ( crypto_pwhash_str( hash, job->mPassword, length, ops, memory ) != 0 )
+		{
+			ErrorLog.Write( "Failed to hash the password of account %u, out of memory.\n", E_ERROR, job->mAccountId );
+		}
+		else if ( !connected || !DB::Account_SetPassword( job->mAccountId, hash ) )
+		{
+			ErrorLog.Write( "Failed to store the new password hash of account %u.\n", E_ERROR, job->mAccountId );
+		}
+	}
+
+	sodium_memzero( job->mPassword, sizeof( job->mPassword ) );
+}
+
+/* Posts the result of a check to its session, if the session is still there. */
+void PasswordService::OnChecked( void *target, const Mail *mail )
+{
+	PasswordJob *job     = (PasswordJob *)mail->mData;
+	Session     *session = job->mSession;
+
+	if ( SessionManager::At<Session>( job->mSessionId ) == session && !session->mEOF )
+	{
+		if ( !session->mMailbox.Post( job->mHandler, job->mResult ) )
+		{
+			ErrorLog.Write( "[%d] Mailbox full, dropping session.\n", E_WARNING, job->mSessionId );
+			session->mEOF = true;
+		}
+	}
+
+	InterlockedDecrement( &mPending );
+	delete job;
+}
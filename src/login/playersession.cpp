@@ -27,8 +27,12 @@
 #include <crypt.h>
 #include <time.h>
 #include <log.h>
+#include <dbstats.h>
+#include <admission.h>
 #include <database.h>
 #include <squaremanager.h>
+#include <algorithm>
+#include <vector>
 
 /* Initializes a new instance of the CPlayerSession class. */
 PlayerSession::PlayerSession( Socket *socket ):
@@ -36,10 +40,15 @@ PlayerSession::PlayerSession( Socket *socket ):
 	mAuthenticated( false ), 
 	mCharacter( NULL ), 
 	mAccount( NULL ),
-	mStatus( ST_INLOBBY )
+	mStatus( ST_INLOBBY ),
+	mLoginPending( false ),
+	mCharacterVersion( 1 ),
+	mCharacterPacketVersion( 0 )
 {
 	mSessionId = INVALID_SESSION;
 	mEOF       = false;
+
+	ResetIdleTimer( SESSION_IDLE_TIMEOUT );
 }
 
 /* Releases all resources used by the session. */
@@ -49,15 +58,20 @@ PlayerSession::~PlayerSession()
 	{
 		delete mSocket;
 	}
-	if ( mAccount != NULL ) free( mAccount );
+	if ( mAccount != NULL ) delete mAccount;
 }
 
 /* Updates the client by retrieving all the data send by the client and processing it. */
 void PlayerSession::Update()
 {
+	/* Handle everything other parts of the server have send this session. */
+	mMailbox.Drain( this );
+
 	int received = mSocket->Receive( &mBufferIn );
 	if ( received == SOCKET_ERROR )
 		return;
+	else if ( received > 0 )
+		ResetIdleTimer( SESSION_IDLE_TIMEOUT );
 
 	while ( mBufferIn.Size() >= 2 )
 	{
@@ -73,13 +87,49 @@ void PlayerSession::Update()
 		else break;
 	}
 
+	/* Send all outgoing data, whatever the socket does not accept stays queued. */
 	if ( mBufferOut.Size() > 0 )
 	{
-		mSocket->Send( mBufferOut.Content(), mBufferOut.Size() );
-		mBufferOut.Clear();
+		int sent = mSocket->Send( mBufferOut.Content(), mBufferOut.Size() );
+		if ( sent != SOCKET_ERROR )
+		{
+			mBufferOut.Drain( sent );
+		}
+	}
+
+	/* A client that stops reading is dropped, instead of queueing for it without end. */
+	if ( mBufferOut.Size() > SEND_BUFFER_LIMIT )
+	{
+		ServerLog.Write( "[%d][CLIENT] Dropped, %u bytes are waiting to be sent.\n", E_WARNING, mSessionId, (uint32_t)mBufferOut.Size() );
+		mEOF = true;
 	}
 }
 
+/* The login of the session was let in after waiting. */
+void PlayerSession::OnLoginAdmitted( void *target, const Mail *mail )
+{
+	PlayerSession *session = (PlayerSession *)target;
+	session->Login();
+}
+
+/* The password of the login was checked by a worker. */
+void PlayerSession::OnPasswordChecked( void *target, const Mail *mail )
+{
+	PlayerSession *session = (PlayerSession *)target;
+	session->FinishLogin( mail->mParam1 );
+}
+
+/* The position of the session in the login queue, the session is kept alive while it waits. */
+void PlayerSession::OnQueuePosition( void *target, const Mail *mail )
+{
+	PlayerSession *session = (PlayerSession *)target;
+	session->ResetIdleTimer( SESSION_IDLE_TIMEOUT );
+
+	#if defined( _DEBUG )
+	DebugLog.Write( "[%d][CLIENT] Waiting to log in, position %u of %u.\n", E_DEBUG, session->mSessionId, mail->mParam1, mail->mParam2 );
+	#endif
+}
+
 /* Processes the specified packet. */
 void PlayerSession::Process(Buffer& packet)
 {
@@ -90,6 +140,9 @@ void PlayerSession::Process(Buffer& packet)
 	} *header = (HEADER *)packet.Content();
 	packet.Seek(6);
 
+	/* Database calls made for this packet are attributed to it. */
+	DBStats::SetCaller( header->command, mSessionId );
+
 	switch ( header->command )
 	{
 		case MSG_CLIENTHASH:	     Msg_ClientHash( packet );        break;
@@ -109,6 +162,8 @@ void PlayerSession::Process(Buffer& packet)
 			#endif
 			break;
 	}
+
+	DBStats::SetCaller( 0, -1 );
 }
 
 /* Sends a packet to the client. */
@@ -158,8 +213,23 @@ void PlayerSession::SendCharacterList()
 	if ( !IsAuthenticated() )
 		return;
 
-	/* Send the character limit and the available character licenses. */
-	Buffer licensepkt;
+	/* The payloads are built once for every change of the characters, after that a request costs a copy. */
+	if ( mCharacterPacketVersion != mCharacterVersion )
+	{
+		BuildCharacterList();
+		mCharacterPacketVersion = mCharacterVersion;
+	}
+
+	Send( mLicensePacket, MSG_CHARACTER_LICENSE );
+	Send( mCharacterPacket, MSG_CHARACTER_LIST );
+}
+
+/* Serializes the character limit, the character licenses and the character list of the account. */
+void PlayerSession::BuildCharacterList()
+{
+	/* The character limit and the available character licenses. */
+	Buffer &licensepkt = mLicensePacket;
+	licensepkt.Reset();
 	licensepkt.WriteUInt32( mAccount->mMaxChars );
 	licensepkt.WriteUInt32( HASH_LIST_CHARLICENCES );
 	licensepkt.WriteUInt32( mAccount->mLicenseCount );
@@ -167,10 +237,9 @@ void PlayerSession::SendCharacterList()
 		for ( uint32_t i = 0; i < mAccount->mLicenseCount; i++ )
 			licensepkt.WriteUInt32( mAccount->mLicenses[i] );
 
-	Send( licensepkt, MSG_CHARACTER_LICENSE );
-
-	/* Send the character list. */
-	Buffer listpkt;
+	/* The character list. */
+	Buffer &listpkt = mCharacterPacket;
+	listpkt.Reset();
 	listpkt.WriteUInt32( HASH_LIST_CHARACTERS );
 	listpkt.WriteUInt32( mAccount->mCharacters.size() );
 	if ( mAccount->mCharacters.size() > 0 )
@@ -181,7 +250,7 @@ void PlayerSession::SendCharacterList()
 			CharacterData *chara = *i;
 
 			listpkt.WriteUInt32( HASH_OBJ_CHARACTER +  index );
-			listpkt.WriteWideString( UTF16( chara->mName ) );
+			listpkt.WriteWideString( chara->mName );
 
 			listpkt.WriteUInt32( 0 );
 			listpkt.WriteUInt32( chara->mClassId );
@@ -219,33 +288,73 @@ void PlayerSession::SendCharacterList()
 			listpkt.WriteUInt32( 0 );
 		}
 	}
-	Send( listpkt, MSG_CHARACTER_LIST );
 }
 
-/* Sends the squarelist to the client. */
-void PlayerSession::SendSquareList()
+/* Orders squares by load, least loaded first. */
+static bool CompareSquareLoad( const Square *a, const Square *b )
 {
-	if ( !IsAuthenticated() || mCharacter == NULL )
-		return;
-
-	Buffer listpkt;
-	listpkt.WriteUInt32( 0 );
-	listpkt.WriteUInt32( HASH_LIST_SQUARES );
-	listpkt.WriteUInt32( SquareManager::GetSquareCount() );
+	return a->mLoad < b->mLoad;
+}
 
+/* Serializes the square list, which is the same for every client. */
+static void BuildSquareList( Buffer &listpkt )
+{
+	/* Collect the active squares and put the least loaded ones on top. */
 	Square *squares = SquareManager::GetList();
-	for ( uint32_t i = 0, j = 0; i < MAX_SQUARES; i++ )
+	std::vector<Square *> active;
+	for ( uint32_t i = 0; i < MAX_SQUARES; i++ )
 	{
-		if ( squares[i].IsActive() != NULL )
-		{
-			listpkt.WriteUInt32( HASH_OBJ_SQUARE + j );
-			listpkt.WriteWideString( UTF16( squares[i].mName ) );
-			listpkt.WriteUInt32( squares[i].mStatus );
-			listpkt.WriteUInt32( squares[i].mType );
-			listpkt.WriteUInt32( squares[i].mCapacity );
+		if ( squares[i].IsActive() )
+			active.push_back( &squares[i] );
+	}
+	std::stable_sort( active.begin(), active.end(), CompareSquareLoad );
 
+	/* Shards of the same square are listed once; the first one is the least loaded. */
+	std::vector<Square *> listed;
+	std::vector<uint32_t> capacity;
+	for ( uint32_t i = 0; i < active.size(); i++ )
+	{
+		uint32_t j = 0;
+		while ( j < listed.size() && _stricmp( listed[j]->mName, active[i]->mName ) != 0 )
 			j++;
+
+		if ( j == listed.size() )
+		{
+			listed.push_back( active[i] );
+			capacity.push_back( 0 );
 		}
+		capacity[j] += active[i]->mCapacity;
+	}
+
+	listpkt.Reset();
+	listpkt.WriteUInt32( 0 );
+	listpkt.WriteUInt32( HASH_LIST_SQUARES );
+	listpkt.WriteUInt32( listed.size() );
+
+	for ( uint32_t j = 0; j < listed.size(); j++ )
+	{
+		listpkt.WriteUInt32( HASH_OBJ_SQUARE + j );
+		listpkt.WriteWideString( listed[j]->mName );
+		listpkt.WriteUInt32( listed[j]->mStatus );
+		listpkt.WriteUInt32( listed[j]->mType );
+		listpkt.WriteUInt32( capacity[j] );
+	}
+}
+
+/* Sends the squarelist to the client. */
+void PlayerSession::SendSquareList()
+{
+	static Buffer   listpkt;
+	static uint32_t version = 0;
+
+	if ( !IsAuthenticated() || mCharacter == NULL )
+		return;
+
+	/* The list is built once for every change of the squares and shared by all clients. */
+	if ( version != SquareManager::GetVersion() )
+	{
+		BuildSquareList( listpkt );
+		version = SquareManager::GetVersion();
 	}
 	Send( listpkt, MSG_SQUARE_LIST );
 }
@@ -27,9 +27,10 @@
 
 Square   SquareManager::mSquareList[MAX_SQUARES];
 uint32_t SquareManager::mSquareCount = 0;
+uint32_t SquareManager::mVersion     = 1;
 
 /* Adds the specified square to the list. */
-int SquareManager::Add( const char *name, uint32_t hostaddr, uint16_t port, uint32_t capacity, SquareSession *session )
+int SquareManager::Add( const char *name, uint32_t shard, uint32_t hostaddr, uint16_t port, uint32_t capacity, SquareSession *session )
 {
 	if ( !session || !session->IsConnected() || mSquareCount == MAX_SQUARES )
 		return -1;
@@ -38,17 +39,26 @@ int SquareManager::Add( const char *name, uint32_t hostaddr, uint16_t port, uint
 	{
 		if ( mSquareList[i].mSession == NULL )
 		{
-			strcpy( mSquareList[i].mName, name );
+			strncpy( mSquareList[i].mName, name, MAX_SQUARENAME_LEN - 1 );
+			mSquareList[i].mName[MAX_SQUARENAME_LEN - 1] = 0;
+
+			mSquareList[i].mShard       = shard;
+			mSquareList[i].mStageCount  = 0;
 
 			mSquareList[i].mHostAddr.S_un.S_addr = hostaddr;
 			mSquareList[i].mPort        = port;
 			mSquareList[i].mCapacity    = capacity;
 			mSquareList[i].mOnlineUsers = 0;
+			mSquareList[i].mTickTime    = 0;
+			mSquareList[i].mQueueDepth  = 0;
+			mSquareList[i].mCpuUsage    = 0;
+			mSquareList[i].mLoad        = 0;
 			mSquareList[i].mSession     = session;
 			mSquareList[i].mStatus      = STATUS_SMOOTH;
 			mSquareList[i].mType        = SQUARE_NORMAL;
 
 			mSquareCount++;
+			mVersion++;
 			return i;
 		}
 	}
@@ -60,6 +70,7 @@ bool SquareManager::Remove( uint32_t index )
 {
 	memset( &mSquareList[index], 0, sizeof( Square ) );
 	mSquareCount--;
+	mVersion++;
 
 	return true;
 }
@@ -74,6 +85,118 @@ Square *SquareManager::Find( const char *name )
 	return NULL;
 }
 
+/* Finds a specific shard of the square with the specified name. */
+Square *SquareManager::FindShard( const char *name, uint32_t shard )
+{
+	for ( int i = 0; i < MAX_SQUARES; i++ )
+		if ( mSquareList[i].mSession != NULL && mSquareList[i].mShard == shard && ( _stricmp( mSquareList[i].mName, name ) == 0 ) )
+			return &mSquareList[i];
+
+	return NULL;
+}
+
+/* Routes a player to the shard of the named square that hosts the stage group and has the lowest load. */
+Square *SquareManager::Route( const char *name, uint32_t stage_group )
+{
+	Square *best = NULL;
+	for ( int i = 0; i < MAX_SQUARES; i++ )
+	{
+		Square *square = &mSquareList[i];
+		if ( square->mSession == NULL || _stricmp( square->mName, name ) != 0 )
+			continue;
+
+		if ( square->mStatus == STATUS_FULL || !square->HasRoom( stage_group ) )
+			continue;
+
+		if ( best == NULL || square->mLoad < best->mLoad )
+			best = square;
+	}
+	return best;
+}
+
+/* Checks if the shard hosts a stage of the specified group with room for another player. */
+bool Square::HasRoom( uint32_t stage_group ) const
+{
+	/* Shards that have not advertised their stages yet are assumed to host everything. */
+	if ( mStageCount == 0 )
+		return true;
+
+	for ( uint32_t i = 0; i < mStageCount; i++ )
+	{
+		if ( mStages[i].mGroup == stage_group && mStages[i].mPlayers < mStages[i].mMaxPlayers )
+			return true;
+	}
+	return false;
+}
+
+/* Searches for the active square of the specified type with the lowest load that has room in the stage group. */
+Square *SquareManager::FindLeastLoaded( squaretype_t type, uint32_t stage_group, const Square *exclude )
+{
+	Square *best = NULL;
+	for ( int i = 0; i < MAX_SQUARES; i++ )
+	{
+		Square *square = &mSquareList[i];
+		if ( square->mSession == NULL || square == exclude || square->mType != type || square->mStatus == STATUS_FULL )
+			continue;
+
+		if ( !square->HasRoom( stage_group ) )
+			continue;
+
+		if ( best == NULL || square->mLoad < best->mLoad )
+			best = square;
+	}
+	return best;
+}
+
+/* Derives the load and status of a square from the signals in its last update. */
+void SquareManager::UpdateLoad( Square *square )
+{
+	uint32_t load = 0;
+	if ( square->mCapacity > 0 )
+		load = ( square->mOnlineUsers * 100 ) / square->mCapacity;
+
+	load = MAX( load, ( square->mTickTime * 100 ) / LOAD_TICK_BUDGET );
+	load = MAX( load, (uint32_t)( ( (double)square->mQueueDepth * 100 ) / LOAD_QUEUE_LIMIT ) );
+	load = MAX( load, square->mCpuUsage );
+
+	load = MIN( load, 100 );
+
+	squarestatus_t status;
+	if ( square->mOnlineUsers >= square->mCapacity || load >= LOAD_FULL )
+		status = STATUS_FULL;
+	else if ( load >= LOAD_BUSY )
+		status = STATUS_BUSY;
+	else if ( load >= LOAD_AVERAGE )
+		status = STATUS_AVERAGE;
+	else
+		status = STATUS_SMOOTH;
+
+	/* The list is ordered by load and shows the status. */
+	if ( load != square->mLoad || status != square->mStatus )
+	{
+		square->mLoad   = load;
+		square->mStatus = status;
+		mVersion++;
+	}
+}
+
+/* Accounts for a player that is on its way to the square until the next update arrives. */
+void SquareManager::Reserve( Square *square, uint32_t stage_group )
+{
+	for ( uint32_t i = 0; i < square->mStageCount; i++ )
+	{
+		SquareStage *stage = &square->mStages[i];
+		if ( stage->mGroup == stage_group && stage->mPlayers < stage->mMaxPlayers )
+		{
+			stage->mPlayers++;
+			break;
+		}
+	}
+
+	square->mOnlineUsers++;
+	UpdateLoad( square );
+}
+
 /* Initializes the square manager. */
 void SquareManager::Initialize()
 {
@@ -32,12 +32,13 @@
 
 /* Initializes a new instance of the Client class. */
 SquareSession::SquareSession( Socket *socket ): 
-	mSocket    ( socket ), 
-	mSquareId  ( INVALID_SQUARE ), 
-	mLastUpdate( time( NULL ) )  
+	mSocket      ( socket ), 
+	mSquareId    ( INVALID_SQUARE )
 { 
 	mSessionId = INVALID_SESSION;
 	mEOF = false;
+
+	ResetIdleTimer( LINK_TIMEOUT );
 }
 
 /* Releases all resources used by the session. */
@@ -54,20 +55,16 @@ SquareSession::~SquareSession()
 /* Updates the client by retrieving all the data send by the client and processing it. */
 void SquareSession::Update()
 {
+	/* Handle everything other parts of the server have send this session. */
+	mMailbox.Drain( this );
+
 	int received = mSocket->Receive( &mBufferIn );
 	if (received == SOCKET_ERROR)
 		return;
 
-	/* If we receive no data for a specific period of time close the connection. */
-	time_t current = time(NULL);
-	if ( received == 0 && ( current - mLastUpdate ) >= MAX_IDLE_TIME )
-	{
-		mSocket->Disconnect();
-		mEOF = true;
-		
-		return;
-	}
-	else if (received > 0) mLastUpdate = current;
+	/* The square sends a heartbeat every couple of seconds, close the link once they stop. */
+	if ( received > 0 )
+		ResetIdleTimer( LINK_TIMEOUT );
 
 	/* Process all packets in the incoming data buffer. */
 	while ( mBufferIn.Size() >= 2 )
@@ -84,11 +81,21 @@ void SquareSession::Update()
 		else break;
 	}
 
-	/* Send the content of the outgoing buffer to the square server. */
+	/* All replies generated by this batch of requests leave in a single write. */
 	if ( mBufferOut.Size() > 0 )
 	{
-		mSocket->Send( (char *)mBufferOut.Content(), mBufferOut.Size() );
-		mBufferOut.Clear();
+		int sent = mSocket->Send( (char *)mBufferOut.Content(), mBufferOut.Size() );
+		if ( sent != SOCKET_ERROR )
+		{
+			mBufferOut.Drain( sent );
+		}
+	}
+
+	/* A square that stops reading is dropped, instead of queueing for it without end. */
+	if ( mBufferOut.Size() > SEND_BUFFER_LIMIT )
+	{
+		ServerLog.Write( "[%d][SQUARE] Dropped, %u bytes are waiting to be sent.\n", E_WARNING, mSessionId, (uint32_t)mBufferOut.Size() );
+		mEOF = true;
 	}
 }
 
@@ -109,6 +116,11 @@ void SquareSession::Process( Buffer& packet )
 		case MSG_SQUARE_AUTH:        Msg_Auth          ( packet ); break;
 		case MSG_SQUARE_UPDATE:      Msg_Update        ( packet ); break;
 		case MSG_SQUARE_SESSIONINFO: Msg_GetSessionInfo( packet ); break;
+		case MSG_SQUARE_HEARTBEAT:   Msg_Heartbeat     ( packet ); break;
+		case MSG_SQUARE_STAGES:      Msg_Stages        ( packet ); break;
+		case MSG_SQUARE_MIGRATE_PREPARE: Msg_MigratePrepare( packet ); break;
+		case MSG_SQUARE_MIGRATE_READY:   Msg_MigrateReady  ( packet ); break;
+		case MSG_SQUARE_MIGRATE_COMMIT:  Msg_MigrateCommit ( packet ); break;
 	}
 }
 
@@ -119,7 +131,7 @@ void SquareSession::Send( Buffer &buffer, uint16_t cmd, uint16_t type )
 	mBufferOut.WriteUInt16( type );
 	mBufferOut.WriteUInt16( cmd );
 
-	if ( mBufferOut.Size() > 0 )
+	if ( buffer.Size() > 0 )
 	{
 		mBufferOut.Write( buffer.Content(), buffer.Size() );
 	}
@@ -132,9 +144,10 @@ void SquareSession::Msg_Auth( Buffer &packet )
 	uint16_t port     = packet.ReadUInt16();
 	uint32_t capacity = packet.ReadUInt32();
 	const char *name  = packet.ReadString();
+	uint32_t    shard = packet.ReadUInt32();
 
-	/* Register the square. */
-	mSquareId = SquareManager::Add( name, hostaddr, port, capacity, this );
+	/* Register the square, shards of the same square share its name. */
+	mSquareId = SquareManager::Add( name, shard, hostaddr, port, capacity, this );
 	if ( mSquareId == INVALID_SQUARE )
 	{
 		mSocket->Disconnect();
@@ -145,41 +158,147 @@ void SquareSession::Msg_Auth( Buffer &packet )
 	else
 	{
 		Square *square = SquareManager::At( mSquareId );
-		ServerLog.Write( "[%d][%d][SQUARE] Square '%s' (%s:%d) has been added.\n", E_NOTICE, 
-			mSessionId, mSquareId, square->mName, inet_ntoa( square->mHostAddr ), square->mPort );
+		ServerLog.Write( "[%d][%d][SQUARE] Square '%s' shard %u (%s:%d) has been added.\n", E_NOTICE, 
+			mSessionId, mSquareId, square->mName, square->mShard, inet_ntoa( square->mHostAddr ), square->mPort );
 	}
 };
 
-/* Updates the number of players on the square. */
+/* Updates the load signals of the square. */
 void SquareSession::Msg_Update( Buffer &packet )
 {
 	Square *square = SquareManager::At( mSquareId );
 	if ( square != NULL )
 	{
 		square->mOnlineUsers = packet.ReadUInt32();
+		square->mTickTime    = packet.ReadUInt32();
+		square->mQueueDepth  = packet.ReadUInt32();
+		square->mCpuUsage    = packet.ReadUInt32();
+
+		SquareManager::UpdateLoad( square );
 	}
 }
 
+/* Updates the set of stages hosted by the square shard. */
+void SquareSession::Msg_Stages( Buffer &packet )
+{
+	Square *square = SquareManager::At( mSquareId );
+	if ( square == NULL )
+		return;
+
+	square->mShard = packet.ReadUInt32();
+
+	uint32_t count = MIN( packet.ReadUInt32(), LINK_MAX_STAGES );
+	for ( uint32_t i = 0; i < count; i++ )
+	{
+		SquareStage *stage = &square->mStages[i];
+		stage->mStageId    = packet.ReadUInt32();
+		stage->mGroup      = packet.ReadUInt32();
+		stage->mLevel      = packet.ReadUInt16();
+		stage->mPlayers    = packet.ReadUInt32();
+		stage->mMaxPlayers = packet.ReadUInt32();
+	}
+	square->mStageCount = count;
+}
+
 /* Square has requested information about a session.  */
 void SquareSession::Msg_GetSessionInfo( Buffer &packet )
 {
-	uint32_t       session_id  = packet.ReadUInt32();
+	uint32_t       request_id  = packet.ReadUInt32();
+	packet.ReadUInt32(); /* Session ID on the square. */
 	const char    *session_key = packet.ReadString();
 	PlayerSession *client;
 
-	/* Generate the response. */
+	/* Generate the response, the request ID lets the square match it with the lookup. */
 	Buffer infopkt;
+	infopkt.WriteUInt32( request_id );
 	if ( ( client = SessionManager::Find<PlayerSession>( session_key ) ) != NULL )
 	{
 		infopkt.WriteUInt32( 0 );
-		infopkt.WriteUInt32( session_id );
 		infopkt.WriteUInt32( client->GetCharacterID() );
 		infopkt.WriteUInt32( client->GetAccountID() );
 	}
 	else 
 	{
 		infopkt.WriteUInt32( ERR_SESSION_NOTFOUND );
-		infopkt.WriteUInt32( session_id );
 	}
 	Send( infopkt, MSG_SQUARE_SESSIONINFO );
 }
+
+/* Echoes the heartbeat so the square can measure the round trip time. */
+void SquareSession::Msg_Heartbeat( Buffer &packet )
+{
+	Buffer heartbeatpkt;
+	heartbeatpkt.WriteUInt32( packet.ReadUInt32() );
+	Send( heartbeatpkt, MSG_SQUARE_HEARTBEAT );
+}
+
+/* Forwards a player migration to the target shard of the same square. */
+void SquareSession::Msg_MigratePrepare( Buffer &packet )
+{
+	uint32_t request_id = packet.ReadUInt32();
+	uint32_t shard      = packet.ReadUInt32();
+
+	Square *source = SquareManager::At( mSquareId );
+	Square *target = ( source != NULL ) ? SquareManager::FindShard( source->mName, shard ) : NULL;
+	if ( target == NULL || target == source )
+	{
+		Buffer readypkt;
+		readypkt.WriteUInt32( request_id );
+		readypkt.WriteUInt32( MIGRATE_NOTARGET );
+		readypkt.WriteString( "" );
+		readypkt.WriteUInt16( 0 );
+		Send( readypkt, MSG_SQUARE_MIGRATE_READY );
+		return;
+	}
+
+	/* The target only needs to know where to send the answer to. */
+	Buffer preparepkt;
+	preparepkt.WriteUInt32( request_id );
+	preparepkt.WriteUInt32( mSquareId );
+	preparepkt.Write( packet.Content() + packet.Tell(), packet.Size() - packet.Tell() );
+	target->mSession->Send( preparepkt, MSG_SQUARE_MIGRATE_PREPARE );
+}
+
+/* The target shard has preloaded the player, pass its address to the source shard. */
+void SquareSession::Msg_MigrateReady( Buffer &packet )
+{
+	uint32_t    request_id  = packet.ReadUInt32();
+	uint32_t    source_id   = packet.ReadUInt32();
+	uint32_t    result      = packet.ReadUInt32();
+	const char *session_key = packet.ReadString();
+
+	Square *source = SquareManager::At( source_id );
+	Square *target = SquareManager::At( mSquareId );
+	if ( source == NULL || target == NULL || !source->IsActive() )
+		return;
+
+	Buffer readypkt;
+	readypkt.WriteUInt32( request_id );
+	readypkt.WriteUInt32( result );
+	readypkt.WriteString( inet_ntoa( target->mHostAddr ) );
+	readypkt.WriteUInt16( target->mPort );
+	source->mSession->Send( readypkt, MSG_SQUARE_MIGRATE_READY );
+
+	/* The player now belongs to the target shard. */
+	PlayerSession *client;
+	if ( result == MIGRATE_OK && ( client = SessionManager::Find<PlayerSession>( session_key ) ) != NULL )
+	{
+		client->SetSquare( target );
+		SquareManager::Reserve( target, STAGE_GROUP_SQUARE );
+	}
+}
+
+/* Forwards the final state of a migrating player to the target shard. */
+void SquareSession::Msg_MigrateCommit( Buffer &packet )
+{
+	uint32_t shard = packet.ReadUInt32();
+
+	Square *source = SquareManager::At( mSquareId );
+	Square *target = ( source != NULL ) ? SquareManager::FindShard( source->mName, shard ) : NULL;
+	if ( target == NULL )
+		return;
+
+	Buffer commitpkt;
+	commitpkt.Write( packet.Content() + packet.Tell(), packet.Size() - packet.Tell() );
+	target->mSession->Send( commitpkt, MSG_SQUARE_MIGRATE_COMMIT );
+}
@@ -0,0 +1,182 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <admission.h>
+#include <loadmonitor.h>
+
+std::deque<AdmissionTicket>  Admission::mQueue;
+std::vector<AdmissionTicket> Admission::mInFlight;
+MailHandler                  Admission::mReportHandler = NULL;
+uint32_t                     Admission::mTickBudget    = 20 * 1000;
+uint32_t                     Admission::mMaxInFlight   = 32;
+uint32_t                     Admission::mMaxQueue      = 5000;
+uint32_t                     Admission::mAllowance     = 1;
+uint32_t                     Admission::mCost          = ADMISSION_INITIAL_COST;
+uint32_t                     Admission::mWorkTime      = 0;
+uint32_t                     Admission::mLastReport    = 0;
+LARGE_INTEGER                Admission::mFrequency;
+LARGE_INTEGER                Admission::mWorkStart;
+
+/* Sets the time (in ms) admissions may take per tick, and how many sessions may be in flight or waiting. */
+void Admission::Configure( uint32_t tick_budget, uint32_t max_in_flight, uint32_t max_queue )
+{
+	mTickBudget  = tick_budget * 1000;
+	mMaxInFlight = MAX( max_in_flight, 1 );
+	mMaxQueue    = max_queue;
+}
+
+/* Asks admission for a session, the handler is posted to its mailbox once it is let in later. */
+int Admission::Request( Session *session, MailHandler handler )
+{
+	AdmissionTicket ticket;
+	ticket.mSession   = session;
+	ticket.mSessionId = session->mSessionId;
+	ticket.mHandler   = handler;
+	ticket.mPosition  = 0;
+	ticket.mTime      = 0;
+
+	/* Nobody is waiting and the tick has room, go ahead right away. */
+	if ( mQueue.empty() && mAllowance > 0 && mInFlight.size() < mMaxInFlight )
+	{
+		Admit( ticket );
+		return ADMIT_NOW;
+	}
+
+	if ( mQueue.size() >= mMaxQueue )
+		return ADMIT_REJECTED;
+
+	ticket.mPosition = (uint32_t)mQueue.size() + 1;
+	mQueue.push_back( ticket );
+	return ADMIT_QUEUED;
+}
+
+/* The admitted work of the session is done, which frees its place. */
+void Admission::Finish( Session *session )
+{
+	for ( size_t i = 0; i < mInFlight.size(); i++ )
+	{
+		if ( mInFlight[i].mSession == session )
+		{
+			mInFlight[i] = mInFlight.back();
+			mInFlight.pop_back();
+			return;
+		}
+	}
+}
+
+/* Marks the start of the work of an admitted session on the main thread. */
+void Admission::BeginWork()
+{
+	if ( mFrequency.QuadPart == 0 )
+		QueryPerformanceFrequency( &mFrequency );
+
+	QueryPerformanceCounter( &mWorkStart );
+}
+
+/* Marks the end of the work of an admitted session and updates the average cost. */
+void Admission::EndWork()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter( &now );
+
+	uint32_t elapsed = (uint32_t)( ( ( now.QuadPart - mWorkStart.QuadPart ) * 1000000 ) / mFrequency.QuadPart );
+
+	mWorkTime += elapsed;
+	mCost      = mCost + ( (int)( elapsed - mCost ) / ADMISSION_COST_SMOOTHING );
+}
+
+/* Lets in as many waiting sessions as the tick has room for, called once at the start of every tick. */
+void Admission::Pump()
+{
+	uint32_t now = GetTick();
+
+	/* Forget admissions whose session is gone, or that never finished. */
+	for ( size_t i = 0; i < mInFlight.size(); )
+	{
+		if ( !IsAlive( mInFlight[i] ) || now - mInFlight[i].mTime > ADMISSION_TIMEOUT )
+		{
+			mInFlight[i] = mInFlight.back();
+			mInFlight.pop_back();
+		}
+		else i++;
+	}
+
+	/* What the last tick spent on everything else is what the admissions have to fit next to. */
+	uint32_t tick  = LoadMonitor::GetLastTickTime();
+	uint32_t other = ( tick > mWorkTime ) ? tick - mWorkTime : 0;
+
+	mAllowance = ( other < mTickBudget ) ? ( mTickBudget - other ) / MAX( mCost, 1 ) : 0;
+	mAllowance = MAX( mAllowance, 1 );
+	mWorkTime  = 0;
+
+	while ( !mQueue.empty() && mAllowance > 0 && mInFlight.size() < mMaxInFlight )
+	{
+		AdmissionTicket ticket = mQueue.front();
+		mQueue.pop_front();
+
+		if ( !IsAlive( ticket ) )
+			continue;
+
+		/* A full mailbox is tried again next tick. */
+		if ( !ticket.mSession->mMailbox.Post( ticket.mHandler ) )
+		{
+			mQueue.push_front( ticket );
+			break;
+		}
+		Admit( ticket );
+	}
+
+	/* Tell the waiting sessions where they are, when it changed. */
+	if ( mReportHandler != NULL && now - mLastReport >= ADMISSION_REPORT_INTERVAL )
+	{
+		mLastReport = now;
+
+		uint32_t position = 0;
+		for ( std::deque<AdmissionTicket>::iterator i = mQueue.begin(); i != mQueue.end(); i++ )
+		{
+			if ( !IsAlive( *i ) )
+				continue;
+
+			if ( i->mPosition != ++position && i->mSession->mMailbox.Post( mReportHandler, position, (uint32_t)mQueue.size() ) )
+				i->mPosition = position;
+		}
+	}
+}
+
+/* Checks if the session of a ticket is still connected. */
+bool Admission::IsAlive( const AdmissionTicket &ticket )
+{
+	return ( SessionManager::At<Session>( ticket.mSessionId ) == ticket.mSession && !ticket.mSession->mEOF );
+}
+
+/* Counts an admission against this tick and keeps it until it finishes. */
+void Admission::Admit( AdmissionTicket &ticket )
+{
+	ticket.mTime = GetTick();
+	mInFlight.push_back( ticket );
+
+	if ( mAllowance > 0 )
+		mAllowance--;
+}
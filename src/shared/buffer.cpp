@@ -147,6 +147,20 @@ int Buffer::Slice( char *dest, size_t len, size_t offset )
 	return 0;
 }
 
+/* Removes the specified number of bytes from the front of the buffer without releasing the memory. */
+void Buffer::Drain( size_t len )
+{
+	if ( len >= mOffsetWrite )
+	{
+		mOffsetWrite = mOffsetRead = 0;
+		return;
+	}
+
+	memmove( mBuffer, mBuffer + len, mOffsetWrite - len );
+	mOffsetWrite -= len;
+	mOffsetRead   = ( mOffsetRead > len ) ? ( mOffsetRead - len ) : 0;
+}
+
 /* Reads a byte (unsigned 8-bit integer) from the buffer. */
 byte Buffer::ReadByte()
 {
@@ -234,6 +248,27 @@ const wchar_t *Buffer::ReadWideString()
 	return p;
 }
 
+/* Reads a wide string from the buffer and writes it to the specified destination as UTF-8. */
+size_t Buffer::ReadWideString( char *dest, size_t size )
+{
+	if ( mOffsetRead + 2 > mOffsetWrite )
+	{
+		if ( size > 0 ) dest[0] = 0;
+		return 0;
+	}
+
+	uint16_t units = (uint16_t)MIN( ( mOffsetWrite - mOffsetRead - 2 ) / 2, *( ( uint16_t * )( mBuffer + mOffsetRead ) ) );
+	const uint16_t *str = (const uint16_t *)( mBuffer + mOffsetRead + 2 );
+
+	/* The length includes the terminator, stop at the first one. */
+	size_t len = 0;
+	while ( len < units && str[len] != 0 )
+		len++;
+
+	mOffsetRead += ( units * 2 ) + 2;
+	return Utf16ToUtf8( str, len, dest, size );
+}
+
 /* Writes a character string to the buffer. */
 void Buffer::WriteString( const char *str )
 {
@@ -251,3 +286,18 @@ void Buffer::WriteWideString( const wchar_t *str )
 	Write( (char *)&size, 2 );
 	Write( (char *)str, size * sizeof( wchar_t ) );
 }
+
+/* Writes a UTF-8 string to the buffer as a wide string, without an intermediate copy. */
+void Buffer::WriteWideString( const char *str )
+{
+	/* Every byte of UTF-8 becomes at most one unit of UTF-16. */
+	size_t len      = strlen( str );
+	size_t req_size = mOffsetWrite + 2 + ( len + 1 ) * 2;
+	if ( req_size > mBufferSize && Resize( req_size * 2 ) != BUFFER_OK )
+		return;
+
+	uint16_t size = (uint16_t)Utf8ToUtf16( str, len, (uint16_t *)( mBuffer + mOffsetWrite + 2 ), len + 1 ) + 1;
+
+	memcpy( mBuffer + mOffsetWrite, &size, 2 );
+	mOffsetWrite += 2 + size * 2;
+}
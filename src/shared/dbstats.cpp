@@ -0,0 +1,159 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <dbstats.h>
+#include <log.h>
+#include <stdio.h>
+#include <string.h>
+
+StatementStats        DBStats::mStats[STMT_COUNT];
+LARGE_INTEGER         DBStats::mFrequency;
+uint32_t              DBStats::mSlowThreshold = 100 * 1000;
+uint32_t              DBStats::mInterval      = 0;
+Timer                 DBStats::mTimer;
+THREAD_LOCAL uint16_t DBStats::mOpcode        = 0;
+THREAD_LOCAL int      DBStats::mSession       = -1;
+
+static const char *g_statement_names[STMT_COUNT] = {
+	"other", "account_by_name", "account", "account_licenses", "character_list", "character", 
+	"character_bags", "character_items", "character_exists", "character_create", "character_delete",
+	"replication_lag", "character_names", "account_password",
+	"account_directory"
+};
+
+/* Starts timing a call. */
+void DBStats::Begin( StatementCall &call, uint8_t statement, const char *query )
+{
+	call.mStatement = statement;
+	call.mQuery     = query;
+	QueryPerformanceCounter( &call.mStart );
+}
+
+/* Adds a finished call to the statistics of its statement, and logs it if it was slow. */
+void DBStats::End( const StatementCall &call, bool failed, uint32_t rows, uint32_t bytes )
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter( &now );
+
+	if ( mFrequency.QuadPart == 0 )
+		QueryPerformanceFrequency( &mFrequency );
+
+	uint32_t        elapsed = (uint32_t)( ( now.QuadPart - call.mStart.QuadPart ) * 1000000 / mFrequency.QuadPart );
+	StatementStats &stats   = mStats[call.mStatement];
+
+	InterlockedIncrement( &stats.mCount );
+	InterlockedExchangeAdd( &stats.mRows, rows );
+	InterlockedExchangeAdd( &stats.mBytes, bytes );
+	InterlockedExchangeAdd( &stats.mTotalTime, elapsed );
+	if ( failed )
+		InterlockedIncrement( &stats.mErrors );
+
+	/* Raise the maximum, unless another thread raised it further in the meantime. */
+	LONG max = stats.mMaxTime;
+	while ( (LONG)elapsed > max && InterlockedCompareExchange( &stats.mMaxTime, elapsed, max ) != max )
+		max = stats.mMaxTime;
+
+	uint32_t bucket = 0;
+	while ( bucket < DBSTATS_BUCKETS - 1 && elapsed >= ( 64u << bucket ) )
+		bucket++;
+	InterlockedIncrement( &stats.mBuckets[bucket] );
+
+	if ( elapsed >= mSlowThreshold )
+	{
+		/* The text of a password update holds the hash, it stays out of the log. */
+		const char *query = ( call.mStatement == STMT_ACCOUNT_PASSWORD ) ? "UPDATE `sol_accounts` SET `passwd` = ..." : call.mQuery;
+
+		SlowLog.Write( "%s took %u.%03u ms, %u rows, %u bytes%s (opcode 0x%04X, session %d): %.*s\n", E_WARNING, 
+			g_statement_names[call.mStatement], elapsed / 1000, elapsed % 1000, rows, bytes, failed ? ", failed" : "", 
+			mOpcode, mSession, DBSTATS_SLOW_QUERY_LEN, query );
+	}
+}
+
+/* Writes the calls of every statement since the last report to the server log, and starts over. */
+void DBStats::Report()
+{
+	for ( uint8_t i = 0; i < STMT_COUNT; i++ )
+	{
+		StatementStats &stats = mStats[i];
+
+		LONG count  = InterlockedExchange( &stats.mCount, 0 );
+		LONG errors = InterlockedExchange( &stats.mErrors, 0 );
+		LONG rows   = InterlockedExchange( &stats.mRows, 0 );
+		LONG bytes  = InterlockedExchange( &stats.mBytes, 0 );
+		LONG total  = InterlockedExchange( &stats.mTotalTime, 0 );
+		LONG max    = InterlockedExchange( &stats.mMaxTime, 0 );
+
+		LONG buckets[DBSTATS_BUCKETS];
+		for ( uint32_t b = 0; b < DBSTATS_BUCKETS; b++ )
+			buckets[b] = InterlockedExchange( &stats.mBuckets[b], 0 );
+
+		if ( count == 0 )
+			continue;
+
+		/* The percentiles are the upper bounds of the buckets they fall in. */
+		char     histogram[DBSTATS_BUCKETS * 24];
+		size_t   length = 0;
+		LONG     seen   = 0;
+		uint32_t p50    = 0, p99 = 0;
+
+		histogram[0] = 0;
+		for ( uint32_t b = 0; b < DBSTATS_BUCKETS; b++ )
+		{
+			if ( buckets[b] == 0 )
+				continue;
+
+			seen += buckets[b];
+			if ( p50 == 0 && seen * 2 >= count )    p50 = 64u << b;
+			if ( p99 == 0 && seen * 100 >= count * 99 ) p99 = 64u << b;
+
+			length += sprintf( histogram + length, " <%uus:%d", 64u << b, buckets[b] );
+		}
+
+		ServerLog.Write( "DB %s: %d calls, %d errors, avg %uus, p50 <%uus, p99 <%uus, max %dus, %d rows, %d bytes;%s\n", E_INFO, 
+			g_statement_names[i], count, errors, (uint32_t)( total / count ), p50, p99, max, rows, bytes, histogram );
+	}
+}
+
+/* Reports every interval (in seconds), 0 stops the reports. */
+void DBStats::Start( uint32_t interval )
+{
+	if ( interval * 1000 == mInterval )
+		return;
+
+	mInterval = interval * 1000;
+	if ( mInterval == 0 )
+		Timers.Cancel( &mTimer );
+	else
+		Timers.Schedule( &mTimer, mInterval, OnReport, NULL );
+}
+
+/* Writes a report and waits for the next one. */
+void DBStats::OnReport( void *context )
+{
+	Report();
+
+	if ( mInterval > 0 )
+		Timers.Schedule( &mTimer, mInterval, OnReport, NULL );
+}
@@ -30,18 +30,31 @@
 #include <character.h>
 #include <vector>
 
+/* Number of character classes an account can hold a license for. */
+#define MAX_CHARACTER_LICENSES 32
+
+/* Size of the password field, which holds an encoded password hash. */
+#define ACCOUNT_PASSWORD_SIZE 128
+
 typedef std::vector<CharacterData *> CharacterList;
 
 struct account_info_t {
 	uint32_t      mId;
 	char          mName[33];
-	char          mPassword[33];
+	char          mPassword[ACCOUNT_PASSWORD_SIZE];
 	uint32_t      mMaxChars;
 	uint32_t      mGmLevel;
 	uint8_t       mStatus;
 	CharacterList mCharacters;
 	uint32_t      mLicenseCount;
-	uint32_t      mLicenses[32];
+	uint32_t      mLicenses[MAX_CHARACTER_LICENSES];
+
+	/* Releases the characters in the list. */
+	~account_info_t()
+	{
+		for ( CharacterList::iterator i = mCharacters.begin(); i != mCharacters.end(); i++ )
+			delete *i;
+	}
 };
 
 typedef struct account_info_t AccountInfo;
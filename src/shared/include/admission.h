@@ -0,0 +1,100 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_ADMISSION_H__
+#define __SOLDIN_ADMISSION_H__
+
+#include <shared.h>
+#include <sessionmanager.h>
+#include <deque>
+#include <vector>
+
+/* Results of Admission::Request(). */
+#define ADMIT_NOW      0  /* Go ahead, and call Finish() once done. */
+#define ADMIT_QUEUED   1  /* The handler is posted to the session once it is its turn. */
+#define ADMIT_REJECTED 2  /* The queue is full. */
+
+#define ADMISSION_REPORT_INTERVAL 1000   /* Time (ms) between reports of the queue positions. */
+#define ADMISSION_TIMEOUT         30000  /* Time (ms) after which an unfinished admission stops counting. */
+#define ADMISSION_COST_SMOOTHING  8      /* Weight of the newest cost sample in the average (1/n). */
+#define ADMISSION_INITIAL_COST    5000   /* Cost (usec) assumed for an admission before one is measured. */
+
+/* A session that waits for, or holds, an admission. */
+struct admission_ticket_t {
+	Session     *mSession;
+	int          mSessionId;
+	MailHandler  mHandler;
+	uint32_t     mPosition;  /* Last position reported to the session. */
+	uint32_t     mTime;      /* When the ticket was admitted. */
+};
+typedef struct admission_ticket_t AdmissionTicket;
+
+/* Limits how many logins and handoffs are let in at once, so a storm of
+ * them after a restart does not stall the tick for the players that are 
+ * already in. Every tick the time the other work took is subtracted from
+ * the tick budget, and the rest is shared out by the measured cost of an
+ * admission, which is mostly database time. Whoever does not fit waits 
+ * in a FIFO and gets its position reported at an interval. At least one 
+ * session is admitted per tick, so the queue keeps moving. */
+class Admission {
+public:
+	static void Configure( uint32_t tick_budget, uint32_t max_in_flight, uint32_t max_queue );
+	static int  Request( Session *session, MailHandler handler );
+	static void Finish( Session *session );
+	static void BeginWork();
+	static void EndWork();
+	static void Pump();
+
+	/* Sets the handler posted to waiting sessions with their position (param 1) and the queue length (param 2). */
+	inline static void SetReportHandler( MailHandler handler ) { mReportHandler = handler; }
+
+	/* Gets the number of sessions that wait for admission. */
+	inline static uint32_t GetQueueLength() { return (uint32_t)mQueue.size(); }
+
+	/* Gets the number of sessions that were admitted and did not finish yet. */
+	inline static uint32_t GetInFlight() { return (uint32_t)mInFlight.size(); }
+
+	/* Gets the average cost of an admission in microseconds. */
+	inline static uint32_t GetCost() { return mCost; }
+
+private:
+	static bool IsAlive( const AdmissionTicket &ticket );
+	static void Admit( AdmissionTicket &ticket );
+
+	static std::deque<AdmissionTicket>  mQueue;
+	static std::vector<AdmissionTicket> mInFlight;
+	static MailHandler                  mReportHandler;
+	static uint32_t                     mTickBudget;    /* Microseconds. */
+	static uint32_t                     mMaxInFlight;
+	static uint32_t                     mMaxQueue;
+	static uint32_t                     mAllowance;     /* Admissions left in this tick. */
+	static uint32_t                     mCost;          /* Microseconds. */
+	static uint32_t                     mWorkTime;      /* Time (usec) spent on admissions in this tick. */
+	static uint32_t                     mLastReport;
+	static LARGE_INTEGER                mFrequency;
+	static LARGE_INTEGER                mWorkStart;
+};
+
+#endif /* __SOLDIN_ADMISSION_H__ */
@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <shared.h>
+#include <utf.h>
 
 #define BUFFER_OK    0
 #define BUFFER_ERROR 1
@@ -41,10 +42,13 @@ public:
 
 	int            Resize( size_t size );
 	void           Clear();
+	inline void    Reset() { mOffsetWrite = mOffsetRead = 0; }
 	int            Slice( char *dest, size_t len, size_t offset = 0 );
+	void           Drain( size_t len );
 	inline void    Seek( size_t offset ) { mOffsetRead = MIN( offset, mOffsetWrite ); }
 	inline char   *Content() const { return mBuffer; }
 	inline size_t  Size() const { return mOffsetWrite; }
+	inline size_t  Tell() const { return mOffsetRead; }
 
 	int            Write( const char *data, size_t len );
 	inline int     Write( const uint8_t *data, size_t len ) { return Write( (const char *)data, len ); }
@@ -56,6 +60,7 @@ public:
 	inline void    WriteInt16( short value ) { return WriteUInt16( (uint16_t)value ); }
 	void           WriteString( const char *str );
 	void           WriteWideString( const wchar_t *str );
+	void           WriteWideString( const char *str );
 
 	int            Read( char *dest, size_t len );
 	float          ReadFloat();
@@ -68,6 +73,7 @@ public:
 	const char    *ReadString();
 	size_t         ReadWideString( wchar_t *buffer, size_t size );
 	const wchar_t *ReadWideString();
+	size_t         ReadWideString( char *buffer, size_t size );
 
 	/* Gets the byte at the specified index in the buffer. */
 	inline byte operator[] ( size_t index ) const
@@ -92,21 +98,4 @@ private:
 	size_t mOffsetRead;
 };
 
-static char    __utf8_buff[1025];
-static wchar_t __utf16_buff[1025];
-
-/* Converts a specified UTF-16 string to UTF-8. */
-inline static const char *UTF8(const wchar_t *instr)
-{
-	wcstombs(__utf8_buff, instr, 1024);
-	return __utf8_buff;
-}
-
-/* Converts a specified UTF-8 string to UTF-16. */
-inline static const wchar_t *UTF16(const char *instr)
-{
-	mbstowcs(__utf16_buff, instr, 1024);
-	return __utf16_buff;
-}
-
 #endif /* __SOLDIN_BUFFER_H__ */
@@ -28,23 +28,17 @@
 
 #include <shared.h>
 #include <equipment.h>
-#include <vector>
+#include <inventory.h>
+#include <time.h>
 
 #define MAX_CHARACTERS 32
 
-#define BAG_SIZE       20
-#define MAX_BAGS       7
-#define MAX_BANK_BOXES 5
+/* Every bag needs a license, so a character never has more licenses than bags. */
+#define MAX_BAG_LICENSES MAX_BAGS
 
+/* Status of a bag license that never expires. */
+#define LICENSE_PERMANENT 2
 
-struct item_info_t 
-{
-	uint64_t mId;
-	uint32_t mItemId;
-	uint32_t mAmount;
-
-};
-typedef struct item_info_t ItemInfo;
 
 struct bag_license_t 
 {
@@ -55,7 +49,7 @@ struct bag_license_t
 };
 typedef struct bag_license_t BagLicense;
 
-
+/* Summary of a character, the items are kept in separately loaded inventories. */
 class CharacterData {
 public:
 	uint32_t      mId;
@@ -74,16 +68,22 @@ public:
 	EquipmentInfo mEquipment[32];
 
 #	ifdef _SQUARE
-	uint32_t mMoney;
-	ItemInfo mBags[MAX_BAGS][BAG_SIZE];
+	uint32_t       mMoney;
+	uint32_t       mBankMoney;
+	uint32_t       mLicenseCount;
+	BagLicense     mLicenses[MAX_BAG_LICENSES];
+	Inventory     *mInventory;  /* NULL until the bags are needed. */
+	Inventory     *mBank;       /* NULL until the bank is needed. */
 
-	std::vector<BagLicense *> *mBagLicenses;
+	/* Initializes a character without its bags or bank loaded. */
+	CharacterData(): mMoney( 0 ), mBankMoney( 0 ), mLicenseCount( 0 ), mInventory( NULL ), mBank( NULL ) { }
 
-	struct {
-		uint32_t mMoney;
-		ItemInfo mBags[MAX_BANK_BOXES][BAG_SIZE];
-.
-	} mBank;
+	/* Releases the bags and bank if they were loaded. */
+	~CharacterData()
+	{
+		if ( mInventory != NULL ) delete mInventory;
+		if ( mBank != NULL )      delete mBank;
+	}
 #	endif
 };
 
@@ -26,37 +26,46 @@
 #ifndef __SOLIN_DATABASE_H__
 #define __SOLIN_DATABASE_H__
 
-#include <winsock2.h> 
-#include <mysql.h>
 #include <shared.h>
+#include <storage.h>
 #include <character.h>
 #include <account.h>
 
+/* Access to the accounts and characters. The calls are forwarded to the 
+ * storage selected with Use(), MySQL unless configured otherwise. */
 class DB {
 public:
+	static bool Use( Storage *storage );
 	static bool Connect( const char *host, const char *user, const char *passwd, const char *db, uint16_t port );
+	static bool Connect();
+	static void Disconnect();
+
+	/* Gets the storage in use. */
+	inline static Storage *GetStorage() { return mStorage; }
 
     /*  Character management. */
-	static uint32_t       Character_GetList( uint32_t account_id, CharacterList &list );
-	static void           Character_Delete( uint32_t char_id );
-	static CharacterData *Character_Load( uint32_t char_id, CharacterData *info );
-	static bool           Character_Exists( const char *name );
-	static uint32_t       Character_Create( uint32_t account_id, uint32_t class_id, const char *name );
+	static uint32_t       Character_GetList( uint32_t account_id, CharacterList &list )                { return mStorage->Character_GetList( account_id, list ); }
+	static void           Character_Delete( uint32_t char_id )                                        { mStorage->Character_Delete( char_id ); }
+	static CharacterData *Character_Load( uint32_t char_id, CharacterData *info )                     { return mStorage->Character_Load( char_id, info ); }
+	static bool           Character_Exists( const char *name )                                        { return mStorage->Character_Exists( name ); }
+	static uint32_t       Character_Create( uint32_t account_id, uint32_t class_id, const char *name ) { return mStorage->Character_Create( account_id, class_id, name ); }
+	static uint32_t       Character_ScanNames( NameCallback callback, void *context )                  { return mStorage->Character_ScanNames( callback, context ); }
 	//static uint32_t       Character_GetEquipment( uint32_t char_id, EquipmentInfo *list );
-	static void           Character_LoadInventory( CharacterData *c );
-	static void           Character_LoadBank( CharacterData *c );
+	static void           Character_LoadInventory( CharacterData *c )                                 { mStorage->Character_LoadInventory( c ); }
+	static void           Character_LoadBank( CharacterData *c )                                      { mStorage->Character_LoadBank( c ); }
 
 
 	/* Account management. */
-	static AccountInfo   *Account_Load( const char *account_name, AccountInfo *account, bool load_charlist = true );
-	static AccountInfo   *Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist = true );
+	static AccountInfo   *Account_Load( const char *account_name, AccountInfo *account, bool load_charlist = true ) { return mStorage->Account_Load( account_name, account, load_charlist ); }
+	static AccountInfo   *Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist = true )      { return mStorage->Account_Load( account_id, account, load_charlist ); }
+	static bool           Account_SetPassword( uint32_t account_id, const char *password )                          { return mStorage->Account_SetPassword( account_id, password ); }
 	//static void           Account_Delete( uint32_t account_id );
 
 	/* Error handling. */
 	static void LogError();
 
 private:
-	static MYSQL *mConn;
+	static Storage *mStorage;
 };
 
 #endif /* __SOLIN_DATABASE_H__ */
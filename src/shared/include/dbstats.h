@@ -0,0 +1,109 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_DBSTATS_H__
+#define __SOLDIN_DBSTATS_H__
+
+#include <shared.h>
+#include <timerwheel.h>
+
+/* Statements the database calls are attributed to. */
+#define STMT_OTHER             0   /* Plain queries of tools. */
+#define STMT_ACCOUNT_BY_NAME   1
+#define STMT_ACCOUNT           2
+#define STMT_ACCOUNT_LICENSES  3
+#define STMT_CHARACTER_LIST    4
+#define STMT_CHARACTER         5
+#define STMT_CHARACTER_BAGS    6
+#define STMT_CHARACTER_ITEMS   7
+#define STMT_CHARACTER_EXISTS  8
+#define STMT_CHARACTER_CREATE  9
+#define STMT_CHARACTER_DELETE  10
+#define STMT_REPLICATION_LAG   11
+#define STMT_CHARACTER_NAMES   12
+#define STMT_ACCOUNT_PASSWORD  13
+#define STMT_ACCOUNT_DIRECTORY 14
+#define STMT_COUNT             15
+
+/* Latency buckets of the histograms, bucket n holds calls below 2^(n + 6) microseconds (64us up to 4s and more). */
+#define DBSTATS_BUCKETS        17
+
+/* Longest part of a query written to the slow query log. */
+#define DBSTATS_SLOW_QUERY_LEN 512
+
+/* Calls of a single statement since the last report. */
+struct statement_stats_t {
+	volatile LONG mCount;
+	volatile LONG mErrors;
+	volatile LONG mRows;
+	volatile LONG mBytes;
+	volatile LONG mTotalTime;  /* Microseconds. */
+	volatile LONG mMaxTime;
+	volatile LONG mBuckets[DBSTATS_BUCKETS];
+};
+typedef struct statement_stats_t StatementStats;
+
+/* A call that is being timed. */
+struct statement_call_t {
+	uint8_t       mStatement;
+	const char   *mQuery;
+	LARGE_INTEGER mStart;
+};
+typedef struct statement_call_t StatementCall;
+
+/* Times every database call per statement, with the rows and bytes it
+ * returned. Calls slower than the threshold are written to the slow 
+ * query log with the query and the packet and session that caused it. 
+ * A report with the latency histogram of every statement is written to
+ * the server log at an interval, and the counters start over. */
+class DBStats {
+public:
+	static void Begin( StatementCall &call, uint8_t statement, const char *query );
+	static void End( const StatementCall &call, bool failed, uint32_t rows, uint32_t bytes );
+	static void Report();
+	static void Start( uint32_t interval );
+
+	/* Sets the packet and session the calls of this thread are made for, until the next call. */
+	inline static void SetCaller( uint16_t opcode, int session ) { mOpcode = opcode; mSession = session; }
+
+	/* Sets the time (in ms) after which a call is logged as slow, 0 logs every call. */
+	inline static void SetSlowThreshold( uint32_t threshold ) { mSlowThreshold = threshold * 1000; }
+
+	/* Gets the calls of a statement since the last report. */
+	inline static const StatementStats &Get( uint8_t statement ) { return mStats[statement]; }
+
+private:
+	static void OnReport( void *context );
+
+	static StatementStats             mStats[STMT_COUNT];
+	static LARGE_INTEGER              mFrequency;
+	static uint32_t                   mSlowThreshold;  /* Microseconds. */
+	static uint32_t                   mInterval;       /* Milliseconds. */
+	static Timer                      mTimer;
+	static THREAD_LOCAL uint16_t      mOpcode;
+	static THREAD_LOCAL int           mSession;
+};
+
+#endif /* __SOLDIN_DBSTATS_H__ */
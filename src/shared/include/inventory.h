@@ -0,0 +1,94 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_INVENTORY_H__
+#define __SOLDIN_INVENTORY_H__
+
+#include <shared.h>
+
+#define BAG_SIZE       20
+#define MAX_BAGS       7
+#define MAX_BANK_BOXES 5
+
+/* Number of slots an inventory grows by when it runs out of room. */
+#define INVENTORY_GROW 16
+
+struct item_info_t 
+{
+	uint64_t mId;
+	uint32_t mItemId;
+	uint32_t mAmount;
+
+};
+typedef struct item_info_t ItemInfo;
+
+/* An occupied (or recently emptied) slot of an inventory. */
+struct inventory_slot_t
+{
+	uint16_t mKey;      /* bag * BAG_SIZE + slot. */
+	uint32_t mVersion;  /* Version of the inventory when this slot last changed. */
+	ItemInfo mItem;     /* An item id of 0 marks a slot that was emptied. */
+
+	inline uint8_t GetBag() const  { return (uint8_t)( mKey / BAG_SIZE ); }
+	inline uint8_t GetSlot() const { return (uint8_t)( mKey % BAG_SIZE ); }
+};
+typedef struct inventory_slot_t InventorySlot;
+
+/* A set of bags that only stores the occupied slots, sorted by slot so a
+ * lookup is a binary search. Every change bumps the version of the 
+ * inventory, which lets the changes since a version be send on their own.
+ * Emptied slots are kept until Purge() is called with a version the
+ * client has seen. */
+class Inventory {
+public:
+	Inventory( uint8_t bag_count );
+	~Inventory();
+
+	const ItemInfo *Get( uint8_t bag, uint8_t slot ) const;
+	bool            Set( uint8_t bag, uint8_t slot, const ItemInfo &item );
+	bool            Clear( uint8_t bag, uint8_t slot );
+	void            Purge( uint32_t version );
+
+	static bool     Move( Inventory &src, uint8_t src_bag, uint8_t src_slot, Inventory &dest, uint8_t dest_bag, uint8_t dest_slot );
+
+	inline bool     IsValid( uint8_t bag, uint8_t slot ) const { return ( bag < mBagCount && slot < BAG_SIZE ); }
+	inline uint8_t  GetBagCount() const   { return mBagCount; }
+	inline uint16_t GetItemCount() const  { return mItemCount; }
+	inline uint32_t GetVersion() const    { return mVersion; }
+	inline uint16_t Size() const          { return mCount; }
+	inline const InventorySlot &At( uint16_t index ) const { return mSlots[index]; }
+
+private:
+	int  Find( uint16_t key ) const;
+
+	InventorySlot *mSlots;
+	uint16_t       mCount;      /* Slots in use, including emptied ones. */
+	uint16_t       mCapacity;
+	uint16_t       mItemCount;  /* Slots that hold an item. */
+	uint8_t        mBagCount;
+	uint32_t       mVersion;
+};
+
+#endif /* __SOLDIN_INVENTORY_H__ */
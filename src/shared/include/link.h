@@ -0,0 +1,67 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_LINK_H__
+#define __SOLDIN_LINK_H__
+
+#include <shared.h>
+
+/* Gateway <-> Square message ID's. */
+#define MSG_SQUARE_AUTH         0x0001
+#define MSG_SQUARE_UPDATE       0x0002
+#define MSG_SQUARE_SESSIONINFO  0x0003
+#define MSG_SQUARE_HEARTBEAT    0x0004
+#define MSG_SQUARE_STAGES       0x0005
+#define MSG_SQUARE_MIGRATE_PREPARE 0x0006
+#define MSG_SQUARE_MIGRATE_READY   0x0007
+#define MSG_SQUARE_MIGRATE_COMMIT  0x0008
+
+/* Link timings (in seconds). */
+#define LINK_HEARTBEAT_INTERVAL 2   /* Time between two heartbeats send by the square. */
+#define LINK_TIMEOUT            10  /* A link that has been silent this long is considered dead. */
+#define LINK_REQUEST_TIMEOUT    15  /* Maximum time a request may remain unanswered. */
+#define LINK_RECONNECT_MIN      1   /* Initial delay before reconnecting to the gateway. */
+#define LINK_RECONNECT_MAX      30  /* Upper bound of the reconnect backoff. */
+#define LINK_CONNECT_TIMEOUT    5   /* Time a connection attempt may take before it is given up. */
+
+/* Maximum number of requests that may be in-flight on a single link. */
+#define LINK_MAX_PENDING        1024
+
+/* Maximum number of stages a single square shard advertises. */
+#define LINK_MAX_STAGES         32
+
+/* Stage group of the square hub stages. */
+#define STAGE_GROUP_SQUARE      0x0330A106
+
+/* Player migration result codes. */
+#define MIGRATE_OK              0
+#define MIGRATE_NOTARGET        1  /* The target shard is not connected to the gateway. */
+#define MIGRATE_FULL            2  /* The target has no room for the player. */
+#define MIGRATE_FAILED          3  /* The target could not load the player. */
+
+/* Request ID's are never 0, so 0 can be used to mark a unused slot. */
+#define LINK_INVALID_REQUEST    0
+
+#endif /* __SOLDIN_LINK_H__ */
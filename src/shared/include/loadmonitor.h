@@ -0,0 +1,57 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_LOADMONITOR_H__
+#define __SOLDIN_LOADMONITOR_H__
+
+#include <shared.h>
+
+/* Weight of the newest sample in the tick time average (1/n). */
+#define LOAD_TICK_SMOOTHING 16
+
+/* Measures how busy the main loop of the server is. */
+class LoadMonitor {
+public:
+	static void     BeginTick();
+	static void     EndTick();
+	static uint32_t GetCpuUsage();
+
+	/* Gets the average time spent per tick in microseconds. */
+	inline static uint32_t GetTickTime() { return mTickTime; }
+
+	/* Gets the time spent in the last tick in microseconds. */
+	inline static uint32_t GetLastTickTime() { return mLastTickTime; }
+
+private:
+	static LARGE_INTEGER mFrequency;
+	static LARGE_INTEGER mTickStart;
+	static uint32_t      mTickTime;
+	static uint32_t      mLastTickTime;
+	static HANDLE        mThread;
+	static ULONGLONG     mLastCpuTime;
+	static ULONGLONG     mLastWallTime;
+};
+
+#endif /* __SOLDIN_LOADMONITOR_H__ */
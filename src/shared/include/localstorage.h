@@ -0,0 +1,164 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_LOCALSTORAGE_H__
+#define __SOLDIN_LOCALSTORAGE_H__
+
+#include <shared.h>
+#include <storage.h>
+#include <buffer.h>
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+/* Types of the records in the log. */
+#define LOCAL_REC_ACCOUNT          1
+#define LOCAL_REC_ACCOUNT_LICENSE  2
+#define LOCAL_REC_CHARACTER        3
+#define LOCAL_REC_CHARACTER_DELETE 4
+#define LOCAL_REC_BAG              5
+#define LOCAL_REC_ITEM             6
+
+/* Size of the header in front of every record, the length and the type. */
+#define LOCAL_REC_HEADER 3
+
+/* Bytes read from the log at once when catching up. */
+#define LOCAL_READ_SIZE  65536
+
+/* Compares names without regard to case, like the MySQL collation does. */
+struct local_name_less_t {
+	bool operator()( const char *a, const char *b ) const { return _stricmp( a, b ) < 0; }
+};
+typedef std::map<const char *, uint32_t, local_name_less_t> LocalNameIndex;
+
+/* An item of a character, either in the bags (type 0) or in the bank (type 1). */
+struct local_item_t {
+	uint8_t  mType;
+	uint8_t  mBag;
+	uint8_t  mSlot;
+	ItemInfo mItem;
+};
+typedef struct local_item_t LocalItem;
+
+/* An account with the IDs of its characters. */
+struct local_account_t {
+	uint32_t              mId;
+	char                  mName[33];
+	char                  mPassword[ACCOUNT_PASSWORD_SIZE];
+	uint32_t              mMaxChars;
+	uint32_t              mGmLevel;
+	uint8_t               mStatus;
+	std::vector<uint32_t> mLicenses;
+	std::vector<uint32_t> mCharacters;
+};
+typedef struct local_account_t LocalAccount;
+
+/* A character with its bag licenses and items. */
+struct local_character_t {
+	uint32_t                mId;
+	uint32_t                mAccountId;
+	char                    mName[33];
+	uint32_t                mClassId;
+	uint32_t                mLastPlayed;
+	uint16_t                mLevel;
+	uint32_t                mExperience;
+	uint16_t                mPvpLevel;
+	uint32_t                mPvpExperience;
+	uint16_t                mWarLevel;
+	uint32_t                mWarExperience;
+	uint16_t                mRebirthLevel;
+	uint16_t                mRebirthCount;
+	uint32_t                mMoney;
+	uint32_t                mBankMoney;
+	std::vector<BagLicense> mBags;
+	std::vector<LocalItem>  mItems;
+};
+typedef struct local_character_t LocalCharacter;
+
+/* Embedded storage for small shards and benchmarks, without a database server.
+ * Every change is appended to a log file and applied to an index in memory,
+ * reads never touch the disk. Opening the file replays the log. Another 
+ * process can read the same file, before every call the records appended 
+ * since the last one are applied, but only one process may write to it. 
+ * The writer drops a record that was cut off by a crash. */
+class LocalStorage: public Storage {
+public:
+	LocalStorage( const char *path );
+	~LocalStorage();
+
+	bool        Connect();
+	void        Disconnect() { }
+	void        LogError();
+	const char *GetName() const { return "local"; }
+
+	/*  Character management. */
+	uint32_t       Character_GetList( uint32_t account_id, CharacterList &list );
+	void           Character_Delete( uint32_t char_id );
+	CharacterData *Character_Load( uint32_t char_id, CharacterData *info );
+	bool           Character_Exists( const char *name );
+	uint32_t       Character_Create( uint32_t account_id, uint32_t class_id, const char *name );
+	uint32_t       Character_ScanNames( NameCallback callback, void *context );
+	void           Character_LoadInventory( CharacterData *c );
+	void           Character_LoadBank( CharacterData *c );
+
+	/* Account management. */
+	AccountInfo   *Account_Load( const char *account_name, AccountInfo *account, bool load_charlist );
+	AccountInfo   *Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist );
+	bool           Account_SetPassword( uint32_t account_id, const char *password );
+
+	/* Adding data directly, for tools that fill the storage. */
+	void           PutAccount( const AccountInfo &account );
+	void           PutAccountLicense( uint32_t account_id, uint32_t class_id );
+	void           PutCharacter( uint32_t account_id, const LocalCharacter &c );
+	void           PutBag( uint32_t char_id, const BagLicense &bag );
+	void           PutItem( uint32_t char_id, const LocalItem &item );
+	void           BeginBatch();
+	void           EndBatch();
+	uint32_t       GetMaxId( uint8_t type );
+
+private:
+	bool Append( uint8_t type, const Buffer &record );
+	void Refresh();
+	void Trim();
+	void Apply( uint8_t type, Buffer &record );
+	void ApplyCharacter( Buffer &record );
+	void ApplyCharacterDelete( uint32_t char_id );
+	void ToCharacterData( const LocalCharacter &c, CharacterData *info );
+	void LoadItems( uint32_t char_id, uint8_t type, Inventory *inventory );
+
+	char                              *mPath;
+	FILE                              *mFile;
+	long                               mOffset;
+	bool                               mBatch;
+	const char                        *mError;
+	CRITICAL_SECTION                   mLock;
+	std::map<uint32_t, LocalAccount>   mAccounts;
+	std::map<uint32_t, LocalCharacter> mCharacters;
+	LocalNameIndex                     mAccountNames;
+	LocalNameIndex                     mCharacterNames;
+	uint32_t                           mMaxIds[LOCAL_REC_ITEM + 1];
+};
+
+#endif /* __SOLDIN_LOCALSTORAGE_H__ */
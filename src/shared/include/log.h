@@ -38,7 +38,11 @@ public:
 
 	void Write( const char *format, byte error_level, ... );
 
+	static void SetLevel( const char *level );
+
 private:
+	static int mMinRank;
+
 	bool  mVerbose;
 	FILE *mFile;
 };
@@ -46,5 +50,6 @@ private:
 extern Log ServerLog;
 extern Log ErrorLog;
 extern Log DebugLog;
+extern Log SlowLog;
 
 #endif /* __SOLDIN_LOG_H__ */
@@ -0,0 +1,75 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_MAILBOX_H__
+#define __SOLDIN_MAILBOX_H__
+
+#include <shared.h>
+
+#define MAILBOX_CAPACITY 64                      /* Must be a power of two. */
+#define MAILBOX_MASK     ( MAILBOX_CAPACITY - 1 )
+#define MAILBOX_BATCH    32                      /* Messages handled per Drain() call. */
+
+struct mail_t;
+typedef void (*MailHandler)( void *target, const struct mail_t *mail );
+
+/* A message for the owner of a mailbox, the handler runs on the owning thread. */
+struct mail_t {
+	MailHandler mHandler;
+	uint32_t    mParam1;
+	uint32_t    mParam2;
+	void       *mData;
+};
+typedef struct mail_t Mail;
+
+/* Bounded lock-free inbox, any thread may post, only the owning thread
+ * drains. Every cell carries a sequence number that tells producers and
+ * the consumer whose turn it is, so producers only race on the tail 
+ * counter and the consumer never has to synchronize at all. */
+class Mailbox {
+public:
+	Mailbox();
+	~Mailbox();
+
+	bool        Post( MailHandler handler, uint32_t param1 = 0, uint32_t param2 = 0, void *data = NULL );
+	uint32_t    Drain( void *target, uint32_t max = MAILBOX_BATCH );
+	static void Wait( uint32_t timeout );
+
+private:
+	struct cell_t {
+		volatile LONG mSequence;
+		Mail          mMail;
+	};
+
+	cell_t        mCells[MAILBOX_CAPACITY];
+	volatile LONG mTail;
+	LONG          mHead;
+
+	static HANDLE        mWakeEvent;
+	static volatile LONG mSleeping;
+	static volatile LONG mPending;   /* Messages posted to any mailbox and not drained yet. */
+};
+
+#endif /* __SOLDIN_MAILBOX_H__ */
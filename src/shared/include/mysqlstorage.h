@@ -0,0 +1,103 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_MYSQLSTORAGE_H__
+#define __SOLDIN_MYSQLSTORAGE_H__
+
+#include <winsock2.h> 
+#include <mysql.h>
+#include <shared.h>
+#include <storage.h>
+#include <dbstats.h>
+
+/* Most MySQL servers a process can use at once, every server takes a connection slot in each thread. */
+#define MYSQL_MAX_NODES 32
+
+/* Storage on a MySQL server. Every thread has its own connection, so 
+ * threads other than the first one have to Connect() before using it. 
+ * Several servers can be used side by side, each has its own slot in 
+ * the connections of a thread. */
+class MySqlStorage: public Storage {
+public:
+	MySqlStorage( const char *host, const char *user, const char *passwd, const char *db, uint16_t port );
+	~MySqlStorage();
+
+	bool        Connect();
+	void        Disconnect();
+	void        LogError();
+	const char *GetName() const { return "mysql"; }
+
+	/*  Character management. */
+	uint32_t       Character_GetList( uint32_t account_id, CharacterList &list );
+	void           Character_Delete( uint32_t char_id );
+	CharacterData *Character_Load( uint32_t char_id, CharacterData *info );
+	bool           Character_Exists( const char *name );
+	uint32_t       Character_Create( uint32_t account_id, uint32_t class_id, const char *name );
+	uint32_t       Character_ScanNames( NameCallback callback, void *context );
+	void           Character_LoadInventory( CharacterData *c );
+	void           Character_LoadBank( CharacterData *c );
+
+	/* Account management. */
+	AccountInfo   *Account_Load( const char *account_name, AccountInfo *account, bool load_charlist );
+	AccountInfo   *Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist );
+	bool           Account_SetPassword( uint32_t account_id, const char *password );
+
+	/* The directory of account names, kept by the sharded storage on its first shard. */
+	uint32_t       Directory_Find( const char *account_name );
+	bool           Directory_Add( const char *account_name, uint32_t account_id );
+
+	/* Plain queries, for tools that work on the tables directly and for routing. */
+	int            Query( const char *query, uint8_t statement = STMT_OTHER );
+	int            QueryInt( const char *query, int default_value = 0 );
+	int            GetReplicationLag();
+
+	/* Checks if the calling thread has a connection with this server. */
+	inline bool IsConnected() const { return mSlot < MYSQL_MAX_NODES && mConns[mSlot] != NULL; }
+
+	/* Gets the number of queries the calling thread has run. */
+	inline static uint32_t GetQueryCount() { return mQueryCount; }
+
+private:
+	MYSQL_RES *StoreResult();
+
+#	if defined( _SQUARE )
+	void Character_LoadItems( uint32_t char_id, int type, Inventory *inventory );
+#	endif
+
+	char    *mHost;
+	char    *mUser;
+	char    *mPassword;
+	char    *mDatabase;
+	uint16_t mPort;
+	uint32_t mSlot;
+
+	static THREAD_LOCAL MYSQL        *mConns[MYSQL_MAX_NODES];
+	static THREAD_LOCAL uint32_t      mOpenCount;
+	static THREAD_LOCAL uint32_t      mQueryCount;
+	static THREAD_LOCAL StatementCall mCall;    /* The call being timed. */
+	static volatile LONG              mNextSlot;
+};
+
+#endif /* __SOLDIN_MYSQLSTORAGE_H__ */
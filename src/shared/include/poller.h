@@ -0,0 +1,60 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_POLLER_H__
+#define __SOLDIN_POLLER_H__
+
+#include <shared.h>
+#include <socket.h>
+
+/* I/O backends. */
+#define IO_BACKEND_SOCKET 0  /* Every socket checks its own readiness when it is used. */
+#define IO_BACKEND_POLLER 1  /* The readiness of all sockets is collected once per tick. */
+
+/* Maximum number of sockets handled by the poller, sockets beyond this use the per-socket path. */
+#define POLLER_MAX_SOCKETS FD_SETSIZE
+
+/* Collects the readiness of every registered socket with a single select 
+ * per tick, so a tick costs one readiness call instead of one per socket 
+ * per receive and send. Sockets that are not registered keep checking 
+ * their own readiness. This is a stopgap, select still walks every socket
+ * on each call, I/O completion ports would not. */
+class Poller {
+public:
+	static void     Initialize( int backend );
+	static bool     Register( Socket *socket );
+	static void     Unregister( Socket *socket );
+	static int      Poll();
+
+	inline static bool     IsEnabled() { return mEnabled; }
+	inline static uint32_t GetCount()  { return mCount; }
+
+private:
+	static Socket  *mSockets[POLLER_MAX_SOCKETS];
+	static uint32_t mCount;
+	static bool     mEnabled;
+};
+
+#endif /* __SOLDIN_POLLER_H__ */
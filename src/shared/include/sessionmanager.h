@@ -30,9 +30,16 @@
 #include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <timerwheel.h>
+#include <mailbox.h>
 
 #define INVALID_SESSION -1
-#define MAX_SESSIONS    200
+#ifndef MAX_SESSIONS
+#	define MAX_SESSIONS 200 /* The benchmarks raise this to measure large tables. */
+#endif
+
+/* Seconds a client may stay silent before its session is closed. */
+#define SESSION_IDLE_TIMEOUT 120
 
 /* Session types. */
 #define SESS_NONE       0
@@ -48,6 +55,11 @@ public:
 	char        mSessionKey[9];
 	bool        mEOF;
 	const char *mName;
+	Timer       mIdleTimer;
+	Mailbox     mMailbox;
+
+	/* Makes sure the idle timer does not outlive the session. */
+	~Session() { Timers.Cancel( &mIdleTimer ); }
 
 	/* Initializes the session by generating a random key. */
 	void Initialize()
@@ -55,6 +67,18 @@ public:
 		sprintf( &mSessionKey[0], "%8X", time( NULL ) + rand() );
 		mSessionKey[8] = 0;
 	}
+
+	/* Restarts the idle timer, the session is closed once it runs out (timeout in seconds). */
+	void ResetIdleTimer( uint32_t timeout )
+	{
+		Timers.Schedule( &mIdleTimer, timeout * 1000, OnIdle, this );
+	}
+
+	/* The session has been idle for too long. */
+	static void OnIdle( void *context )
+	{
+		( (Session *)context )->mEOF = true;
+	}
 };
 
 /* Represents the session list. */
@@ -70,7 +94,7 @@ public:
 	static _T *Find( const char *session_key )
 	{
 		for ( int i = 0; i < MAX_SESSIONS; i++ )
-			if ( strcmp( mSessions[i]->mSessionKey, session_key ) == 0 )
+			if ( mSessions[i] != NULL && strcmp( mSessions[i]->mSessionKey, session_key ) == 0 )
 				return (_T *)mSessions[i];
 		
 		return NULL;
@@ -91,7 +115,7 @@ public:
 	static _T *FindByName( const char *name )
 	{
 		for ( int i = 0; i < MAX_SESSIONS; i++ )
-			if ( mSessions[i]->mName != NULL && _stricmp( mSessions[i]->mName, name ) == 0 )
+			if ( mSessions[i] != NULL && mSessions[i]->mName != NULL && _stricmp( mSessions[i]->mName, name ) == 0 )
 				return (_T *)mSessions[i];
 
 		return NULL;
@@ -26,25 +26,72 @@
 #ifndef __SOLDIN_SETTINGS_H__
 #define __SOLDIN_SETTINGS_H__
 
-class Setting {
-public:
-	char *mName;
-	char *mValue;
+#include <shared.h>
+#include <time.h>
+
+/* Smallest number of buckets in a settings table, always a power of two. */
+#define SETTINGS_MIN_BUCKETS 16
+
+/* Milliseconds between checks of the configuration file for changes. */
+#define SETTINGS_POLL_INTERVAL 2000
+
+/* A single setting, the value is converted to every type when the file is read. */
+struct settings_entry_t {
+	uint32_t    mHash;   /* 0 marks an empty bucket. */
+	const char *mName;
+	const char *mValue;
+	int         mInt;
+	float       mFloat;
+	bool        mBool;
 };
+typedef struct settings_entry_t Setting;
 
+/* The settings read from one version of the file. A table never changes
+ * once it is published, a reload builds a new one. */
+struct settings_table_t {
+	char                    *mText;      /* The file, names and values point into it. */
+	Setting                 *mBuckets;
+	uint32_t                 mMask;
+	uint32_t                 mCount;
+	uint32_t                 mVersion;
+	struct settings_table_t *mRetired;   /* Table this one replaced, freed by the next reload. */
+};
+typedef struct settings_table_t SettingsTable;
+
+/* Case-insensitive settings from a configuration file, indexed by an
+ * open-addressed hash table. Reloading swaps in a new table with a single
+ * atomic pointer exchange, so readers never lock. The table a reload
+ * replaces is kept until the next reload, so strings handed out by 
+ * GetString() stay valid until then. Code that keeps such a string for
+ * longer gets it again whenever the settings are reloaded, or copies it.
+ * A file that does not parse, or that is still being written, is not
+ * loaded and the current settings stay. */
 class Settings {
 public:
-	Settings( const char * path );
+	Settings( const char *path );
 	~Settings();
 
-	const char *GetString( const char *name, const char *default = "" );
-	int			GetInt( const char *name, int default = 0 );
-	float		GetFloat( const char *name, float default = 0.0f );
-	bool		GetBool( const char *name, bool default = false );
+	const char *GetString( const char *name, const char *default_value = "" );
+	int			GetInt( const char *name, int default_value = 0 );
+	float		GetFloat( const char *name, float default_value = 0.0f );
+	bool		GetBool( const char *name, bool default_value = false );
+
+	bool        Reload();
+	bool        Poll();
+
+	/* Gets the version of the settings, which increases with every reload. */
+	inline uint32_t GetVersion() const { return ( mTable != NULL ) ? mTable->mVersion : 0; }
 
 private:
-	Setting **mList;
-	size_t    mCount;
+	const Setting *Find( const char *name ) const;
+	SettingsTable *Parse();
+	time_t         GetModified() const;
+
+	char                   *mPath;
+	SettingsTable *volatile mTable;
+	time_t                  mModified;
+	time_t                  mChanged;    /* Time of a change that is waited on to settle. */
+	uint32_t                mLastPoll;
 };
 
 #endif /* __SOLDIN_SETTINGS_H__ */
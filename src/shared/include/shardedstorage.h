@@ -0,0 +1,116 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_SHARDEDSTORAGE_H__
+#define __SOLDIN_SHARDEDSTORAGE_H__
+
+#include <shared.h>
+#include <mysqlstorage.h>
+#include <settings.h>
+#include <vector>
+
+/* Most primaries the accounts can be spread over. */
+#define STORAGE_MAX_SHARDS 16
+
+/* Milliseconds between checks of how far a replica is behind. */
+#define REPLICA_CHECK_INTERVAL 1000
+
+/* A read-only copy of a primary. */
+struct storage_replica_t {
+	MySqlStorage  *mStorage;
+	volatile LONG  mLag;        /* Seconds behind the primary, -1 if unknown or not replicating. */
+	volatile LONG  mCheckedAt;  /* Tick of the last lag check. */
+};
+typedef struct storage_replica_t StorageReplica;
+
+/* A primary that owns a part of the accounts, with its replicas. */
+struct storage_shard_t {
+	MySqlStorage               *mPrimary;
+	std::vector<StorageReplica> mReplicas;
+	volatile LONG               mNextReplica;
+	volatile LONG               mLastWrite;  /* Tick of the last write by this process. */
+};
+typedef struct storage_shard_t StorageShard;
+
+/* Spreads the accounts over several MySQL primaries and sends reads to
+ * their replicas. An account, its characters and their items live on 
+ * the shard of the account, and the IDs tell which shard that is: the 
+ * primaries hand out IDs with auto_increment_increment set to the number
+ * of shards and auto_increment_offset to the shard number plus one. 
+ * Account names are looked up in the directory on the first shard, the
+ * sol_account_directory table, which maps them to account IDs. A name
+ * that is not listed yet is searched on every shard and then listed. 
+ * Reads go to a replica that is at most the configured number of seconds
+ * behind, or to the primary when none is or when this process wrote to 
+ * the shard within that time. A read that finds nothing on a replica is
+ * repeated on the primary, the row might not have arrived yet. */
+class ShardedStorage: public Storage {
+public:
+	ShardedStorage( uint32_t max_lag );
+	~ShardedStorage();
+
+	static ShardedStorage *Load( Settings &config );
+
+	void        AddShard( MySqlStorage *primary );
+	void        AddReplica( uint32_t shard, MySqlStorage *replica );
+
+	bool        Connect();
+	void        Disconnect();
+	void        LogError();
+	const char *GetName() const { return "sharded"; }
+
+	/* Gets the number of shards. */
+	inline uint32_t GetShardCount() const { return (uint32_t)mShards.size(); }
+
+	/* Gets the shard that owns the account or character with the specified ID. */
+	inline uint32_t GetShard( uint32_t id ) const { return ( id - 1 ) % mShards.size(); }
+	uint32_t        FindAccount( const char *account_name );
+
+	/*  Character management. */
+	uint32_t       Character_GetList( uint32_t account_id, CharacterList &list );
+	void           Character_Delete( uint32_t char_id );
+	CharacterData *Character_Load( uint32_t char_id, CharacterData *info );
+	bool           Character_Exists( const char *name );
+	uint32_t       Character_Create( uint32_t account_id, uint32_t class_id, const char *name );
+	uint32_t       Character_ScanNames( NameCallback callback, void *context );
+	void           Character_LoadInventory( CharacterData *c );
+	void           Character_LoadBank( CharacterData *c );
+
+	/* Account management. */
+	AccountInfo   *Account_Load( const char *account_name, AccountInfo *account, bool load_charlist );
+	AccountInfo   *Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist );
+	bool           Account_SetPassword( uint32_t account_id, const char *password );
+
+private:
+	MySqlStorage *GetReader( uint32_t shard );
+	MySqlStorage *GetWriter( uint32_t shard );
+	bool          IsFresh( uint32_t shard, StorageReplica &replica );
+
+	std::vector<StorageShard> mShards;
+	uint32_t                  mMaxLag;   /* Seconds. */
+	const char               *mError;
+};
+
+#endif /* __SOLDIN_SHARDEDSTORAGE_H__ */
@@ -54,6 +54,18 @@ typedef unsigned long	uint64_t;
 
 #endif
 
+/* Storage that every thread has its own copy of. */
+#ifdef _MSC_VER
+#	define THREAD_LOCAL __declspec( thread )
+#else
+#	define THREAD_LOCAL __thread
+#endif
+
+/* The benchmarks count every allocation. */
+#ifdef _BENCH
+#	include <benchalloc.h>
+#endif
+
 typedef struct vector2_t {
 	float x, y;
 } Vector2;
@@ -25,18 +25,37 @@
  */
 #ifndef __SOLDIN_SOCKET_H__
 #define __SOLDIN_SOCKET_H__
+
+/* Room for every session in a single select set. The projects define it as well, 
+ * it has to be the same in every file that includes winsock2.h. */
+#ifndef FD_SETSIZE
+#	define FD_SETSIZE 1024
+#endif
+
 #include <winsock2.h>
 #include <buffer.h>
 #include <crypt.h>
 #include <shared.h>
 
+/* Maximum number of connections accepted from the backlog in a single tick. */
+#define ACCEPT_BATCH 256
+
+/* Bytes a session may have waiting to be sent, a peer that stops reading is dropped beyond this. */
+#define SEND_BUFFER_LIMIT ( 256 * 1024 )
+
+/* Poll index of a socket that is not registered with the poller. */
+#define POLLER_NONE -1
+
 class Socket {
+	friend class Poller;
+
 public:
 	Socket();
 	Socket( SOCKET socket, sockaddr_in *addr, size_t len );
 	~Socket();
 	
 	int         Connect( const char *hostname, uint16_t port );
+	int         FinishConnect();
 	int         Listen( uint16_t port );
 	Socket*     Accept();
 	int         Receive( Buffer *dest );
@@ -46,6 +65,7 @@ public:
 	void        DisableEncryption();
 	const char *Address();
 	inline bool Connected() const { return mConnected; }
+	inline bool Connecting() const { return mConnecting; }
 	inline bool Encrypted() const { return ( mCrypt != NULL ); }
 
 	/* Transmits the contents of a buffer. */
@@ -87,15 +107,36 @@ private:
 		return FD_ISSET( mSocket, &set ) != 0;
 	}
 
+	/* Checks if a pending connect has completed or failed. */
+	void CheckConnect()
+	{
+		fd_set write_set, error_set;
+		struct timeval tm;
+		tm.tv_sec = tm.tv_usec = 0;
+		FD_ZERO( &write_set );
+		FD_ZERO( &error_set );
+		FD_SET( mSocket, &write_set );
+		FD_SET( mSocket, &error_set );
+
+		select( mSocket + 1, 0, &write_set, &error_set, &tm );
+		mWritable = FD_ISSET( mSocket, &write_set ) != 0;
+		mFailed   = FD_ISSET( mSocket, &error_set ) != 0;
+	}
+
 	SOCKET         mSocket;
 	uint16_t       mPort;
 	bool           mConnected;
+	bool           mConnecting;
 	static bool    mInitialized;
 	static size_t  mSocketCount;
 	static WSADATA mWsaData;
     SOCKADDR_IN    mAddr;
 	char          *mIpAddr;
 	Crypto        *mCrypt;
+	int            mPollIndex;
+	bool           mReadable;
+	bool           mWritable;  /* A pending connect completed. */
+	bool           mFailed;    /* A pending connect failed. */
 };
 
 #endif /* __SOLDIN_SOCKET_H__ */
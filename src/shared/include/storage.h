@@ -0,0 +1,70 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_STORAGE_H__
+#define __SOLDIN_STORAGE_H__
+
+#include <shared.h>
+#include <character.h>
+#include <account.h>
+
+/* Called for every name by Character_ScanNames(). */
+typedef void (*NameCallback)( const char *name, void *context );
+
+/* Where accounts and characters are kept. The DB class forwards to the 
+ * selected storage, so the servers do not know which one is used. */
+class Storage {
+public:
+	virtual ~Storage() { }
+
+	/* Prepares the calling thread for using the storage. */
+	virtual bool Connect() = 0;
+
+	/* Releases what the calling thread used. */
+	virtual void Disconnect() = 0;
+
+	/* Writes the last error of the calling thread to the error log. */
+	virtual void LogError() = 0;
+
+	/* Gets the name of the storage, as used in the configuration. */
+	virtual const char *GetName() const = 0;
+
+	/* Character management. */
+	virtual uint32_t       Character_GetList( uint32_t account_id, CharacterList &list ) = 0;
+	virtual void           Character_Delete( uint32_t char_id ) = 0;
+	virtual CharacterData *Character_Load( uint32_t char_id, CharacterData *info ) = 0;
+	virtual bool           Character_Exists( const char *name ) = 0;
+	virtual uint32_t       Character_Create( uint32_t account_id, uint32_t class_id, const char *name ) = 0;
+	virtual uint32_t       Character_ScanNames( NameCallback callback, void *context ) = 0;
+	virtual void           Character_LoadInventory( CharacterData *c ) = 0;
+	virtual void           Character_LoadBank( CharacterData *c ) = 0;
+
+	/* Account management. */
+	virtual AccountInfo   *Account_Load( const char *account_name, AccountInfo *account, bool load_charlist ) = 0;
+	virtual AccountInfo   *Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist ) = 0;
+	virtual bool           Account_SetPassword( uint32_t account_id, const char *password ) = 0;
+};
+
+#endif /* __SOLDIN_STORAGE_H__ */
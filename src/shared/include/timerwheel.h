@@ -0,0 +1,86 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_TIMERWHEEL_H__
+#define __SOLDIN_TIMERWHEEL_H__
+
+#include <shared.h>
+
+/* Wheel layout. */
+#define TIMER_RESOLUTION 10   /* Milliseconds per wheel tick. */
+#define TIMER_LEVELS     4
+#define TIMER_SLOT_BITS  6
+#define TIMER_SLOTS      ( 1 << TIMER_SLOT_BITS )
+#define TIMER_SLOT_MASK  ( TIMER_SLOTS - 1 )
+
+/* Longest delay (in ms) the wheel can hold, longer timers have to re-arm themselves. */
+#define TIMER_MAX_DELAY  ( ( ( 1 << ( TIMER_SLOT_BITS * TIMER_LEVELS ) ) - 1 ) * TIMER_RESOLUTION )
+
+typedef void (*TimerCallback)( void *context );
+
+/* A timer, embedded in the object that owns it so scheduling never allocates. */
+struct wheel_timer_t {
+	struct wheel_timer_t *mNext;
+	struct wheel_timer_t *mPrev;
+	uint32_t              mExpires;
+	TimerCallback         mCallback;
+	void                 *mContext;
+
+	/* Initializes an unscheduled timer. */
+	wheel_timer_t(): mNext( NULL ), mPrev( NULL ), mExpires( 0 ), mCallback( NULL ), mContext( NULL ) { }
+
+	inline bool IsScheduled() const { return ( mNext != NULL ); }
+};
+typedef struct wheel_timer_t Timer;
+
+/* Hierarchical timer wheel. Scheduling and cancelling a timer are O(1), 
+ * timers far in the future are cascaded down to the finer levels as
+ * the wheel turns, so advancing never has to look at every timer. */
+class TimerWheel {
+public:
+	TimerWheel();
+
+	void Schedule( Timer *timer, uint32_t delay, TimerCallback callback, void *context );
+	void Cancel( Timer *timer );
+	void Advance( uint32_t tick );
+
+	inline uint32_t GetCount() const { return mCount; }
+
+private:
+	void     Insert( Timer *timer );
+	uint32_t Cascade( uint32_t level, uint32_t index );
+
+	Timer    mSlots[TIMER_LEVELS][TIMER_SLOTS];
+	uint32_t mCurrent;    /* Next wheel tick to process. */
+	uint32_t mDue;        /* Last wheel tick that is due. */
+	uint32_t mLastTick;   /* Tick (ms) of the last call to Advance(). */
+	uint32_t mRemainder;  /* Milliseconds that did not make a whole wheel tick yet. */
+	uint32_t mCount;
+	bool     mStarted;
+};
+
+extern TimerWheel Timers;
+
+#endif /* __SOLDIN_TIMERWHEEL_H__ */
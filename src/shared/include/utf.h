@@ -0,0 +1,74 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_UTF_H__
+#define __SOLDIN_UTF_H__
+
+#include <shared.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+/* Size (in characters) of the per-thread buffers used by UTF8() and UTF16(). */
+#define UTF_BUFFER_SIZE 1025
+
+/* Replacement for malformed input. */
+#define UTF_REPLACEMENT 0xFFFD
+
+/* The ASCII fast path needs SSE2 and 16-bit wchar_t, which is what Windows has. */
+#if ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __SSE2__ ) ) && WCHAR_MAX == 0xFFFF
+#	define UTF_SSE2
+#endif
+
+/* Converts UTF-8 to UTF-16. At most size - 1 units are written followed by a
+ * terminator, output is only cut between two characters. Returns the number 
+ * of units written, not counting the terminator. */
+size_t Utf8ToUtf16( const char *src, size_t len, uint16_t *dest, size_t size );
+
+/* Converts UTF-16 to UTF-8, with the same rules as Utf8ToUtf16. */
+size_t Utf16ToUtf8( const uint16_t *src, size_t len, char *dest, size_t size );
+
+/* Gets the length (in units) of a terminated UTF-16 string. */
+size_t Utf16Length( const uint16_t *str );
+
+extern THREAD_LOCAL char    __utf8_buff[UTF_BUFFER_SIZE];
+extern THREAD_LOCAL wchar_t __utf16_buff[UTF_BUFFER_SIZE];
+
+/* Converts a specified UTF-16 string to UTF-8, the result is valid until the next call on this thread. */
+inline const char *UTF8( const wchar_t *instr )
+{
+	const uint16_t *str = (const uint16_t *)instr;
+	Utf16ToUtf8( str, Utf16Length( str ), __utf8_buff, UTF_BUFFER_SIZE );
+	return __utf8_buff;
+}
+
+/* Converts a specified UTF-8 string to UTF-16, the result is valid until the next call on this thread. */
+inline const wchar_t *UTF16( const char *instr )
+{
+	Utf8ToUtf16( instr, strlen( instr ), (uint16_t *)__utf16_buff, UTF_BUFFER_SIZE );
+	return __utf16_buff;
+}
+
+#endif /* __SOLDIN_UTF_H__ */
@@ -0,0 +1,175 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <inventory.h>
+
+/* Initializes a new instance of the Inventory class. */
+Inventory::Inventory( uint8_t bag_count ): 
+	mSlots( NULL ), 
+	mCount( 0 ), 
+	mCapacity( 0 ), 
+	mItemCount( 0 ), 
+	mBagCount( bag_count ), 
+	mVersion( 0 )
+{
+}
+
+/* Releases all resources used by the inventory. */
+Inventory::~Inventory()
+{
+	if ( mSlots != NULL ) free( mSlots );
+}
+
+/* Returns the index of the slot with the specified key, or -( insert position ) - 1 if there is none. */
+int Inventory::Find( uint16_t key ) const
+{
+	int low  = 0;
+	int high = (int)mCount - 1;
+	while ( low <= high )
+	{
+		int mid = ( low + high ) >> 1;
+		if ( mSlots[mid].mKey < key )
+			low = mid + 1;
+		else if ( mSlots[mid].mKey > key )
+			high = mid - 1;
+		else
+			return mid;
+	}
+	return -low - 1;
+}
+
+/* Returns the item in a slot, or NULL if the slot is empty. */
+const ItemInfo *Inventory::Get( uint8_t bag, uint8_t slot ) const
+{
+	if ( !IsValid( bag, slot ) )
+		return NULL;
+
+	int index = Find( bag * BAG_SIZE + slot );
+	if ( index < 0 || mSlots[index].mItem.mItemId == 0 )
+		return NULL;
+
+	return &mSlots[index].mItem;
+}
+
+/* Puts an item in a slot, replacing whatever was there. Returns false if the slot does not exist. */
+bool Inventory::Set( uint8_t bag, uint8_t slot, const ItemInfo &item )
+{
+	if ( !IsValid( bag, slot ) )
+		return false;
+
+	if ( item.mItemId == 0 )
+		return Clear( bag, slot );
+
+	uint16_t key   = bag * BAG_SIZE + slot;
+	int      index = Find( key );
+	if ( index < 0 )
+	{
+		index = -index - 1;
+		if ( mCount == mCapacity )
+		{
+			uint16_t       capacity = mCapacity + INVENTORY_GROW;
+			InventorySlot *slots    = (InventorySlot *)realloc( mSlots, capacity * sizeof( InventorySlot ) );
+			if ( slots == NULL )
+				return false;
+
+			mSlots    = slots;
+			mCapacity = capacity;
+		}
+
+		memmove( &mSlots[index + 1], &mSlots[index], ( mCount - index ) * sizeof( InventorySlot ) );
+		mSlots[index].mKey = key;
+		mSlots[index].mItem.mItemId = 0;
+		mCount++;
+	}
+
+	if ( mSlots[index].mItem.mItemId == 0 )
+		mItemCount++;
+
+	mSlots[index].mItem    = item;
+	mSlots[index].mVersion = ++mVersion;
+	return true;
+}
+
+/* Empties a slot. Returns false if there was nothing in it. */
+bool Inventory::Clear( uint8_t bag, uint8_t slot )
+{
+	if ( !IsValid( bag, slot ) )
+		return false;
+
+	int index = Find( bag * BAG_SIZE + slot );
+	if ( index < 0 || mSlots[index].mItem.mItemId == 0 )
+		return false;
+
+	/* The slot stays around so the change can be send to the client. */
+	memset( &mSlots[index].mItem, 0, sizeof( ItemInfo ) );
+	mSlots[index].mVersion = ++mVersion;
+	mItemCount--;
+	return true;
+}
+
+/* Forgets the emptied slots that changed at or before the specified version. */
+void Inventory::Purge( uint32_t version )
+{
+	uint16_t kept = 0;
+	for ( uint16_t i = 0; i < mCount; i++ )
+	{
+		if ( mSlots[i].mItem.mItemId == 0 && mSlots[i].mVersion <= version )
+			continue;
+
+		if ( kept != i )
+			mSlots[kept] = mSlots[i];
+		kept++;
+	}
+	mCount = kept;
+}
+
+/* Moves an item to another slot, possibly in another inventory. An item in the destination swaps places with it. */
+bool Inventory::Move( Inventory &src, uint8_t src_bag, uint8_t src_slot, Inventory &dest, uint8_t dest_bag, uint8_t dest_slot )
+{
+	if ( !dest.IsValid( dest_bag, dest_slot ) || ( &src == &dest && src_bag == dest_bag && src_slot == dest_slot ) )
+		return false;
+
+	const ItemInfo *source = src.Get( src_bag, src_slot );
+	if ( source == NULL )
+		return false;
+
+	/* Copies, because inserting a slot can move the storage around. */
+	ItemInfo        moved  = *source;
+	ItemInfo        swapped;
+	const ItemInfo *target = dest.Get( dest_bag, dest_slot );
+	bool            swap   = ( target != NULL );
+	if ( swap )
+		swapped = *target;
+
+	if ( !dest.Set( dest_bag, dest_slot, moved ) )
+		return false;
+
+	if ( swap )
+		src.Set( src_bag, src_slot, swapped );
+	else
+		src.Clear( src_bag, src_slot );
+
+	return true;
+}
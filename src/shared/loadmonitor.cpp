@@ -0,0 +1,87 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <loadmonitor.h>
+
+LARGE_INTEGER LoadMonitor::mFrequency;
+LARGE_INTEGER LoadMonitor::mTickStart;
+uint32_t      LoadMonitor::mTickTime     = 0;
+uint32_t      LoadMonitor::mLastTickTime = 0;
+HANDLE        LoadMonitor::mThread       = NULL;
+ULONGLONG     LoadMonitor::mLastCpuTime  = 0;
+ULONGLONG     LoadMonitor::mLastWallTime = 0;
+
+/* Converts a FILETIME to a 64-bit integer. */
+static ULONGLONG FileTimeToInt( const FILETIME &ft )
+{
+	return ( ( (ULONGLONG)ft.dwHighDateTime ) << 32 ) | ft.dwLowDateTime;
+}
+
+/* Marks the start of a tick. */
+void LoadMonitor::BeginTick()
+{
+	if ( mFrequency.QuadPart == 0 )
+		QueryPerformanceFrequency( &mFrequency );
+
+	/* The thread that runs the ticks is the one that is measured, a real handle is kept since GetCurrentThread is only valid on it. */
+	if ( mThread == NULL )
+		DuplicateHandle( GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &mThread, THREAD_QUERY_INFORMATION, FALSE, 0 );
+
+	QueryPerformanceCounter( &mTickStart );
+}
+
+/* Marks the end of a tick and updates the average tick time. */
+void LoadMonitor::EndTick()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter( &now );
+
+	uint32_t elapsed = (uint32_t)( ( ( now.QuadPart - mTickStart.QuadPart ) * 1000000 ) / mFrequency.QuadPart );
+
+	mLastTickTime = elapsed;
+	mTickTime     = mTickTime + ( (int)( elapsed - mTickTime ) / LOAD_TICK_SMOOTHING );
+}
+
+/* Gets the CPU usage of the main loop thread (in percent of one core) since the last call. */
+uint32_t LoadMonitor::GetCpuUsage()
+{
+	/* The main loop runs on a single thread, so a saturated square uses one core whatever the machine has. */
+	FILETIME creation, exit, kernel, user, wall;
+	if ( mThread == NULL || !GetThreadTimes( mThread, &creation, &exit, &kernel, &user ) )
+		return 0;
+
+	GetSystemTimeAsFileTime( &wall );
+
+	ULONGLONG cpu_time  = FileTimeToInt( kernel ) + FileTimeToInt( user );
+	ULONGLONG wall_time = FileTimeToInt( wall );
+
+	uint32_t usage = 0;
+	if ( mLastWallTime != 0 && wall_time > mLastWallTime )
+		usage = (uint32_t)( ( ( cpu_time - mLastCpuTime ) * 100 ) / ( wall_time - mLastWallTime ) );
+
+	mLastCpuTime  = cpu_time;
+	mLastWallTime = wall_time;
+	return MIN( usage, 100 );
+}
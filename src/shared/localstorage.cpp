@@ -0,0 +1,745 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <localstorage.h>
+#include <log.h>
+#include <string.h>
+#include <io.h>
+
+/* Reads a name written with WriteString() into a 33 character array. */
+static void ReadName( Buffer &record, char *dest )
+{
+	record.ReadString( dest, 33 );
+	dest[32] = 0;
+}
+
+/* Copies a name into a 33 character array. */
+static void CopyName( char *dest, const char *name )
+{
+	strncpy( dest, name, 32 );
+	dest[32] = 0;
+}
+
+/* Opens the log file, it is created if it does not exist yet. */
+LocalStorage::LocalStorage( const char *path ): 
+	mPath  ( _strdup( path ) ), 
+	mFile  ( NULL ), 
+	mOffset( 0 ), 
+	mBatch ( false ),
+	mError ( NULL )
+{
+	memset( mMaxIds, 0, sizeof( mMaxIds ) );
+	InitializeCriticalSection( &mLock );
+}
+
+/* Closes the log file. */
+LocalStorage::~LocalStorage()
+{
+	if ( mFile != NULL )
+		fclose( mFile );
+
+	DeleteCriticalSection( &mLock );
+	free( mPath );
+}
+
+/* Opens the log and replays it, the first call does the work, threads need nothing of their own. */
+bool LocalStorage::Connect()
+{
+	EnterCriticalSection( &mLock );
+
+	if ( mFile == NULL )
+	{
+		mFile = fopen( mPath, "a+b" );
+		if ( mFile == NULL )
+		{
+			mError = "unable to open the storage file";
+			LeaveCriticalSection( &mLock );
+			return false;
+		}
+
+		Refresh();
+		ServerLog.Write( "Local storage %s holds %u accounts and %u characters.\n", E_INFO, mPath, mAccounts.size(), mCharacters.size() );
+	}
+
+	LeaveCriticalSection( &mLock );
+	return true;
+}
+
+/* Writes the last error to the error log. */
+void LocalStorage::LogError()
+{
+	ErrorLog.Write( "Storage Error: %s (%s)\n", E_ERROR, ( mError != NULL ) ? mError : "none", mPath );
+}
+
+/* Applies the records that were added to the log since the last call, by this or another process. */
+void LocalStorage::Refresh()
+{
+	fseek( mFile, 0, SEEK_END );
+	long end = ftell( mFile );
+	if ( end <= mOffset )
+		return;
+
+	fseek( mFile, mOffset, SEEK_SET );
+
+	Buffer data;
+	char   chunk[LOCAL_READ_SIZE];
+	size_t read;
+
+	while ( mOffset < end && ( read = fread( chunk, 1, MIN( (long)sizeof( chunk ), end - mOffset ), mFile ) ) > 0 )
+	{
+		data.Write( chunk, read );
+
+		/* Apply every complete record, a partial one waits for the rest of its bytes. */
+		while ( data.Size() - data.Tell() >= LOCAL_REC_HEADER )
+		{
+			size_t   start  = data.Tell();
+			uint16_t length = data.ReadUInt16();
+			uint8_t  type   = data.ReadByte();
+
+			if ( data.Size() - data.Tell() < length )
+			{
+				data.Seek( start );
+				break;
+			}
+
+			Apply( type, data );
+			data.Seek( start + LOCAL_REC_HEADER + length );
+			mOffset += LOCAL_REC_HEADER + length;
+		}
+
+		data.Drain( data.Tell() );
+	}
+
+	/* Writing right after reading needs a seek in between. */
+	fseek( mFile, 0, SEEK_END );
+}
+
+/* Drops a record at the end of the log that was cut off by a crash, so new records
+ * follow the last complete one. Readers leave it alone, it might still be written. */
+void LocalStorage::Trim()
+{
+	Refresh();
+
+	long end = ftell( mFile );
+	if ( end > mOffset )
+	{
+		ErrorLog.Write( "Dropping %d bytes of an incomplete record at the end of %s\n", E_WARNING, (int)( end - mOffset ), mPath );
+		fflush( mFile );
+		_chsize( _fileno( mFile ), mOffset );
+		fseek( mFile, 0, SEEK_END );
+	}
+}
+
+/* Writes a record to the log and applies it. */
+bool LocalStorage::Append( uint8_t type, const Buffer &record )
+{
+	/* Seeking flushes the file, so a batch only does this once, in BeginBatch(). */
+	if ( !mBatch )
+		Trim();
+
+	uint16_t length = (uint16_t)record.Size();
+
+	Buffer header;
+	header.WriteUInt16( length );
+	header.WriteByte( type );
+
+	if ( fwrite( header.Content(), LOCAL_REC_HEADER, 1, mFile ) != 1 || fwrite( record.Content(), length, 1, mFile ) != 1 )
+	{
+		mError = "unable to write to the storage file";
+		LogError();
+		return false;
+	}
+
+	/* Batches are flushed as a whole, a single change is on disk before the call returns. */
+	if ( !mBatch )
+		fflush( mFile );
+
+	mOffset += LOCAL_REC_HEADER + length;
+
+	Buffer copy( record.Content(), length );
+	Apply( type, copy );
+	return true;
+}
+
+/* Applies a single record to the index. */
+void LocalStorage::Apply( uint8_t type, Buffer &record )
+{
+	switch ( type )
+	{
+		case LOCAL_REC_ACCOUNT:
+		{
+			uint32_t id = record.ReadUInt32();
+
+			/* The name index points into the account, so the old name has to go first. */
+			std::map<uint32_t, LocalAccount>::iterator i = mAccounts.find( id );
+			if ( i != mAccounts.end() )
+				mAccountNames.erase( i->second.mName );
+
+			LocalAccount &account = mAccounts[id];
+			account.mId = id;
+			ReadName( record, account.mName );
+			size_t length = record.ReadString( account.mPassword, ACCOUNT_PASSWORD_SIZE - 1 );
+			account.mPassword[length] = 0;
+			account.mMaxChars = record.ReadUInt32();
+			account.mStatus   = record.ReadByte();
+			account.mGmLevel  = record.ReadUInt32();
+
+			mAccountNames[account.mName] = id;
+			mMaxIds[type] = MAX( mMaxIds[type], id );
+			break;
+		}
+		case LOCAL_REC_ACCOUNT_LICENSE:
+		{
+			uint32_t account_id = record.ReadUInt32();
+			uint32_t class_id   = record.ReadUInt32();
+
+			std::map<uint32_t, LocalAccount>::iterator i = mAccounts.find( account_id );
+			if ( i != mAccounts.end() )
+				i->second.mLicenses.push_back( class_id );
+			break;
+		}
+		case LOCAL_REC_CHARACTER:
+			ApplyCharacter( record );
+			break;
+
+		case LOCAL_REC_CHARACTER_DELETE:
+			ApplyCharacterDelete( record.ReadUInt32() );
+			break;
+
+		case LOCAL_REC_BAG:
+		{
+			uint32_t   char_id = record.ReadUInt32();
+			BagLicense bag;
+			bag.mId      = record.ReadUInt32();
+			bag.mIndex   = record.ReadByte();
+			bag.mStatus  = record.ReadByte();
+			bag.mExpires = record.ReadUInt32();
+
+			std::map<uint32_t, LocalCharacter>::iterator i = mCharacters.find( char_id );
+			if ( i != mCharacters.end() )
+				i->second.mBags.push_back( bag );
+
+			mMaxIds[type] = MAX( mMaxIds[type], bag.mId );
+			break;
+		}
+		case LOCAL_REC_ITEM:
+		{
+			uint32_t  char_id = record.ReadUInt32();
+			LocalItem item;
+			item.mItem.mId     = record.ReadUInt32();
+			item.mType         = record.ReadByte();
+			item.mBag          = record.ReadByte();
+			item.mSlot         = record.ReadByte();
+			item.mItem.mItemId = record.ReadUInt32();
+			item.mItem.mAmount = record.ReadUInt32();
+
+			std::map<uint32_t, LocalCharacter>::iterator i = mCharacters.find( char_id );
+			if ( i != mCharacters.end() )
+				i->second.mItems.push_back( item );
+
+			mMaxIds[type] = MAX( mMaxIds[type], (uint32_t)item.mItem.mId );
+			break;
+		}
+		default:
+			ErrorLog.Write( "Unknown record type %d in %s\n", E_WARNING, type, mPath );
+			break;
+	}
+}
+
+/* Adds or replaces a character. */
+void LocalStorage::ApplyCharacter( Buffer &record )
+{
+	uint32_t id      = record.ReadUInt32();
+	bool     created = true;
+
+	std::map<uint32_t, LocalCharacter>::iterator i = mCharacters.find( id );
+	if ( i != mCharacters.end() )
+	{
+		mCharacterNames.erase( i->second.mName );
+		created = false;
+	}
+
+	LocalCharacter &c = mCharacters[id];
+	c.mId = id;
+
+	uint32_t account_id = record.ReadUInt32();
+	ReadName( record, c.mName );
+	c.mClassId       = record.ReadUInt32();
+	c.mLevel         = record.ReadUInt16();
+	c.mExperience    = record.ReadUInt32();
+	c.mPvpLevel      = record.ReadUInt16();
+	c.mPvpExperience = record.ReadUInt32();
+	c.mWarLevel      = record.ReadUInt16();
+	c.mWarExperience = record.ReadUInt32();
+	c.mRebirthLevel  = record.ReadUInt16();
+	c.mRebirthCount  = record.ReadUInt16();
+	c.mLastPlayed    = record.ReadUInt32();
+	c.mMoney         = record.ReadUInt32();
+	c.mBankMoney     = record.ReadUInt32();
+
+	/* Only new characters are added to the list of their account. */
+	if ( created )
+	{
+		c.mAccountId = account_id;
+
+		std::map<uint32_t, LocalAccount>::iterator a = mAccounts.find( account_id );
+		if ( a != mAccounts.end() )
+			a->second.mCharacters.push_back( id );
+	}
+
+	mCharacterNames[c.mName] = id;
+	mMaxIds[LOCAL_REC_CHARACTER] = MAX( mMaxIds[LOCAL_REC_CHARACTER], id );
+}
+
+/* Removes a character with its bags and items. */
+void LocalStorage::ApplyCharacterDelete( uint32_t char_id )
+{
+	std::map<uint32_t, LocalCharacter>::iterator c = mCharacters.find( char_id );
+	if ( c == mCharacters.end() )
+		return;
+
+	std::map<uint32_t, LocalAccount>::iterator a = mAccounts.find( c->second.mAccountId );
+	if ( a != mAccounts.end() )
+	{
+		std::vector<uint32_t> &list = a->second.mCharacters;
+		for ( std::vector<uint32_t>::iterator i = list.begin(); i != list.end(); ++i )
+		{
+			if ( *i == char_id )
+			{
+				list.erase( i );
+				break;
+			}
+		}
+	}
+
+	mCharacterNames.erase( c->second.mName );
+	mCharacters.erase( c );
+}
+
+/* Copies the summary of a character. */
+void LocalStorage::ToCharacterData( const LocalCharacter &c, CharacterData *info )
+{
+	memcpy( info->mName, c.mName, sizeof( info->mName ) );
+
+	info->mId             = c.mId;
+	info->mClassId        = c.mClassId;
+	info->mLevel          = c.mLevel;
+	info->mExperience     = c.mExperience;
+	info->mPvpLevel       = c.mPvpLevel;
+	info->mPvpExperience  = c.mPvpExperience;
+	info->mWarLevel       = c.mWarLevel;
+	info->mWarExperience  = c.mWarExperience;
+	info->mRebirthLevel   = c.mRebirthLevel;
+	info->mRebirthCount   = c.mRebirthCount;
+	info->mLastPlayed     = c.mLastPlayed;
+	info->mEquipmentCount = 0;
+
+	#if defined( _SQUARE )
+	info->mMoney          = c.mMoney;
+	info->mBankMoney      = c.mBankMoney;
+	#endif
+}
+
+/* Gets all the characters that belong to the specified account. */
+uint32_t LocalStorage::Character_GetList( uint32_t account_id, CharacterList &list )
+{
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	uint32_t numchars = 0;
+
+	std::map<uint32_t, LocalAccount>::iterator a = mAccounts.find( account_id );
+	if ( a != mAccounts.end() )
+	{
+		std::vector<uint32_t> &ids = a->second.mCharacters;
+		for ( size_t i = 0; i < ids.size() && numchars < MAX_CHARACTERS; i++ )
+		{
+			CharacterData *chara = new CharacterData();
+			ToCharacterData( mCharacters[ids[i]], chara );
+
+			list.push_back( chara );
+			numchars++;
+		}
+	}
+
+	LeaveCriticalSection( &mLock );
+	return numchars;
+}
+
+/* Deletes the character with the specified ID. */
+void LocalStorage::Character_Delete( uint32_t char_id )
+{
+	Buffer record;
+	record.WriteUInt32( char_id );
+
+	EnterCriticalSection( &mLock );
+	Append( LOCAL_REC_CHARACTER_DELETE, record );
+	LeaveCriticalSection( &mLock );
+}
+
+/* Retrieves the details of the character with the specified ID. */
+CharacterData *LocalStorage::Character_Load( uint32_t char_id, CharacterData *info )
+{
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	std::map<uint32_t, LocalCharacter>::iterator c = mCharacters.find( char_id );
+	if ( c == mCharacters.end() )
+	{
+		LeaveCriticalSection( &mLock );
+		return NULL;
+	}
+
+	if ( info == NULL )
+	{
+		info = new CharacterData();
+	}
+
+	ToCharacterData( c->second, info );
+
+	#if defined( _SQUARE )
+	info->mLicenseCount = 0;
+
+	std::vector<BagLicense> &bags = c->second.mBags;
+	for ( size_t i = 0; i < bags.size() && info->mLicenseCount < MAX_BAG_LICENSES; i++ )
+		info->mLicenses[info->mLicenseCount++] = bags[i];
+	#endif
+
+	LeaveCriticalSection( &mLock );
+	return info;
+}
+
+/* Fills an inventory with the items of the specified type. */
+void LocalStorage::LoadItems( uint32_t char_id, uint8_t type, Inventory *inventory )
+{
+#if defined( _SQUARE )
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	std::map<uint32_t, LocalCharacter>::iterator c = mCharacters.find( char_id );
+	if ( c != mCharacters.end() )
+	{
+		std::vector<LocalItem> &items = c->second.mItems;
+		for ( size_t i = 0; i < items.size(); i++ )
+		{
+			if ( items[i].mType != type )
+				continue;
+
+			if ( !inventory->Set( items[i].mBag, items[i].mSlot, items[i].mItem ) )
+				ErrorLog.Write( "Item %u of character %u is in invalid slot %d:%d\n", E_WARNING, (uint32_t)items[i].mItem.mId, char_id, items[i].mBag, items[i].mSlot );
+		}
+	}
+
+	LeaveCriticalSection( &mLock );
+#endif
+}
+
+/* Loads the inventory of the specified character. */
+void LocalStorage::Character_LoadInventory( CharacterData *c )
+{
+#if defined( _SQUARE )
+	if ( c == NULL || c->mId == 0 || c->mInventory != NULL ) return;
+
+	c->mInventory = new Inventory( MAX_BAGS );
+	LoadItems( c->mId, 0, c->mInventory );
+#endif
+}
+
+/* Loads the bank of the specified character. */
+void LocalStorage::Character_LoadBank( CharacterData *c )
+{
+#if defined( _SQUARE )
+	if ( c == NULL || c->mId == 0 || c->mBank != NULL ) return;
+
+	c->mBank = new Inventory( MAX_BANK_BOXES );
+	LoadItems( c->mId, 1, c->mBank );
+#endif
+}
+
+/* Checks if a characters with the specified name exists. */
+bool LocalStorage::Character_Exists( const char *name )
+{
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	bool exists = ( mCharacterNames.find( name ) != mCharacterNames.end() );
+
+	LeaveCriticalSection( &mLock );
+	return exists;
+}
+
+/* Creates a new character, names are unique. */
+uint32_t LocalStorage::Character_Create( uint32_t account_id, uint32_t class_id, const char *name )
+{
+	LocalCharacter c;
+	c.mAccountId     = account_id;
+	c.mClassId       = class_id;
+	c.mLastPlayed    = 0;
+	c.mLevel         = 1;
+	c.mExperience    = 0;
+	c.mPvpLevel      = 1;
+	c.mPvpExperience = 0;
+	c.mWarLevel      = 1;
+	c.mWarExperience = 0;
+	c.mRebirthLevel  = 0;
+	c.mRebirthCount  = 0;
+	c.mMoney         = 0;
+	c.mBankMoney     = 0;
+	CopyName( c.mName, name );
+
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	uint32_t char_id = 0;
+	if ( mCharacterNames.find( c.mName ) == mCharacterNames.end() )
+	{
+		c.mId = mMaxIds[LOCAL_REC_CHARACTER] + 1;
+		PutCharacter( account_id, c );
+
+		if ( mCharacters.find( c.mId ) != mCharacters.end() )
+			char_id = c.mId;
+	}
+	else mError = "a character with this name already exists";
+
+	LeaveCriticalSection( &mLock );
+	return char_id;
+}
+
+/* Passes the name of every character to the callback, and returns how many there were. */
+uint32_t LocalStorage::Character_ScanNames( NameCallback callback, void *context )
+{
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	uint32_t count = 0;
+	for ( LocalNameIndex::iterator i = mCharacterNames.begin(); i != mCharacterNames.end(); i++, count++ )
+		callback( i->first, context );
+
+	LeaveCriticalSection( &mLock );
+	return count;
+}
+
+/* Loads the account with the specified name. */
+AccountInfo *LocalStorage::Account_Load( const char *account_name, AccountInfo *account, bool load_charlist )
+{
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	LocalNameIndex::iterator i = mAccountNames.find( account_name );
+	uint32_t account_id = ( i != mAccountNames.end() ) ? i->second : 0;
+
+	LeaveCriticalSection( &mLock );
+
+	if ( account_id == 0 )
+		return NULL;
+
+	return Account_Load( account_id, account, load_charlist );
+}
+
+/* Loads the account with the specified id. */
+AccountInfo *LocalStorage::Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist )
+{
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	std::map<uint32_t, LocalAccount>::iterator a = mAccounts.find( account_id );
+	if ( a == mAccounts.end() )
+	{
+		LeaveCriticalSection( &mLock );
+		return NULL;
+	}
+
+	if ( account == NULL )
+	{
+		account = new AccountInfo();
+	}
+
+	const LocalAccount &stored = a->second;
+	account->mId       = stored.mId;
+	account->mMaxChars = stored.mMaxChars;
+	account->mStatus   = stored.mStatus;
+	account->mGmLevel  = stored.mGmLevel;
+
+	memcpy( account->mName, stored.mName, sizeof( account->mName ) );
+	memcpy( account->mPassword, stored.mPassword, sizeof( account->mPassword ) );
+
+	account->mLicenseCount = 0;
+	for ( size_t i = 0; i < stored.mLicenses.size() && account->mLicenseCount < MAX_CHARACTER_LICENSES; i++ )
+		account->mLicenses[account->mLicenseCount++] = stored.mLicenses[i];
+
+	LeaveCriticalSection( &mLock );
+
+	/* Get the characters. */
+	if ( load_charlist )
+	{
+		Character_GetList( account->mId, account->mCharacters );
+	}
+
+	return account;
+}
+
+/* Replaces the stored password of an account, the account is written again with it. */
+bool LocalStorage::Account_SetPassword( uint32_t account_id, const char *password )
+{
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	std::map<uint32_t, LocalAccount>::iterator a = mAccounts.find( account_id );
+	if ( a == mAccounts.end() )
+	{
+		LeaveCriticalSection( &mLock );
+		return false;
+	}
+
+	const LocalAccount &stored = a->second;
+
+	Buffer record;
+	record.WriteUInt32( stored.mId );
+	record.WriteString( stored.mName );
+	record.WriteString( password );
+	record.WriteUInt32( stored.mMaxChars );
+	record.WriteByte( stored.mStatus );
+	record.WriteUInt32( stored.mGmLevel );
+
+	bool written = Append( LOCAL_REC_ACCOUNT, record );
+	LeaveCriticalSection( &mLock );
+	return written;
+}
+
+/* Adds an account, or replaces the one with the same ID. */
+void LocalStorage::PutAccount( const AccountInfo &account )
+{
+	Buffer record;
+	record.WriteUInt32( account.mId );
+	record.WriteString( account.mName );
+	record.WriteString( account.mPassword );
+	record.WriteUInt32( account.mMaxChars );
+	record.WriteByte( account.mStatus );
+	record.WriteUInt32( account.mGmLevel );
+
+	EnterCriticalSection( &mLock );
+	Append( LOCAL_REC_ACCOUNT, record );
+	LeaveCriticalSection( &mLock );
+}
+
+/* Gives an account the license for a character class. */
+void LocalStorage::PutAccountLicense( uint32_t account_id, uint32_t class_id )
+{
+	Buffer record;
+	record.WriteUInt32( account_id );
+	record.WriteUInt32( class_id );
+
+	EnterCriticalSection( &mLock );
+	Append( LOCAL_REC_ACCOUNT_LICENSE, record );
+	LeaveCriticalSection( &mLock );
+}
+
+/* Adds a character or replaces the summary of an existing one, the bags and items are added separately. */
+void LocalStorage::PutCharacter( uint32_t account_id, const LocalCharacter &c )
+{
+	Buffer record;
+	record.WriteUInt32( c.mId );
+	record.WriteUInt32( account_id );
+	record.WriteString( c.mName );
+	record.WriteUInt32( c.mClassId );
+	record.WriteUInt16( c.mLevel );
+	record.WriteUInt32( c.mExperience );
+	record.WriteUInt16( c.mPvpLevel );
+	record.WriteUInt32( c.mPvpExperience );
+	record.WriteUInt16( c.mWarLevel );
+	record.WriteUInt32( c.mWarExperience );
+	record.WriteUInt16( c.mRebirthLevel );
+	record.WriteUInt16( c.mRebirthCount );
+	record.WriteUInt32( c.mLastPlayed );
+	record.WriteUInt32( c.mMoney );
+	record.WriteUInt32( c.mBankMoney );
+
+	EnterCriticalSection( &mLock );
+	Append( LOCAL_REC_CHARACTER, record );
+	LeaveCriticalSection( &mLock );
+}
+
+/* Gives a character the license for a bag. */
+void LocalStorage::PutBag( uint32_t char_id, const BagLicense &bag )
+{
+	Buffer record;
+	record.WriteUInt32( char_id );
+	record.WriteUInt32( bag.mId );
+	record.WriteByte( bag.mIndex );
+	record.WriteByte( bag.mStatus );
+	record.WriteUInt32( (uint32_t)bag.mExpires );
+
+	EnterCriticalSection( &mLock );
+	Append( LOCAL_REC_BAG, record );
+	LeaveCriticalSection( &mLock );
+}
+
+/* Adds an item to the bags or bank of a character. */
+void LocalStorage::PutItem( uint32_t char_id, const LocalItem &item )
+{
+	Buffer record;
+	record.WriteUInt32( char_id );
+	record.WriteUInt32( (uint32_t)item.mItem.mId );
+	record.WriteByte( item.mType );
+	record.WriteByte( item.mBag );
+	record.WriteByte( item.mSlot );
+	record.WriteUInt32( item.mItem.mItemId );
+	record.WriteUInt32( item.mItem.mAmount );
+
+	EnterCriticalSection( &mLock );
+	Append( LOCAL_REC_ITEM, record );
+	LeaveCriticalSection( &mLock );
+}
+
+/* Stops flushing the log after every change, for adding a lot of data at once. */
+void LocalStorage::BeginBatch()
+{
+	EnterCriticalSection( &mLock );
+	Trim();
+	mBatch = true;
+	LeaveCriticalSection( &mLock );
+}
+
+/* Writes everything added since BeginBatch() to disk. */
+void LocalStorage::EndBatch()
+{
+	EnterCriticalSection( &mLock );
+	mBatch = false;
+	if ( mFile != NULL )
+		fflush( mFile );
+	LeaveCriticalSection( &mLock );
+}
+
+/* Gets the highest ID used for the specified record type. */
+uint32_t LocalStorage::GetMaxId( uint8_t type )
+{
+	EnterCriticalSection( &mLock );
+	Refresh();
+
+	uint32_t id = ( type <= LOCAL_REC_ITEM ) ? mMaxIds[type] : 0;
+
+	LeaveCriticalSection( &mLock );
+	return id;
+}
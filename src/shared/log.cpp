@@ -25,6 +25,7 @@
  */
 #include <log.h>
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
 #include <console.h>
 
@@ -33,12 +34,40 @@
 Log ServerLog( "logs/gateway-server.log" );
 Log ErrorLog ( "logs/gateway-error.log"  );
 Log DebugLog ( "logs/gateway-debug.log"  );
+Log SlowLog  ( "logs/gateway-slow.log", false );
 #elif defined( _SQUARE )
 Log ServerLog( "logs/square-server.log"  );
 Log ErrorLog ( "logs/square-error.log"   );
 Log DebugLog ( "logs/square-debug.log"   );
+Log SlowLog  ( "logs/square-slow.log", false );
 #endif
 
+/* How important each error level is, messages below the configured level are not written. */
+static const int g_levelRank[] = { 
+	1,  /* E_INFO */
+	2,  /* E_NOTICE */
+	3,  /* E_WARNING */
+	4,  /* E_ERROR */
+	0,  /* E_DEBUG */
+	2   /* E_SUCCESS */
+};
+
+int Log::mMinRank = 0;
+
+/* Sets the least important level that is still written (debug, info, notice, warning or error). */
+void Log::SetLevel( const char *level )
+{
+	static const char *names[] = { "debug", "info", "notice", "warning", "error" };
+	for ( int i = 0; i < 5; i++ )
+	{
+		if ( _stricmp( level, names[i] ) == 0 )
+		{
+			mMinRank = i;
+			return;
+		}
+	}
+}
+
 /* Initializes a new instance of the Log class. */
 Log::Log( const char *file, bool verbose ): mVerbose( verbose )
 {
@@ -59,6 +88,9 @@ Log::~Log()
 /* Writes a text message to the log. */
 void Log::Write( const char *format, byte error_level, ... )
 {
+	if ( error_level <= E_SUCCESS && g_levelRank[error_level] < mMinRank )
+		return;
+
 	va_list vl;
 	va_start( vl, error_level );
 
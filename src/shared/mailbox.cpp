@@ -0,0 +1,135 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <mailbox.h>
+
+HANDLE        Mailbox::mWakeEvent = NULL;
+volatile LONG Mailbox::mSleeping  = 0;
+volatile LONG Mailbox::mPending   = 0;
+
+/* Initializes a new instance of the Mailbox class. */
+Mailbox::Mailbox(): mTail( 0 ), mHead( 0 )
+{
+	for ( LONG i = 0; i < MAILBOX_CAPACITY; i++ )
+		mCells[i].mSequence = i;
+}
+
+/* Forgets the messages that were never drained. */
+Mailbox::~Mailbox()
+{
+	if ( mTail != mHead )
+		InterlockedExchangeAdd( &mPending, -( mTail - mHead ) );
+}
+
+/* Posts a message, returns false if the mailbox is full. Safe to call from any thread. */
+bool Mailbox::Post( MailHandler handler, uint32_t param1, uint32_t param2, void *data )
+{
+	cell_t *cell;
+	LONG    pos = mTail;
+
+	for ( ;; )
+	{
+		cell = &mCells[pos & MAILBOX_MASK];
+
+		LONG diff = cell->mSequence - pos;
+		if ( diff == 0 )
+		{
+			/* The cell is free, claim it by moving the tail. */
+			LONG current = InterlockedCompareExchange( &mTail, pos + 1, pos );
+			if ( current == pos )
+				break;
+
+			pos = current;
+		}
+		else if ( diff < 0 )
+		{
+			return false;
+		}
+		else pos = mTail;
+	}
+
+	cell->mMail.mHandler = handler;
+	cell->mMail.mParam1  = param1;
+	cell->mMail.mParam2  = param2;
+	cell->mMail.mData    = data;
+
+	/* Publish the message to the consumer. */
+	InterlockedExchange( &cell->mSequence, pos + 1 );
+
+	/* Count the message before looking for a sleeper, Wait() looks in the opposite order. */
+	InterlockedIncrement( &mPending );
+
+	/* Wake the owning thread if it is waiting. */
+	if ( InterlockedCompareExchange( &mSleeping, 0, 1 ) == 1 )
+		SetEvent( mWakeEvent );
+
+	return true;
+}
+
+/* Runs the handlers of up to max pending messages, returns the number of messages handled. */
+uint32_t Mailbox::Drain( void *target, uint32_t max )
+{
+	Mail     batch[MAILBOX_BATCH];
+	uint32_t count = 0;
+
+	max = MIN( max, MAILBOX_BATCH );
+
+	/* Take the batch out first, handlers may post to this mailbox again. */
+	while ( count < max )
+	{
+		cell_t *cell = &mCells[mHead & MAILBOX_MASK];
+		if ( cell->mSequence - ( mHead + 1 ) < 0 )
+			break;
+
+		batch[count++] = cell->mMail;
+
+		/* Hand the cell back to the producers for the next round. */
+		InterlockedExchange( &cell->mSequence, mHead + MAILBOX_CAPACITY );
+		mHead++;
+	}
+
+	if ( count > 0 )
+		InterlockedExchangeAdd( &mPending, -(LONG)count );
+
+	for ( uint32_t i = 0; i < count; i++ )
+		batch[i].mHandler( target, &batch[i] );
+
+	return count;
+}
+
+/* Lets the owning thread sleep until it is either woken by a post or the timeout (ms) runs out. 
+ * The thread is marked as sleeping before the mailboxes are checked, so a message posted after 
+ * the check sees the mark and wakes it, and one posted before it is found by the check. */
+void Mailbox::Wait( uint32_t timeout )
+{
+	if ( mWakeEvent == NULL )
+		mWakeEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+
+	InterlockedExchange( &mSleeping, 1 );
+	if ( mPending == 0 )
+		WaitForSingleObject( mWakeEvent, timeout );
+
+	InterlockedExchange( &mSleeping, 0 );
+}
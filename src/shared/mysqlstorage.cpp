@@ -0,0 +1,638 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <mysqlstorage.h>
+#include <stdio.h>
+#include <log.h>
+#include <string.h>
+
+THREAD_LOCAL MYSQL        *MySqlStorage::mConns[MYSQL_MAX_NODES];
+THREAD_LOCAL uint32_t      MySqlStorage::mOpenCount  = 0;
+THREAD_LOCAL uint32_t      MySqlStorage::mQueryCount = 0;
+THREAD_LOCAL StatementCall MySqlStorage::mCall;
+volatile LONG              MySqlStorage::mNextSlot   = 0;
+
+static THREAD_LOCAL char sql[1024];
+
+/* Keeps the connection details, every thread connects on its own with Connect(). */
+MySqlStorage::MySqlStorage( const char *host, const char *user, const char *passwd, const char *db, uint16_t port ):
+	mHost    ( _strdup( host ) ),
+	mUser    ( _strdup( user ) ),
+	mPassword( _strdup( passwd ) ),
+	mDatabase( _strdup( db ) ),
+	mPort    ( port ),
+	mSlot    ( InterlockedIncrement( &mNextSlot ) - 1 )
+{
+}
+
+/* Closes the connection of the calling thread and frees the connection details. */
+MySqlStorage::~MySqlStorage()
+{
+	Disconnect();
+
+	free( mHost );
+	free( mUser );
+	free( mPassword );
+	free( mDatabase );
+}
+
+/* Opens a connection with the MySQL server for the calling thread. */
+bool MySqlStorage::Connect()
+{
+	if ( mSlot >= MYSQL_MAX_NODES )
+	{
+		ErrorLog.Write( "SQL Error: more than %d MySQL servers are in use.\n", E_ERROR, MYSQL_MAX_NODES );
+		return false;
+	}
+
+	MYSQL *&conn = mConns[mSlot];
+	if ( conn != NULL )
+	{
+		if ( mysql_ping( conn ) != 0 )
+		{
+			mysql_close( conn );
+			mOpenCount--;
+		}
+		else return true;
+	}
+
+	conn = mysql_init( NULL );
+	mOpenCount++;
+
+	if ( mysql_real_connect( conn, mHost, mUser, mPassword, mDatabase, mPort, NULL, 0 ) == NULL )
+	{
+		return false;
+	}
+	return true;
+}
+
+/* Closes the connection of this thread with the MySQL server. */
+void MySqlStorage::Disconnect()
+{
+	if ( mSlot >= MYSQL_MAX_NODES || mConns[mSlot] == NULL )
+		return;
+
+	mysql_close( mConns[mSlot] );
+	mConns[mSlot] = NULL;
+
+	/* The thread is done with MySQL once all of its connections are closed. */
+	if ( --mOpenCount == 0 )
+		mysql_thread_end();
+}
+
+/* Runs a query on the connection of this thread, timed as the specified statement. */
+int MySqlStorage::Query( const char *query, uint8_t statement )
+{
+	MYSQL *conn = mConns[mSlot];
+
+	mQueryCount++;
+	DBStats::Begin( mCall, statement, query );
+
+	/* A statement without a result set is done, the others are once StoreResult() fetched the rows. */
+	int result = mysql_query( conn, query );
+	if ( result != 0 )
+		DBStats::End( mCall, true, 0, (uint32_t)strlen( query ) );
+	else if ( mysql_field_count( conn ) == 0 )
+		DBStats::End( mCall, false, (uint32_t)mysql_affected_rows( conn ), (uint32_t)strlen( query ) );
+
+	return result;
+}
+
+/* Fetches the result of the last query and finishes its timing, with the rows and bytes it returned. */
+MYSQL_RES *MySqlStorage::StoreResult()
+{
+	MYSQL_RES *res   = mysql_store_result( mConns[mSlot] );
+	uint32_t   rows  = 0;
+	uint32_t   bytes = (uint32_t)strlen( mCall.mQuery );
+
+	if ( res != NULL )
+	{
+		rows = (uint32_t)mysql_num_rows( res );
+
+		/* Add up the length of every column, then rewind for the caller. */
+		unsigned int fields = mysql_num_fields( res );
+		while ( mysql_fetch_row( res ) != NULL )
+		{
+			unsigned long *lengths = mysql_fetch_lengths( res );
+			for ( unsigned int i = 0; i < fields; i++ )
+				bytes += lengths[i];
+		}
+		mysql_data_seek( res, 0 );
+	}
+
+	DBStats::End( mCall, res == NULL, rows, bytes );
+	return res;
+}
+
+/* Runs a query and gets the first column of the first row as a number. */
+int MySqlStorage::QueryInt( const char *query, int default_value )
+{
+	if ( Query( query ) != 0 )
+	{
+		LogError();
+		return default_value;
+	}
+
+	MYSQL_RES *res = StoreResult();
+	if ( res == NULL )
+		return default_value;
+
+	MYSQL_ROW row = mysql_fetch_row( res );
+	int value = ( row != NULL && row[0] != NULL ) ? atoi( row[0] ) : default_value;
+
+	mysql_free_result( res );
+	return value;
+}
+
+/* Gets how many seconds this server is behind its primary, or -1 when it is not replicating. */
+int MySqlStorage::GetReplicationLag()
+{
+	if ( Query( "SHOW SLAVE STATUS", STMT_REPLICATION_LAG ) != 0 )
+	{
+		LogError();
+		return -1;
+	}
+
+	MYSQL_RES *res = StoreResult();
+	if ( res == NULL )
+		return -1;
+
+	int       lag = -1;
+	MYSQL_ROW row = mysql_fetch_row( res );
+	if ( row != NULL )
+	{
+		/* The column is NULL while replication is stopped. */
+		MYSQL_FIELD *fields = mysql_fetch_fields( res );
+		for ( unsigned int i = 0; i < mysql_num_fields( res ); i++ )
+		{
+			if ( strcmp( fields[i].name, "Seconds_Behind_Master" ) == 0 && row[i] != NULL )
+				lag = atoi( row[i] );
+		}
+	}
+
+	mysql_free_result( res );
+	return lag;
+}
+
+/* Copies the summary columns of a sol_characters row into a character. */
+static void Character_ParseRow( MYSQL_ROW row, CharacterData *info )
+{
+	strncpy( info->mName, row[2], sizeof( info->mName ) - 1 );
+	info->mName[sizeof( info->mName ) - 1] = 0;
+
+	info->mId             = atoi( row[0]  );
+	info->mClassId        = atoi( row[3]  );
+	info->mLevel          = atoi( row[4]  );
+	info->mExperience     = atoi( row[5]  );
+	info->mPvpLevel       = atoi( row[6]  );
+	info->mPvpExperience  = atoi( row[7]  );
+	info->mWarLevel       = atoi( row[8]  );
+	info->mWarExperience  = atoi( row[9]  );
+	info->mRebirthLevel   = atoi( row[10] );
+	info->mRebirthCount   = atoi( row[11] );
+	info->mLastPlayed     = atol( row[12] );
+	info->mEquipmentCount = 0;
+
+	#if defined( _SQUARE )
+	info->mMoney          = atoi( row[13] );
+	info->mBankMoney      = atoi( row[14] );
+	#endif
+}
+
+/* Gets all the characters that belong to the specified account. */
+uint32_t MySqlStorage::Character_GetList( uint32_t account_id, CharacterList &list )
+{
+	if ( account_id == 0 )
+		return 0;
+
+	/* The summaries of all characters come back in a single round trip. */
+	sprintf( sql, "SELECT * FROM `sol_characters` WHERE `account_id` = %d LIMIT %d", account_id, MAX_CHARACTERS );
+	if ( Query( sql, STMT_CHARACTER_LIST ) != 0 )
+	{
+		LogError();
+		return 0;
+	}
+
+	MYSQL_RES *result = StoreResult();
+	if ( result == NULL )
+	{
+		LogError();
+		return 0;
+	}
+
+	uint32_t numchars = 0;
+
+	MYSQL_ROW row = NULL;
+	while ( row = mysql_fetch_row( result ) )
+	{
+		CharacterData *chara = new CharacterData();
+		Character_ParseRow( row, chara );
+
+		list.push_back( chara );
+		numchars++;
+	}
+	mysql_free_result( result );
+	return numchars;
+}
+
+/* Deletes the character with the specified ID. */
+void MySqlStorage::Character_Delete( uint32_t char_id )
+{
+	sprintf( sql, "DELETE FROM sol_characters WHERE id = %d", char_id );
+	if ( Query( sql, STMT_CHARACTER_DELETE ) != 0 )
+	{
+		LogError();
+	}
+}
+
+/* Retrieves the details of the character with the specified ID. */
+CharacterData *MySqlStorage::Character_Load( uint32_t char_id, CharacterData *info )
+{
+	sprintf( sql, "SELECT * FROM `sol_characters` WHERE `id` = %d", char_id );
+	if ( Query( sql, STMT_CHARACTER ) != 0 )
+	{
+		LogError();
+		return NULL;
+	}
+
+	MYSQL_RES *res = StoreResult();
+	if ( res == NULL || mysql_num_rows( res ) == 0 )
+	{
+		mysql_free_result( res );
+		return NULL;
+	}
+
+	MYSQL_ROW row = mysql_fetch_row( res );
+	if ( row != NULL )
+	{
+		if ( info == NULL )
+		{
+			info = new CharacterData();
+		}
+
+		Character_ParseRow( row, info );
+		mysql_free_result( res );
+
+		#if defined( _SQUARE )
+		/* The licenses are small and needed for the bag list, the items are
+		 * only loaded once the client asks for them. */
+		info->mLicenseCount = 0;
+
+		sprintf( sql, "SELECT * FROM bags WHERE char_id = %u", info->mId );
+		if ( Query( sql, STMT_CHARACTER_BAGS ) == 0 )
+		{
+			res = StoreResult();
+			if ( res != NULL )
+			{
+				while ( ( row = mysql_fetch_row( res ) ) && info->mLicenseCount < MAX_BAG_LICENSES )
+				{
+					BagLicense *license = &info->mLicenses[info->mLicenseCount++];
+
+					license->mId      = atol( row[0] );
+					license->mIndex   = atoi( row[2] );
+					license->mStatus  = atoi( row[3] );
+					license->mExpires = atol( row[4] );
+				}
+				mysql_free_result( res );
+			}
+		}
+		else MySqlStorage::LogError();
+		#endif
+	}
+	else mysql_free_result( res );
+
+	return info;
+}
+
+#if defined( _SQUARE )
+/* Fills an inventory with the items of the specified type. */
+void MySqlStorage::Character_LoadItems( uint32_t char_id, int type, Inventory *inventory )
+{
+	sprintf( sql, "SELECT * FROM items WHERE type = %d AND char_id = %u", type, char_id );
+	if ( Query( sql, STMT_CHARACTER_ITEMS ) != 0 )
+	{
+		LogError();
+		return;
+	}
+
+	MYSQL_RES *res = StoreResult();
+	if ( res == NULL )
+	{
+		LogError();
+		return;
+	}
+
+	MYSQL_ROW row;
+	while ( row = mysql_fetch_row( res ) )
+	{
+		int bag  = atoi( row[4] );
+		int slot = atoi( row[5] );
+
+		ItemInfo item;
+		item.mId     = atoi( row[0] );
+		item.mItemId = atoi( row[2] );
+		item.mAmount = atoi( row[6] );
+
+		/* The columns are not trusted, rows that point outside the bags are skipped. */
+		if ( bag < 0 || bag > 0xFF || slot < 0 || slot > 0xFF || !inventory->Set( (uint8_t)bag, (uint8_t)slot, item ) )
+			ErrorLog.Write( "Item %s of character %u is in invalid slot %d:%d\n", E_WARNING, row[0], char_id, bag, slot );
+	}
+	mysql_free_result( res );
+}
+#endif
+
+/* Loads the inventory of the specified character. */
+void MySqlStorage::Character_LoadInventory( CharacterData *c )
+{
+#if defined( _SQUARE )
+	if ( c == NULL || c->mId == 0 || c->mInventory != NULL ) return;
+
+	c->mInventory = new Inventory( MAX_BAGS );
+	Character_LoadItems( c->mId, 0, c->mInventory );
+#endif
+}
+
+/* Loads the bank of the specified character. */
+void MySqlStorage::Character_LoadBank( CharacterData *c )
+{
+#if defined( _SQUARE )
+	if ( c == NULL || c->mId == 0 || c->mBank != NULL ) return;
+
+	c->mBank = new Inventory( MAX_BANK_BOXES );
+	Character_LoadItems( c->mId, 1, c->mBank );
+#endif
+}
+
+/* Checks if a characters with the specified name exists. */
+bool MySqlStorage::Character_Exists( const char *name )
+{
+	char *p_sql = sql;
+	p_sql += sprintf( p_sql, "SELECT COUNT(`id`) FROM `sol_characters` WHERE `name` = '" );
+	p_sql += mysql_real_escape_string( mConns[mSlot], p_sql, name, strlen( name ) );
+	p_sql += sprintf( p_sql, "'" );
+
+	if ( Query( sql, STMT_CHARACTER_EXISTS ) != 0 )
+	{
+		LogError();
+		return false;
+	}
+
+	bool exists = false;
+
+	MYSQL_RES *res = StoreResult();
+	if ( res != NULL )
+	{
+		if ( mysql_num_rows( res ) == 1 )
+		{
+			MYSQL_ROW row = mysql_fetch_row( res );
+			if ( row != 0 )
+			{
+				exists = ( atoi( row[0] ) > 0 );
+			}
+		}
+		mysql_free_result( res );
+	}
+	return exists;
+}
+
+/* Creates a new character. */
+uint32_t MySqlStorage::Character_Create( uint32_t account_id, uint32_t class_id, const char *name )
+{
+	char *p_sql = sql;
+	p_sql += sprintf( p_sql, "INSERT INTO `sol_characters` (`account_id`, `class`, `name`) VALUES (%d, %d, '", account_id, class_id );
+	p_sql += mysql_real_escape_string( mConns[mSlot], p_sql, name, strlen( name ) );
+	p_sql += sprintf( p_sql, "')" );
+
+	if ( Query( sql, STMT_CHARACTER_CREATE ) != 0 )
+	{
+		return 0;
+	}
+	return (uint32_t)mysql_insert_id( mConns[mSlot] );
+}
+
+/* Passes the name of every character to the callback, and returns how many there were. */
+uint32_t MySqlStorage::Character_ScanNames( NameCallback callback, void *context )
+{
+	if ( Query( "SELECT `name` FROM `sol_characters`", STMT_CHARACTER_NAMES ) != 0 )
+	{
+		LogError();
+		return 0;
+	}
+
+	/* The rows are streamed from the server, so the table never has to fit in memory. */
+	MYSQL_RES *res   = mysql_use_result( mConns[mSlot] );
+	uint32_t   count = 0;
+	uint32_t   bytes = (uint32_t)strlen( mCall.mQuery );
+
+	if ( res != NULL )
+	{
+		MYSQL_ROW row;
+		while ( ( row = mysql_fetch_row( res ) ) != NULL )
+		{
+			bytes += (uint32_t)mysql_fetch_lengths( res )[0];
+			if ( row[0] != NULL )
+			{
+				callback( row[0], context );
+				count++;
+			}
+		}
+		mysql_free_result( res );
+	}
+
+	DBStats::End( mCall, res == NULL, count, bytes );
+	return count;
+}
+
+/* Loads the account with the specified name. */
+AccountInfo *MySqlStorage::Account_Load( const char *account_name, AccountInfo *account, bool load_charlist )
+{
+	/* Generate the query. */
+	char *p_sql = sql;
+	p_sql += sprintf( p_sql, "SELECT id FROM `sol_accounts` WHERE `name` = '" );
+	p_sql += mysql_real_escape_string( mConns[mSlot], p_sql, account_name, strlen( account_name ) );
+	p_sql += sprintf( p_sql, "';" );
+
+	if ( Query( sql, STMT_ACCOUNT_BY_NAME ) != 0 )
+	{
+		LogError();
+		return NULL;
+	}
+
+	MYSQL_RES *res = StoreResult();
+	if ( res != NULL )
+	{
+		if ( mysql_num_rows( res ) == 0 )
+		{
+			mysql_free_result( res );
+			return NULL;
+		}
+
+		MYSQL_ROW row = mysql_fetch_row( res );
+		uint32_t account_id = atoi( row[0] );
+
+		mysql_free_result( res );
+		return Account_Load( account_id, account, load_charlist );
+	}
+	return NULL;
+}
+
+
+/* Loads the account with the specified id. */
+AccountInfo *MySqlStorage::Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist )
+{
+	/* Generate the query. */
+	sprintf( sql, "SELECT `name`, `max_chars`, `passwd`, `status`, `gmlevel` FROM `sol_accounts` WHERE `id` = %d", account_id );
+	if ( Query( sql, STMT_ACCOUNT ) != 0 )
+	{
+		LogError();
+		return NULL;
+	}
+
+	MYSQL_RES *res = StoreResult();
+	if ( res == NULL )
+	{
+		LogError();
+		return NULL;
+	}
+
+	/* Unknown accounts are not loaded, just like an unknown name. */
+	MYSQL_ROW row = mysql_fetch_row( res );
+	if ( row == NULL )
+	{
+		mysql_free_result( res );
+		return NULL;
+	}
+
+	if ( account == NULL )
+	{
+		account = new AccountInfo();
+	}
+
+	/* Copy the data to the account struct. */
+	account->mId       = account_id;
+	account->mMaxChars = atoi( row[1] );
+	account->mStatus   = atoi( row[3] );
+	account->mGmLevel  = atoi( row[4] );
+
+	strcpy( account->mName, row[0] );
+	strncpy( account->mPassword, row[2], ACCOUNT_PASSWORD_SIZE - 1 );
+	account->mPassword[ACCOUNT_PASSWORD_SIZE - 1] = 0;
+	mysql_free_result( res );
+
+	/* Get the available character licences for this account. */
+	account->mLicenseCount = 0;
+
+	sprintf( sql, "SELECT class_id FROM sol_character_licenses WHERE account_id = %d", account->mId );
+	if ( Query( sql, STMT_ACCOUNT_LICENSES ) == 0 )
+	{
+		res = StoreResult();
+		if ( res != NULL )
+		{
+			while ( ( row = mysql_fetch_row( res ) ) && account->mLicenseCount < MAX_CHARACTER_LICENSES )
+			{
+				account->mLicenses[account->mLicenseCount++] = atoi( row[0] );
+			}
+
+			mysql_free_result( res );
+		}
+	}
+
+	/* Get the characters. */
+	if ( load_charlist )
+	{
+		Character_GetList( account->mId, account->mCharacters );
+	}
+
+	return account;
+}
+
+/* Replaces the stored password of an account, with a new hash of it. */
+bool MySqlStorage::Account_SetPassword( uint32_t account_id, const char *password )
+{
+	char *p_sql = sql;
+	p_sql += sprintf( p_sql, "UPDATE `sol_accounts` SET `passwd` = '" );
+	p_sql += mysql_real_escape_string( mConns[mSlot], p_sql, password, strlen( password ) );
+	p_sql += sprintf( p_sql, "' WHERE `id` = %d", account_id );
+
+	if ( Query( sql, STMT_ACCOUNT_PASSWORD ) != 0 )
+	{
+		LogError();
+		return false;
+	}
+	return true;
+}
+
+/* Gets the ID of the account with the specified name from the directory, or 0 if it is not listed. */
+uint32_t MySqlStorage::Directory_Find( const char *account_name )
+{
+	char *p_sql = sql;
+	p_sql += sprintf( p_sql, "SELECT `account_id` FROM `sol_account_directory` WHERE `name` = '" );
+	p_sql += mysql_real_escape_string( mConns[mSlot], p_sql, account_name, strlen( account_name ) );
+	p_sql += sprintf( p_sql, "'" );
+
+	if ( Query( sql, STMT_ACCOUNT_DIRECTORY ) != 0 )
+	{
+		LogError();
+		return 0;
+	}
+
+	uint32_t account_id = 0;
+
+	MYSQL_RES *res = StoreResult();
+	if ( res != NULL )
+	{
+		MYSQL_ROW row = mysql_fetch_row( res );
+		if ( row != NULL && row[0] != NULL )
+			account_id = atoi( row[0] );
+
+		mysql_free_result( res );
+	}
+	return account_id;
+}
+
+/* Lists an account in the directory, a name that is already listed keeps its ID. */
+bool MySqlStorage::Directory_Add( const char *account_name, uint32_t account_id )
+{
+	char *p_sql = sql;
+	p_sql += sprintf( p_sql, "INSERT IGNORE INTO `sol_account_directory` (`name`, `account_id`) VALUES ('" );
+	p_sql += mysql_real_escape_string( mConns[mSlot], p_sql, account_name, strlen( account_name ) );
+	p_sql += sprintf( p_sql, "', %d)", account_id );
+
+	if ( Query( sql, STMT_ACCOUNT_DIRECTORY ) != 0 )
+	{
+		LogError();
+		return false;
+	}
+	return true;
+}
+
+/* Writes a MySQL error to the error log. */
+void MySqlStorage::LogError()
+{
+	if ( mSlot >= MYSQL_MAX_NODES || mConns[mSlot] == NULL )
+		return;
+
+	ErrorLog.Write( "SQL Error: [%d] %s\n", E_ERROR, mysql_errno( mConns[mSlot] ), mysql_error( mConns[mSlot] ) );
+}
@@ -0,0 +1,107 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <poller.h>
+
+Socket  *Poller::mSockets[POLLER_MAX_SOCKETS];
+uint32_t Poller::mCount   = 0;
+bool     Poller::mEnabled = false;
+
+/* Selects the I/O backend, must be called before any socket is created. */
+void Poller::Initialize( int backend )
+{
+	mEnabled = ( backend == IO_BACKEND_POLLER );
+	mCount   = 0;
+}
+
+/* Adds a socket to the poller, returns false if the socket has to check its own readiness. */
+bool Poller::Register( Socket *socket )
+{
+	if ( !mEnabled || mCount >= POLLER_MAX_SOCKETS || socket->mPollIndex != POLLER_NONE )
+		return false;
+
+	socket->mPollIndex = mCount;
+	socket->mReadable  = false;
+	mSockets[mCount++] = socket;
+	return true;
+}
+
+/* Removes a socket from the poller. */
+void Poller::Unregister( Socket *socket )
+{
+	int index = socket->mPollIndex;
+	if ( index == POLLER_NONE )
+		return;
+
+	/* Keep the list packed by moving the last socket into the free slot. */
+	mSockets[index] = mSockets[--mCount];
+	mSockets[index]->mPollIndex = index;
+	socket->mPollIndex = POLLER_NONE;
+}
+
+/* Collects the readiness of all registered sockets, returns the number of readable sockets. */
+int Poller::Poll()
+{
+	if ( mCount == 0 )
+		return 0;
+
+	/* Connected sockets are checked for data, connecting sockets for completion or failure. */
+	fd_set set, write_set, error_set;
+	FD_ZERO( &set );
+	FD_ZERO( &write_set );
+	FD_ZERO( &error_set );
+	for ( uint32_t i = 0; i < mCount; i++ )
+	{
+		if ( mSockets[i]->mConnected )
+		{
+			FD_SET( mSockets[i]->mSocket, &set );
+		}
+		else if ( mSockets[i]->mConnecting )
+		{
+			FD_SET( mSockets[i]->mSocket, &write_set );
+			FD_SET( mSockets[i]->mSocket, &error_set );
+		}
+	}
+
+	struct timeval tm;
+	tm.tv_sec = tm.tv_usec = 0;
+
+	int result = select( 0, &set, &write_set, &error_set, &tm );
+	if ( result == SOCKET_ERROR )
+		return 0;
+
+	for ( uint32_t i = 0; i < mCount; i++ )
+	{
+		Socket *s = mSockets[i];
+		s->mReadable = ( result > 0 && FD_ISSET( s->mSocket, &set ) != 0 );
+
+		if ( s->mConnecting )
+		{
+			s->mWritable = ( result > 0 && FD_ISSET( s->mSocket, &write_set ) != 0 );
+			s->mFailed   = ( result > 0 && FD_ISSET( s->mSocket, &error_set ) != 0 );
+		}
+	}
+	return result;
+}
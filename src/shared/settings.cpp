@@ -27,172 +27,262 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
 #include <log.h>
 
-/* Removes the white space characters from the input string. */
-size_t trim( const char *in, char *out )
+/* Case-insensitive FNV-1a hash of a setting name, never 0. */
+static uint32_t Hash( const char *name )
 {
-	size_t len = strlen( in );
-	if ( len > 0 )
-	{
-		size_t i = 0, j = 0;
-		while ( in[i] <= 32 || in[i] > 128 )
-		{
-			if ( in[i] == 0 )
-			{
-				out[0] = 0;
-				return 0;
-			}
-			else i++;
-		}
+	uint32_t hash = 2166136261u;
+	for ( ; *name != 0; name++ )
+		hash = ( hash ^ (uint8_t)tolower( (uint8_t)*name ) ) * 16777619u;
 
-		for ( ; i < len; i++, j++ )
-			out[j] = in[i];
+	return ( hash != 0 ) ? hash : 1;
+}
 
-		for ( len = j; len >= 0; len-- )
-		{
-			if ( out[len] > 32 && out[len] <= 128 )
-			{
-				out[len + 1] = 0;
-				break;
-			}
-		}
+/* Cuts the white space off both ends of a string, which is modified in place. */
+static char *Trim( char *str )
+{
+	while ( *str != 0 && isspace( (uint8_t)*str ) )
+		str++;
+
+	size_t len = strlen( str );
+	while ( len > 0 && isspace( (uint8_t)str[len - 1] ) )
+		str[--len] = 0;
+
+	return str;
+}
+
+/* Checks if a value means 'yes'. */
+static bool ParseBool( const char *v )
+{
+	return ( _stricmp( v, "true" ) == 0 ) || ( _stricmp( v, "yes" ) == 0 ) || ( _stricmp( v, "1" ) == 0 ) || ( _stricmp( v, "on" ) == 0 );
+}
+
+/* Frees a table and everything it replaced. */
+static void FreeTable( SettingsTable *table )
+{
+	while ( table != NULL )
+	{
+		SettingsTable *retired = table->mRetired;
+
+		free( table->mText );
+		free( table->mBuckets );
+		free( table );
+		table = retired;
 	}
-	return len;
 }
 
-/* Initializes a new instance of the Config class. */
-Settings::Settings( const char *path ): mCount(0), mList(NULL)
+/* Initializes a new instance of the Settings class. */
+Settings::Settings( const char *path ): mTable( NULL ), mModified( 0 ), mChanged( 0 ), mLastPoll( 0 )
+{
+	mPath = strdup( path );
+	Reload();
+}
+
+/* Frees all memory allocated by the configuration. */
+Settings::~Settings()
+{
+	FreeTable( mTable );
+	free( mPath );
+}
+
+/* Reads the configuration file into a new table. */
+SettingsTable *Settings::Parse()
 {
-	FILE *fp = fopen( path, "rb" );
+	FILE *fp = fopen( mPath, "rb" );
 	if ( !fp ) 
 	{
-		ErrorLog.Write( "Unable to open configuration file '%s'.", E_ERROR, path );
-		return;
+		ErrorLog.Write( "Unable to open configuration file '%s'.\n", E_ERROR, mPath );
+		return NULL;
 	}
 
 	/* Get the size of the file. */
 	fseek( fp, 0, SEEK_END );
 	long size = ftell( fp );
-	if ( size == 0 ) 
+	fseek( fp, 0, SEEK_SET );
+
+	SettingsTable *table = (SettingsTable *)calloc( 1, sizeof( SettingsTable ) );
+	table->mText = (char *)malloc( MAX( size, 0 ) + 1 );
+	size = (long)fread( table->mText, 1, MAX( size, 0 ), fp );
+	table->mText[size] = 0;
+	fclose( fp );
+
+	/* A file that is emptied to be rewritten has no settings yet. */
+	if ( size == 0 )
 	{
-		fclose( fp );
-		return;
+		ErrorLog.Write( "Configuration file '%s' is empty, it is not loaded.\n", E_ERROR, mPath );
+		FreeTable( table );
+		return NULL;
 	}
-	fseek( fp, 0, SEEK_SET );
 
+	/* Every line with a '=' is a setting, so that is enough buckets to keep the table at most half full. */
+	uint32_t lines = 0;
+	for ( char *p = table->mText; *p != 0; p++ )
+		if ( *p == '=' ) lines++;
 
-	char *buffer = (char *)malloc( size + 1 );
-	fread( buffer, size, 1, fp );
-	fclose( fp );
-	buffer[size] = 0;
+	uint32_t buckets = SETTINGS_MIN_BUCKETS;
+	while ( buckets < lines * 2 )
+		buckets <<= 1;
 
-	size_t list_size = 100;
-	mList = (Setting **)malloc( list_size * sizeof( Setting * ) );
-	memset( mList, 0, list_size * sizeof( Setting * ) );
+	table->mBuckets = (Setting *)calloc( buckets, sizeof( Setting ) );
+	table->mMask    = buckets - 1;
 
 	/* Parse the configuration file. */
-	char *line = strtok( buffer, "\n" );
-	while ( line != NULL )
+	char    *line   = table->mText;
+	uint32_t number = 0;
+	while ( line != NULL && *line != 0 )
 	{
-		int len_line = strlen( line ), len_key = 0, len_value = 0;
-		if ( len_line != 0 && line[0] != ';' )
+		char *next = strchr( line, '\n' );
+		if ( next != NULL )
+			*next++ = 0;
+
+		line = Trim( line );
+		number++;
+
+		if ( line[0] != 0 && line[0] != ';' && line[0] != '#' )
 		{
-			/* Get the character that seperate they key and value. */
+			/* Anything else has to be a setting, a file cut off while it is written often is not. */
 			char *value = strchr( line, '=' );
+			char *name  = NULL;
 			if ( value != NULL )
 			{
-				/* Calculate the length and */
-				len_key = value - line;
-				*value = 0;
-				++value;
-
-				len_value = strlen(value);
-				if (len_key > 0)
-				{
-					mList[mCount] = (Setting *)malloc( sizeof( Setting ) );
-					mList[mCount]->mName = (char *)malloc( len_key + len_value + 2 );
-					mList[mCount]->mValue = mList[mCount]->mName + len_key + 1;
-
-					trim( line, mList[mCount]->mName );
-					trim( value, mList[mCount]->mValue );
-					++mCount;
-
-					/* Increase the size of the vartable if the limit as been reached. */
-					if ( mCount == list_size )
-					{
-						list_size += 100;
-						mList = (Setting **)realloc( mList, list_size * sizeof( Setting * ) );
-
-						memset( mList + ( ( list_size - 100 ) * sizeof( Setting * ) ), 0, ( 100 * sizeof( Setting * ) ) );
-					}
-				}
+				*value++ = 0;
+				name = Trim( line );
 			}
+
+			if ( name == NULL || *name == 0 )
+			{
+				ErrorLog.Write( "Configuration file '%s' has no setting on line %u, it is not loaded.\n", E_ERROR, mPath, number );
+				FreeTable( table );
+				return NULL;
+			}
+
+			/* A setting that appears twice keeps the last value. */
+			uint32_t hash = Hash( name );
+			uint32_t i    = hash & table->mMask;
+			while ( table->mBuckets[i].mHash != 0 && ( table->mBuckets[i].mHash != hash || _stricmp( table->mBuckets[i].mName, name ) != 0 ) )
+				i = ( i + 1 ) & table->mMask;
+
+			Setting *s = &table->mBuckets[i];
+			if ( s->mHash == 0 )
+				table->mCount++;
+
+			s->mHash  = hash;
+			s->mName  = name;
+			s->mValue = Trim( value );
+			s->mInt   = atoi( s->mValue );
+			s->mFloat = (float)atof( s->mValue );
+			s->mBool  = ParseBool( s->mValue );
 		}
-		line = strtok( NULL, "\n" );
+		line = next;
 	}
-	if ( mCount != list_size ) 
-		mList = ( Setting ** )realloc( mList, mCount * sizeof( Setting * ) );
+	return table;
+}
+
+/* Reads the configuration file again and publishes the new settings. */
+bool Settings::Reload()
+{
+	time_t modified = GetModified();
+
+	SettingsTable *table = Parse();
+	if ( table == NULL )
+		return false;
+
+	table->mRetired = mTable;
+	table->mVersion = ( mTable != NULL ) ? mTable->mVersion + 1 : 1;
+	mModified = modified;
 
-	/* Cleanup... */
-	free( buffer );
+	/* Readers either see the old table or the complete new one. */
+	InterlockedExchangePointer( (void * volatile *)&mTable, table );
+
+	/* The table the previous reload retired has been out of use for at least a poll interval. */
+	if ( table->mRetired != NULL )
+	{
+		FreeTable( table->mRetired->mRetired );
+		table->mRetired->mRetired = NULL;
+	}
+	return true;
 }
 
-/* Frees all memory allocated by the configuration. */
-Settings::~Settings()
+/* Reloads the settings if the file changed, returns true if it did. Checks at most once per SETTINGS_POLL_INTERVAL. */
+bool Settings::Poll()
 {
-	if ( mCount > 0 && mList )
+	uint32_t tick = GetTick();
+	if ( mLastPoll != 0 && tick - mLastPoll < SETTINGS_POLL_INTERVAL )
+		return false;
+
+	mLastPoll = tick;
+
+	time_t modified = GetModified();
+	if ( modified == 0 || modified == mModified )
+		return false;
+
+	/* A file that is still being written keeps changing, it is loaded once it stayed the same for a whole interval. */
+	if ( modified != mChanged )
 	{
-		for ( size_t i = 0; i < mCount; i++ )
-			free( mList[i]->mName );
+		mChanged = modified;
+		return false;
+	}
 
-		free( mList );
+	if ( !Reload() )
+		return false;
+
+	ServerLog.Write( "Configuration file '%s' reloaded.\n", E_NOTICE, mPath );
+	return true;
+}
+
+/* Gets the time the configuration file was last written, or 0 if it is missing. */
+time_t Settings::GetModified() const
+{
+	struct stat info;
+	if ( stat( mPath, &info ) != 0 )
+		return 0;
+
+	return info.st_mtime;
+}
+
+/* Finds a setting, or returns NULL if there is no such setting. */
+const Setting *Settings::Find( const char *name ) const
+{
+	const SettingsTable *table = mTable;
+	if ( table == NULL )
+		return NULL;
+
+	uint32_t hash = Hash( name );
+	for ( uint32_t i = hash & table->mMask; table->mBuckets[i].mHash != 0; i = ( i + 1 ) & table->mMask )
+	{
+		if ( table->mBuckets[i].mHash == hash && _stricmp( table->mBuckets[i].mName, name ) == 0 )
+			return &table->mBuckets[i];
 	}
+	return NULL;
 }
 
 /* Gets the string value of the setting with the specified name. */
-const char *Settings::GetString( const char *name, const char *default )
+const char *Settings::GetString( const char *name, const char *default_value )
 {
-	for ( size_t i = 0; i < mCount; i++ )
-		if ( _stricmp( mList[i]->mName, name ) == 0 )
-			return mList[i]->mValue;
-
-	return default;
+	const Setting *s = Find( name );
+	return ( s != NULL ) ? s->mValue : default_value;
 }
 
 /* Gets the integer value of the setting with the specified name. */
-int Settings::GetInt( const char *name, int default )
+int Settings::GetInt( const char *name, int default_value )
 {
-	for ( size_t i = 0; i < mCount; i++ )
-		if ( _stricmp( mList[i]->mName, name ) == 0 )
-			return atoi( mList[i]->mValue );
-
-	return default;
+	const Setting *s = Find( name );
+	return ( s != NULL ) ? s->mInt : default_value;
 }
 
 /* Gets the floating point value of the setting with the specified name. */
-float Settings::GetFloat( const char *name, float default )
+float Settings::GetFloat( const char *name, float default_value )
 {
-	for ( size_t i = 0; i < mCount; i++ )
-		if ( _stricmp( mList[i]->mName, name ) == 0 )
-			return (float)atof( mList[i]->mValue );
-
-	return default;
+	const Setting *s = Find( name );
+	return ( s != NULL ) ? s->mFloat : default_value;
 }
 
 /* Gets the boolean value of the setting with the specified name. */
-bool Settings::GetBool( const char *name, bool default )
+bool Settings::GetBool( const char *name, bool default_value )
 {
-	for ( size_t i = 0; i < mCount; i++ )
-	{
-		if ( _stricmp( mList[i]->mName, name ) == 0 )
-		{
-			const char *v = mList[i]->mValue;
-			if ( ( _stricmp( v, "true" ) == 0 ) || ( _stricmp( v, "yes" ) == 0 ) || ( _stricmp( v, "1" ) == 0 ) || ( _stricmp( v, "on" ) == 0 ) )
-				return true;
-
-			return false;
-		}
-	}
-	return default;
+	const Setting *s = Find( name );
+	return ( s != NULL ) ? s->mBool : default_value;
 }
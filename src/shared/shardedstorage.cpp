@@ -0,0 +1,395 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <shardedstorage.h>
+#include <log.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Reads a "host:port" entry from a comma separated list, and returns where the next entry starts. */
+static const char *ParseNode( const char *list, char *host, size_t size, uint16_t *port )
+{
+	while ( *list == ' ' || *list == ',' )
+		list++;
+
+	size_t len = 0;
+	while ( *list != 0 && *list != ':' && *list != ',' && *list != ' ' )
+	{
+		if ( len < size - 1 )
+			host[len++] = *list;
+		list++;
+	}
+	host[len] = 0;
+
+	*port = 3306;
+	if ( *list == ':' )
+	{
+		*port = (uint16_t)atoi( ++list );
+		while ( *list != 0 && *list != ',' )
+			list++;
+	}
+	return list;
+}
+
+/* Creates a storage without shards, AddShard() adds them. */
+ShardedStorage::ShardedStorage( uint32_t max_lag ): mMaxLag( max_lag ), mError( NULL )
+{
+}
+
+/* Frees the servers. */
+ShardedStorage::~ShardedStorage()
+{
+	for ( size_t i = 0; i < mShards.size(); i++ )
+	{
+		delete mShards[i].mPrimary;
+		for ( size_t r = 0; r < mShards[i].mReplicas.size(); r++ )
+			delete mShards[i].mReplicas[r].mStorage;
+	}
+}
+
+/* Creates the storage from the sql_ settings, or returns NULL when they name a single server without replicas. */
+ShardedStorage *ShardedStorage::Load( Settings &config )
+{
+	const char *user   = config.GetString( "sql_username", "root" );
+	const char *passwd = config.GetString( "sql_password", "" );
+	const char *db     = config.GetString( "sql_database", "soldin" );
+	uint32_t    shards = MAX( 1, MIN( config.GetInt( "sql_shards", 1 ), STORAGE_MAX_SHARDS ) );
+	bool        replicas = false;
+	char        key[32], host[128];
+	uint16_t    port;
+
+	for ( uint32_t i = 0; i < shards; i++ )
+	{
+		sprintf( key, "sql_replicas%u", i );
+		if ( *config.GetString( key, "" ) != 0 )
+			replicas = true;
+	}
+
+	if ( shards == 1 && !replicas )
+		return NULL;
+
+	ShardedStorage *storage = new ShardedStorage( config.GetInt( "sql_replica_max_lag", 5 ) );
+	for ( uint32_t i = 0; i < shards; i++ )
+	{
+		/* The first shard is the server of the plain sql_host and sql_port settings. */
+		if ( i == 0 )
+		{
+			storage->AddShard( new MySqlStorage( config.GetString( "sql_host", "localhost" ), user, passwd, db, config.GetInt( "sql_port", 3306 ) ) );
+		}
+		else
+		{
+			sprintf( key, "sql_shard%u", i );
+			ParseNode( config.GetString( key, "localhost" ), host, sizeof( host ), &port );
+			storage->AddShard( new MySqlStorage( host, user, passwd, db, port ) );
+		}
+
+		sprintf( key, "sql_replicas%u", i );
+		for ( const char *list = config.GetString( key, "" ); *list != 0; )
+		{
+			list = ParseNode( list, host, sizeof( host ), &port );
+			if ( host[0] != 0 )
+				storage->AddReplica( i, new MySqlStorage( host, user, passwd, db, port ) );
+		}
+	}
+	return storage;
+}
+
+/* Adds a primary, the shards are numbered in the order they are added. */
+void ShardedStorage::AddShard( MySqlStorage *primary )
+{
+	StorageShard shard;
+	shard.mPrimary     = primary;
+	shard.mNextReplica = 0;
+	shard.mLastWrite   = (LONG)( GetTickCount() - mMaxLag * 1000 - 1 );
+
+	mShards.push_back( shard );
+}
+
+/* Adds a replica of the primary of the specified shard. */
+void ShardedStorage::AddReplica( uint32_t shard, MySqlStorage *replica )
+{
+	StorageReplica copy;
+	copy.mStorage   = replica;
+	copy.mLag       = -1;
+	copy.mCheckedAt = (LONG)( GetTickCount() - REPLICA_CHECK_INTERVAL );
+
+	mShards[shard].mReplicas.push_back( copy );
+}
+
+/* Connects the calling thread with every server. The primaries have to hand out the IDs of their shard. */
+bool ShardedStorage::Connect()
+{
+	if ( mShards.empty() )
+	{
+		mError = "no shards are configured";
+		return false;
+	}
+
+	for ( uint32_t i = 0; i < mShards.size(); i++ )
+	{
+		MySqlStorage *primary = mShards[i].mPrimary;
+		if ( !primary->Connect() )
+		{
+			primary->LogError();
+			mError = "unable to connect with a primary";
+			return false;
+		}
+
+		int increment = primary->QueryInt( "SELECT @@auto_increment_increment", 1 );
+		int offset    = primary->QueryInt( "SELECT @@auto_increment_offset", 1 );
+		if ( increment != (int)mShards.size() || offset != (int)i + 1 )
+		{
+			ErrorLog.Write( "Shard %u uses auto_increment_increment %d and auto_increment_offset %d, expected %u and %u.\n", E_ERROR, i, increment, offset, (uint32_t)mShards.size(), i + 1 );
+			mError = "a primary hands out IDs of another shard";
+			return false;
+		}
+
+		/* A replica that is down is skipped until it is back. */
+		for ( size_t r = 0; r < mShards[i].mReplicas.size(); r++ )
+		{
+			if ( !mShards[i].mReplicas[r].mStorage->Connect() )
+				mShards[i].mReplicas[r].mStorage->LogError();
+		}
+	}
+	return true;
+}
+
+/* Closes the connections of the calling thread. */
+void ShardedStorage::Disconnect()
+{
+	for ( size_t i = 0; i < mShards.size(); i++ )
+	{
+		mShards[i].mPrimary->Disconnect();
+		for ( size_t r = 0; r < mShards[i].mReplicas.size(); r++ )
+			mShards[i].mReplicas[r].mStorage->Disconnect();
+	}
+}
+
+/* Writes the last error to the error log. */
+void ShardedStorage::LogError()
+{
+	ErrorLog.Write( "Storage Error: %s\n", E_ERROR, ( mError != NULL ) ? mError : "none" );
+}
+
+/* Gets the ID of the account with the specified name from the directory on the first shard, or 0 if it is not listed. */
+uint32_t ShardedStorage::FindAccount( const char *account_name )
+{
+	MySqlStorage *reader = GetReader( 0 );
+
+	uint32_t account_id = reader->Directory_Find( account_name );
+	if ( account_id == 0 && reader != mShards[0].mPrimary )
+		account_id = mShards[0].mPrimary->Directory_Find( account_name );
+
+	return account_id;
+}
+
+/* Checks if a replica is close enough behind its primary, the lag is checked by one thread at a time. */
+bool ShardedStorage::IsFresh( uint32_t shard, StorageReplica &replica )
+{
+	DWORD now     = GetTickCount();
+	LONG  checked = replica.mCheckedAt;
+
+	if ( now - (DWORD)checked >= REPLICA_CHECK_INTERVAL && InterlockedCompareExchange( &replica.mCheckedAt, (LONG)now, checked ) == checked )
+	{
+		LONG lag = replica.mStorage->Connect() ? replica.mStorage->GetReplicationLag() : -1;
+		LONG old = InterlockedExchange( &replica.mLag, lag );
+
+		bool was_fresh = ( old >= 0 && old <= (LONG)mMaxLag );
+		bool is_fresh  = ( lag >= 0 && lag <= (LONG)mMaxLag );
+		if ( was_fresh != is_fresh )
+		{
+			if ( is_fresh )
+				ServerLog.Write( "A replica of shard %u is %d seconds behind, reads go to it.\n", E_NOTICE, shard, lag );
+			else if ( lag < 0 )
+				ServerLog.Write( "A replica of shard %u is not replicating, reads skip it.\n", E_WARNING, shard );
+			else
+				ServerLog.Write( "A replica of shard %u is %d seconds behind, reads skip it.\n", E_WARNING, shard, lag );
+		}
+	}
+
+	LONG lag = replica.mLag;
+	return lag >= 0 && lag <= (LONG)mMaxLag;
+}
+
+/* Picks the server for a read from a shard, replicas take turns. */
+MySqlStorage *ShardedStorage::GetReader( uint32_t shard )
+{
+	StorageShard &s = mShards[shard];
+
+	/* Right after a write the replicas might not have it yet. */
+	if ( s.mReplicas.empty() || GetTickCount() - (DWORD)s.mLastWrite <= mMaxLag * 1000 )
+		return s.mPrimary;
+
+	size_t   count = s.mReplicas.size();
+	uint32_t first = (uint32_t)InterlockedIncrement( &s.mNextReplica );
+
+	for ( size_t i = 0; i < count; i++ )
+	{
+		StorageReplica &replica = s.mReplicas[( first + i ) % count];
+		if ( IsFresh( shard, replica ) && ( replica.mStorage->IsConnected() || replica.mStorage->Connect() ) )
+			return replica.mStorage;
+	}
+	return s.mPrimary;
+}
+
+/* Gets the primary of a shard for a write, and sends the reads of this process there for a while. */
+MySqlStorage *ShardedStorage::GetWriter( uint32_t shard )
+{
+	InterlockedExchange( &mShards[shard].mLastWrite, (LONG)GetTickCount() );
+	return mShards[shard].mPrimary;
+}
+
+/* Gets all the characters that belong to the specified account. */
+uint32_t ShardedStorage::Character_GetList( uint32_t account_id, CharacterList &list )
+{
+	if ( account_id == 0 )
+		return 0;
+
+	uint32_t      shard  = GetShard( account_id );
+	MySqlStorage *reader = GetReader( shard );
+
+	uint32_t count = reader->Character_GetList( account_id, list );
+	if ( count == 0 && reader != mShards[shard].mPrimary )
+		count = mShards[shard].mPrimary->Character_GetList( account_id, list );
+
+	return count;
+}
+
+/* Deletes the character with the specified ID. */
+void ShardedStorage::Character_Delete( uint32_t char_id )
+{
+	GetWriter( GetShard( char_id ) )->Character_Delete( char_id );
+}
+
+/* Retrieves the details of the character with the specified ID. */
+CharacterData *ShardedStorage::Character_Load( uint32_t char_id, CharacterData *info )
+{
+	uint32_t      shard  = GetShard( char_id );
+	MySqlStorage *reader = GetReader( shard );
+
+	CharacterData *loaded = reader->Character_Load( char_id, info );
+	if ( loaded == NULL && reader != mShards[shard].mPrimary )
+		loaded = mShards[shard].mPrimary->Character_Load( char_id, info );
+
+	return loaded;
+}
+
+/* Checks if a characters with the specified name exists, names are unique over all shards. */
+bool ShardedStorage::Character_Exists( const char *name )
+{
+	for ( size_t i = 0; i < mShards.size(); i++ )
+	{
+		if ( mShards[i].mPrimary->Character_Exists( name ) )
+			return true;
+	}
+	return false;
+}
+
+/* Creates a new character on the shard of the account, the ID it gets points there. The 
+ * unique key of a shard only covers its own names, so the other shards are checked first. */
+uint32_t ShardedStorage::Character_Create( uint32_t account_id, uint32_t class_id, const char *name )
+{
+	uint32_t shard = GetShard( account_id );
+
+	for ( size_t i = 0; i < mShards.size(); i++ )
+	{
+		if ( i != shard && mShards[i].mPrimary->Character_Exists( name ) )
+			return 0;
+	}
+	return GetWriter( shard )->Character_Create( account_id, class_id, name );
+}
+
+/* Passes the name of every character on every shard to the callback, and returns how many there were. */
+uint32_t ShardedStorage::Character_ScanNames( NameCallback callback, void *context )
+{
+	uint32_t count = 0;
+	for ( size_t i = 0; i < mShards.size(); i++ )
+		count += mShards[i].mPrimary->Character_ScanNames( callback, context );
+
+	return count;
+}
+
+/* Loads the inventory of the specified character. */
+void ShardedStorage::Character_LoadInventory( CharacterData *c )
+{
+	if ( c == NULL || c->mId == 0 ) return;
+
+	GetReader( GetShard( c->mId ) )->Character_LoadInventory( c );
+}
+
+/* Loads the bank of the specified character. */
+void ShardedStorage::Character_LoadBank( CharacterData *c )
+{
+	if ( c == NULL || c->mId == 0 ) return;
+
+	GetReader( GetShard( c->mId ) )->Character_LoadBank( c );
+}
+
+/* Loads the account with the specified name, the directory tells its shard. Accounts
+ * it does not list yet are searched on every shard, and listed once they are found. */
+AccountInfo *ShardedStorage::Account_Load( const char *account_name, AccountInfo *account, bool load_charlist )
+{
+	uint32_t account_id = FindAccount( account_name );
+	if ( account_id != 0 )
+		return Account_Load( account_id, account, load_charlist );
+
+	for ( uint32_t shard = 0; shard < mShards.size(); shard++ )
+	{
+		MySqlStorage *reader = GetReader( shard );
+
+		AccountInfo *loaded = reader->Account_Load( account_name, account, load_charlist );
+		if ( loaded == NULL && reader != mShards[shard].mPrimary )
+			loaded = mShards[shard].mPrimary->Account_Load( account_name, account, load_charlist );
+
+		if ( loaded != NULL )
+		{
+			GetWriter( 0 )->Directory_Add( account_name, loaded->mId );
+			return loaded;
+		}
+	}
+	return NULL;
+}
+
+/* Loads the account with the specified id. */
+AccountInfo *ShardedStorage::Account_Load( uint32_t account_id, AccountInfo *account, bool load_charlist )
+{
+	if ( account_id == 0 )
+		return NULL;
+
+	uint32_t      shard  = GetShard( account_id );
+	MySqlStorage *reader = GetReader( shard );
+
+	AccountInfo *loaded = reader->Account_Load( account_id, account, load_charlist );
+	if ( loaded == NULL && reader != mShards[shard].mPrimary )
+		loaded = mShards[shard].mPrimary->Account_Load( account_id, account, load_charlist );
+
+	return loaded;
+}
+
+/* Replaces the stored password of an account. */
+bool ShardedStorage::Account_SetPassword( uint32_t account_id, const char *password )
+{
+	return GetWriter( GetShard( account_id ) )->Account_SetPassword( account_id, password );
+}
@@ -25,6 +25,7 @@
  */
 #include <socket.h>
 #include <ws2tcpip.h>
+#include <poller.h>
 
 #define CAN_RECEIVE (this->DataAvailable())
 #define CAN_SEND	(this->CanSend())
@@ -40,7 +41,12 @@ Socket::Socket():
 	mIpAddr   ( NULL ), 
 	mPort     ( 0 ), 
 	mConnected( false ), 
-	mCrypt    ( NULL )
+	mConnecting( false ),
+	mCrypt    ( NULL ),
+	mPollIndex( POLLER_NONE ),
+	mReadable ( false ),
+	mWritable ( false ),
+	mFailed   ( false )
 {
 	if ( !mInitialized )
 		Initialize();
@@ -58,13 +64,17 @@ Socket::Socket( SOCKET socket, sockaddr_in *addr, size_t len ):
 	mIpAddr   ( NULL ),
 	mPort     ( 0 ), 
 	mConnected( true ), 
-	mCrypt    ( NULL )
+	mConnecting( false ),
+	mCrypt    ( NULL ),
+	mPollIndex( POLLER_NONE ),
+	mReadable ( false ),
+	mWritable ( false ),
+	mFailed   ( false )
 {
 	mSocketCount++;
+	Poller::Register( this );
 
-	uint64_t non_blocking = 1;
-	ioctlsocket( mSocket, FIONBIO, &non_blocking );
-
+	/* Accepted sockets inherit the non-blocking mode of the listening socket. */
 	if ( addr != NULL && len > 0 )
 		memcpy( &mAddr, addr, len );
 }
@@ -72,6 +82,8 @@ Socket::Socket( SOCKET socket, sockaddr_in *addr, size_t len ):
 /* Closes the socket and releases all allocated resources. */
 Socket::~Socket()
 {
+	Poller::Unregister( this );
+
 	if ( mIpAddr != NULL ) free( mIpAddr );
 	if ( mCrypt != NULL ) delete mCrypt;
 
@@ -82,23 +94,75 @@ Socket::~Socket()
 	}
 }
 
-/* Connects to the specified host on the specified port. */
+/* Starts connecting to the specified host on the specified port without waiting for it. Returns 0 
+ * if the connection was made right away, WSAEWOULDBLOCK if FinishConnect() has to be checked later, 
+ * or the error that made the attempt fail. */
 int Socket::Connect( const char *hostname, uint16_t port )
 {
+	if ( mConnected || mConnecting )
+		return 0;
+
 	mAddr.sin_family      = AF_INET;
 	mAddr.sin_port        = htons( mPort = port );
 	mAddr.sin_addr.s_addr = inet_addr( hostname );
 
-	if ( connect( mSocket, (SOCKADDR *)&mAddr, sizeof( mAddr ) ) == SOCKET_ERROR )
-		return WSAGetLastError();
-
 	uint64_t non_blocking = 1;
 	ioctlsocket( mSocket, FIONBIO, &non_blocking );
 
+	/* The poller reports completion along with the readiness of the other sockets. */
+	Poller::Register( this );
+	mWritable = mFailed = false;
+
+	if ( connect( mSocket, (SOCKADDR *)&mAddr, sizeof( mAddr ) ) == SOCKET_ERROR )
+	{
+		int error = WSAGetLastError();
+		if ( error != WSAEWOULDBLOCK )
+		{
+			/* The socket is undefined after a failed connect, the next attempt gets a new one. */
+			closesocket( mSocket );
+			mSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+			return error;
+		}
+
+		mConnecting = true;
+		return WSAEWOULDBLOCK;
+	}
+
 	mConnected = true;
 	return 0;
 }
 
+/* Checks on a connection started by Connect(). Returns 0 once connected, WSAEWOULDBLOCK while
+ * it is still in progress, or the error that made it fail. */
+int Socket::FinishConnect()
+{
+	if ( mConnected )
+		return 0;
+	if ( !mConnecting )
+		return WSAENOTCONN;
+
+	/* Sockets the poller does not handle check for themselves. */
+	if ( mPollIndex == POLLER_NONE )
+		CheckConnect();
+
+	if ( mFailed )
+	{
+		int error = 0;
+		int len   = sizeof( error );
+		getsockopt( mSocket, SOL_SOCKET, SO_ERROR, (char *)&error, &len );
+
+		Disconnect();
+		return ( error != 0 ) ? error : WSAECONNREFUSED;
+	}
+
+	if ( !mWritable )
+		return WSAEWOULDBLOCK;
+
+	mConnecting = false;
+	mConnected  = true;
+	return 0;
+}
+
 /* Start listening on the specified port for connection requests. */
 int Socket::Listen( uint16_t port )
 {
@@ -164,8 +228,15 @@ int Socket::Receive( Buffer *dest )
 	size_t received    = 0;
 	int    error       = 0;
 
+	/* Polled sockets already know if there is anything to receive. */
+	bool polled = ( mPollIndex != POLLER_NONE );
+	if ( polled && !mReadable )
+		return 0;
+
+	mReadable = false;
+
 	/* Loop until all data has been received. */
-	while ( CAN_RECEIVE )
+	while ( polled || CAN_RECEIVE )
 	{
 		size = recv( mSocket, buffer, buffer_size, 0 );
 		if ( size == SOCKET_ERROR )
@@ -184,8 +255,12 @@ int Socket::Receive( Buffer *dest )
 					Disconnect();
 					return SOCKET_ERROR;
 
+				case WSAEWOULDBLOCK:
+					/* Everything that was available has been read. */
+					return received;
+
 				default:
-					break;
+					return received;
 			}
 		}
 		else 
@@ -215,8 +290,11 @@ int Socket::Send( char *src, size_t len )
 	size_t bytes_left = len;
 	int    error      = 0;
 
+	/* Polled sockets skip the readiness check and stop when the send buffer is full. */
+	bool polled = ( mPollIndex != POLLER_NONE );
+
 	/* Loop until all data has been sent. */
-	while ( CAN_SEND )
+	while ( polled || CAN_SEND )
 	{
 		sent = send( mSocket, src + sent_total, bytes_left, 0 );
 		if ( sent == SOCKET_ERROR )
@@ -237,11 +315,11 @@ int Socket::Send( char *src, size_t len )
 
 				case WSAEWOULDBLOCK:
 				case WSAEINPROGRESS:
-					Disconnect();
+					/* The send buffer is full, the caller keeps the remainder. */
 					return sent_total;
 
 				default:
-					break;
+					return sent_total;
 			}
 		}
 
@@ -257,14 +335,15 @@ int Socket::Send( char *src, size_t len )
 /* Closes the connection and socket. */
 void Socket::Disconnect()
 {
-	if ( !mConnected )
+	if ( !mConnected && !mConnecting )
 		return;
 
 	/* Close the current socket and get a new one. */
 	closesocket( mSocket );
 	mSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
 
-	mConnected = false;
+	mConnected = mConnecting = false;
+	mReadable  = mWritable = mFailed = false;
 }
 
 /* Enables encryption on the socket. */
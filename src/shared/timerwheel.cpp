@@ -0,0 +1,174 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <timerwheel.h>
+
+TimerWheel Timers;
+
+/* Unlinks a timer from the list it is in. */
+static inline void Unlink( Timer *timer )
+{
+	timer->mPrev->mNext = timer->mNext;
+	timer->mNext->mPrev = timer->mPrev;
+	timer->mNext = timer->mPrev = NULL;
+}
+
+/* Appends a timer to a list. */
+static inline void Append( Timer *head, Timer *timer )
+{
+	timer->mNext = head;
+	timer->mPrev = head->mPrev;
+	head->mPrev->mNext = timer;
+	head->mPrev = timer;
+}
+
+/* Moves all timers of a list to another (empty) list. */
+static inline void Splice( Timer *from, Timer *to )
+{
+	if ( from->mNext == from )
+	{
+		to->mNext = to->mPrev = to;
+		return;
+	}
+
+	to->mNext = from->mNext;
+	to->mPrev = from->mPrev;
+	to->mNext->mPrev = to;
+	to->mPrev->mNext = to;
+	from->mNext = from->mPrev = from;
+}
+
+/* Initializes a new instance of the TimerWheel class. */
+TimerWheel::TimerWheel(): mCurrent( 0 ), mDue( 0 ), mLastTick( 0 ), mRemainder( 0 ), mCount( 0 ), mStarted( false )
+{
+	for ( uint32_t l = 0; l < TIMER_LEVELS; l++ )
+		for ( uint32_t s = 0; s < TIMER_SLOTS; s++ )
+			mSlots[l][s].mNext = mSlots[l][s].mPrev = &mSlots[l][s];
+}
+
+/* Schedules a timer to run the callback after the specified delay (in ms), a scheduled timer is moved. */
+void TimerWheel::Schedule( Timer *timer, uint32_t delay, TimerCallback callback, void *context )
+{
+	if ( timer->IsScheduled() )
+		Cancel( timer );
+
+	if ( !mStarted )
+	{
+		mLastTick = GetTick();
+		mStarted  = true;
+	}
+
+	delay = MIN( delay, TIMER_MAX_DELAY );
+
+	timer->mExpires  = mCurrent + ( delay + TIMER_RESOLUTION - 1 ) / TIMER_RESOLUTION;
+	timer->mCallback = callback;
+	timer->mContext  = context;
+
+	Insert( timer );
+	mCount++;
+}
+
+/* Cancels a timer, nothing happens if the timer is not scheduled. */
+void TimerWheel::Cancel( Timer *timer )
+{
+	if ( !timer->IsScheduled() )
+		return;
+
+	Unlink( timer );
+	mCount--;
+}
+
+/* Runs all timers that expired up to the specified tick. */
+void TimerWheel::Advance( uint32_t tick )
+{
+	if ( !mStarted )
+		return;
+
+	/* The wheel turns by the time that passed, which stays right when the tick count wraps. */
+	mRemainder += tick - mLastTick;
+	mLastTick   = tick;
+	mDue       += mRemainder / TIMER_RESOLUTION;
+	mRemainder %= TIMER_RESOLUTION;
+
+	while ( (int)( mDue - mCurrent ) >= 0 )
+	{
+		/* Bring the timers of the next coarser slot down once the finer level wraps around. */
+		uint32_t index = mCurrent & TIMER_SLOT_MASK;
+		if ( index == 0 && Cascade( 1, ( mCurrent >> TIMER_SLOT_BITS ) & TIMER_SLOT_MASK ) == 0 && 
+			 Cascade( 2, ( mCurrent >> ( TIMER_SLOT_BITS * 2 ) ) & TIMER_SLOT_MASK ) == 0 )
+		{
+			Cascade( 3, ( mCurrent >> ( TIMER_SLOT_BITS * 3 ) ) & TIMER_SLOT_MASK );
+		}
+
+		/* Take the slot first, so callbacks can schedule new timers for the current tick. */
+		Timer expired;
+		Splice( &mSlots[0][index], &expired );
+		mCurrent++;
+
+		while ( expired.mNext != &expired )
+		{
+			Timer *timer = expired.mNext;
+			Unlink( timer );
+			mCount--;
+
+			timer->mCallback( timer->mContext );
+		}
+	}
+}
+
+/* Puts a timer in the slot that matches its expiry time. */
+void TimerWheel::Insert( Timer *timer )
+{
+	uint32_t expires = timer->mExpires;
+	uint32_t delta   = expires - mCurrent;
+
+	if ( (int)delta < 0 )
+	{
+		/* Already due, run it on the next tick. */
+		Append( &mSlots[0][mCurrent & TIMER_SLOT_MASK], timer );
+		return;
+	}
+
+	uint32_t level = 0;
+	while ( level < TIMER_LEVELS - 1 && delta >= ( 1U << ( TIMER_SLOT_BITS * ( level + 1 ) ) ) )
+		level++;
+
+	Append( &mSlots[level][( expires >> ( TIMER_SLOT_BITS * level ) ) & TIMER_SLOT_MASK], timer );
+}
+
+/* Redistributes the timers of a slot over the finer levels, returns the index of the slot. */
+uint32_t TimerWheel::Cascade( uint32_t level, uint32_t index )
+{
+	Timer list;
+	Splice( &mSlots[level][index], &list );
+
+	while ( list.mNext != &list )
+	{
+		Timer *timer = list.mNext;
+		Unlink( timer );
+		Insert( timer );
+	}
+	return index;
+}
@@ -0,0 +1,203 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <utf.h>
+#ifdef UTF_SSE2
+#	include <emmintrin.h>
+#endif
+
+THREAD_LOCAL char    __utf8_buff[UTF_BUFFER_SIZE];
+THREAD_LOCAL wchar_t __utf16_buff[UTF_BUFFER_SIZE];
+
+/* Converts UTF-8 to UTF-16. */
+size_t Utf8ToUtf16( const char *src, size_t len, uint16_t *dest, size_t size )
+{
+	const uint8_t *in  = (const uint8_t *)src;
+	size_t         i   = 0;
+	size_t         out = 0;
+
+	if ( size == 0 )
+		return 0;
+
+	while ( i < len )
+	{
+#		ifdef UTF_SSE2
+		/* Widen 16 characters at a time for as long as the input is ASCII. */
+		__m128i zero = _mm_setzero_si128();
+		while ( i + 16 <= len && out + 16 < size )
+		{
+			__m128i chunk = _mm_loadu_si128( (const __m128i *)( in + i ) );
+			if ( _mm_movemask_epi8( chunk ) != 0 )
+				break;
+
+			_mm_storeu_si128( (__m128i *)( dest + out ),     _mm_unpacklo_epi8( chunk, zero ) );
+			_mm_storeu_si128( (__m128i *)( dest + out + 8 ), _mm_unpackhi_epi8( chunk, zero ) );
+			i   += 16;
+			out += 16;
+		}
+		if ( i >= len )
+			break;
+#		endif
+
+		uint32_t c     = in[i];
+		uint32_t cp    = UTF_REPLACEMENT;
+		uint32_t count = 1;
+		uint32_t min   = 0;
+
+		if ( c < 0x80 )
+		{
+			cp = c;
+		}
+		else if ( ( c & 0xE0 ) == 0xC0 ) { count = 2; cp = c & 0x1F; min = 0x80; }
+		else if ( ( c & 0xF0 ) == 0xE0 ) { count = 3; cp = c & 0x0F; min = 0x800; }
+		else if ( ( c & 0xF8 ) == 0xF0 ) { count = 4; cp = c & 0x07; min = 0x10000; }
+
+		/* Decode the continuation bytes, a broken sequence only consumes its first byte. */
+		if ( count > 1 )
+		{
+			uint32_t k = 1;
+			if ( i + count <= len )
+			{
+				for ( ; k < count && ( in[i + k] & 0xC0 ) == 0x80; k++ )
+					cp = ( cp << 6 ) | ( in[i + k] & 0x3F );
+			}
+
+			if ( k != count || cp < min || cp > 0x10FFFF || ( cp >= 0xD800 && cp <= 0xDFFF ) )
+			{
+				cp    = UTF_REPLACEMENT;
+				count = 1;
+			}
+		}
+
+		if ( cp >= 0x10000 )
+		{
+			if ( out + 2 >= size )
+				break;
+
+			cp -= 0x10000;
+			dest[out++] = (uint16_t)( 0xD800 + ( cp >> 10 ) );
+			dest[out++] = (uint16_t)( 0xDC00 + ( cp & 0x3FF ) );
+		}
+		else
+		{
+			if ( out + 1 >= size )
+				break;
+
+			dest[out++] = (uint16_t)cp;
+		}
+		i += count;
+	}
+
+	dest[out] = 0;
+	return out;
+}
+
+/* Converts UTF-16 to UTF-8. */
+size_t Utf16ToUtf8( const uint16_t *src, size_t len, char *dest, size_t size )
+{
+	uint8_t *out = (uint8_t *)dest;
+	size_t   i   = 0;
+	size_t   n   = 0;
+
+	if ( size == 0 )
+		return 0;
+
+	while ( i < len )
+	{
+#		ifdef UTF_SSE2
+		/* Narrow 16 units at a time for as long as the input is ASCII. */
+		__m128i mask = _mm_set1_epi16( (short)0xFF80 );
+		__m128i zero = _mm_setzero_si128();
+		while ( i + 16 <= len && n + 16 < size )
+		{
+			__m128i lo = _mm_loadu_si128( (const __m128i *)( src + i ) );
+			__m128i hi = _mm_loadu_si128( (const __m128i *)( src + i + 8 ) );
+			__m128i high_bits = _mm_and_si128( _mm_or_si128( lo, hi ), mask );
+			if ( _mm_movemask_epi8( _mm_cmpeq_epi16( high_bits, zero ) ) != 0xFFFF )
+				break;
+
+			_mm_storeu_si128( (__m128i *)( out + n ), _mm_packus_epi16( lo, hi ) );
+			i += 16;
+			n += 16;
+		}
+		if ( i >= len )
+			break;
+#		endif
+
+		uint32_t cp    = src[i];
+		uint32_t count = 1;
+
+		if ( cp >= 0xD800 && cp <= 0xDBFF && i + 1 < len && src[i + 1] >= 0xDC00 && src[i + 1] <= 0xDFFF )
+		{
+			cp    = 0x10000 + ( ( cp - 0xD800 ) << 10 ) + ( src[i + 1] - 0xDC00 );
+			count = 2;
+		}
+		else if ( cp >= 0xD800 && cp <= 0xDFFF )
+		{
+			cp = UTF_REPLACEMENT;
+		}
+
+		if ( cp < 0x80 )
+		{
+			if ( n + 1 >= size ) break;
+			out[n++] = (uint8_t)cp;
+		}
+		else if ( cp < 0x800 )
+		{
+			if ( n + 2 >= size ) break;
+			out[n++] = (uint8_t)( 0xC0 | ( cp >> 6 ) );
+			out[n++] = (uint8_t)( 0x80 | ( cp & 0x3F ) );
+		}
+		else if ( cp < 0x10000 )
+		{
+			if ( n + 3 >= size ) break;
+			out[n++] = (uint8_t)( 0xE0 | ( cp >> 12 ) );
+			out[n++] = (uint8_t)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+			out[n++] = (uint8_t)( 0x80 | ( cp & 0x3F ) );
+		}
+		else
+		{
+			if ( n + 4 >= size ) break;
+			out[n++] = (uint8_t)( 0xF0 | ( cp >> 18 ) );
+			out[n++] = (uint8_t)( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+			out[n++] = (uint8_t)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+			out[n++] = (uint8_t)( 0x80 | ( cp & 0x3F ) );
+		}
+		i += count;
+	}
+
+	out[n] = 0;
+	return n;
+}
+
+/* Gets the length (in units) of a terminated UTF-16 string. */
+size_t Utf16Length( const uint16_t *str )
+{
+	const uint16_t *p = str;
+	while ( *p != 0 )
+		p++;
+
+	return (size_t)( p - str );
+}
@@ -0,0 +1,132 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <chat.h>
+#include <playersession.h>
+#include <sessionmanager.h>
+#include <stage.h>
+#include <log.h>
+#include <vector>
+
+extern std::vector<PlayerSession *> g_clients;
+
+std::vector<int> ChatService::mPending;
+
+/* Sends a line to everyone on the stage of the sender. */
+void ChatService::Say( PlayerSession *sender, uint32_t type, const char *message )
+{
+	Stage *stage = sender->GetStage();
+	if ( stage == NULL )
+		return;
+
+	Buffer frame;
+	Frame( frame, sender->GetCharacter()->mId, type, message );
+
+	for ( uint32_t i = 0; i < stage->GetPlayerCount(); i++ )
+	{
+		PlayerSession *player = stage->GetPlayer( i );
+		if ( player != NULL )
+			Queue( player, frame );
+	}
+}
+
+/* Sends a line to the player with the specified character name and echoes it to the sender. */
+bool ChatService::Whisper( PlayerSession *sender, const char *target, uint32_t type, const char *message )
+{
+	PlayerSession *recipient = SessionManager::FindByName<PlayerSession>( target );
+	if ( recipient == NULL || recipient->GetCharacter() == NULL )
+		return false;
+
+	Buffer frame;
+	Frame( frame, sender->GetCharacter()->mId, type, message );
+
+	Queue( recipient, frame );
+	if ( recipient != sender )
+		Queue( sender, frame );
+
+	return true;
+}
+
+/* Shows a message on the board of every player on this square. */
+void ChatService::Announce( const char *from, const char *message )
+{
+	char line[CHAT_MAX_LENGTH + 64];
+	_snprintf( line, sizeof( line ) - 1, "1 %s %s", from, message );
+	line[sizeof( line ) - 1] = 0;
+
+	Buffer frame;
+	Frame( frame, 0xFFFFFFFF, CHAT_TYPE_BOARD, line );
+
+	for ( std::vector<PlayerSession *>::iterator i = g_clients.begin(); i != g_clients.end(); ++i )
+	{
+		if ( ( *i )->GetCharacter() != NULL )
+			Queue( *i, frame );
+	}
+}
+
+/* Takes a token from the bucket, returns false if the player is chatting too fast. */
+bool ChatService::Allow( ChatLimiter &limiter, uint32_t tick )
+{
+	uint32_t elapsed = tick - limiter.mLastTick;
+	limiter.mLastTick = tick;
+	limiter.mTokens   = MIN( limiter.mTokens + MIN( elapsed, CHAT_BURST * CHAT_RATE ), CHAT_BURST * CHAT_RATE );
+
+	if ( limiter.mTokens < CHAT_RATE )
+		return false;
+
+	limiter.mTokens -= CHAT_RATE;
+	return true;
+}
+
+/* Hands the chat gathered during this tick to the sessions. */
+void ChatService::Flush()
+{
+	for ( std::vector<int>::iterator i = mPending.begin(); i != mPending.end(); ++i )
+	{
+		/* The session may have disconnected since. */
+		PlayerSession *player = SessionManager::At<PlayerSession>( *i );
+		if ( player != NULL )
+			player->FlushChat();
+	}
+	mPending.clear();
+}
+
+/* Serializes a chat message, header included. */
+void ChatService::Frame( Buffer &frame, uint32_t char_id, uint32_t type, const char *message )
+{
+	Buffer chatpkt;
+	chatpkt.WriteUInt32( char_id );
+	chatpkt.WriteUInt32( type );
+	chatpkt.WriteWideString( message );
+
+	PlayerSession::Frame( frame, chatpkt, MSG_CHAT_MESSAGE );
+}
+
+/* Adds a serialized message to the pending chat of a player. */
+void ChatService::Queue( PlayerSession *recipient, const Buffer &frame )
+{
+	if ( recipient->QueueChat( frame ) )
+		mPending.push_back( recipient->mSessionId );
+}
@@ -25,70 +25,186 @@
  */
 #include <gatewayclient.h>
 #include <time.h>
+#include <stdlib.h>
+#include <string.h>
 #include <log.h>
 #include <sessionmanager.h>
 #include <playersession.h>
+#include <loadmonitor.h>
+#include <square.h>
+#include <migration.h>
+#include <vector>
 
 extern uint16_t    cfg_square_port;
 extern uint32_t    cfg_square_host;
 extern uint32_t    cfg_square_capacity;
 extern const char *cfg_square_name;
+extern uint32_t    cfg_square_shard;
+
+extern std::vector<PlayerSession *> g_clients;
 
 /* Creates a connection with a gateway server. */
 GatewayClient::GatewayClient( const char *host, uint16_t port ): 
-	mHostname( host ), 
-	mPort( port )
+	mHostname      ( _strdup( host ) ), 
+	mPort          ( port ),
+	mState         ( GATEWAY_DISCONNECTED ),
+	mReconnectDelay( LINK_RECONNECT_MIN ),
+	mRoundTrip     ( 0 ),
+	mNextRequestId ( 1 )
 {
 	ServerLog.Write( "Connecting to gateway %s:%d.\n", E_INFO, mHostname, mPort );
+
+	/* Unanswered session lookups must also expire while the gateway is unreachable. */
+	Timers.Schedule( &mHeartbeatTimer, LINK_HEARTBEAT_INTERVAL * 1000, OnHeartbeat, this );
 	Connect();
 }
 
 /* Closes the connection with the gateway server. */
 GatewayClient::~GatewayClient()
 {
+	Timers.Cancel( &mTimeoutTimer );
+	Timers.Cancel( &mHeartbeatTimer );
+	Timers.Cancel( &mUpdateTimer );
+	Timers.Cancel( &mReconnectTimer );
+
 	ServerLog.Write( "Closing connection with gateway.\n", E_INFO );
+	free( mHostname );
 }
 
-/* Gets data send by the gateway and sends a update every couple of seconds. */
+/* Gets data send by the gateway, the heartbeats and updates are driven by timers. */
 void GatewayClient::Update()
 {
-	if ( mSocket.Connected() )
+	/* Check on a connection attempt without ever waiting for it. */
+	if ( mState == GATEWAY_CONNECTING )
 	{
-		/* Receive incoming data from the gateway. */
-		int recv = mSocket.Receive( &mBufferIn );
-		if ( recv == SOCKET_ERROR )
+		int result = mSocket.FinishConnect();
+		if ( result == 0 )
 		{
-			ErrorLog.Write( "Lost connection with gateway.\n", E_ERROR );
-			return;
+			Established();
 		}
-
-		while ( mBufferIn.Size() >= 2 )
+		else if ( result != WSAEWOULDBLOCK )
 		{
-			uint16_t size = mBufferIn[0] | ( mBufferIn[1] << 8 );
-			if ( size <= mBufferIn.Size() )
-			{
-				char *data = (char *)malloc( size );
-				mBufferIn.Slice( data, size, 0 );
-
-				Process( Buffer( data, size ) );
-				free( data );
-			}
-			else break;
+			ErrorLog.Write( "Unable to connect to gateway (error %d).\n", E_ERROR, result );
+			Disconnect();
 		}
+		return;
+	}
+
+	if ( mState != GATEWAY_CONNECTED )
+		return;
 
-		/* Send a update to the gateway every <x> seconds. */
-		time_t current = time(NULL);
-		if ( mNextUpdate == 0 || current >= mNextUpdate )
+	/* Receive incoming data from the gateway. */
+	int recv = mSocket.Receive( &mBufferIn );
+	if ( recv == SOCKET_ERROR )
+	{
+		ErrorLog.Write( "Lost connection with gateway.\n", E_ERROR );
+		Disconnect();
+		return;
+	}
+	else if ( recv > 0 )
+	{
+		/* The gateway echoes every heartbeat, so a silent link is a dead link. */
+		Timers.Schedule( &mTimeoutTimer, LINK_TIMEOUT * 1000, OnTimeout, this );
+	}
+
+	while ( mBufferIn.Size() >= 2 )
+	{
+		uint16_t size = mBufferIn[0] | ( mBufferIn[1] << 8 );
+		if ( size <= mBufferIn.Size() )
 		{
-			Buffer updatepkt;
+			char *data = (char *)malloc( size );
+			mBufferIn.Slice( data, size, 0 );
 
-			updatepkt.WriteUInt32( 0 );
-			Send( updatepkt, MSG_SQUARE_UPDATE );
-			
-			mNextUpdate = current + UPDATE_INTERVAL;
+			Process( Buffer( data, size ) );
+			free( data );
 		}
+		else break;
 	}
-	else Connect();
+}
+
+/* Sends the load signals and stage set of this square to the gateway. */
+void GatewayClient::SendUpdate()
+{
+	/* Number of bytes still waiting to be send to clients. */
+	uint32_t queued = 0;
+	for ( std::vector<PlayerSession *>::iterator i = g_clients.begin(); i != g_clients.end(); ++i )
+		queued += (uint32_t)( *i )->GetQueuedBytes();
+
+	Buffer updatepkt;
+	updatepkt.WriteUInt32( (uint32_t)g_clients.size() );
+	updatepkt.WriteUInt32( LoadMonitor::GetTickTime() );
+	updatepkt.WriteUInt32( queued );
+	updatepkt.WriteUInt32( LoadMonitor::GetCpuUsage() );
+	Send( updatepkt, MSG_SQUARE_UPDATE );
+
+	/* Refresh the stage set so the gateway routes by current occupancy. */
+	Buffer stagespkt;
+	Square::WriteStages( stagespkt );
+	Send( stagespkt, MSG_SQUARE_STAGES );
+}
+
+/* Sends a heartbeat every couple of seconds and drops requests that were never answered. */
+void GatewayClient::OnHeartbeat( void *context )
+{
+	GatewayClient *gateway = (GatewayClient *)context;
+
+	if ( gateway->mState == GATEWAY_CONNECTED )
+	{
+		Buffer heartbeatpkt;
+		heartbeatpkt.WriteUInt32( GetTick() );
+		gateway->Send( heartbeatpkt, MSG_SQUARE_HEARTBEAT );
+	}
+
+	time_t current = time( NULL );
+	gateway->ExpireRequests( current );
+	Migration::Expire( current );
+
+	Timers.Schedule( &gateway->mHeartbeatTimer, LINK_HEARTBEAT_INTERVAL * 1000, OnHeartbeat, gateway );
+}
+
+/* Send a update to the gateway every <x> seconds. */
+void GatewayClient::OnUpdate( void *context )
+{
+	GatewayClient *gateway = (GatewayClient *)context;
+	gateway->SendUpdate();
+
+	Timers.Schedule( &gateway->mUpdateTimer, UPDATE_INTERVAL * 1000, OnUpdate, gateway );
+}
+
+/* Nothing has been received from the gateway for too long, or connecting took too long. */
+void GatewayClient::OnTimeout( void *context )
+{
+	GatewayClient *gateway = (GatewayClient *)context;
+	if ( gateway->mState == GATEWAY_CONNECTING )
+		ErrorLog.Write( "Connecting to gateway timed out after %d seconds.\n", E_ERROR, LINK_CONNECT_TIMEOUT );
+	else
+		ErrorLog.Write( "Gateway did not respond for %d seconds, reconnecting.\n", E_ERROR, LINK_TIMEOUT );
+
+	gateway->Disconnect();
+}
+
+/* Retries the connection with the gateway. */
+void GatewayClient::OnReconnect( void *context )
+{
+	( (GatewayClient *)context )->Connect();
+}
+
+/* Transmits all messages queued during this tick in a single write. */
+void GatewayClient::Flush()
+{
+	if ( mState != GATEWAY_CONNECTED || mBufferOut.Size() == 0 )
+		return;
+
+	int sent = mSocket.Send( mBufferOut.Content(), mBufferOut.Size() );
+	if ( sent == SOCKET_ERROR )
+	{
+		ErrorLog.Write( "Lost connection with gateway.\n", E_ERROR );
+		Disconnect();
+		return;
+	}
+
+	/* Keep whatever the socket did not accept for the next tick. */
+	mBufferOut.Drain( sent );
 }
 
 /* Processes message received from the gateway. */
@@ -100,15 +216,46 @@ void GatewayClient::Process( Buffer &packet )
 	switch ( cmd )
 	{
 		case MSG_SQUARE_SESSIONINFO: Msg_SessionInfo( packet ); break;
+		case MSG_SQUARE_HEARTBEAT:   Msg_Heartbeat( packet );   break;
+		case MSG_SQUARE_MIGRATE_PREPARE: Migration::Msg_Prepare( packet ); break;
+		case MSG_SQUARE_MIGRATE_READY:   Migration::Msg_Ready( packet );   break;
+		case MSG_SQUARE_MIGRATE_COMMIT:  Migration::Msg_Commit( packet );  break;
 	}
 }
 
 /* Request session details from the gateway. */
 void GatewayClient::GetSessionInfo( uint32_t session_id, const char *key )
+{
+	if ( mRequests.size() >= LINK_MAX_PENDING )
+	{
+		ErrorLog.Write( "[%d] Too many pending session lookups, dropping request.\n", E_WARNING, session_id );
+
+		PlayerSession *cl = SessionManager::At<PlayerSession>( session_id );
+		if ( cl != NULL ) cl->mEOF = true;
+		return;
+	}
+
+	uint32_t request_id = mNextRequestId++;
+	if ( mNextRequestId == LINK_INVALID_REQUEST ) mNextRequestId = 1;
+
+	LinkRequest &request = mRequests[request_id];
+	request.mSessionId = session_id;
+	request.mIssued    = time( NULL );
+	strncpy( request.mSessionKey, key, 8 );
+	request.mSessionKey[8] = 0;
+
+	/* While the gateway is unreachable the request waits here and is send once the link is back. */
+	if ( mState == GATEWAY_CONNECTED )
+		SendRequest( request_id, request );
+}
+
+/* Sends a session lookup to the gateway. */
+void GatewayClient::SendRequest( uint32_t request_id, const LinkRequest &request )
 {
 	Buffer requestpkt;
-	requestpkt.WriteUInt32( session_id );
-	requestpkt.WriteString( key );
+	requestpkt.WriteUInt32( request_id );
+	requestpkt.WriteUInt32( request.mSessionId );
+	requestpkt.WriteString( request.mSessionKey );
 
 	Send( requestpkt, MSG_SQUARE_SESSIONINFO );
 }
@@ -116,59 +263,151 @@ void GatewayClient::GetSessionInfo( uint32_t session_id, const char *key )
 /* Session information received from the gateway. */
 void GatewayClient::Msg_SessionInfo( Buffer &packet )
 {
+	uint32_t request_id = packet.ReadUInt32();
 	uint32_t result     = packet.ReadUInt32();
-	uint32_t session_id = packet.ReadInt32();
 
-	PlayerSession *cl = SessionManager::At<PlayerSession>( session_id );
-	if ( cl != NULL )
+	LinkRequestMap::iterator i = mRequests.find( request_id );
+	if ( i == mRequests.end() )
+		return;
+
+	LinkRequest request = i->second;
+	mRequests.erase( i );
+
+	/* Make sure the slot has not been reused by another client in the meantime. */
+	PlayerSession *cl = SessionManager::At<PlayerSession>( request.mSessionId );
+	if ( cl == NULL || strcmp( cl->mSessionKey, request.mSessionKey ) != 0 )
+		return;
+
+	/* The session picks up the result on its own tick. */
+	bool posted;
+	if ( result != 0 )
 	{
-		if (result != 0)
+		posted = cl->mMailbox.Post( PlayerSession::OnSessionRejected );
+	}
+	else
+	{
+		uint32_t char_id    = packet.ReadUInt32();
+		uint32_t account_id = packet.ReadUInt32();
+
+		posted = cl->mMailbox.Post( PlayerSession::OnSessionInfo, char_id, account_id );
+	}
+
+	if ( !posted )
+	{
+		ErrorLog.Write( "[%d] Mailbox full, dropping session.\n", E_WARNING, request.mSessionId );
+		cl->mEOF = true;
+	}
+}
+
+/* Heartbeat echoed by the gateway. */
+void GatewayClient::Msg_Heartbeat( Buffer &packet )
+{
+	mRoundTrip = GetTick() - packet.ReadUInt32();
+}
+
+/* Disconnects the clients whose session lookup has not been answered in time. */
+void GatewayClient::ExpireRequests( time_t current )
+{
+	for ( LinkRequestMap::iterator i = mRequests.begin(); i != mRequests.end(); )
+	{
+		if ( ( current - i->second.mIssued ) < LINK_REQUEST_TIMEOUT )
 		{
-			cl->mEOF = true;
-			return;
+			++i;
+			continue;
 		}
-		else 
-		{
-			uint32_t char_id    = packet.ReadUInt32();
-			uint32_t account_id = packet.ReadUInt32();
 
-			cl->LoadCharacter( char_id, account_id );
-		}
+		PlayerSession *cl = SessionManager::At<PlayerSession>( i->second.mSessionId );
+		if ( cl != NULL && strcmp( cl->mSessionKey, i->second.mSessionKey ) == 0 )
+			cl->mEOF = true;
+
+		mRequests.erase( i++ );
 	}
 }
 
-/* Sends a packet to the gateway. */
+/* Queues a packet for the gateway, it is transmitted by the next Flush(). */
 void GatewayClient::Send( Buffer &data, uint16_t cmd, uint16_t type )
 {
-	/* Create the packet. */
-	Buffer buffer_packet;
-	buffer_packet.WriteUInt16( data.Size() + 6 );
-	buffer_packet.WriteUInt16( type );
-	buffer_packet.WriteUInt16( cmd );
+	if ( mState != GATEWAY_CONNECTED )
+		return;
 
-	if (data.Size() > 0)
-		buffer_packet.Write( data.Content(), data.Size() );
+	mBufferOut.WriteUInt16( data.Size() + 6 );
+	mBufferOut.WriteUInt16( type );
+	mBufferOut.WriteUInt16( cmd );
 
-	mSocket.Send( (char *)buffer_packet.Content(), buffer_packet.Size() );
+	if ( data.Size() > 0 )
+		mBufferOut.Write( data.Content(), data.Size() );
 }
 
-/* Connects to the gateway server. */
+/* Starts connecting to the gateway server, the result is picked up by Update(). */
 void GatewayClient::Connect()
 {
-	if ( !mSocket.Connected() )
+	if ( mState != GATEWAY_DISCONNECTED )
+		return;
+
+	int result = mSocket.Connect( mHostname, mPort );
+	if ( result == 0 )
 	{
-		int result;
-		if ( ( result = mSocket.Connect( mHostname, mPort ) ) == 0 )
-		{
-			ServerLog.Write( "Connection with gateway established.\n", E_SUCCESS );
+		Established();
+	}
+	else if ( result == WSAEWOULDBLOCK )
+	{
+		mState = GATEWAY_CONNECTING;
+		Timers.Schedule( &mTimeoutTimer, LINK_CONNECT_TIMEOUT * 1000, OnTimeout, this );
+	}
+	else
+	{
+		mSocket.Disconnect();
+		ScheduleReconnect();
+	}
+}
+
+/* The connection with the gateway has been made, introduce this square and replay the waiting requests. */
+void GatewayClient::Established()
+{
+	ServerLog.Write( "Connection with gateway established.\n", E_SUCCESS );
 
-			Buffer infopkt;
-			infopkt.WriteUInt32( cfg_square_host );
-			infopkt.WriteUInt16( cfg_square_port );
-			infopkt.WriteUInt32( cfg_square_capacity );
-			infopkt.WriteString( cfg_square_name );
+	mState          = GATEWAY_CONNECTED;
+	mReconnectDelay = LINK_RECONNECT_MIN;
+	mBufferIn.Clear();
+	mBufferOut.Clear();
 
-			Send( infopkt, MSG_SQUARE_AUTH );
-		}
-	}
+	Buffer infopkt;
+	infopkt.WriteUInt32( cfg_square_host );
+	infopkt.WriteUInt16( cfg_square_port );
+	infopkt.WriteUInt32( cfg_square_capacity );
+	infopkt.WriteString( cfg_square_name );
+	infopkt.WriteUInt32( cfg_square_shard );
+
+	Send( infopkt, MSG_SQUARE_AUTH );
+
+	for ( LinkRequestMap::iterator i = mRequests.begin(); i != mRequests.end(); ++i )
+		SendRequest( i->first, i->second );
+
+	Flush();
+
+	Timers.Schedule( &mTimeoutTimer, LINK_TIMEOUT * 1000, OnTimeout, this );
+	Timers.Schedule( &mHeartbeatTimer, 0, OnHeartbeat, this );
+	Timers.Schedule( &mUpdateTimer, 0, OnUpdate, this );
+}
+
+/* Drops the link, the pending requests are kept and send again after reconnecting. */
+void GatewayClient::Disconnect()
+{
+	mSocket.Disconnect();
+	mState = GATEWAY_DISCONNECTED;
+
+	Timers.Cancel( &mTimeoutTimer );
+	Timers.Cancel( &mUpdateTimer );
+	ScheduleReconnect();
+}
+
+/* Schedules the next connection attempt. The delay doubles with every failure, and is
+ * randomized so squares that lost the same gateway do not all reconnect at once. */
+void GatewayClient::ScheduleReconnect()
+{
+	uint32_t delay = mReconnectDelay * 1000;
+	delay = delay / 2 + (uint32_t)rand() % ( delay / 2 + 1 );
+
+	Timers.Schedule( &mReconnectTimer, delay, OnReconnect, this );
+	mReconnectDelay = MIN( mReconnectDelay * 2, LINK_RECONNECT_MAX );
 }
@@ -0,0 +1,74 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_CHAT_H__
+#define __SOLDIN_CHAT_H__
+
+#include <shared.h>
+#include <buffer.h>
+#include <vector>
+
+/* Message type the client shows on the board. */
+#define CHAT_TYPE_BOARD 8
+
+/* Rate limit, a player can send CHAT_BURST lines in a row and earns one back every CHAT_RATE ms. */
+#define CHAT_BURST 5
+#define CHAT_RATE  1000
+
+/* Longest line (in bytes of UTF-8) that is relayed. */
+#define CHAT_MAX_LENGTH 256
+
+/* Token bucket that limits how fast a player can chat. */
+struct chat_limiter_t
+{
+	uint32_t mTokens;    /* In ms, a line costs CHAT_RATE. */
+	uint32_t mLastTick;
+
+	/* Initializes a full bucket. */
+	chat_limiter_t(): mTokens( CHAT_BURST * CHAT_RATE ), mLastTick( 0 ) { }
+};
+typedef struct chat_limiter_t ChatLimiter;
+
+class PlayerSession;
+
+/* Routes chat to the players that should see it. Every line is serialized
+ * once and copied into the pending chat of each recipient, which is handed
+ * to the sessions in a single write per recipient at the end of the tick. */
+class ChatService {
+public:
+	static void Say( PlayerSession *sender, uint32_t type, const char *message );
+	static bool Whisper( PlayerSession *sender, const char *target, uint32_t type, const char *message );
+	static void Announce( const char *from, const char *message );
+	static bool Allow( ChatLimiter &limiter, uint32_t tick );
+	static void Flush();
+
+private:
+	static void Frame( Buffer &frame, uint32_t char_id, uint32_t type, const char *message );
+	static void Queue( PlayerSession *recipient, const Buffer &frame );
+
+	static std::vector<int> mPending;  /* Sessions with chat waiting to be flushed. */
+};
+
+#endif /* __SOLDIN_CHAT_H__ */
@@ -28,13 +28,27 @@
 
 #include <socket.h>
 #include <buffer.h>
-#include <vector>
+#include <link.h>
+#include <sessionmanager.h>
+#include <timerwheel.h>
+#include <map>
 
 #define UPDATE_INTERVAL 5
 
-#define MSG_SQUARE_AUTH        0x0001
-#define MSG_SQUARE_UPDATE      0x0002
-#define MSG_SQUARE_SESSIONINFO 0x0003
+/* States of the link with the gateway. */
+#define GATEWAY_DISCONNECTED 0
+#define GATEWAY_CONNECTING   1
+#define GATEWAY_CONNECTED    2
+
+/* A session lookup that has been send to the gateway but not yet answered. */
+struct link_request_t {
+	int    mSessionId;
+	char   mSessionKey[9];
+	time_t mIssued;
+};
+typedef struct link_request_t LinkRequest;
+
+typedef std::map<uint32_t, LinkRequest> LinkRequestMap;
 
 class GatewayClient {
 public:
@@ -42,25 +56,51 @@ public:
 	~GatewayClient();
 
 	void        Update();
+	void        Flush();
 	void        Send( Buffer &data, uint16_t cmd, uint16_t type = 0x55E0 );
 	void        Process( Buffer &packet );
 	void        GetSessionInfo( uint32_t session_id, const char *key );
 
-	const char *GetHostname() { return mHostname; }
-	uint16_t	GetPort()     { return mPort; }
-	Socket     *GetSocket()   { return &mSocket; }
+	const char *GetHostname()     { return mHostname; }
+	uint16_t	GetPort()         { return mPort; }
+	Socket     *GetSocket()       { return &mSocket; }
+	int         GetState()        { return mState; }
+	size_t      GetPendingCount() { return mRequests.size(); }
+	uint32_t    GetRoundTrip()    { return mRoundTrip; }
 
 private:
 	void Connect();
+	void Established();
+	void Disconnect();
+	void ScheduleReconnect();
+	void ExpireRequests( time_t current );
+	void SendRequest( uint32_t request_id, const LinkRequest &request );
+	void SendUpdate();
+
+	/* Timer callbacks. */
+	static void OnHeartbeat( void *context );
+	static void OnUpdate( void *context );
+	static void OnTimeout( void *context );
+	static void OnReconnect( void *context );
 
 	/* Packet handlers. */
 	void Msg_SessionInfo( Buffer &packet );
+	void Msg_Heartbeat( Buffer &packet );
 
-	const char *mHostname;
-	uint16_t    mPort;
-	Socket      mSocket;
-	time_t      mNextUpdate;
-	Buffer      mBufferIn;
+	char          *mHostname;   /* A copy, the settings it came from can be reloaded. */
+	uint16_t       mPort;
+	Socket         mSocket;
+	int            mState;
+	Timer          mUpdateTimer;
+	Timer          mHeartbeatTimer;
+	Timer          mTimeoutTimer;
+	Timer          mReconnectTimer;
+	uint32_t       mReconnectDelay;
+	uint32_t       mRoundTrip;
+	uint32_t       mNextRequestId;
+	LinkRequestMap mRequests;
+	Buffer         mBufferIn;
+	Buffer         mBufferOut;
 };
 
 #endif /* __SOLDIN_GATEWAYCLIENT_H__ */
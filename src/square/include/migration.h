@@ -0,0 +1,92 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_MIGRATION_H__
+#define __SOLDIN_MIGRATION_H__
+
+#include <shared.h>
+#include <buffer.h>
+#include <account.h>
+#include <character.h>
+#include <link.h>
+#include <time.h>
+
+/* Maximum number of players that can be migrating to or from this square at once. */
+#define MAX_MIGRATIONS     512
+
+/* Seconds a preloaded player is kept around waiting for the client to show up. */
+#define MIGRATION_TIMEOUT  30
+
+class PlayerSession;
+
+/* The state of a player that is being moved to another square. */
+struct migration_state_t {
+	bool           mUsed;
+	char           mSessionKey[9];
+	time_t         mIssued;
+	uint32_t       mRequestId;
+	int            mSessionId;    /* Session on the source square (source only). */
+	uint32_t       mTargetShard;  /* Shard the player is moving to (source only). */
+	AccountInfo   *mAccount;      /* Preloaded account (target only). */
+	CharacterData *mCharacter;    /* Preloaded character (target only). */
+	Vector3        mPosition;
+	Vector3        mDirection;
+	bool           mMoving;
+	uint8_t        mMoveDirection;
+	uint32_t       mStageGroup;
+	uint32_t       mStageLevel;
+};
+typedef struct migration_state_t MigrationState;
+
+/* Moves players between square shards without kicking them. The gateway 
+ * relays the messages, the target preloads the player before the client 
+ * is redirected so only the reconnect itself is visible to the player. */
+class Migration {
+public:
+	static bool            Begin( PlayerSession *player, uint32_t target_shard );
+	static uint32_t        Drain( uint32_t target_shard );
+	static MigrationState *Claim( const char *session_key );
+	static void            Release( MigrationState *state );
+	static void            Expire( time_t current );
+
+	/* Link message handlers. */
+	static void Msg_Prepare( Buffer &packet );
+	static void Msg_Ready( Buffer &packet );
+	static void Msg_Commit( Buffer &packet );
+
+	static void WriteCharacter( Buffer &packet, const CharacterData *c );
+	static bool ReadCharacter( Buffer &packet, CharacterData *c );
+	static void ReadState( Buffer &packet, MigrationState *state );
+
+private:
+	static MigrationState *Allocate( const char *session_key );
+	static MigrationState *Find( const char *session_key );
+	static uint32_t        GetArrivingCount();
+
+	static MigrationState mStates[MAX_MIGRATIONS];
+	static uint32_t       mNextRequestId;
+};
+
+#endif /* __SOLDIN_MIGRATION_H__ */
@@ -35,4 +35,43 @@
 #define DIR_NORTH     8
 #define DIR_NORTHEAST 9
 
+#include <shared.h>
+
+/* Fixed point layout of the movement simulation. */
+#define MOVEMENT_FIXED_SHIFT 10     /* Positions are stored in 1/1024th of a unit. */
+#define MOVEMENT_STEP_SHIFT  16     /* Precision of the per tick time step. */
+#define MOVEMENT_MAX_STEP    250    /* Longest time (ms) integrated in a single tick. */
+#define MOVEMENT_RUN_SPEED   33.33f /* Units per second a running character covers. */
+
+/* Simulates the movement of everything on a stage. Entities are stored 
+ * as a structure of arrays in the same packed order as the players of
+ * the stage, so a tick is a single branch-free pass over a few arrays. */
+class MovementSystem {
+public:
+	MovementSystem();
+	~MovementSystem();
+
+	bool     Initialize( uint32_t capacity );
+	uint32_t Add( const Vector3 &position, uint8_t dir );
+	void     Remove( uint32_t slot );
+	void     SetDirection( uint32_t slot, uint8_t dir );
+	void     GetPosition( uint32_t slot, Vector3 &position ) const;
+	void     Integrate( uint32_t tick );
+
+	inline uint32_t GetCount() const { return mCount; }
+
+	static bool           IsValidDirection( uint8_t dir );
+	static const Vector3 &GetDirection( uint8_t dir );
+
+private:
+	int     *mPosX;
+	int     *mPosY;
+	int     *mPosZ;
+	int     *mVelX;
+	int     *mVelZ;
+	uint32_t mCount;
+	uint32_t mCapacity;
+	uint32_t mLastTick;
+};
+
 #endif /* __SOLDIN_MOVEMENT_H__ */
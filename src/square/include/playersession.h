@@ -30,6 +30,8 @@
 #include <buffer.h>
 #include <sessionmanager.h>
 #include <database.h>
+#include <migration.h>
+#include <chat.h>
 
 /* Packet command ID's. */
 #define MSG_CHARACTER_INFO			0x3DDA
@@ -39,6 +41,7 @@
 #define MSG_LOAD_AUTHENTICATE		0x7260 // send only by the client.
 #define MSG_LOAD_PROGRESS			0x81B6
 #define MSG_LOAD_DONE				0xB98B
+#define MSG_SQUARE_REDIRECT			0xB98B // same layout as the square details send by the gateway.
 #define MSG_INVENTORY_GETBAGITEMS	0x2CF3
 #define MSG_INVENTORY_BAGLIST		0xFA8D
 #define MSG_INVENTORY_GETBANKITEMS	0x5190
@@ -66,11 +69,26 @@
 #define HASH_LIST_STATEFLAGS		0x393C1276
 #define HASH_LIST_STAGELICENSES		0x393C61D4
 
+/* Item list hashes. */
+#define HASH_ITEMSLOT				0x13D35362
+#define HASH_ITEMPOSITION			0x613E5DCA
+
 /* Action hashes. */
 #define ACT_IDLE	0x01327338
 #define ACT_RUN		0x00004e0d
 #define ACT_DASH	0x0002cbf3
 
+/* Slot of a player that is not on a stage. */
+#define INVALID_STAGE_SLOT 0xFFFFFFFF
+
+/* The version of an inventory the client has been send. */
+struct inventory_sync_t
+{
+	bool     mSent;
+	uint32_t mVersion;
+};
+typedef struct inventory_sync_t InventorySync;
+
 class Stage;
 class PlayerSession: public Session
 {
@@ -81,14 +99,41 @@ public:
 	void           Update();
 	void           Process( Buffer &buffer );
     void           Send( Buffer &buffer, uint16_t cmd, uint16_t type = 0x55E0 );
+	static void    Frame( Buffer &out, const Buffer &buffer, uint16_t cmd, uint16_t type = 0x55E0 );
 	void           SendBoardMessage( const char *from, const char *message );
+	void           SendFrames( const Buffer &frames );
 	void           SetAction( uint32_t action );
 	void           SetEncryptionKey( uint32_t key );
 	void           LoadCharacter( uint32_t char_id, uint32_t account_id );
 
+	/* Mail handlers. */
+	static void    OnSessionInfo( void *target, const Mail *mail );
+	static void    OnSessionRejected( void *target, const Mail *mail );
+	static void    OnLoadAdmitted( void *target, const Mail *mail );
+	static void    OnQueuePosition( void *target, const Mail *mail );
+
 	inline bool	   Connected()    { return mSocket->Connected(); }
 	inline Socket *GetSocket()    { return mSocket; }
-	CharacterInfo *GetCharacter() { return mCharacter; }
+	inline const Vector3 &GetPosition() const { return mPosition; }
+	inline const Vector3 &GetDirection() const { return mDirection; }
+	inline uint8_t GetMoveDirection() const { return mMoving ? mMoveDirection : 0; }
+	inline size_t  GetQueuedBytes() const { return mBufferOut.Size(); }
+	CharacterData *GetCharacter() { return mCharacter; }
+	AccountInfo   *GetAccount()   { return mAccount; }
+	Stage         *GetStage()     { return mStage; }
+	Inventory     *GetInventory();
+	Inventory     *GetBank();
+
+	/* Migration */
+	void           WriteMigrationState( Buffer &packet );
+	void           ResumeMigration( MigrationState *state );
+	void           Redirect( const char *host, uint16_t port );
+
+	/* Chat */
+	bool           QueueChat( const Buffer &frame );
+	void           FlushChat();
+
+	uint32_t       mStageSlot;
 
 private:
 	Socket        *mSocket;
@@ -98,8 +143,10 @@ private:
 	Vector3		   mPosition;
 	Vector3		   mDirection;
 	AccountInfo   *mAccount;
-	CharacterInfo *mCharacter;
+	CharacterData *mCharacter;
 	Stage         *mStage;
+	bool           mClosing;
+	bool           mLoadRequested;  /* The client asked to be loaded, repeats are ignored. */
 
 	/* Movement */
 	//uint32_t last_move_tick;
@@ -107,7 +154,6 @@ private:
 
 	
 	bool     mMoving;
-	uint32_t mMoveStartTick;
 	uint8_t  mMoveDirection;
 	//bool     is_dash;
 	
@@ -117,6 +163,7 @@ private:
 	//void Move( uint32_t tick );
 
 	void Unsupported( Buffer &packet );
+	void Authenticate();
 
 	/* Packet handlers. */
 	void Msg_Character_Move( Buffer &packet );
@@ -139,6 +186,22 @@ private:
 
 	void SendCharacterList();
 	void SendCharacterInfo();
+	void SendBagList();
+
+	/* Chat. */
+	Buffer      mChatOut;
+	ChatLimiter mChatLimiter;
+
+	/* Item lists. */
+	InventorySync mBagSync;
+	InventorySync mBankSync;
+	void SendItems( Inventory *inventory, uint32_t list_hash, uint16_t command, InventorySync &sync );
+	void SyncItems();
+
+	/* Bag license expiry. */
+	Timer mLicenseTimer;
+	void  ScheduleLicenseExpiry();
+	static void OnLicenseExpiry( void *context );
 };
 
 #endif /* __SOLDIN_PLAYERSESSION_H__ */
@@ -0,0 +1,87 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#ifndef __SOLDIN_SNAPSHOT_H__
+#define __SOLDIN_SNAPSHOT_H__
+
+#include <shared.h>
+#include <buffer.h>
+
+/* Maximum number of entity updates send to a single observer in one tick. */
+#define SNAPSHOT_MAX_UPDATES   32
+
+/* Positions are compared at 1/16th of a unit, smaller changes can not be seen and are not published. */
+#define SNAPSHOT_QUANTIZE      16
+
+/* Size of a framed SetAction message, the client knows no smaller way to receive an update. */
+#define SNAPSHOT_FRAME_SIZE    42
+
+class PlayerSession;
+
+/* Publishes the action state of the entities on a stage. Changes are 
+ * collected during the tick and only the latest state of every changed 
+ * entity is send once per tick. Every observer keeps track of the changes 
+ * it has received, so an observer that hit the update limit picks up 
+ * where it left off during the next tick. Entities and observers share 
+ * the packed slot order of the stage. The message of a changed entity is
+ * built once per tick and copied to every observer, whose updates leave
+ * as a single write. */
+class SnapshotSystem {
+public:
+	SnapshotSystem();
+	~SnapshotSystem();
+
+	bool     Initialize( uint32_t capacity );
+	uint32_t Add( uint32_t character_id );
+	void     Remove( uint32_t slot );
+	void     Set( uint32_t slot, uint32_t action, const Vector3 &position, const Vector3 &direction );
+	void     Publish( PlayerSession **observers );
+
+private:
+	void     Write( uint32_t slot );
+
+	/* Entity state. */
+	uint32_t *mCharacterId;
+	uint32_t *mAction;
+	int      *mPosition;   /* Quantized x, y, z. */
+	float    *mDirection;  /* x, y, z. */
+	uint32_t *mChanged;    /* Sequence of the last change. */
+	uint32_t *mFramed;     /* Sequence the frame below was built in. */
+	char     *mFrames;     /* Framed SetAction message of every entity. */
+
+	/* Observer state. */
+	uint32_t *mDelivered;  /* Every change up to this sequence has been send. */
+	uint32_t *mPass;       /* Sequence at the start of the current pass over the entities. */
+	uint32_t *mCursor;     /* Entity the current pass continues at. */
+
+	uint32_t  mSequence;
+	uint32_t  mCount;
+	uint32_t  mCapacity;
+	Buffer    mPacket;
+	Buffer    mFrame;
+	Buffer    mBatch;      /* Updates of the current observer. */
+};
+
+#endif /* __SOLDIN_SNAPSHOT_H__ */
@@ -28,16 +28,25 @@
 
 #include <shared.h>
 #include <stage.h>
+#include <link.h>
+
+#define MAX_HUB_STAGES LINK_MAX_STAGES
 
 class Square {
 public:
-	static void   Initialize();
-	static Stage *GetStage()         { return mStageSquare; }
-	static Stage *GetTutorialStage() { return mStageTutorial; }
+	static void     Initialize( uint32_t stage_count, uint32_t stage_capacity );
+	static Stage   *GetStage();
+	static uint32_t GetFreeRoom();
+	static Stage   *GetTutorialStage() { return mStageTutorial; }
+	static void     WriteStages( Buffer &packet );
+
+	inline static uint32_t GetStageCount() { return mStageCount; }
+	inline static Stage   *GetStage( uint32_t index ) { return ( index < mStageCount ) ? mStages[index] : NULL; }
 
 private:
-	static Stage *mStageSquare;
-	static Stage *mStageTutorial;
+	static Stage   *mStages[MAX_HUB_STAGES];
+	static uint32_t mStageCount;
+	static Stage   *mStageTutorial;
 };
 
 #endif /* __SOLDIN_SQUARE_H__ */
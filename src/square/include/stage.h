@@ -29,6 +29,10 @@
 #include <shared.h>
 #include <playersession.h>
 #include <buffer.h>
+#include <movement.h>
+#include <snapshot.h>
+#include <timerwheel.h>
+#include <mailbox.h>
 #include <vector>
 
 /* Stage error codes. */
@@ -37,6 +41,10 @@
 #define STERR_UNKNOWN    2
 #define STERR_PLNOTFOUND 3
 #define STERR_CLOSED     4
+#define STERR_JOINED     5
+
+/* Seconds an empty stage is kept around before it is destroyed. */
+#define STAGE_SHUTDOWN_DELAY 30
 
 typedef struct object_t {
 	uint32_t id;
@@ -50,17 +58,25 @@ public:
 	Stage( uint32_t stage_group, uint32_t level, uint32_t max_players );
 	~Stage();
 
+	bool     Initialize();
+
 	int      Join( PlayerSession *player );
 	int      Leave( PlayerSession *player );
 	void     Send( Buffer &packet, uint16_t cmd, int exclude_id = -1 );
 	void     Transfer( PlayerSession *player );
+	void     Update( uint32_t tick );
+	inline MovementSystem &GetMovement() { return mMovement; }
+	inline SnapshotSystem &GetSnapshots() { return mSnapshots; }
 	uint32_t GetGroupID()     const { return mStageGroup; }
+	uint32_t GetLevel()       const { return mLevel; }
 	uint32_t GetPlayerCount() const { return mPlayerCount; }
 	uint32_t MaxPlayers()     const { return mMaxPlayers; }
+	PlayerSession *GetPlayer( uint32_t index ) const { return ( index < mPlayerCount ) ? mPlayers[index] : NULL; }
 
 	int  mStageId;
-	bool mHub;
-	bool mClosed;
+	bool    mHub;
+	bool    mClosed;
+	Mailbox mMailbox;
 
 private:
 	PlayerSession **mPlayers;
@@ -70,6 +86,11 @@ private:
 	uint32_t        mLevel;
 	uint32_t        mNextObjectId;
 	objectlist_t    mObjects;
+	MovementSystem  mMovement;
+	SnapshotSystem  mSnapshots;
+	Timer           mShutdownTimer;
+
+	static void OnShutdown( void *context );
 };
 
 #endif /* __SOLDIN_STAGE_H__ */
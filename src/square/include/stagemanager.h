@@ -37,6 +37,7 @@ public:
 	static void   Initialize();
 	static Stage *Create( uint32_t stage_group, uint32_t level, uint32_t max_players );
 	static void   Destroy( uint32_t stage_id );
+	static void   Update();
 	static Stage *At( uint32_t stage_id ) { return mStages[stage_id]; }
 
 private:
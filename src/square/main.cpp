@@ -35,10 +35,19 @@
 #include <playersession.h>
 #include <vector>
 #include <database.h>
+#include <localstorage.h>
+#include <shardedstorage.h>
+#include <dbstats.h>
 #include <crypt.h>
 #include <time.h>
 #include <square.h>
 #include <stagemanager.h>
+#include <loadmonitor.h>
+#include <admission.h>
+#include <timerwheel.h>
+#include <poller.h>
+#include <mailbox.h>
+#include <chat.h>
 
 Socket         g_square_socket;
 Settings       g_square_config("config/soldin_square.cfg");
@@ -48,6 +57,7 @@ uint16_t    cfg_square_port;
 uint32_t    cfg_square_host;
 uint32_t    cfg_square_capacity;
 const char *cfg_square_name;
+uint32_t    cfg_square_shard;
 uint16_t    cfg_gateway_port;
 const char *cfg_gateway_host;
 const char *cfg_sql_host;
@@ -55,6 +65,7 @@ const char *cfg_sql_username;
 const char *cfg_sql_password;
 const char *cfg_sql_database;
 uint16_t    cfg_sql_port;
+uint32_t    cfg_tick_interval;
 
 std::vector<PlayerSession *> g_clients;
 
@@ -76,10 +87,11 @@ void PrintBanner()
 	Console::SetTitle("Soldin Square Server");
 }
 
+/* Accepts all pending connections, so a burst of logins does not trickle in at one client per tick. */
 void Accept()
 {
-	Socket *sock = g_square_socket.Accept();
-	if ( sock != NULL )
+	Socket *sock;
+	for ( uint32_t n = 0; n < ACCEPT_BATCH && ( sock = g_square_socket.Accept() ) != NULL; n++ )
 	{
 		PlayerSession *pl = new PlayerSession( sock );
 
@@ -159,6 +171,22 @@ void LoadNPCs()
 	}
 }
 
+/* Reads the settings that can be changed while the server is running. */
+void ApplySettings()
+{
+	cfg_square_capacity = g_square_config.GetInt( "square_capacity", 100 );
+	cfg_tick_interval   = MAX( g_square_config.GetInt( "tick_interval", 10 ), 1 );
+	Log::SetLevel( g_square_config.GetString( "log_level", "debug" ) );
+
+	/* The string belongs to the settings, so it is taken again after every reload. */
+	cfg_square_name = g_square_config.GetString( "square_name", "Square" );
+
+	DBStats::SetSlowThreshold( g_square_config.GetInt( "sql_slow_query_ms", 100 ) );
+	DBStats::Start( g_square_config.GetInt( "sql_stats_interval", 60 ) );
+	Admission::Configure( g_square_config.GetInt( "admission_tick_budget", 10 ), g_square_config.GetInt( "admission_max_in_flight", 32 ), 
+		g_square_config.GetInt( "admission_max_queue", 2000 ) );
+}
+
 /* Main entry point of the application. */
 int main()
 {
@@ -171,16 +199,25 @@ int main()
 	/* Initialize managers. */
 	StageManager::Initialize();
 
-	Square::Initialize();
-
-
 	/* Load the square configuration. */
-	cfg_square_name  = g_square_config.GetString("square_name", "Square");
-	cfg_square_capacity = g_square_config.GetInt("square_capacity", 100);
+	ApplySettings();
 	cfg_square_host = inet_addr(g_square_config.GetString("square_host", "127.0.0.1"));
 	cfg_square_port = g_square_config.GetInt("square_port", 15551);
+	cfg_square_shard = g_square_config.GetInt("square_shard", 0);
 	ServerLog.Write("Square: %s (port: %d, capacity: %d)\n", E_NOTICE, cfg_square_name, cfg_square_port, cfg_square_capacity);
 
+	/* Select how socket readiness is collected. */
+	Poller::Initialize( _stricmp( g_square_config.GetString( "io_backend", "poller" ), "socket" ) == 0 ? IO_BACKEND_SOCKET : IO_BACKEND_POLLER );
+
+	/* Create the hub stages served by this shard. */
+	Square::Initialize( g_square_config.GetInt( "square_stages", 1 ), g_square_config.GetInt( "square_stage_capacity", 100 ) );
+	if ( Square::GetStageCount() == 0 )
+	{
+		ErrorLog.Write( "Failed to create the hub stages.\n", E_ERROR );
+		exit( -1 );
+	}
+	ServerLog.Write("Shard %u is hosting %u hub stage(s).\n", E_NOTICE, cfg_square_shard, Square::GetStageCount());
+
 	/* Load the SQL configuration. */
 	cfg_sql_host     = g_square_config.GetString("sql_host",     "localhost");
 	cfg_sql_username = g_square_config.GetString("sql_username", "root");
@@ -188,7 +225,30 @@ int main()
 	cfg_sql_database = g_square_config.GetString("sql_database", "soldin");
 	cfg_sql_port     = g_square_config.GetInt(   "sql_port",     3306);
 
-	if ( !DB::Connect( cfg_sql_host, cfg_sql_username, cfg_sql_password, cfg_sql_database, cfg_sql_port ) )
+	/* Use the embedded storage when no database server is wanted, and route
+	 * over several MySQL servers when shards or replicas are configured. */
+	ShardedStorage *sharded;
+	if ( _stricmp( g_square_config.GetString( "storage", "mysql" ), "local" ) == 0 )
+	{
+		const char *path = g_square_config.GetString( "storage_path", "data/soldin.db" );
+
+		if ( !DB::Use( new LocalStorage( path ) ) )
+		{
+			DB::LogError();
+			exit( -1 );
+		}
+		else ServerLog.Write( "Using the local storage in %s.\n", E_SUCCESS, path );
+	}
+	else if ( ( sharded = ShardedStorage::Load( g_square_config ) ) != NULL )
+	{
+		if ( !DB::Use( sharded ) )
+		{
+			DB::LogError();
+			exit( -1 );
+		}
+		else ServerLog.Write( "Connection with %u MySQL shard(s) established.\n", E_SUCCESS, sharded->GetShardCount() );
+	}
+	else if ( !DB::Connect( cfg_sql_host, cfg_sql_username, cfg_sql_password, cfg_sql_database, cfg_sql_port ) )
 	{
 		DB::LogError();
 		exit( -1 );
@@ -210,15 +270,45 @@ int main()
 	g_gateway = new GatewayClient( cfg_gateway_host, cfg_gateway_port );
 
 	
+	/* The queue position only keeps waiting clients alive and is logged, the client has no packet to show it. */
+	Admission::SetReportHandler( PlayerSession::OnQueuePosition );
+
 	/* Main server loop. */
 	while (true)
 	{
+		LoadMonitor::BeginTick();
+
+		/* Pick up changes to the configuration file. */
+		if ( g_square_config.Poll() )
+			ApplySettings();
+
+		/* Run everything that is due, timeouts, heartbeats and expiries. */
+		Timers.Advance( GetTick() );
+
+		/* Let in the loads and handoffs the tick has room for. */
+		Admission::Pump();
+
+		/* A single readiness check for every connection. */
+		Poller::Poll();
+
 		g_gateway->Update();
 
 		Accept();
 
+		/* Move everything before the clients act on the positions. */
+		StageManager::Update();
+
 		Update();
+
+		/* Hand out the chat of this tick, one write per recipient. */
+		ChatService::Flush();
+
+		/* Send everything queued for the gateway during this tick at once. */
+		g_gateway->Flush();
+
+		LoadMonitor::EndTick();
 		
-		sleep(10);
+		/* Sleep until the next tick, or until another thread posts something. */
+		Mailbox::Wait( cfg_tick_interval );
 	}
 }
\ No newline at end of file
@@ -27,18 +27,63 @@
 #include <gatewayclient.h>
 #include <log.h>
 #include <square.h>
+#include <migration.h>
+#include <admission.h>
 
 extern GatewayClient *g_gateway;
 
 /* Receives a session key from the client and tries to lookup the details for that session. */
 void PlayerSession::Msg_Load_Authenticate( Buffer &packet )
 {
-	const char *session_key = UTF8( packet.ReadWideString() );
+	/* A client is loaded once, a repeat would take another admission and load the character again. */
+	if ( mLoadRequested )
+		return;
+
+	mLoadRequested = true;
+
+	char session_key[UTF_BUFFER_SIZE];
+	packet.ReadWideString( session_key, sizeof( session_key ) );
 	#if defined(_DEBUG)
 	DebugLog.Write( "[%d][CLIENT] Received session key '%s', authenticating...\n", E_INFO, mSessionId, session_key );
 	#endif
 
-	g_gateway->GetSessionInfo( mSessionId, session_key );
+	/* Remember the key so the reply can be matched to this client. */
+	strncpy( mSessionKey, session_key, 8 );
+	mSessionKey[8] = 0;
+
+	/* Loads and handoffs are let in as the tick has room for them, the others wait their turn. */
+	switch ( Admission::Request( this, OnLoadAdmitted ) )
+	{
+		case ADMIT_NOW:
+			Authenticate();
+			break;
+
+		case ADMIT_QUEUED:
+			break;
+
+		default:
+			ServerLog.Write( "[%d][CLIENT] Load refused, the load queue is full.\n", E_WARNING, mSessionId );
+			mEOF = true;
+			break;
+	}
+}
+
+/* Looks up the admitted session at the gateway, or takes over a player migrating from another shard. */
+void PlayerSession::Authenticate()
+{
+	/* Players migrating from another shard have already been loaded. */
+	MigrationState *state = Migration::Claim( mSessionKey );
+	if ( state != NULL )
+	{
+		Admission::BeginWork();
+		ResumeMigration( state );
+		Admission::EndWork();
+
+		Migration::Release( state );
+		return;
+	}
+
+	g_gateway->GetSessionInfo( mSessionId, mSessionKey );
 }
 
 /* When the client sends the loading progress reply with the previous
@@ -49,7 +94,7 @@ void PlayerSession::Msg_Load_Progress( Buffer &packet )
 	float progress = packet.ReadFloat();
 
 	Buffer progresspkt;
-	progresspkt.WriteWideString( UTF16( mCharacter->mName ) );
+	progresspkt.WriteWideString( mCharacter->mName );
 	progresspkt.WriteFloat( mProgress );
 
 	Send( progresspkt, MSG_LOAD_PROGRESS );
@@ -59,6 +104,13 @@ void PlayerSession::Msg_Load_Progress( Buffer &packet )
 /* Client has finished loading, move the client to the square stage. */
 void PlayerSession::Msg_Load_Done( Buffer &buffer )
 {
+	/* Only a loaded character can join, and only once. */
+	if ( mStage != NULL || mCharacter == NULL )
+		return;
+
+	/* The client is in, which makes room for the next one. */
+	Admission::Finish( this );
+
 	SendCharacterList();
 
 	/* StateBundle data?? ??? */
@@ -70,41 +122,36 @@ void PlayerSession::Msg_Load_Done( Buffer &buffer )
 			changestagepkt.WriteUInt32(0); // ID of stage change initiator.
 			Send(changestagepkt, MSG_STAGE_CHANGE);*/
 
-	mStage = Square::GetStage();
-
-	int result = 0;
-	if ( ( result = mStage->Join( this ) ) != STERR_NONE )
+	/* The stage is only remembered once the player has a slot on it, the rest of the batch may still move. */
+	Stage *stage = Square::GetStage();
+	if ( stage->Join( this ) != STERR_NONE )
 	{
 		mEOF = true;
+		return;
 	}
+
+	mStage = stage;
 }
 
-/* Sends a list of all the items in the characters bags. */
+/* Sends a list of the items in the characters bags, or the changes if the client already has it. */
 void PlayerSession::Msg_Inventory_GetBagItems( Buffer &packet )
 {
-	Buffer listpkt;
-	listpkt.WriteUInt32( HASH_LIST_BAGITEMS );
-	listpkt.WriteUInt32( 0 );
+	/* The bags are only read from the database once the client opens them. */
+	Inventory *bags = GetInventory();
+	if ( bags == NULL )
+		return;
 
-	Send( listpkt, MSG_INVENTORY_GETBAGITEMS );
+	SendItems( bags, HASH_LIST_BAGITEMS, MSG_INVENTORY_GETBAGITEMS, mBagSync );
 }
 
-/* Sends a list of all the items in the characters bank. */
+/* Sends a list of the items in the characters bank, or the changes if the client already has it. */
 void PlayerSession::Msg_Inventory_GetBankItems( Buffer &packet )
 {
-	Buffer listpkt;
-	listpkt.WriteUInt32( HASH_LIST_BANKITEMS );
-	listpkt.WriteUInt32( 0 );
-	/*
-	out.Add_uint32(0x13d35362); // ItemSlot identifier/Counter
-	out.Add_uint32(0x01566d86); // Id
-	out.Add_uint32(0x613e5dca); // ItemPosition identifier
-	out.Add_uint8(0x00); // Bag
-	out.Add_uint8(0x01); // Position
-	out.Add_uint8(0x23); // Stacked
-	out.Add_uint64(0); // Instance
-	*/
-	Send( listpkt, MSG_INVENTORY_GETBANKITEMS );
+	Inventory *bank = GetBank();
+	if ( bank == NULL )
+		return;
+
+	SendItems( bank, HASH_LIST_BANKITEMS, MSG_INVENTORY_GETBANKITEMS, mBankSync );
 }
 
 /* Gets the quickbar layout. */
@@ -145,32 +192,57 @@ void PlayerSession::Msg_Character_Move( Buffer &packet )
 void PlayerSession::Msg_Chat_Message( Buffer &packet )
 {
 	uint32_t type = packet.ReadUInt32();
-	const wchar_t *message = packet.ReadWideString();
 
-	const char *str = UTF8( message );
-	if ( str[0] == '#' )
+	char message[CHAT_MAX_LENGTH];
+	packet.ReadWideString( message, sizeof( message ) );
+
+	if ( message[0] == '#' && mAccount->mGmLevel > 0 )
 	{
-		/*if ( _stricmp(str + 1, "update") == 0 )
+		/* Move everyone on this square to another shard. */
+		if ( strncmp( message + 1, "drain ", 6 ) == 0 )
+		{
+			Migration::Drain( (uint32_t)atoi( message + 7 ) );
+			return;
+		}
+
+		/* Show a message to everyone on this square. */
+		if ( strncmp( message + 1, "announce ", 9 ) == 0 )
 		{
-			message = UTF16( "[GM] Sending position update." );
+			ChatService::Announce( mCharacter->mName, message + 10 );
+			return;
+		}
+	}
+
+	if ( !ChatService::Allow( mChatLimiter, GetTick() ) )
+	{
+		SendBoardMessage( "System", "You are sending messages too fast." );
+		return;
+	}
 
-			SetAction( ( mMoving ? ACT_RUN : ACT_IDLE ) );
-		}*/
+	/* Whispers are written as "/w <name> <message>". */
+	if ( strncmp( message, "/w ", 3 ) == 0 )
+	{
+		char *target = message + 3;
+		char *text   = strchr( target, ' ' );
+		if ( text == NULL )
+			return;
+
+		*text++ = 0;
+		if ( !ChatService::Whisper( this, target, type, text ) )
+			SendBoardMessage( "System", "That player is not online." );
+		return;
 	}
 
-	/* Send the chat message. */
-	Buffer chatpkt;
-	chatpkt.WriteUInt32( mCharacter->mId );
-	chatpkt.WriteUInt32( type );
-	chatpkt.WriteWideString( message );
-	//Send(chatpkt, MSG_CHAT_MESSAGE);
-	mStage->Send( chatpkt, MSG_CHAT_MESSAGE );
+	ChatService::Say( this, type, message );
 }
 
 
 
 void PlayerSession::Msg_Shop_Enter( Buffer &packet ) 
 {
+	if ( mStage == NULL )
+		return;
+
 	uint32_t shop_id = packet.ReadUInt32();
 
 	Buffer response;
@@ -183,6 +255,11 @@ void PlayerSession::Msg_Shop_Enter( Buffer &packet )
 
 void PlayerSession::Msg_Shop_Leave( Buffer &packet )
 {
+	if ( mStage == NULL )
+		return;
+
+	CalculatePosition();
+
 	Buffer response;
 	response.WriteUInt32( mCharacter->mId );
 	response.WriteFloat( mPosition.x );
@@ -209,8 +286,8 @@ void PlayerSession::Msg_Bank_Deposit( Buffer &packet )
 	uint32_t amount = packet.ReadUInt32();
 	if ( amount <= mCharacter->mMoney )
 	{
-		mCharacter->mMoney       -= amount;
-		mCharacter->mBank.mMoney += amount;
+		mCharacter->mMoney     -= amount;
+		mCharacter->mBankMoney += amount;
 	}
 
 	Buffer response;
@@ -223,10 +300,10 @@ void PlayerSession::Msg_Bank_Deposit( Buffer &packet )
 void PlayerSession::Msg_Bank_Withdraw( Buffer &packet )
 {
 	uint32_t amount = packet.ReadUInt32();
-	if ( amount <= mCharacter->mBank.mMoney )
+	if ( amount <= mCharacter->mBankMoney )
 	{
-		mCharacter->mBank.mMoney -= amount;
-		mCharacter->mMoney       += amount;
+		mCharacter->mBankMoney -= amount;
+		mCharacter->mMoney     += amount;
 	}
 
 	Buffer response;
@@ -241,31 +318,17 @@ void PlayerSession::Msg_Bank_Move( Buffer &packet )
 	packet.ReadUInt32();
 	uint16_t  src_bag    = packet.ReadUInt16();
 	uint16_t  src_index  = packet.ReadUInt16();
-	ItemInfo *source     = &mCharacter->mBags[src_bag][src_index];
 
 	packet.ReadUInt32();
 	uint16_t  dest_bag   = packet.ReadUInt16();
 	uint16_t  dest_index = packet.ReadUInt16();
-	ItemInfo *dest       = &mCharacter->mBank.mBags[dest_bag][dest_index];
 
+	Inventory *inventory = GetInventory();
+	Inventory *bank      = GetBank();
+	if ( inventory == NULL || bank == NULL || src_bag > 0xFF || src_index > 0xFF || dest_bag > 0xFF || dest_index > 0xFF )
+		return;
 
-	if ( source->mItemId != 0 )
-	{
-	
-		if ( dest->mItemId != 0 )
-		{
-			/* Swap destination and source. */
-			ItemInfo temp;
-			memcpy( &temp, source, sizeof( ItemInfo ) );
-
-			memcpy( source, dest, sizeof( ItemInfo ) );
-			memcpy( dest, &temp, sizeof( ItemInfo ) );
-		}
-		else
-		{
-			/* Copy destination to source and clear the source. */
-			memcpy( dest, source, sizeof( ItemInfo ) );
-			memset( source, 0, sizeof( ItemInfo ) );
-		}
-	}
+	/* Swaps with an item in the destination, out of range slots are refused. */
+	if ( Inventory::Move( *inventory, (uint8_t)src_bag, (uint8_t)src_index, *bank, (uint8_t)dest_bag, (uint8_t)dest_index ) )
+		SyncItems();
 }
@@ -0,0 +1,422 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <migration.h>
+#include <playersession.h>
+#include <gatewayclient.h>
+#include <sessionmanager.h>
+#include <square.h>
+#include <log.h>
+#include <dbstats.h>
+#include <link.h>
+#include <vector>
+
+extern GatewayClient *g_gateway;
+extern std::vector<PlayerSession *> g_clients;
+
+MigrationState Migration::mStates[MAX_MIGRATIONS];
+uint32_t       Migration::mNextRequestId = 1;
+
+/* Starts moving a player to the specified shard of this square. */
+bool Migration::Begin( PlayerSession *player, uint32_t target_shard )
+{
+	CharacterData *c = player->GetCharacter();
+	if ( c == NULL || player->GetAccount() == NULL || player->mSessionKey[0] == 0 )
+		return false;
+
+	/* Already on its way? */
+	if ( Find( player->mSessionKey ) != NULL )
+		return false;
+
+	MigrationState *state = Allocate( player->mSessionKey );
+	if ( state == NULL )
+	{
+		ErrorLog.Write( "[%d] Unable to migrate player, too many migrations in progress.\n", E_WARNING, player->mSessionId );
+		return false;
+	}
+
+	state->mRequestId   = mNextRequestId++;
+	state->mSessionId   = player->mSessionId;
+	state->mTargetShard = target_shard;
+
+	/* Send everything the target needs to preload the player. */
+	Buffer preparepkt;
+	preparepkt.WriteUInt32( state->mRequestId );
+	preparepkt.WriteUInt32( target_shard );
+	preparepkt.WriteString( player->mSessionKey );
+	preparepkt.WriteUInt32( player->GetAccount()->mId );
+	WriteCharacter( preparepkt, c );
+	player->WriteMigrationState( preparepkt );
+
+	g_gateway->Send( preparepkt, MSG_SQUARE_MIGRATE_PREPARE );
+	return true;
+}
+
+/* Migrates every player on this square to the specified shard. */
+uint32_t Migration::Drain( uint32_t target_shard )
+{
+	uint32_t count = 0;
+	for ( std::vector<PlayerSession *>::iterator i = g_clients.begin(); i != g_clients.end(); ++i )
+	{
+		if ( Begin( *i, target_shard ) )
+			count++;
+	}
+
+	ServerLog.Write( "Draining %u player(s) to shard %u.\n", E_NOTICE, count, target_shard );
+	return count;
+}
+
+/* The source square wants to move a player here, preload it. */
+void Migration::Msg_Prepare( Buffer &packet )
+{
+	uint32_t    request_id   = packet.ReadUInt32();
+	uint32_t    source       = packet.ReadUInt32();
+	const char *session_key  = packet.ReadString();
+	uint32_t    account_id   = packet.ReadUInt32();
+	uint32_t    result       = MIGRATE_OK;
+
+	MigrationState *state = Allocate( session_key );
+	if ( state == NULL )
+	{
+		result = MIGRATE_FULL;
+	}
+	else
+	{
+		state->mRequestId = request_id;
+		state->mCharacter = new CharacterData();
+
+		/* The request comes from another shard, not from a client. */
+		DBStats::SetCaller( 0, -1 );
+		state->mAccount   = DB::Account_Load( account_id, NULL, false );
+
+		if ( state->mAccount == NULL || !ReadCharacter( packet, state->mCharacter ) )
+		{
+			result = MIGRATE_FAILED;
+		}
+		else
+		{
+			ReadState( packet, state );
+
+			/* Players that are preloaded but not in yet need a place as well, this one included. */
+			if ( GetArrivingCount() > Square::GetFreeRoom() )
+				result = MIGRATE_FULL;
+		}
+	}
+
+	Buffer readypkt;
+	readypkt.WriteUInt32( request_id );
+	readypkt.WriteUInt32( source );
+	readypkt.WriteUInt32( result );
+	readypkt.WriteString( session_key );
+	g_gateway->Send( readypkt, MSG_SQUARE_MIGRATE_READY );
+
+	if ( result != MIGRATE_OK && state != NULL )
+		Release( state );
+}
+
+/* The target has preloaded the player, send over the latest state and redirect the client. */
+void Migration::Msg_Ready( Buffer &packet )
+{
+	uint32_t request_id = packet.ReadUInt32();
+	uint32_t result     = packet.ReadUInt32();
+	char     host[16];
+	packet.ReadString( host, sizeof( host ) );
+	host[sizeof( host ) - 1] = 0;
+	uint16_t port       = packet.ReadUInt16();
+
+	MigrationState *state = NULL;
+	for ( uint32_t i = 0; i < MAX_MIGRATIONS; i++ )
+	{
+		if ( mStates[i].mUsed && mStates[i].mRequestId == request_id && mStates[i].mAccount == NULL )
+		{
+			state = &mStates[i];
+			break;
+		}
+	}
+	if ( state == NULL )
+		return;
+
+	PlayerSession *player = SessionManager::At<PlayerSession>( state->mSessionId );
+	if ( player == NULL || strcmp( player->mSessionKey, state->mSessionKey ) != 0 )
+	{
+		Release( state );
+		return;
+	}
+
+	if ( result != MIGRATE_OK )
+	{
+		ErrorLog.Write( "[%d] Migration to shard %u failed (%u).\n", E_WARNING, state->mSessionId, state->mTargetShard, result );
+		Release( state );
+		return;
+	}
+
+	/* The position may have changed while the target was loading. */
+	Buffer commitpkt;
+	commitpkt.WriteUInt32( state->mTargetShard );
+	commitpkt.WriteString( state->mSessionKey );
+	player->WriteMigrationState( commitpkt );
+	g_gateway->Send( commitpkt, MSG_SQUARE_MIGRATE_COMMIT );
+
+	player->Redirect( host, port );
+	Release( state );
+}
+
+/* Latest state of a player that is about to arrive. */
+void Migration::Msg_Commit( Buffer &packet )
+{
+	MigrationState *state = Find( packet.ReadString() );
+	if ( state == NULL || state->mCharacter == NULL )
+		return;
+
+	ReadState( packet, state );
+}
+
+/* Gets the preloaded state of a migrating player that has connected. */
+MigrationState *Migration::Claim( const char *session_key )
+{
+	MigrationState *state = Find( session_key );
+	if ( state == NULL || state->mCharacter == NULL )
+		return NULL;
+
+	return state;
+}
+
+/* Frees a migration slot and everything that was not taken over by a session. */
+void Migration::Release( MigrationState *state )
+{
+	if ( state->mCharacter != NULL ) delete state->mCharacter;
+	if ( state->mAccount != NULL )   delete state->mAccount;
+
+	memset( state, 0, sizeof( MigrationState ) );
+}
+
+/* Drops migrations for players that never arrived. */
+void Migration::Expire( time_t current )
+{
+	for ( uint32_t i = 0; i < MAX_MIGRATIONS; i++ )
+	{
+		if ( mStates[i].mUsed && ( current - mStates[i].mIssued ) >= MIGRATION_TIMEOUT )
+			Release( &mStates[i] );
+	}
+}
+
+/* Gets a free migration slot. */
+MigrationState *Migration::Allocate( const char *session_key )
+{
+	for ( uint32_t i = 0; i < MAX_MIGRATIONS; i++ )
+	{
+		if ( mStates[i].mUsed )
+			continue;
+
+		MigrationState *state = &mStates[i];
+		memset( state, 0, sizeof( MigrationState ) );
+
+		state->mUsed   = true;
+		state->mIssued = time( NULL );
+		strncpy( state->mSessionKey, session_key, 8 );
+		state->mSessionKey[8] = 0;
+		return state;
+	}
+	return NULL;
+}
+
+/* Finds the migration of the player with the specified session key. */
+MigrationState *Migration::Find( const char *session_key )
+{
+	for ( uint32_t i = 0; i < MAX_MIGRATIONS; i++ )
+	{
+		if ( mStates[i].mUsed && strcmp( mStates[i].mSessionKey, session_key ) == 0 )
+			return &mStates[i];
+	}
+	return NULL;
+}
+
+/* Gets the number of preloaded players that have not joined a stage yet. */
+uint32_t Migration::GetArrivingCount()
+{
+	uint32_t count = 0;
+	for ( uint32_t i = 0; i < MAX_MIGRATIONS; i++ )
+	{
+		if ( mStates[i].mUsed && mStates[i].mCharacter != NULL )
+			count++;
+	}
+	return count;
+}
+
+/* Writes a single item. */
+static void WriteItem( Buffer &packet, uint8_t bag, uint8_t slot, const ItemInfo *item )
+{
+	packet.WriteByte( bag );
+	packet.WriteByte( slot );
+	packet.WriteUInt32( (uint32_t)item->mId );
+	packet.WriteUInt32( item->mItemId );
+	packet.WriteUInt32( item->mAmount );
+}
+
+/* Writes the occupied slots of an inventory. */
+static void WriteItems( Buffer &packet, const Inventory *inventory )
+{
+	packet.WriteUInt16( inventory->GetItemCount() );
+	for ( uint16_t i = 0; i < inventory->Size(); i++ )
+	{
+		const InventorySlot &slot = inventory->At( i );
+		if ( slot.mItem.mItemId != 0 ) WriteItem( packet, slot.GetBag(), slot.GetSlot(), &slot.mItem );
+	}
+}
+
+/* Reads the occupied slots of an inventory, returns false if a slot is out of range. */
+static bool ReadItems( Buffer &packet, Inventory *inventory )
+{
+	for ( uint16_t i = 0, count = packet.ReadUInt16(); i < count; i++ )
+	{
+		uint8_t bag  = packet.ReadByte();
+		uint8_t slot = packet.ReadByte();
+
+		ItemInfo item;
+		item.mId     = packet.ReadUInt32();
+		item.mItemId = packet.ReadUInt32();
+		item.mAmount = packet.ReadUInt32();
+
+		if ( !inventory->Set( bag, slot, item ) )
+			return false;
+	}
+	return true;
+}
+
+/* Serializes a character. */
+void Migration::WriteCharacter( Buffer &packet, const CharacterData *c )
+{
+	packet.WriteUInt32( c->mId );
+	packet.WriteString( c->mName );
+	packet.WriteUInt32( c->mClassId );
+	packet.WriteUInt32( (uint32_t)c->mLastPlayed );
+	packet.WriteUInt16( c->mLevel );
+	packet.WriteUInt32( c->mExperience );
+	packet.WriteUInt16( c->mPvpLevel );
+	packet.WriteUInt32( c->mPvpExperience );
+	packet.WriteUInt16( c->mWarLevel );
+	packet.WriteUInt32( c->mWarExperience );
+	packet.WriteUInt16( c->mRebirthLevel );
+	packet.WriteUInt16( c->mRebirthCount );
+
+	packet.WriteUInt32( c->mEquipmentCount );
+	for ( uint32_t i = 0; i < c->mEquipmentCount; i++ )
+		packet.WriteUInt32( c->mEquipment[i].mId );
+
+	packet.WriteUInt32( c->mMoney );
+	packet.WriteUInt32( c->mBankMoney );
+
+	packet.WriteByte( (uint8_t)c->mLicenseCount );
+	for ( uint32_t i = 0; i < c->mLicenseCount; i++ )
+	{
+		const BagLicense *l = &c->mLicenses[i];
+		packet.WriteUInt32( l->mId );
+		packet.WriteByte( l->mIndex );
+		packet.WriteByte( l->mStatus );
+		packet.WriteUInt32( (uint32_t)l->mExpires );
+	}
+
+	/* Inventories that were never loaded stay in the database, only occupied slots are send. */
+	packet.WriteByte( c->mInventory != NULL );
+	if ( c->mInventory != NULL )
+		WriteItems( packet, c->mInventory );
+
+	packet.WriteByte( c->mBank != NULL );
+	if ( c->mBank != NULL )
+		WriteItems( packet, c->mBank );
+}
+
+/* Deserializes a character, returns false if the data is malformed. */
+bool Migration::ReadCharacter( Buffer &packet, CharacterData *c )
+{
+	c->mId = packet.ReadUInt32();
+	if ( packet.ReadString( c->mName, sizeof( c->mName ) - 1 ) == 0 )
+		return false;
+
+	c->mName[sizeof( c->mName ) - 1] = 0;
+	c->mClassId       = packet.ReadUInt32();
+	c->mLastPlayed    = packet.ReadUInt32();
+	c->mLevel         = packet.ReadUInt16();
+	c->mExperience    = packet.ReadUInt32();
+	c->mPvpLevel      = packet.ReadUInt16();
+	c->mPvpExperience = packet.ReadUInt32();
+	c->mWarLevel      = packet.ReadUInt16();
+	c->mWarExperience = packet.ReadUInt32();
+	c->mRebirthLevel  = packet.ReadUInt16();
+	c->mRebirthCount  = packet.ReadUInt16();
+
+	c->mEquipmentCount = packet.ReadUInt32();
+	if ( c->mEquipmentCount > 32 )
+		return false;
+
+	for ( uint32_t i = 0; i < c->mEquipmentCount; i++ )
+		c->mEquipment[i].mId = packet.ReadUInt32();
+
+	c->mMoney        = packet.ReadUInt32();
+	c->mBankMoney    = packet.ReadUInt32();
+	c->mLicenseCount = packet.ReadByte();
+	if ( c->mLicenseCount > MAX_BAG_LICENSES )
+		return false;
+
+	for ( uint32_t i = 0; i < c->mLicenseCount; i++ )
+	{
+		BagLicense *license = &c->mLicenses[i];
+
+		license->mId      = packet.ReadUInt32();
+		license->mIndex   = packet.ReadByte();
+		license->mStatus  = packet.ReadByte();
+		license->mExpires = packet.ReadUInt32();
+	}
+
+	if ( packet.ReadByte() != 0 )
+	{
+		c->mInventory = new Inventory( MAX_BAGS );
+		if ( !ReadItems( packet, c->mInventory ) )
+			return false;
+	}
+
+	if ( packet.ReadByte() != 0 )
+	{
+		c->mBank = new Inventory( MAX_BANK_BOXES );
+		if ( !ReadItems( packet, c->mBank ) )
+			return false;
+	}
+	return true;
+}
+
+/* Reads the position and stage written by PlayerSession::WriteMigrationState. */
+void Migration::ReadState( Buffer &packet, MigrationState *state )
+{
+	state->mPosition.x    = packet.ReadFloat();
+	state->mPosition.y    = packet.ReadFloat();
+	state->mPosition.z    = packet.ReadFloat();
+	state->mDirection.x   = packet.ReadFloat();
+	state->mDirection.y   = packet.ReadFloat();
+	state->mDirection.z   = packet.ReadFloat();
+	state->mMoving        = packet.ReadByte() != 0;
+	state->mMoveDirection = packet.ReadByte();
+	state->mStageGroup    = packet.ReadUInt32();
+	state->mStageLevel    = packet.ReadUInt32();
+}
@@ -25,6 +25,7 @@
  */
 #include <playersession.h>
 #include <movement.h>
+#include <stage.h>
 
 /* Direction angles. */
 static Vector3 g_vecAngles[9] = {
@@ -39,79 +40,154 @@ static Vector3 g_vecAngles[9] = {
 	{  0.707099974155426, 0,  0.707099974155426 },
 };
 
-/* Starts movement in the specified direction. */
-void PlayerSession::StartMovement( uint8_t dir, bool dash )
+/* Initializes a new instance of the MovementSystem class. */
+MovementSystem::MovementSystem(): 
+	mPosX( NULL ), 
+	mPosY( NULL ), 
+	mPosZ( NULL ), 
+	mVelX( NULL ), 
+	mVelZ( NULL ), 
+	mCount( 0 ), 
+	mCapacity( 0 ), 
+	mLastTick( 0 )
+{
+}
+
+/* Releases all resources used by the movement system. */
+MovementSystem::~MovementSystem()
+{
+	/* All arrays share a single allocation. */
+	if ( mPosX != NULL ) free( mPosX );
+}
+
+/* Allocates room for the specified number of entities. */
+bool MovementSystem::Initialize( uint32_t capacity )
+{
+	mPosX = (int *)malloc( sizeof( int ) * capacity * 5 );
+	if ( mPosX == NULL )
+		return false;
+
+	memset( mPosX, 0, sizeof( int ) * capacity * 5 );
+	mPosY = mPosX + capacity;
+	mPosZ = mPosY + capacity;
+	mVelX = mPosZ + capacity;
+	mVelZ = mVelX + capacity;
+
+	mCapacity = capacity;
+	return true;
+}
+
+/* Adds an entity at the end of the arrays, moving in the specified direction (0 when standing still). */
+uint32_t MovementSystem::Add( const Vector3 &position, uint8_t dir )
+{
+	uint32_t slot = mCount++;
+
+	mPosX[slot] = (int)( position.x * ( 1 << MOVEMENT_FIXED_SHIFT ) );
+	mPosY[slot] = (int)( position.y * ( 1 << MOVEMENT_FIXED_SHIFT ) );
+	mPosZ[slot] = (int)( position.z * ( 1 << MOVEMENT_FIXED_SHIFT ) );
+	SetDirection( slot, dir );
+
+	return slot;
+}
+
+/* Removes an entity by moving the last entity into its slot, like Stage::Leave does with the players. */
+void MovementSystem::Remove( uint32_t slot )
+{
+	uint32_t last = --mCount;
+
+	mPosX[slot] = mPosX[last];
+	mPosY[slot] = mPosY[last];
+	mPosZ[slot] = mPosZ[last];
+	mVelX[slot] = mVelX[last];
+	mVelZ[slot] = mVelZ[last];
+}
+
+/* Changes the direction an entity is moving in, 0 stops the entity. */
+void MovementSystem::SetDirection( uint32_t slot, uint8_t dir )
+{
+	const Vector3 &angle = GetDirection( dir );
+	float speed = MOVEMENT_RUN_SPEED * ( 1 << MOVEMENT_FIXED_SHIFT );
+
+	mVelX[slot] = (int)( angle.x * speed );
+	mVelZ[slot] = (int)( angle.z * speed );
+}
+
+/* Gets the current position of an entity. */
+void MovementSystem::GetPosition( uint32_t slot, Vector3 &position ) const
+{
+	position.x = (float)mPosX[slot] / ( 1 << MOVEMENT_FIXED_SHIFT );
+	position.y = (float)mPosY[slot] / ( 1 << MOVEMENT_FIXED_SHIFT );
+	position.z = (float)mPosZ[slot] / ( 1 << MOVEMENT_FIXED_SHIFT );
+}
+
+/* Moves all entities by the time that passed since the previous tick. */
+void MovementSystem::Integrate( uint32_t tick )
 {
-	if ( mMoving )
+	uint32_t elapsed = tick - mLastTick;
+	if ( mLastTick == 0 || elapsed == 0 )
 	{
-		if ( mMoveDirection != dir ) /* Are we changing direction? */
-		{
-			CalculatePosition();
-		}
+		mLastTick = tick;
+		return;
 	}
-	else mMoving = true;
+	mLastTick = tick;
+
+	/* Velocities are per second, convert the step once instead of dividing per entity. */
+	int step = (int)( ( MIN( elapsed, MOVEMENT_MAX_STEP ) << MOVEMENT_STEP_SHIFT ) / 1000 );
+
+	int *px = mPosX, *pz = mPosZ;
+	const int *vx = mVelX, *vz = mVelZ;
+
+	/* Standing entities have no velocity, so every entity takes the same path. */
+	for ( uint32_t i = 0; i < mCount; i++ )
+	{
+		px[i] += ( vx[i] * step ) >> MOVEMENT_STEP_SHIFT;
+		pz[i] += ( vz[i] * step ) >> MOVEMENT_STEP_SHIFT;
+	}
+}
+
+/* Checks if the client send a direction from the angle table. */
+bool MovementSystem::IsValidDirection( uint8_t dir )
+{
+	return ( dir >= DIR_SOUTHWEST && dir <= DIR_NORTHEAST );
+}
 
-	mMoveStartTick = GetTick();
+/* Gets the unit vector of a direction, invalid directions have no length. */
+const Vector3 &MovementSystem::GetDirection( uint8_t dir )
+{
+	return g_vecAngles[IsValidDirection( dir ) ? dir - 1 : 4];
+}
+
+/* Starts movement in the specified direction. */
+void PlayerSession::StartMovement( uint8_t dir, bool dash )
+{
+	/* Anything outside the angle table would let the client pick its own speed. */
+	if ( mStage == NULL || mStageSlot == INVALID_STAGE_SLOT || !MovementSystem::IsValidDirection( dir ) )
+		return;
+
+	mMoving        = true;
 	mMoveDirection = dir;
 	mDirection     = g_vecAngles[dir - 1];
+
+	mStage->GetMovement().SetDirection( mStageSlot, dir );
 	SetAction( ACT_RUN );
 }
 
-/* Calculates the position based on the time elapsed. */
+/* Gets the authoritative position from the movement system of the stage. */
 void PlayerSession::CalculatePosition()
 {
-	uint32_t distance = ( GetTick() - mMoveStartTick ) / 30;
-
-	printf("move_distance: %d\n", distance);
-
-	if ( distance > 0 )
+	if ( mStage != NULL && mStageSlot != INVALID_STAGE_SLOT )
 	{
-		switch ( mMoveDirection )
-		{
-			case DIR_NORTHWEST: 
-				mPosition.x -= ( distance / 1.5f ); 
-				mPosition.z += ( distance / 1.5f ); 
-				break;
-
-			case DIR_NORTH: 
-				mPosition.z += distance; 
-				break;
-
-			case DIR_NORTHEAST: 
-				mPosition.x += ( distance / 1.5f ); 
-				mPosition.z += ( distance / 1.5f ); 
-				break;
-
-			case DIR_WEST:
-				mPosition.x -= distance;
-				break;
-
-			case DIR_EAST:
-				mPosition.x += distance;
-				break;
-
-			case DIR_SOUTHWEST:
-				mPosition.x -= ( distance / 1.5f );
-				mPosition.z -= ( distance / 1.5f );
-				break;
-
-			case DIR_SOUTH:
-				mPosition.z -= distance;
-				break;
-
-			case DIR_SOUTHEAST:
-				mPosition.x += ( distance / 1.5f );
-				mPosition.z -= ( distance / 1.5f );
-				break;
-		}
+		mStage->GetMovement().GetPosition( mStageSlot, mPosition );
 	}
 }
 
 /* Stops movement. */
 void PlayerSession::StopMovement()
 {
-	mMoving = false;
-	CalculatePosition();
+	if ( mStage == NULL || mStageSlot == INVALID_STAGE_SLOT )
+		return;
 
+	mMoving = false;
+	mStage->GetMovement().SetDirection( mStageSlot, 0 );
 	SetAction( ACT_IDLE );
 }
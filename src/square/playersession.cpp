@@ -26,7 +26,10 @@
 #include <playersession.h>
 #include <gatewayclient.h>
 #include <log.h>
+#include <dbstats.h>
+#include <admission.h>
 #include <stage.h>
+#include <link.h>
 
 extern GatewayClient *g_gateway;
 
@@ -35,11 +38,23 @@ PlayerSession::PlayerSession( Socket *socket ):
 	mSocket( socket ), 
 	mProgress( 0.0f ), 
 	mMoving( false ), 
-	mCharacter( NULL )
+	mAccount( NULL ),
+	mCharacter( NULL ),
+	mStage( NULL ),
+	mClosing( false ),
+	mLoadRequested( false )
 {
-	mSessionId = INVALID_SESSION;
-	mEOF       = false;
+	mSessionId     = INVALID_SESSION;
+	mEOF           = false;
+	mName          = NULL;
+	mSessionKey[0] = 0;
+	mStageSlot     = INVALID_STAGE_SLOT;
+	mMoveDirection = 0;
 
+	mBagSync.mSent  = false;
+	mBankSync.mSent = false;
+
+	ResetIdleTimer( SESSION_IDLE_TIMEOUT );
 	SetEncryptionKey( Crypto::GenerateKey() );
 
 	mPosition.x  = 1200.0f;
@@ -55,12 +70,20 @@ PlayerSession::PlayerSession( Socket *socket ):
 /* Releases all resources used by the session. */
 PlayerSession::~PlayerSession()
 {
+	if ( mStage != NULL )
+	{
+		mStage->Leave( this );
+	}
+
 	if ( mSocket != NULL )
 	{
 		delete mSocket;
 	}
 
-	if ( mCharacter ) free( mCharacter );
+	Timers.Cancel( &mLicenseTimer );
+
+	if ( mCharacter ) delete mCharacter;
+	if ( mAccount ) delete mAccount;
 }
 
 /* Sets the encryption key for this session. */
@@ -76,9 +99,14 @@ void PlayerSession::SetEncryptionKey( uint32_t key )
 /* Updates the client by retrieving all the data send by the client and processing it. */
 void PlayerSession::Update()
 {
+	/* Handle everything other parts of the server have send this session. */
+	mMailbox.Drain( this );
+
 	int received = mSocket->Receive( &mBufferIn );
 	if (received == SOCKET_ERROR)
 		return;
+	else if ( received > 0 )
+		ResetIdleTimer( SESSION_IDLE_TIMEOUT );
 
 	/* Process incoming data. */
 	while ( mBufferIn.Size() >= 2 )
@@ -96,17 +124,36 @@ void PlayerSession::Update()
 		else break;
 	}
 
-	/* Send all outgoing data. */
+	/* Send all outgoing data, whatever the socket does not accept stays queued. */
 	if ( mBufferOut.Size() > 0 )
 	{
-		mSocket->Send( mBufferOut.Content(), mBufferOut.Size() );
-		mBufferOut.Clear();
+		int sent = mSocket->Send( mBufferOut.Content(), mBufferOut.Size() );
+		if ( sent != SOCKET_ERROR )
+		{
+			mBufferOut.Drain( sent );
+		}
+	}
+
+	/* A client that stops reading is dropped, instead of queueing for it without end. */
+	if ( mBufferOut.Size() > SEND_BUFFER_LIMIT )
+	{
+		ServerLog.Write( "[%d][CLIENT] Dropped, %u bytes are waiting to be sent.\n", E_WARNING, mSessionId, (uint32_t)mBufferOut.Size() );
+		mEOF = true;
+	}
+
+	/* Redirected clients are dropped once everything has been send. */
+	if ( mClosing && mBufferOut.Size() == 0 )
+	{
+		mEOF = true;
 	}
 }
 
 /* Authentication succesful, load character details. */
 void PlayerSession::LoadCharacter( uint32_t char_id, uint32_t account_id )
 {
+	/* Loading follows the reply of the gateway, not a packet of the client. */
+	DBStats::SetCaller( 0, mSessionId );
+
 	mAccount = DB::Account_Load( account_id, NULL, false );
 	if ( mAccount == NULL )
 	{
@@ -124,8 +171,96 @@ void PlayerSession::LoadCharacter( uint32_t char_id, uint32_t account_id )
 	DebugLog.Write( "[%d] Loaded account %s (aid: %d)\n", E_INFO, mSessionId, mAccount->mName, mAccount->mId );
 	DebugLog.Write( "[%d] Loaded character %s (cid: %d)\n", E_INFO, mSessionId, mCharacter->mName, mCharacter->mId );
 	#endif
+
+	/* Lets other players whisper to this character. */
+	mName = mCharacter->mName;
 	
 	SendCharacterInfo();
+	ScheduleLicenseExpiry();
+}
+
+/* Writes the state of the character in the world for the square it is migrating to. */
+void PlayerSession::WriteMigrationState( Buffer &packet )
+{
+	CalculatePosition();
+
+	packet.WriteFloat( mPosition.x );
+	packet.WriteFloat( mPosition.y );
+	packet.WriteFloat( mPosition.z );
+	packet.WriteFloat( mDirection.x );
+	packet.WriteFloat( mDirection.y );
+	packet.WriteFloat( mDirection.z );
+	packet.WriteByte( mMoving ? 1 : 0 );
+	packet.WriteByte( mMoveDirection );
+	packet.WriteUInt32( ( mStage != NULL ) ? mStage->GetGroupID() : 0 );
+	packet.WriteUInt32( ( mStage != NULL ) ? mStage->GetLevel() : 0 );
+}
+
+/* Takes over the preloaded character of a player that migrated from another shard. */
+void PlayerSession::ResumeMigration( MigrationState *state )
+{
+	mAccount       = state->mAccount;
+	mCharacter     = state->mCharacter;
+	mPosition      = state->mPosition;
+	mDirection     = state->mDirection;
+	mMoving        = state->mMoving;
+	mMoveDirection = state->mMoveDirection;
+
+	state->mAccount   = NULL;
+	state->mCharacter = NULL;
+
+	#if defined( _DEBUG )
+	DebugLog.Write( "[%d] Resumed character %s (cid: %d) from another shard\n", E_INFO, mSessionId, mCharacter->mName, mCharacter->mId );
+	#endif
+
+	mName = mCharacter->mName;
+
+	SendCharacterInfo();
+	ScheduleLicenseExpiry();
+}
+
+/* Tells the client to reconnect to another square. */
+void PlayerSession::Redirect( const char *host, uint16_t port )
+{
+	Buffer redirectpkt;
+	redirectpkt.WriteUInt32( 0 );
+	redirectpkt.WriteString( host );
+	redirectpkt.WriteUInt16( port );
+	redirectpkt.WriteString( mSessionKey );
+	Send( redirectpkt, MSG_SQUARE_REDIRECT );
+
+	mClosing = true;
+}
+
+/* The gateway has confirmed the session (character and account ID). */
+void PlayerSession::OnSessionInfo( void *target, const Mail *mail )
+{
+	Admission::BeginWork();
+	( (PlayerSession *)target )->LoadCharacter( mail->mParam1, mail->mParam2 );
+	Admission::EndWork();
+}
+
+/* The gateway does not know the session. */
+void PlayerSession::OnSessionRejected( void *target, const Mail *mail )
+{
+	( (PlayerSession *)target )->mEOF = true;
+}
+
+/* The client was let in after waiting, its character can be loaded now. */
+void PlayerSession::OnLoadAdmitted( void *target, const Mail *mail )
+{
+	( (PlayerSession *)target )->Authenticate();
+}
+
+/* The position of the client in the load queue, the session is kept alive while it waits. */
+void PlayerSession::OnQueuePosition( void *target, const Mail *mail )
+{
+	PlayerSession *session = (PlayerSession *)target;
+	session->ResetIdleTimer( SESSION_IDLE_TIMEOUT );
+
+	#if defined( _DEBUG )
+	DebugLog.Write( "[%d][CLIENT] Waiting to load, position %u of %u.\n", E_DEBUG, session->mSessionId, mail->mParam1, mail->mParam2 );
+	#endif
 }
 
 /* Processes the specified packet. */
@@ -138,6 +273,9 @@ void PlayerSession::Process( Buffer& packet )
 	} *header = (HEADER *)packet.Content();
 	packet.Seek(6);
 
+	/* Database calls made for this packet are attributed to it. */
+	DBStats::SetCaller( header->mCommand, mSessionId );
+
 	switch ( header->mCommand )
 	{
 		case MSG_LOAD_AUTHENTICATE:      Msg_Load_Authenticate( packet );      break;
@@ -170,23 +308,205 @@ void PlayerSession::Process( Buffer& packet )
 			Unsupported( packet );
 			break;
 	}
+
+	DBStats::SetCaller( 0, -1 );
 }
 
 /* Sets the action/animation of the character. */
 void PlayerSession::SetAction( uint32_t action )
 {
-	Buffer actionpkt;
-	actionpkt.WriteUInt32( mCharacter->mId );
-	actionpkt.WriteUInt32( action );
-	actionpkt.WriteFloat( mPosition.x );
-	actionpkt.WriteFloat( mPosition.y );
-	actionpkt.WriteFloat( mPosition.z );
-	actionpkt.WriteFloat( mDirection.x );
-	actionpkt.WriteFloat( mDirection.y );
-	actionpkt.WriteFloat( mDirection.z );
-	actionpkt.WriteFloat( 0 );
-
-	mStage->Send( actionpkt, MSG_CHARACTER_SETACTION );
+	if ( mStage == NULL || mStageSlot == INVALID_STAGE_SLOT )
+		return;
+
+	/* The stage sends the latest action to everyone at the end of the tick. */
+	CalculatePosition();
+	mStage->GetSnapshots().Set( mStageSlot, action, mPosition, mDirection );
+}
+
+/* Sends the list of bags the character has a license for. */
+void PlayerSession::SendBagList()
+{
+	uint32_t bag_id = 0;
+
+	/* Send a list of all the available bags. */
+	Buffer bagspkt;
+	bagspkt.WriteUInt32( 0x393CE1CC );  // Bag list hash.
+
+#define HASH_BAGLICENSE 0xDAA95362
+#define HASH_DATE_BAGEXPIRATION 0x1769D5AF
+
+
+
+	bagspkt.WriteUInt32( mCharacter->mLicenseCount );
+	for ( uint32_t i = 0; i < mCharacter->mLicenseCount; i++, bag_id++ )
+	{
+		BagLicense *l = &mCharacter->mLicenses[i];
+		bagspkt.WriteUInt32( HASH_BAGLICENSE + bag_id );
+		bagspkt.WriteUInt32( l->mIndex );
+
+		bagspkt.WriteUInt32( HASH_DATE_BAGEXPIRATION );
+		if ( l->mStatus == LICENSE_PERMANENT )
+		{
+			bagspkt.WriteUInt32( 9999 );
+			bagspkt.WriteUInt32( 1 );
+			bagspkt.WriteUInt32( 1 );
+			bagspkt.WriteUInt32( 0 );
+			bagspkt.WriteUInt32( 0 );
+			bagspkt.WriteUInt32( 0 );
+			bagspkt.WriteUInt32( 0 );
+			bagspkt.WriteByte( 0 );
+		}
+		else 
+		{
+			struct tm *the_time = localtime( &l->mExpires );
+			bagspkt.WriteUInt32( the_time->tm_year );
+			bagspkt.WriteUInt32( the_time->tm_mon );
+			bagspkt.WriteUInt32( the_time->tm_mday );
+			bagspkt.WriteUInt32( the_time->tm_hour );
+			bagspkt.WriteUInt32( the_time->tm_min );
+			bagspkt.WriteUInt32( the_time->tm_sec );
+			bagspkt.WriteUInt32( 0 );
+			bagspkt.WriteByte( l->mStatus );
+		}
+	}
+
+
+
+
+
+	bagspkt.WriteUInt32( 0x393CCDE9 );  // Bank vault list hash.
+	bagspkt.WriteUInt32( 0 );           // Number of bank vaults.
+	Send( bagspkt, MSG_INVENTORY_BAGLIST );
+}
+
+/* Schedules the license timer for the first bag license that expires. */
+void PlayerSession::ScheduleLicenseExpiry()
+{
+	time_t next = 0;
+	for ( uint32_t i = 0; i < mCharacter->mLicenseCount; i++ )
+	{
+		const BagLicense *l = &mCharacter->mLicenses[i];
+		if ( l->mStatus != LICENSE_PERMANENT && ( next == 0 || l->mExpires < next ) )
+			next = l->mExpires;
+	}
+
+	if ( next == 0 )
+	{
+		Timers.Cancel( &mLicenseTimer );
+		return;
+	}
+
+	/* Licenses beyond the range of the wheel are checked again when the timer runs out. */
+	time_t delay = MAX( next - time( NULL ), 0 );
+	Timers.Schedule( &mLicenseTimer, (uint32_t)MIN( delay, TIMER_MAX_DELAY / 1000 ) * 1000, OnLicenseExpiry, this );
+}
+
+/* Removes the bag licenses that have expired. */
+void PlayerSession::OnLicenseExpiry( void *context )
+{
+	PlayerSession *player = (PlayerSession *)context;
+	CharacterData *chara  = player->mCharacter;
+
+	/* Compact the remaining licenses to the front of the array. */
+	time_t   current = time( NULL );
+	uint32_t kept    = 0;
+	for ( uint32_t i = 0; i < chara->mLicenseCount; i++ )
+	{
+		const BagLicense *l = &chara->mLicenses[i];
+		if ( l->mStatus != LICENSE_PERMANENT && l->mExpires <= current )
+			continue;
+
+		if ( kept != i )
+			chara->mLicenses[kept] = *l;
+		kept++;
+	}
+
+	uint32_t expired = chara->mLicenseCount - kept;
+	chara->mLicenseCount = kept;
+
+	if ( expired > 0 )
+		player->SendBagList();
+
+	player->ScheduleLicenseExpiry();
+}
+
+/* Returns the bags of the character, loading them on first use. NULL until the character is loaded. */
+Inventory *PlayerSession::GetInventory()
+{
+	if ( mCharacter == NULL )
+		return NULL;
+
+	if ( mCharacter->mInventory == NULL )
+		DB::Character_LoadInventory( mCharacter );
+
+	return mCharacter->mInventory;
+}
+
+/* Returns the bank of the character, loading it on first use. NULL until the character is loaded. */
+Inventory *PlayerSession::GetBank()
+{
+	if ( mCharacter == NULL )
+		return NULL;
+
+	if ( mCharacter->mBank == NULL )
+		DB::Character_LoadBank( mCharacter );
+
+	return mCharacter->mBank;
+}
+
+/* Sends the items of an inventory, the whole list the first time and only the changed slots after that. */
+void PlayerSession::SendItems( Inventory *inventory, uint32_t list_hash, uint16_t command, InventorySync &sync )
+{
+	uint16_t count = 0;
+	if ( sync.mSent )
+	{
+		for ( uint16_t i = 0; i < inventory->Size(); i++ )
+			if ( inventory->At( i ).mVersion > sync.mVersion ) count++;
+	}
+	else count = inventory->GetItemCount();
+
+	Buffer listpkt;
+	listpkt.WriteUInt32( list_hash );
+	listpkt.WriteUInt32( count );
+
+	uint32_t index = 0;
+	for ( uint16_t i = 0; i < inventory->Size(); i++ )
+	{
+		const InventorySlot &slot = inventory->At( i );
+		if ( sync.mSent ? ( slot.mVersion <= sync.mVersion ) : ( slot.mItem.mItemId == 0 ) )
+			continue;
+
+		/* An emptied slot is send with an item id of 0. */
+		listpkt.WriteUInt32( HASH_ITEMSLOT + index++ );
+		listpkt.WriteUInt32( slot.mItem.mItemId );
+		listpkt.WriteUInt32( HASH_ITEMPOSITION );
+		listpkt.WriteByte( slot.GetBag() );
+		listpkt.WriteByte( slot.GetSlot() );
+		listpkt.WriteByte( (uint8_t)slot.mItem.mAmount );
+		listpkt.WriteUInt32( (uint32_t)slot.mItem.mId );  // 64-bit instance.
+		listpkt.WriteUInt32( 0 );
+	}
+	Send( listpkt, command );
+
+	/* The client knows about the emptied slots now. */
+	sync.mSent    = true;
+	sync.mVersion = inventory->GetVersion();
+	inventory->Purge( sync.mVersion );
+}
+
+/* Sends the slots that changed since the item lists were last send. */
+void PlayerSession::SyncItems()
+{
+	if ( mCharacter == NULL )
+		return;
+
+	Inventory *bags = mCharacter->mInventory;
+	if ( bags != NULL && mBagSync.mSent && bags->GetVersion() != mBagSync.mVersion )
+		SendItems( bags, HASH_LIST_BAGITEMS, MSG_INVENTORY_GETBAGITEMS, mBagSync );
+
+	Inventory *bank = mCharacter->mBank;
+	if ( bank != NULL && mBankSync.mSent && bank->GetVersion() != mBankSync.mVersion )
+		SendItems( bank, HASH_LIST_BANKITEMS, MSG_INVENTORY_GETBANKITEMS, mBankSync );
 }
 
 /* Sends a textbox message to the client. */ 
@@ -198,22 +518,52 @@ void PlayerSession::SendBoardMessage( const char *from, const char *message )
 	
 	char msg_data[1024];
 	sprintf( msg_data, "1 %s %s", from, message );
-	chatpkt.WriteWideString( UTF16( msg_data ) );
+	chatpkt.WriteWideString( msg_data );
 
 	Send( chatpkt, MSG_CHAT_MESSAGE );
 }
 
 /* Sends a packet to the client. */
 void PlayerSession::Send( Buffer &buffer, uint16_t cmd, uint16_t type )
+{
+	Frame( mBufferOut, buffer, cmd, type );
+}
+
+/* Adds messages that already have their header to the outgoing data. */
+void PlayerSession::SendFrames( const Buffer &frames )
+{
+	mBufferOut.Write( frames );
+}
+
+/* Writes a packet with its header to the specified buffer. */
+void PlayerSession::Frame( Buffer &out, const Buffer &buffer, uint16_t cmd, uint16_t type )
 {
 	if ( buffer.Size() == 0 )
 		return;
 
-	mBufferOut.WriteUInt16( buffer.Size() + 6 );
-	mBufferOut.WriteUInt16( type );
-	mBufferOut.WriteUInt16( cmd );
+	out.WriteUInt16( buffer.Size() + 6 );
+	out.WriteUInt16( type );
+	out.WriteUInt16( cmd );
+
+	out.Write( buffer.Content(), buffer.Size() );
+}
 
-	mBufferOut.Write( buffer.Content(), buffer.Size() );
+/* Adds serialized chat to what is send at the end of the tick, returns true if nothing was queued yet. */
+bool PlayerSession::QueueChat( const Buffer &frame )
+{
+	bool first = ( mChatOut.Size() == 0 );
+	mChatOut.Write( frame.Content(), frame.Size() );
+	return first;
+}
+
+/* Moves the chat gathered during this tick to the outgoing data. */
+void PlayerSession::FlushChat()
+{
+	if ( mChatOut.Size() == 0 )
+		return;
+
+	mBufferOut.Write( mChatOut.Content(), mChatOut.Size() );
+	mChatOut.Reset();
 }
 
 /* Logs packets that are not supported. */
@@ -246,9 +596,9 @@ void PlayerSession::Unsupported( Buffer &packet )
 void PlayerSession::SendCharacterInfo()
 {
 	Buffer unknownpkt;
-	unknownpkt.WriteWideString( UTF16( mCharacter->mName ) ); // Charactername.
+	unknownpkt.WriteWideString( mCharacter->mName ); // Charactername.
 	unknownpkt.WriteUInt32( 0x529E424F ); // Stagegroup Hash.
-	unknownpkt.WriteUInt32( 0x0330A106 ); // Stagegroup ID.
+	unknownpkt.WriteUInt32( STAGE_GROUP_SQUARE ); // Stagegroup ID.
 	unknownpkt.WriteUInt16( 0 ); // Level.
 	unknownpkt.WriteUInt32( 0x393C107A ); // Unknown list hash.
 	unknownpkt.WriteUInt32( 0 );
@@ -274,60 +624,7 @@ void PlayerSession::SendCharacterInfo()
 	infopkt.WriteByte( 0 );                     // Unknown...
 	Send( infopkt, MSG_CHARACTER_INFO );
 
-	uint32_t bag_id = 0;
-
-	/* Send a list of all the available bags. */
-	Buffer bagspkt;
-	bagspkt.WriteUInt32( 0x393CE1CC );  // Bag list hash.
-
-#define HASH_BAGLICENSE 0xDAA95362
-#define HASH_DATE_BAGEXPIRATION 0x1769D5AF
-
-
-
-	bagspkt.WriteUInt32( mCharacter->mBagLicenses->size() );
-
-	printf( "bag_lic = %d\n", mCharacter->mBagLicenses->size() );
-
-	for ( std::vector<BagLicense *>::iterator i = mCharacter->mBagLicenses->begin(); i != mCharacter->mBagLicenses->end(); ++i, bag_id++ )
-	{
-		BagLicense *l = *i;
-		bagspkt.WriteUInt32( HASH_BAGLICENSE + bag_id );
-		bagspkt.WriteUInt32( l->mIndex );
-
-		bagspkt.WriteUInt32( HASH_DATE_BAGEXPIRATION );
-		if ( l->mStatus == 2 ) /* Is this a permanent bag? */
-		{
-			bagspkt.WriteUInt32( 9999 );
-			bagspkt.WriteUInt32( 1 );
-			bagspkt.WriteUInt32( 1 );
-			bagspkt.WriteUInt32( 0 );
-			bagspkt.WriteUInt32( 0 );
-			bagspkt.WriteUInt32( 0 );
-			bagspkt.WriteUInt32( 0 );
-			bagspkt.WriteByte( 0 );
-		}
-		else 
-		{
-			struct tm *the_time = localtime( &l->mExpires );
-			bagspkt.WriteUInt32( the_time->tm_year );
-			bagspkt.WriteUInt32( the_time->tm_mon );
-			bagspkt.WriteUInt32( the_time->tm_mday );
-			bagspkt.WriteUInt32( the_time->tm_hour );
-			bagspkt.WriteUInt32( the_time->tm_min );
-			bagspkt.WriteUInt32( the_time->tm_sec );
-			bagspkt.WriteUInt32( 0 );
-			bagspkt.WriteByte( l->mStatus );
-		}
-	}
-
-
-
-
-
-	bagspkt.WriteUInt32( 0x393CCDE9 );  // Bank vault list hash.
-	bagspkt.WriteUInt32( 0 );           // Number of bank vaults.
-	Send( bagspkt, MSG_INVENTORY_BAGLIST );
+	SendBagList();
 
 
 
@@ -421,9 +718,9 @@ void PlayerSession::SendCharacterInfo()
 
 	/* Square information. */
 	Buffer squarepkt;
-	squarepkt.WriteWideString( UTF16( mCharacter->mName ) ); // Charactername.
+	squarepkt.WriteWideString( mCharacter->mName ); // Charactername.
 	squarepkt.WriteUInt32( 0x529E424F ); // Stagegroup Hash.
-	squarepkt.WriteUInt32( 0x0330A106 ); // Stagegroup ID.
+	squarepkt.WriteUInt32( STAGE_GROUP_SQUARE ); // Stagegroup ID.
 	squarepkt.WriteUInt16( 0 ); // Level.
 	squarepkt.WriteUInt32( 0x393C107A ); // Unknown list hash.
 	squarepkt.WriteUInt32( 0 );
@@ -528,7 +825,7 @@ void PlayerSession::SendCharacterList()
 	Buffer charapkt;
 	charapkt.WriteUInt32( mCharacter->mId );
 	charapkt.WriteUInt32( 0 );
-	charapkt.WriteWideString( UTF16( mCharacter->mName ) );
+	charapkt.WriteWideString( mCharacter->mName );
 	charapkt.WriteUInt16( mCharacter->mLevel );
 	charapkt.WriteUInt16( mCharacter->mPvpLevel );
 	charapkt.WriteUInt16( mCharacter->mWarLevel );
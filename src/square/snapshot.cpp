@@ -0,0 +1,202 @@
+/*
+ * Soldin - Lunia Server Emulator 
+ * Copyright (c) 2010 Seipheroth
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE. 
+ */
+#include <snapshot.h>
+#include <playersession.h>
+
+/* Initializes a new instance of the SnapshotSystem class. */
+SnapshotSystem::SnapshotSystem(): 
+	mCharacterId( NULL ), 
+	mAction( NULL ), 
+	mPosition( NULL ), 
+	mDirection( NULL ), 
+	mChanged( NULL ), 
+	mFramed( NULL ), 
+	mFrames( NULL ), 
+	mDelivered( NULL ), 
+	mPass( NULL ), 
+	mCursor( NULL ), 
+	mSequence( 1 ), 
+	mCount( 0 ), 
+	mCapacity( 0 )
+{
+}
+
+/* Releases all resources used by the snapshot system. */
+SnapshotSystem::~SnapshotSystem()
+{
+	if ( mCharacterId != NULL ) free( mCharacterId );
+	if ( mAction != NULL )      free( mAction );
+	if ( mPosition != NULL )    free( mPosition );
+	if ( mDirection != NULL )   free( mDirection );
+	if ( mChanged != NULL )     free( mChanged );
+	if ( mFramed != NULL )      free( mFramed );
+	if ( mFrames != NULL )      free( mFrames );
+	if ( mDelivered != NULL )   free( mDelivered );
+	if ( mPass != NULL )        free( mPass );
+	if ( mCursor != NULL )      free( mCursor );
+}
+
+/* Allocates room for the specified number of entities. */
+bool SnapshotSystem::Initialize( uint32_t capacity )
+{
+	mCharacterId = (uint32_t *)calloc( capacity, sizeof( uint32_t ) );
+	mAction      = (uint32_t *)calloc( capacity, sizeof( uint32_t ) );
+	mPosition    = (int *)calloc( capacity * 3, sizeof( int ) );
+	mDirection   = (float *)calloc( capacity * 3, sizeof( float ) );
+	mChanged     = (uint32_t *)calloc( capacity, sizeof( uint32_t ) );
+	mFramed      = (uint32_t *)calloc( capacity, sizeof( uint32_t ) );
+	mFrames      = (char *)malloc( capacity * SNAPSHOT_FRAME_SIZE );
+	mDelivered   = (uint32_t *)calloc( capacity, sizeof( uint32_t ) );
+	mPass        = (uint32_t *)calloc( capacity, sizeof( uint32_t ) );
+	mCursor      = (uint32_t *)calloc( capacity, sizeof( uint32_t ) );
+
+	if ( mCharacterId == NULL || mAction == NULL || mPosition == NULL || mDirection == NULL || 
+		 mChanged == NULL || mFramed == NULL || mFrames == NULL || mDelivered == NULL || mPass == NULL || mCursor == NULL )
+		return false;
+
+	mCapacity = capacity;
+	return true;
+}
+
+/* Adds an entity that is also an observer, it will receive the state of everything on the stage. */
+uint32_t SnapshotSystem::Add( uint32_t character_id )
+{
+	uint32_t slot = mCount++;
+
+	mCharacterId[slot] = character_id;
+	mAction[slot]      = 0;
+	mChanged[slot]     = mSequence;
+	mFramed[slot]      = 0;
+	mDelivered[slot]   = 0;
+	mPass[slot]        = 0;
+	mCursor[slot]      = 0;
+
+	return slot;
+}
+
+/* Removes an entity by moving the last entity into its slot, like Stage::Leave does with the players. */
+void SnapshotSystem::Remove( uint32_t slot )
+{
+	uint32_t last = --mCount;
+
+	mCharacterId[slot] = mCharacterId[last];
+	mAction[slot]      = mAction[last];
+	memcpy( &mPosition[slot * 3], &mPosition[last * 3], sizeof( int ) * 3 );
+	memcpy( &mDirection[slot * 3], &mDirection[last * 3], sizeof( float ) * 3 );
+	mDelivered[slot]   = mDelivered[last];
+	mPass[slot]        = mPass[last];
+	mCursor[slot]      = mCursor[last];
+
+	/* Observers that already passed this slot have not seen the moved entity yet. */
+	mChanged[slot]     = mSequence;
+	mFramed[slot]      = 0;
+}
+
+/* Updates the state of an entity, changes that are not visible to the client are dropped. */
+void SnapshotSystem::Set( uint32_t slot, uint32_t action, const Vector3 &position, const Vector3 &direction )
+{
+	int x = (int)( position.x * SNAPSHOT_QUANTIZE );
+	int y = (int)( position.y * SNAPSHOT_QUANTIZE );
+	int z = (int)( position.z * SNAPSHOT_QUANTIZE );
+
+	int   *p = &mPosition[slot * 3];
+	float *d = &mDirection[slot * 3];
+	if ( mAction[slot] == action && p[0] == x && p[1] == y && p[2] == z && 
+		 d[0] == direction.x && d[1] == direction.y && d[2] == direction.z )
+		return;
+
+	mAction[slot] = action;
+	p[0] = x; p[1] = y; p[2] = z;
+	d[0] = direction.x; d[1] = direction.y; d[2] = direction.z;
+
+	mChanged[slot] = mSequence;
+}
+
+/* Sends the changed entities to every observer, at most SNAPSHOT_MAX_UPDATES each. */
+void SnapshotSystem::Publish( PlayerSession **observers )
+{
+	for ( uint32_t o = 0; o < mCount; o++ )
+	{
+		PlayerSession *observer = observers[o];
+
+		/* A new pass includes every change made until now. */
+		if ( mCursor[o] == 0 )
+			mPass[o] = mSequence;
+
+		uint32_t sent = 0, i;
+		mBatch.Reset();
+		for ( i = mCursor[o]; i < mCount; i++ )
+		{
+			if ( mChanged[i] <= mDelivered[o] )
+				continue;
+
+			if ( sent == SNAPSHOT_MAX_UPDATES )
+				break;
+
+			if ( mFramed[i] != mSequence )
+				Write( i );
+
+			mBatch.Write( &mFrames[i * SNAPSHOT_FRAME_SIZE], SNAPSHOT_FRAME_SIZE );
+			sent++;
+		}
+		observer->SendFrames( mBatch );
+
+		if ( i < mCount )
+		{
+			mCursor[o] = i;
+		}
+		else
+		{
+			mCursor[o]    = 0;
+			mDelivered[o] = mPass[o];
+		}
+	}
+
+	mSequence++;
+}
+
+/* Builds the framed SetAction message for an entity, the client format is unchanged. */
+void SnapshotSystem::Write( uint32_t slot )
+{
+	const int   *p = &mPosition[slot * 3];
+	const float *d = &mDirection[slot * 3];
+
+	mPacket.Reset();
+	mPacket.WriteUInt32( mCharacterId[slot] );
+	mPacket.WriteUInt32( mAction[slot] );
+	mPacket.WriteFloat( (float)p[0] / SNAPSHOT_QUANTIZE );
+	mPacket.WriteFloat( (float)p[1] / SNAPSHOT_QUANTIZE );
+	mPacket.WriteFloat( (float)p[2] / SNAPSHOT_QUANTIZE );
+	mPacket.WriteFloat( d[0] );
+	mPacket.WriteFloat( d[1] );
+	mPacket.WriteFloat( d[2] );
+	mPacket.WriteFloat( 0 );
+
+	mFrame.Reset();
+	PlayerSession::Frame( mFrame, mPacket, MSG_CHARACTER_SETACTION );
+	memcpy( &mFrames[slot * SNAPSHOT_FRAME_SIZE], mFrame.Content(), SNAPSHOT_FRAME_SIZE );
+	mFramed[slot] = mSequence;
+}
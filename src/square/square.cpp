@@ -26,11 +26,69 @@
 #include <square.h>
 #include <stagemanager.h>
 
-Stage *Square::mStageSquare   = NULL;
-Stage *Square::mStageTutorial = NULL;
+Stage   *Square::mStages[MAX_HUB_STAGES];
+uint32_t Square::mStageCount    = 0;
+Stage   *Square::mStageTutorial = NULL;
 
-/* Initializes the square. */
-void Square::Initialize()
+extern uint32_t cfg_square_shard;
+
+/* Initializes the square by creating the hub stages hosted by this shard. */
+void Square::Initialize( uint32_t stage_count, uint32_t stage_capacity )
+{
+	stage_count = MAX( 1, MIN( stage_count, MAX_HUB_STAGES ) );
+
+	for ( uint32_t i = 0; i < stage_count; i++ )
+	{
+		Stage *stage = StageManager::Create( STAGE_GROUP_SQUARE, 0, stage_capacity );
+		if ( stage == NULL )
+			break;
+
+		stage->mHub = true;
+		mStages[mStageCount++] = stage;
+	}
+}
+
+/* Gets the hub stage with the most room left. */
+Stage *Square::GetStage()
+{
+	Stage *best = NULL;
+	for ( uint32_t i = 0; i < mStageCount; i++ )
+	{
+		Stage *stage = mStages[i];
+		if ( stage->mClosed || stage->GetPlayerCount() >= stage->MaxPlayers() )
+			continue;
+
+		if ( best == NULL || stage->GetPlayerCount() < best->GetPlayerCount() )
+			best = stage;
+	}
+	return ( best != NULL ) ? best : mStages[0];
+}
+
+/* Gets the number of players the open hub stages can still take. */
+uint32_t Square::GetFreeRoom()
+{
+	uint32_t room = 0;
+	for ( uint32_t i = 0; i < mStageCount; i++ )
+	{
+		Stage *stage = mStages[i];
+		if ( !stage->mClosed && stage->GetPlayerCount() < stage->MaxPlayers() )
+			room += stage->MaxPlayers() - stage->GetPlayerCount();
+	}
+	return room;
+}
+
+/* Writes the set of stages hosted by this shard, so the gateway can route players to it. */
+void Square::WriteStages( Buffer &packet )
 {
-	mStageSquare = StageManager::Create( 0x0330A106, 0, 100 );
+	packet.WriteUInt32( cfg_square_shard );
+	packet.WriteUInt32( mStageCount );
+	for ( uint32_t i = 0; i < mStageCount; i++ )
+	{
+		Stage *stage = mStages[i];
+		packet.WriteUInt32( stage->mStageId );
+		packet.WriteUInt32( stage->GetGroupID() );
+		packet.WriteUInt16( (uint16_t)stage->GetLevel() );
+		packet.WriteUInt32( stage->GetPlayerCount() );
+		packet.WriteUInt32( stage->MaxPlayers() );
+	}
 }
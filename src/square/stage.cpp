@@ -28,6 +28,7 @@
 
 /* Initializes a new stage. */
 Stage::Stage(uint32_t stage_group, uint32_t level, uint32_t max_players): 
+	mPlayers( NULL ), 
 	mPlayerCount( 0 ), 
 	mMaxPlayers( max_players ), 
 	mStageGroup( stage_group ), 
@@ -36,18 +37,23 @@ Stage::Stage(uint32_t stage_group, uint32_t level, uint32_t max_players):
 	mClosed( false ), 
 	mLevel( level )
 {
-	mPlayers = (PlayerSession **)malloc( sizeof( PlayerSession * ) * max_players );
+}
+
+/* Allocates room for the players of the stage, a stage that fails this cannot be used. */
+bool Stage::Initialize()
+{
+	mPlayers = (PlayerSession **)calloc( mMaxPlayers, sizeof( PlayerSession * ) );
 	if ( mPlayers == NULL )
-	{
-		// TODO: Error.
-		return;
-	}
-	memset( mPlayers, 0, sizeof( PlayerSession * ) * max_players );
+		return false;
+
+	return mMovement.Initialize( mMaxPlayers ) && mSnapshots.Initialize( mMaxPlayers );
 }
 
 /* Destroy the stage. */
 Stage::~Stage()
 {
+	Timers.Cancel( &mShutdownTimer );
+
 	if ( mPlayerCount > 0 )
 	{
 		// TODO: Move all players on this stage back back to the square stage.
@@ -61,44 +67,56 @@ Stage::~Stage()
 /* Adds the specified player to the stage. */
 int Stage::Join( PlayerSession *player )
 {
+	/* A second slot would keep the session on the stage after Leave freed the first one. */
+	if ( player->mStageSlot != INVALID_STAGE_SLOT )
+		return STERR_JOINED;
+
 	if ( mPlayerCount == mMaxPlayers )
 		return STERR_FULL;
 
 	if ( mClosed ) /* Stage has been closed, nobody can join anymore. */
 		return STERR_CLOSED;
 
-	for ( uint32_t i = 0; i < mMaxPlayers; i++ )
-	{
-		if ( mPlayers[i] == NULL )
-		{
-			mPlayers[i] = player;
-			Transfer( player );
+	/* The list is kept packed, so the player and its movement share the first free slot. */
+	if ( mMovement.GetCount() != mPlayerCount )
+		return STERR_UNKNOWN;
 
-			mPlayerCount++;
-			return STERR_NONE;
-		}
-	}
-	return STERR_UNKNOWN;
+	Timers.Cancel( &mShutdownTimer );
+
+	uint32_t slot = mMovement.Add( player->GetPosition(), player->GetMoveDirection() );
+
+	mSnapshots.Add( player->GetCharacter()->mId );
+	mSnapshots.Set( slot, ( player->GetMoveDirection() != 0 ) ? ACT_RUN : ACT_IDLE, player->GetPosition(), player->GetDirection() );
+
+	mPlayers[slot]    = player;
+	player->mStageSlot = slot;
+	Transfer( player );
+
+	mPlayerCount++;
+	return STERR_NONE;
 }
 
 /* Removes the specified player from the stage. */
 int Stage::Leave( PlayerSession *player )
 {
-	for ( uint32_t i = 0; i < mMaxPlayers; i++ )
+	for ( uint32_t i = 0; i < mPlayerCount; i++ )
 	{
-		if ( mPlayers[i] == NULL )
+		if ( mPlayers[i] == player )
 		{
-			if ( i < ( mPlayerCount - 1 ) )
-			{
-				mPlayers[i] = mPlayers[mPlayerCount - 1];
-				mPlayers[mPlayerCount - 1] = NULL;
-			}
-			else mPlayers[i] = NULL;
+			/* Keep the list packed by moving the last player into the free slot. */
+			mPlayers[i] = mPlayers[mPlayerCount - 1];
+			mPlayers[i]->mStageSlot = i;
+			mPlayers[mPlayerCount - 1] = NULL;
+			mMovement.Remove( i );
+			mSnapshots.Remove( i );
+
+			player->mStageSlot = INVALID_STAGE_SLOT;
 
 			mPlayerCount--;
+			/* Give players that are switching stages a moment to come back before the stage goes away. */
 			if ( mPlayerCount == 0 && !mHub )
 			{
-				StageManager::Destroy( mStageId );
+				Timers.Schedule( &mShutdownTimer, STAGE_SHUTDOWN_DELAY * 1000, OnShutdown, this );
 			}
 
 			return STERR_NONE;
@@ -107,6 +125,25 @@ int Stage::Leave( PlayerSession *player )
 	return STERR_PLNOTFOUND;
 }
 
+/* Destroys the stage if it is still empty. */
+void Stage::OnShutdown( void *context )
+{
+	Stage *stage = (Stage *)context;
+	if ( stage->mPlayerCount == 0 )
+	{
+		StageManager::Destroy( stage->mStageId );
+	}
+}
+
+/* Advances the simulation of the stage. */
+void Stage::Update( uint32_t tick )
+{
+	mMailbox.Drain( this );
+
+	mMovement.Integrate( tick );
+	mSnapshots.Publish( mPlayers );
+}
+
 /* Sends a packet to all players on the stage. */
 void Stage::Send( Buffer &packet, uint16_t cmd, int exclude_id )
 {
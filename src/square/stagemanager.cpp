@@ -24,6 +24,7 @@
  * OTHER DEALINGS IN THE SOFTWARE. 
  */
 #include <stagemanager.h>
+#include <log.h>
 
 Stage   *StageManager::mStages[MAX_STAGES];
 uint32_t StageManager::mStageCount = 0;
@@ -41,7 +42,15 @@ Stage *StageManager::Create( uint32_t stage_group, uint32_t level, uint32_t max_
 	{
 		if ( mStages[i] == NULL )
 		{
-			mStages[i] = new Stage( stage_group, level, max_players );
+			Stage *stage = new Stage( stage_group, level, max_players );
+			if ( !stage->Initialize() )
+			{
+				ErrorLog.Write( "Failed to allocate a stage for %u players.\n", E_ERROR, max_players );
+				delete stage;
+				return NULL;
+			}
+
+			mStages[i] = stage;
 			mStages[i]->mStageId = i;
 
 			mStageCount++;
@@ -51,6 +60,17 @@ Stage *StageManager::Create( uint32_t stage_group, uint32_t level, uint32_t max_
 	return NULL;
 }
 
+/* Runs a tick on every stage. */
+void StageManager::Update()
+{
+	uint32_t tick = GetTick();
+	for ( int i = 0; i < MAX_STAGES; i++ )
+	{
+		if ( mStages[i] != NULL )
+			mStages[i]->Update( tick );
+	}
+}
+
 /* Destroys a stage. */
 void StageManager::Destroy( uint32_t stage_id )
 {